@@ -0,0 +1,202 @@
+#include "BufferPool.h" // Including the header file to define the BufferPool and PooledBuffer classes
+#include <cstring> // This header file is included to use memcpy
+#include <mutex> // This header file is included for the mutexes guarding the shared depot
+#include <new> // This header file is included for the raw operator new and delete
+#include <unistd.h> // This header file is included for syscall
+#include <sys/syscall.h> // This header file is included to ask the kernel for the NUMA node of a thread
+
+// Intrusive list of free buffers of one size class
+struct FreeList
+{
+    BufferBlock* head; // First free buffer
+    size_t count; // Number of free buffers
+};
+
+// Buffers shared between threads, one list per size class
+struct Depot
+{
+    std::mutex mutex; // Guards the list, only taken once per batch
+    FreeList list = {NULL, 0}; // Free buffers
+};
+
+static Depot depots[BUFFER_POOL_MAX_NODES][BUFFER_POOL_CLASS_COUNT]; // Constant-initialised, usable before any constructor runs
+
+// Function to get the usable size of a size class
+static inline size_t classSize(uint32_t sizeClass)
+{
+    return (size_t)1 << (sizeClass + BUFFER_POOL_MIN_SHIFT);
+}
+
+// Function to get the number of buffers of a class a thread caches before giving a batch back
+static inline size_t cacheLimit(uint32_t sizeClass)
+{
+    size_t limit = BUFFER_POOL_CACHE_BYTES / classSize(sizeClass);
+    return limit < 2 ? 2 : (limit > 256 ? 256 : limit);
+}
+
+// Function to move up to count buffers from the front of one list to another
+static void transfer(FreeList& from, FreeList& to, size_t count)
+{
+    while(count-- > 0 && from.head != NULL)
+    {
+        BufferBlock* block = from.head;
+        from.head = block->next;
+        --from.count;
+        block->next = to.head;
+        to.head = block;
+        ++to.count;
+    }
+}
+
+// Function to move count buffers of a list to a depot, freeing whatever no longer fits into the depot
+static void giveBack(Depot& depot, uint32_t sizeClass, FreeList& list, size_t count)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    FreeList surplus = {NULL, 0};
+    {
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        transfer(list, depot.list, count);
+        if(depot.list.count * classSize(sizeClass) > BUFFER_POOL_DEPOT_BYTES)
+        {
+            transfer(depot.list, surplus, count); // Depot is full, the memory goes back to the heap
+        }
+    }
+
+    while(surplus.head != NULL)
+    {
+        BufferBlock* next = surplus.head->next;
+        ::operator delete(surplus.head);
+        surplus.head = next;
+    }
+}
+
+// Function to get the NUMA node of the calling thread, 0 if the kernel cannot tell
+static uint32_t threadNode()
+{
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if(syscall(SYS_getcpu, &cpu, &node, NULL) == -1)
+    {
+        return 0;
+    }
+    return node % BUFFER_POOL_MAX_NODES;
+}
+
+// Per-thread free lists, handed back to the depots when the thread exits
+struct ThreadCache
+{
+    uint32_t node = threadNode(); // Node the thread ran on when it first used the pool, pinned threads never leave it
+    FreeList lists[BUFFER_POOL_CLASS_COUNT] = {}; // Free buffers of this thread's node
+    FreeList remote[BUFFER_POOL_MAX_NODES][BUFFER_POOL_CLASS_COUNT] = {}; // Freed buffers of other nodes, returned in batches
+
+    ~ThreadCache()
+    {
+        for(uint32_t sizeClass = 0; sizeClass < BUFFER_POOL_CLASS_COUNT; ++sizeClass)
+        {
+            giveBack(depots[node][sizeClass], sizeClass, lists[sizeClass], lists[sizeClass].count);
+            for(uint32_t other = 0; other < BUFFER_POOL_MAX_NODES; ++other)
+            {
+                giveBack(depots[other][sizeClass], sizeClass, remote[other][sizeClass], remote[other][sizeClass].count);
+            }
+        }
+    }
+};
+
+static thread_local ThreadCache threadCache;
+
+// Function to get a buffer of at least capacity usable bytes
+BufferBlock* BufferPool::acquire(size_t capacity)
+{
+    // Find the smallest class that fits
+    uint32_t sizeClass = 0;
+    while(sizeClass < BUFFER_POOL_CLASS_COUNT && classSize(sizeClass) < capacity)
+    {
+        ++sizeClass;
+    }
+
+    if(sizeClass == BUFFER_POOL_CLASS_COUNT)
+    {
+        // Too large to be worth pooling
+        BufferBlock* block = new (::operator new(sizeof(BufferBlock) + capacity)) BufferBlock;
+        block->next = NULL;
+        block->sizeClass = BUFFER_POOL_LARGE_CLASS;
+        block->capacity = (uint32_t)capacity;
+        block->references.store(1, std::memory_order_relaxed);
+        block->node = 0;
+        return block;
+    }
+
+    FreeList& list = threadCache.lists[sizeClass];
+    if(list.head == NULL)
+    {
+        // Refill half of the cache from the depot with a single lock acquisition
+        Depot& depot = depots[threadCache.node][sizeClass];
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        transfer(depot.list, list, cacheLimit(sizeClass) / 2);
+    }
+
+    BufferBlock* block = list.head;
+    if(block != NULL)
+    {
+        list.head = block->next;
+        --list.count;
+    }
+    else
+    {
+        block = new (::operator new(sizeof(BufferBlock) + classSize(sizeClass))) BufferBlock; // Pool is still warming up
+        block->sizeClass = sizeClass;
+        block->capacity = (uint32_t)classSize(sizeClass);
+        block->node = threadCache.node; // First touched by this thread, so it lives on its node
+    }
+
+    block->next = NULL;
+    block->references.store(1, std::memory_order_relaxed);
+    return block;
+}
+
+// Function to give a buffer back to the calling thread's cache
+void BufferPool::release(BufferBlock* block)
+{
+    if(block->sizeClass == BUFFER_POOL_LARGE_CLASS)
+    {
+        ::operator delete(block);
+        return;
+    }
+
+    uint32_t sizeClass = block->sizeClass;
+    if(block->node != threadCache.node)
+    {
+        // Memory of another node, e.g. a buffer of a loop on the other socket; caching it here would spread
+        // remote memory into this node's buffers
+        FreeList& remote = threadCache.remote[block->node][sizeClass];
+        block->next = remote.head;
+        remote.head = block;
+        ++remote.count;
+        if(remote.count >= cacheLimit(sizeClass) / 2)
+        {
+            giveBack(depots[block->node][sizeClass], sizeClass, remote, remote.count);
+        }
+        return;
+    }
+
+    FreeList& list = threadCache.lists[sizeClass];
+    block->next = list.head;
+    list.head = block;
+    ++list.count;
+
+    if(list.count > cacheLimit(sizeClass))
+    {
+        // Hand half of the cache to the depot, e.g. a worker returning buffers an event loop allocated
+        giveBack(depots[threadCache.node][sizeClass], sizeClass, list, list.count / 2);
+    }
+}
+
+// Constructor for the PooledBuffer class, copying size bytes into a new pooled buffer
+PooledBuffer::PooledBuffer(const char* data, size_t size) : block(BufferPool::acquire(size)), length(size)
+{
+    memcpy(this->data(), data, size);
+}
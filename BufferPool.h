@@ -0,0 +1,149 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#define BUFFER_POOL_MIN_SHIFT 6 // Smallest size class is 64 bytes
+#define BUFFER_POOL_MAX_SHIFT 21 // Largest size class is 2 MiB, larger buffers bypass the pool
+#define BUFFER_POOL_CLASS_COUNT (BUFFER_POOL_MAX_SHIFT - BUFFER_POOL_MIN_SHIFT + 1)
+#define BUFFER_POOL_LARGE_CLASS 0xFF // Size class tag of buffers allocated outside the pool
+#define BUFFER_POOL_CACHE_BYTES (1024 * 1024) // Bytes of each size class a thread keeps for itself
+#define BUFFER_POOL_DEPOT_BYTES (64 * 1024 * 1024) // Bytes of each size class kept in the shared depot of a NUMA node
+#define BUFFER_POOL_MAX_NODES 8 // NUMA nodes with their own depots, higher nodes share them modulo this
+
+// Header placed in front of every pooled buffer, links free buffers together
+struct BufferBlock
+{
+    BufferBlock* next; // Next free buffer of the same class
+    uint32_t sizeClass; // Index of the size class, BUFFER_POOL_LARGE_CLASS if not pooled
+    uint32_t capacity; // Usable bytes after the header
+    std::atomic<uint32_t> references; // Handles sharing the buffer, it returns to the pool when the last one goes
+    uint32_t node; // Depot of the NUMA node the buffer was allocated on, it only returns there
+};
+
+// Size-classed buffer allocator. Every thread has its own free lists; surplus buffers move in
+// batches through a small locked depot per class, so a buffer allocated by an event loop and freed
+// by a worker comes back without touching the heap. Depots are kept per NUMA node and freed buffers
+// return to the node they came from, so a pinned thread only ever reuses memory of its own node.
+class BufferPool
+{
+public:
+    static BufferBlock* acquire(size_t capacity);
+    static void release(BufferBlock* block);
+};
+
+// Reference-counted handle of a pooled buffer and the number of bytes used in it.
+// Handles are moved by default; share() is the explicit way to add a reference.
+class PooledBuffer
+{
+public:
+    PooledBuffer() noexcept : block(NULL), length(0) {}
+    explicit PooledBuffer(size_t capacity) : block(BufferPool::acquire(capacity)), length(0) {}
+    PooledBuffer(const char* data, size_t size);
+    PooledBuffer(PooledBuffer&& other) noexcept : block(other.block), length(other.length)
+    {
+        other.block = NULL;
+        other.length = 0;
+    }
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept
+    {
+        if(this != &other)
+        {
+            reset();
+            block = other.block;
+            length = other.length;
+            other.block = NULL;
+            other.length = 0;
+        }
+        return *this;
+    }
+    PooledBuffer(const PooledBuffer&) = delete;
+    PooledBuffer& operator=(const PooledBuffer&) = delete;
+    ~PooledBuffer()
+    {
+        reset();
+    }
+
+    // Function to drop this reference, the last one gives the buffer back to the pool
+    void reset()
+    {
+        if(block != NULL)
+        {
+            if(block->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                BufferPool::release(block);
+            }
+            block = NULL;
+        }
+        length = 0;
+    }
+
+    // Function to get another handle to the same buffer
+    PooledBuffer share() const
+    {
+        PooledBuffer other;
+        if(block != NULL)
+        {
+            block->references.fetch_add(1, std::memory_order_relaxed);
+            other.block = block;
+            other.length = length;
+        }
+        return other;
+    }
+
+    // Function to check whether this is the only handle, i.e. the bytes may be rewritten
+    bool unique() const
+    {
+        return block != NULL && block->references.load(std::memory_order_acquire) == 1;
+    }
+
+    char* data() { return block == NULL ? NULL : reinterpret_cast<char*>(block + 1); }
+    const char* data() const { return block == NULL ? NULL : reinterpret_cast<const char*>(block + 1); }
+    size_t size() const { return length; }
+    size_t capacity() const { return block == NULL ? 0 : block->capacity; }
+    bool empty() const { return length == 0; }
+    void setSize(size_t size) { length = size; } // size must not exceed capacity()
+    std::string_view view() const { return std::string_view(data(), length); }
+
+private:
+    BufferBlock* block; // Pooled memory, NULL if none
+    size_t length; // Used bytes
+};
+
+// Immutable view into a pooled buffer that keeps the buffer alive, e.g. one frame of a receive buffer
+class BufferSlice
+{
+public:
+    BufferSlice() noexcept : bytes(NULL), length(0) {}
+    BufferSlice(PooledBuffer&& owner, const char* data, size_t size) : buffer(std::move(owner)), bytes(data), length(size) {}
+    BufferSlice(BufferSlice&& other) noexcept = default;
+    BufferSlice& operator=(BufferSlice&& other) noexcept = default;
+
+    // Function to release the underlying buffer
+    void reset()
+    {
+        buffer.reset();
+        bytes = NULL;
+        length = 0;
+    }
+
+    // Function to get another slice of the same bytes, e.g. to queue one payload to many clients
+    BufferSlice share() const
+    {
+        return BufferSlice(buffer.share(), bytes, length);
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+    std::string_view view() const { return std::string_view(bytes, length); }
+
+private:
+    PooledBuffer buffer; // Reference keeping the bytes alive
+    const char* bytes; // First byte of the slice
+    size_t length; // Bytes in the slice
+};
+
+#endif
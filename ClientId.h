@@ -0,0 +1,17 @@
+#ifndef CLIENT_ID_H
+#define CLIENT_ID_H
+
+#include <cstdint>
+
+// Identity of a client connection; the generation tells apart clients that got the same descriptor
+// one after another, so a late reply can never reach the next client of a reused descriptor
+struct ClientId
+{
+    int socket = -1; // Client socket descriptor
+    uint32_t generation = 0; // Generation of the descriptor's connection slot when the client connected
+
+    bool operator==(const ClientId& other) const { return socket == other.socket && generation == other.generation; }
+    bool operator!=(const ClientId& other) const { return !(*this == other); }
+};
+
+#endif
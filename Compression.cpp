@@ -0,0 +1,552 @@
+#include "Compression.h" // Including the header file to define the compression contexts and their pool
+#include <cstring> // This header file is included to use memset and memcpy
+#ifdef TCPSERVER_WITH_ZSTD
+#include <zstd.h> // This header file is included for the Zstandard streaming API
+#endif
+#ifdef TCPSERVER_WITH_LZ4
+#include <lz4frame.h> // This header file is included for the LZ4 frame API
+#endif
+#ifdef TCPSERVER_WITH_ZLIB
+#include <zlib.h> // This header file is included for deflate and inflate
+#endif
+
+#define STATIC
+#define CODEC_COUNT 4 // Entries of CompressionCodec, contexts are cached per codec
+#define DEFLATE_FLUSH_BYTES 16 // Sync flush marker and pending bits written after the compressed data of a block
+#define ZSTD_STREAM_BYTES 64 // Frame header of the first block and the header of the block a flush ends
+
+#ifdef TCPSERVER_WITH_ZSTD
+// Zstandard compression of one direction, a single endless frame flushed after every block
+class ZstdCompressor : public StreamCompressor
+{
+public:
+    ZstdCompressor() : context(ZSTD_createCCtx()) {}
+    ~ZstdCompressor() override { ZSTD_freeCCtx(context); }
+
+    CompressionCodec codec() const override { return CompressionCodec::ZSTD; }
+    size_t bound(size_t inputSize) const override { return ZSTD_compressBound(inputSize) + ZSTD_STREAM_BYTES; }
+
+    // Function to compress a block and flush it
+    bool compress(const char* input, size_t inputSize, char* output, size_t outputSize, size_t& produced) override
+    {
+        ZSTD_inBuffer source = {input, inputSize, 0};
+        ZSTD_outBuffer destination = {output, outputSize, 0};
+        while(true)
+        {
+            size_t remaining = ZSTD_compressStream2(context, &destination, &source, ZSTD_e_flush);
+            if(ZSTD_isError(remaining))
+            {
+                return false;
+            }
+            if(remaining == 0)
+            {
+                break; // Everything is flushed
+            }
+            if(destination.pos == destination.size)
+            {
+                return false;
+            }
+        }
+        produced = destination.pos;
+        return true;
+    }
+
+    // Function to forget the history and apply the level, 0 is the library's default
+    bool reset(int compressionLevel) override
+    {
+        return context != NULL && !ZSTD_isError(ZSTD_CCtx_reset(context, ZSTD_reset_session_and_parameters)) &&
+               !ZSTD_isError(ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, compressionLevel)) &&
+               !ZSTD_isError(ZSTD_CCtx_setParameter(context, ZSTD_c_windowLog, COMPRESSION_ZSTD_WINDOW_LOG));
+    }
+
+private:
+    ZSTD_CCtx* context; // Stream state and history
+};
+
+// Zstandard decompression of one direction
+class ZstdDecompressor : public StreamDecompressor
+{
+public:
+    ZstdDecompressor() : context(ZSTD_createDCtx()) {}
+    ~ZstdDecompressor() override { ZSTD_freeDCtx(context); }
+
+    CompressionCodec codec() const override { return CompressionCodec::ZSTD; }
+
+    // Function to decompress part of a block
+    bool decompress(const char* input, size_t inputSize, size_t& consumed, char* output, size_t outputSize, size_t& produced) override
+    {
+        ZSTD_inBuffer source = {input, inputSize, 0};
+        ZSTD_outBuffer destination = {output, outputSize, 0};
+        if(ZSTD_isError(ZSTD_decompressStream(context, &destination, &source)))
+        {
+            return false;
+        }
+        consumed = source.pos;
+        produced = destination.pos;
+        return true;
+    }
+
+    // Function to forget the history
+    bool reset() override
+    {
+        return context != NULL && !ZSTD_isError(ZSTD_DCtx_reset(context, ZSTD_reset_session_and_parameters)) &&
+               !ZSTD_isError(ZSTD_DCtx_setParameter(context, ZSTD_d_windowLogMax, COMPRESSION_ZSTD_MAX_WINDOW_LOG));
+    }
+
+private:
+    ZSTD_DCtx* context; // Stream state and history
+};
+#endif
+
+#ifdef TCPSERVER_WITH_LZ4
+// LZ4 compression of one direction, a single frame of linked blocks so later blocks refer back to earlier ones
+class Lz4Compressor : public StreamCompressor
+{
+public:
+    Lz4Compressor() : context(NULL), started(false)
+    {
+        if(LZ4F_isError(LZ4F_createCompressionContext(&context, LZ4F_VERSION)))
+        {
+            context = NULL;
+        }
+        memset(&preferences, 0, sizeof(preferences));
+        preferences.frameInfo.blockMode = LZ4F_blockLinked;
+        preferences.frameInfo.blockSizeID = LZ4F_max64KB;
+        preferences.autoFlush = 1; // Nothing waits in the context for a block to fill up
+    }
+    ~Lz4Compressor() override { LZ4F_freeCompressionContext(context); }
+
+    CompressionCodec codec() const override { return CompressionCodec::LZ4; }
+    size_t bound(size_t inputSize) const override { return LZ4F_compressBound(inputSize, &preferences) + LZ4F_HEADER_SIZE_MAX; }
+
+    // Function to compress a block and flush it, the first one starts with the frame header
+    bool compress(const char* input, size_t inputSize, char* output, size_t outputSize, size_t& produced) override
+    {
+        size_t total = 0;
+        if(!started)
+        {
+            size_t headerSize = LZ4F_compressBegin(context, output, outputSize, &preferences);
+            if(LZ4F_isError(headerSize))
+            {
+                return false;
+            }
+            total = headerSize;
+            started = true;
+        }
+        size_t written = LZ4F_compressUpdate(context, output + total, outputSize - total, input, inputSize, NULL);
+        if(LZ4F_isError(written))
+        {
+            return false;
+        }
+        total += written;
+        written = LZ4F_flush(context, output + total, outputSize - total, NULL);
+        if(LZ4F_isError(written))
+        {
+            return false;
+        }
+        produced = total + written;
+        return true;
+    }
+
+    // Function to start a new frame with the level, 0 is the library's default
+    bool reset(int compressionLevel) override
+    {
+        preferences.compressionLevel = compressionLevel;
+        started = false; // compressBegin drops the history of the previous frame
+        return context != NULL;
+    }
+
+private:
+    LZ4F_cctx* context; // Frame state and history
+    LZ4F_preferences_t preferences; // Block layout and level of the frame
+    bool started; // The frame header was written
+};
+
+// LZ4 decompression of one direction
+class Lz4Decompressor : public StreamDecompressor
+{
+public:
+    Lz4Decompressor() : context(NULL)
+    {
+        if(LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION)))
+        {
+            context = NULL;
+        }
+    }
+    ~Lz4Decompressor() override { LZ4F_freeDecompressionContext(context); }
+
+    CompressionCodec codec() const override { return CompressionCodec::LZ4; }
+
+    // Function to decompress part of a block
+    bool decompress(const char* input, size_t inputSize, size_t& consumed, char* output, size_t outputSize, size_t& produced) override
+    {
+        consumed = inputSize;
+        produced = outputSize;
+        return !LZ4F_isError(LZ4F_decompress(context, output, &produced, input, &consumed, NULL));
+    }
+
+    // Function to forget the frame in progress
+    bool reset() override
+    {
+        if(context == NULL)
+        {
+            return false;
+        }
+        LZ4F_resetDecompressionContext(context);
+        return true;
+    }
+
+private:
+    LZ4F_dctx* context; // Frame state and history
+};
+#endif
+
+#ifdef TCPSERVER_WITH_ZLIB
+// Raw deflate compression of one direction, every block ends with a sync flush
+class DeflateCompressor : public StreamCompressor
+{
+public:
+    DeflateCompressor() : level(Z_DEFAULT_COMPRESSION)
+    {
+        memset(&stream, 0, sizeof(stream));
+        ready = deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+    ~DeflateCompressor() override
+    {
+        if(ready)
+        {
+            deflateEnd(&stream);
+        }
+    }
+
+    CompressionCodec codec() const override { return CompressionCodec::DEFLATE; }
+    size_t bound(size_t inputSize) const override { return compressBound(inputSize) + DEFLATE_FLUSH_BYTES; }
+
+    // Function to compress a block and flush it
+    bool compress(const char* input, size_t inputSize, char* output, size_t outputSize, size_t& produced) override
+    {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input));
+        stream.avail_in = inputSize;
+        stream.next_out = reinterpret_cast<Bytef*>(output);
+        stream.avail_out = outputSize;
+        int result = deflate(&stream, Z_SYNC_FLUSH);
+        if((result != Z_OK && result != Z_BUF_ERROR) || stream.avail_in != 0 || stream.avail_out == 0)
+        {
+            return false; // With no room left the flush may not have completed
+        }
+        produced = outputSize - stream.avail_out;
+        return true;
+    }
+
+    // Function to forget the history and apply the level, 0 is the library's default
+    bool reset(int compressionLevel) override
+    {
+        int wanted = compressionLevel == 0 ? Z_DEFAULT_COMPRESSION : compressionLevel;
+        if(!ready || deflateReset(&stream) != Z_OK)
+        {
+            return false;
+        }
+        if(wanted != level)
+        {
+            if(deflateParams(&stream, wanted, Z_DEFAULT_STRATEGY) != Z_OK)
+            {
+                return false;
+            }
+            level = wanted;
+        }
+        return true;
+    }
+
+private:
+    z_stream stream; // Stream state and history
+    int level; // Level the stream compresses with
+    bool ready; // deflateInit2 succeeded
+};
+
+// Raw deflate decompression of one direction
+class DeflateDecompressor : public StreamDecompressor
+{
+public:
+    DeflateDecompressor()
+    {
+        memset(&stream, 0, sizeof(stream));
+        ready = inflateInit2(&stream, -MAX_WBITS) == Z_OK;
+    }
+    ~DeflateDecompressor() override
+    {
+        if(ready)
+        {
+            inflateEnd(&stream);
+        }
+    }
+
+    CompressionCodec codec() const override { return CompressionCodec::DEFLATE; }
+
+    // Function to decompress part of a block
+    bool decompress(const char* input, size_t inputSize, size_t& consumed, char* output, size_t outputSize, size_t& produced) override
+    {
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input));
+        stream.avail_in = inputSize;
+        stream.next_out = reinterpret_cast<Bytef*>(output);
+        stream.avail_out = outputSize;
+        int result = inflate(&stream, Z_SYNC_FLUSH);
+        if(result != Z_OK && result != Z_BUF_ERROR && result != Z_STREAM_END)
+        {
+            return false;
+        }
+        consumed = inputSize - stream.avail_in;
+        produced = outputSize - stream.avail_out;
+        return true;
+    }
+
+    // Function to forget the history
+    bool reset() override
+    {
+        return ready && inflateReset(&stream) == Z_OK;
+    }
+
+private:
+    z_stream stream; // Stream state and history
+    bool ready; // inflateInit2 succeeded
+};
+#endif
+
+// Released contexts of one thread, freed when the thread exits
+struct ContextCache
+{
+    std::vector<StreamCompressor*> compressors[CODEC_COUNT]; // Reset compressors by codec
+    std::vector<StreamDecompressor*> decompressors[CODEC_COUNT]; // Reset decompressors by codec
+
+    ~ContextCache();
+};
+
+static thread_local ContextCache contextCache; // Contexts released by this thread
+static thread_local bool contextCacheAlive = true; // Cleared once contextCache is destroyed, later releases free right away
+
+// Destructor of the ContextCache class
+ContextCache::~ContextCache()
+{
+    contextCacheAlive = false;
+    for(int codec = 0; codec < CODEC_COUNT; ++codec)
+    {
+        for(StreamCompressor* compressor : compressors[codec])
+        {
+            delete compressor;
+        }
+        for(StreamDecompressor* decompressor : decompressors[codec])
+        {
+            delete decompressor;
+        }
+    }
+}
+
+// Function to park a compressor for reuse by this thread, or free it if enough are parked
+void CompressorRelease::operator()(StreamCompressor* compressor) const
+{
+    std::vector<StreamCompressor*>* cached = contextCacheAlive ? &contextCache.compressors[(int)compressor->codec()] : NULL;
+    if(cached == NULL || cached->size() >= COMPRESSION_CACHED_CONTEXTS)
+    {
+        delete compressor;
+        return;
+    }
+    cached->push_back(compressor); // Reset when it is taken again, the level may differ by then
+}
+
+// Function to park a decompressor for reuse by this thread, or free it if enough are parked
+void DecompressorRelease::operator()(StreamDecompressor* decompressor) const
+{
+    std::vector<StreamDecompressor*>* cached = contextCacheAlive ? &contextCache.decompressors[(int)decompressor->codec()] : NULL;
+    if(cached == NULL || cached->size() >= COMPRESSION_CACHED_CONTEXTS)
+    {
+        delete decompressor;
+        return;
+    }
+    cached->push_back(decompressor);
+}
+
+// Function to get a compressor with no history, reusing one released by this thread if possible.
+// Returns NULL if the codec is not compiled in or its context cannot be set up
+STATIC CompressorHandle CompressionPool::acquireCompressor(CompressionCodec codec, int compressionLevel)
+{
+    StreamCompressor* compressor = NULL;
+    std::vector<StreamCompressor*>& cached = contextCache.compressors[(int)codec];
+    if(!cached.empty())
+    {
+        compressor = cached.back();
+        cached.pop_back();
+    }
+    else
+    {
+        compressor = createCompressor(codec);
+    }
+    if(compressor != NULL && !compressor->reset(compressionLevel))
+    {
+        delete compressor;
+        compressor = NULL;
+    }
+    return CompressorHandle(compressor);
+}
+
+// Function to get a decompressor with no history, reusing one released by this thread if possible.
+// Returns NULL if the codec is not compiled in or its context cannot be set up
+STATIC DecompressorHandle CompressionPool::acquireDecompressor(CompressionCodec codec)
+{
+    StreamDecompressor* decompressor = NULL;
+    std::vector<StreamDecompressor*>& cached = contextCache.decompressors[(int)codec];
+    if(!cached.empty())
+    {
+        decompressor = cached.back();
+        cached.pop_back();
+    }
+    else
+    {
+        decompressor = createDecompressor(codec);
+    }
+    if(decompressor != NULL && !decompressor->reset())
+    {
+        delete decompressor;
+        decompressor = NULL;
+    }
+    return DecompressorHandle(decompressor);
+}
+
+// Function to allocate a compressor of a codec, NULL if it is not compiled in
+STATIC StreamCompressor* CompressionPool::createCompressor(CompressionCodec codec)
+{
+    switch(codec)
+    {
+#ifdef TCPSERVER_WITH_ZSTD
+        case CompressionCodec::ZSTD:
+            return new ZstdCompressor();
+#endif
+#ifdef TCPSERVER_WITH_LZ4
+        case CompressionCodec::LZ4:
+            return new Lz4Compressor();
+#endif
+#ifdef TCPSERVER_WITH_ZLIB
+        case CompressionCodec::DEFLATE:
+            return new DeflateCompressor();
+#endif
+        default:
+            return NULL;
+    }
+}
+
+// Function to allocate a decompressor of a codec, NULL if it is not compiled in
+STATIC StreamDecompressor* CompressionPool::createDecompressor(CompressionCodec codec)
+{
+    switch(codec)
+    {
+#ifdef TCPSERVER_WITH_ZSTD
+        case CompressionCodec::ZSTD:
+            return new ZstdDecompressor();
+#endif
+#ifdef TCPSERVER_WITH_LZ4
+        case CompressionCodec::LZ4:
+            return new Lz4Decompressor();
+#endif
+#ifdef TCPSERVER_WITH_ZLIB
+        case CompressionCodec::DEFLATE:
+            return new DeflateDecompressor();
+#endif
+        default:
+            return NULL;
+    }
+}
+
+// Function to check whether a codec was compiled in
+STATIC bool CompressionPool::available(CompressionCodec codec)
+{
+    switch(codec)
+    {
+#ifdef TCPSERVER_WITH_ZSTD
+        case CompressionCodec::ZSTD:
+            return true;
+#endif
+#ifdef TCPSERVER_WITH_LZ4
+        case CompressionCodec::LZ4:
+            return true;
+#endif
+#ifdef TCPSERVER_WITH_ZLIB
+        case CompressionCodec::DEFLATE:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+// Function to get the name a codec is offered and accepted by
+STATIC const char* CompressionPool::name(CompressionCodec codec)
+{
+    switch(codec)
+    {
+        case CompressionCodec::ZSTD:
+            return "zstd";
+        case CompressionCodec::LZ4:
+            return "lz4";
+        case CompressionCodec::DEFLATE:
+            return "deflate";
+        default:
+            return "none";
+    }
+}
+
+// Function to pick the codec of a connection from the client's comma-separated offer: the first of the
+// server's preferred codecs that the client offered and that is compiled in, NONE if there is none
+STATIC CompressionCodec CompressionPool::negotiate(std::string_view offer, const std::vector<CompressionCodec>& preferred)
+{
+    for(CompressionCodec codec : preferred)
+    {
+        if(!available(codec))
+        {
+            continue;
+        }
+        std::string_view wanted(name(codec));
+        size_t start = 0;
+        while(start <= offer.size())
+        {
+            size_t end = offer.find(',', start);
+            if(end == std::string_view::npos)
+            {
+                end = offer.size();
+            }
+            std::string_view entry = offer.substr(start, end - start);
+            while(!entry.empty() && (entry.front() == ' ' || entry.front() == '\r'))
+            {
+                entry.remove_prefix(1);
+            }
+            while(!entry.empty() && (entry.back() == ' ' || entry.back() == '\r'))
+            {
+                entry.remove_suffix(1); // Tolerate "zstd, lz4" and a CRLF line ending
+            }
+            if(entry == wanted)
+            {
+                return codec;
+            }
+            start = end + 1;
+        }
+    }
+    return CompressionCodec::NONE;
+}
+
+// Function to write one block of at most COMPRESSION_MAX_BLOCK_SIZE bytes into a pooled buffer, header included.
+// The block is compressed by compressor or stored as it is if that is NULL. Returns false if the compressor
+// failed, its stream cannot be continued then
+bool encodeCompressionBlock(StreamCompressor* compressor, const char* input, size_t size, PooledBuffer& block)
+{
+    block = PooledBuffer(COMPRESSION_BLOCK_HEADER_SIZE + (compressor != NULL ? compressor->bound(size) : size));
+    char* content = block.data() + COMPRESSION_BLOCK_HEADER_SIZE;
+    size_t produced = size;
+    if(compressor == NULL)
+    {
+        memcpy(content, input, size);
+    }
+    else if(!compressor->compress(input, size, content, block.capacity() - COMPRESSION_BLOCK_HEADER_SIZE, produced))
+    {
+        return false;
+    }
+    writeCompressionHeader(block.data(), produced, compressor != NULL);
+    block.setSize(COMPRESSION_BLOCK_HEADER_SIZE + produced);
+    return true;
+}
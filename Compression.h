@@ -0,0 +1,107 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include "BufferPool.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// The codecs are compiled in with their libraries, e.g. -DTCPSERVER_WITH_ZSTD ... -lzstd,
+// -DTCPSERVER_WITH_LZ4 ... -llz4 or -DTCPSERVER_WITH_ZLIB ... -lz. Offers of any other codec are declined
+#define COMPRESSION_BLOCK_HEADER_SIZE 4 // Big-endian block length, the top bit marks a compressed block
+#define COMPRESSION_BLOCK_COMPRESSED 0x80000000u // Header bit of a block that has to go through the decompressor
+#define COMPRESSION_MAX_BLOCK_SIZE (1024 * 1024) // Largest uncompressed content of one block, in both directions
+#define COMPRESSION_MAX_WIRE_BLOCK (2 * COMPRESSION_MAX_BLOCK_SIZE) // Clients sending a longer block are disconnected
+#define COMPRESSION_CACHED_CONTEXTS 64 // Released contexts of each codec and direction a thread keeps for reuse
+#define COMPRESSION_ZSTD_WINDOW_LOG 17 // 128 KiB of history per zstd stream instead of several MiB at the higher levels
+#define COMPRESSION_ZSTD_MAX_WINDOW_LOG 23 // Largest history a client's zstd stream may ask the server to keep
+#define COMPRESSION_OFFER_PREFIX "\x7f" "compress:" // First frame of a client offering codecs, e.g. "\x7f" "compress:zstd,lz4"
+#define DEFAULT_COMPRESSION_THRESHOLD 256 // Replies flushed together below this many bytes are sent uncompressed
+
+// Streaming codec of a connection's bytes, negotiated by the client's first frame
+enum class CompressionCodec
+{
+    NONE,    // Plain bytes
+    ZSTD,    // Zstandard, best ratio on repetitive messages
+    LZ4,     // LZ4 frames with linked blocks, cheapest to compress
+    DEFLATE  // Raw deflate, available wherever zlib is
+};
+
+// Compressing half of a stream. Every block is flushed, so the peer can decompress it as soon as it arrives,
+// while the history of the earlier blocks stays in the context and keeps repetitive messages small.
+// compress needs bound(inputSize) bytes of output; a failure leaves the stream unusable
+class StreamCompressor
+{
+public:
+    virtual ~StreamCompressor() {}
+    virtual CompressionCodec codec() const = 0;
+    virtual size_t bound(size_t inputSize) const = 0;
+    virtual bool compress(const char* input, size_t inputSize, char* output, size_t outputSize, size_t& produced) = 0;
+    virtual bool reset(int compressionLevel) = 0;
+};
+
+// Decompressing half of a stream, fed one complete block at a time. A step stops when the input is used up or
+// the output is full, the rest of a block's output is then taken by further steps with the remaining input
+class StreamDecompressor
+{
+public:
+    virtual ~StreamDecompressor() {}
+    virtual CompressionCodec codec() const = 0;
+    virtual bool decompress(const char* input, size_t inputSize, size_t& consumed, char* output, size_t outputSize, size_t& produced) = 0;
+    virtual bool reset() = 0;
+};
+
+// Deleters giving the contexts back to the pool instead of freeing them
+struct CompressorRelease
+{
+    void operator()(StreamCompressor* compressor) const;
+};
+struct DecompressorRelease
+{
+    void operator()(StreamDecompressor* decompressor) const;
+};
+typedef std::unique_ptr<StreamCompressor, CompressorRelease> CompressorHandle;
+typedef std::unique_ptr<StreamDecompressor, DecompressorRelease> DecompressorHandle;
+
+// Per-thread free lists of compression contexts. A stream's context carries its history and stays with the
+// connection, but when the connection closes it is reset and parked for the next client of the same thread,
+// so the large codec state is allocated per thread rather than per connection and never per message
+class CompressionPool
+{
+public:
+    static CompressorHandle acquireCompressor(CompressionCodec codec, int compressionLevel);
+    static DecompressorHandle acquireDecompressor(CompressionCodec codec);
+    static bool available(CompressionCodec codec);
+    static const char* name(CompressionCodec codec);
+    static CompressionCodec negotiate(std::string_view offer, const std::vector<CompressionCodec>& preferred);
+
+private:
+    friend struct CompressorRelease;
+    friend struct DecompressorRelease;
+
+    static StreamCompressor* createCompressor(CompressionCodec codec);
+    static StreamDecompressor* createDecompressor(CompressionCodec codec);
+};
+
+bool encodeCompressionBlock(StreamCompressor* compressor, const char* input, size_t size, PooledBuffer& block);
+
+// Function to check whether a frame is a client's offer of codecs
+inline bool isCompressionOffer(std::string_view frame)
+{
+    std::string_view prefix(COMPRESSION_OFFER_PREFIX);
+    return frame.size() >= prefix.size() && frame.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Function to write the header of a block of size bytes
+inline void writeCompressionHeader(char* out, size_t size, bool compressed)
+{
+    uint32_t header = (uint32_t)size | (compressed ? COMPRESSION_BLOCK_COMPRESSED : 0);
+    out[0] = (char)(header >> 24);
+    out[1] = (char)(header >> 16);
+    out[2] = (char)(header >> 8);
+    out[3] = (char)header;
+}
+
+#endif
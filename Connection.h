@@ -0,0 +1,76 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include "Framing.h"
+#include "BufferPool.h"
+#include "ClientId.h"
+#include "Compression.h"
+#include "ConnectionSession.h"
+#include "TimerWheel.h"
+#include "TokenBucket.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define OUTBOUND_MAX_IOV 64 // Maximum number of queued slices written by a single sendmsg
+#define ZERO_COPY_BACKOFF_SENDS 64 // Large sends copied after a zero copy send failed with ENOBUFS
+
+// State of a client served by an event loop
+struct Connection
+{
+    Connection(int clientSocket, FramingMode framingMode, size_t maximumFrameSize, char frameDelimiter)
+        : socket(clientSocket), decoder(framingMode, maximumFrameSize, frameDelimiter) {}
+    int socket; // Client socket descriptor
+    ClientId id; // Identity handed to message handlers, replies for an older generation are dropped
+    size_t listIndex = 0; // Position in the client list of the owning loop
+    FrameDecoder decoder; // Reassembles frames from the received bytes
+
+    // Timeouts: the timer is only moved when it fires, activity just refreshes the time stamps
+    TimerEntry idleTimer; // Fires at the earliest deadline computed when it was last scheduled
+    uint64_t lastActivity = 0; // Loop time in milliseconds of the last byte received or written
+    uint64_t partialSince = 0; // Loop time the buffered incomplete frame started at, 0 if none
+
+    // Rate limit: a client over its rate is not read until its bucket has refilled
+    TokenBucket rateLimit; // Messages the client may still send
+    uint64_t throttledUntil = 0; // Loop time reading resumes at, 0 while the client is within its rate
+    bool queueLimited = false; // Not read until the workers have handled half of the client's queued messages
+
+    std::deque<BufferSlice> outbound; // Queued replies, oldest first
+    size_t outboundBytes = 0; // Queued bytes not written yet
+    size_t outboundOffset = 0; // Bytes of the oldest reply already written
+    bool flushPending = false; // Listed for a flush at the end of the current wakeup
+    bool readPaused = false; // Reading stopped until the queued replies fall below the low watermark
+
+    // Compression: the replies queued in one wakeup are compressed together when the flush starts
+    bool negotiating = false; // The next frame may still offer codecs, only a client's first frame can
+    CompressorHandle compressor; // Compresses the replies once the client switched to a codec, NULL otherwise
+    std::vector<BufferSlice> uncompressed; // Replies queued since the last flush, not in a block yet
+    size_t uncompressedBytes = 0; // Bytes of the uncompressed replies
+
+    // Handler running on the loop instead of the worker pool, if the server has a session factory
+    std::unique_ptr<ConnectionSession> session; // NULL when the client's messages go to the workers
+    bool awaitingWritable = false; // The session waits for the queued replies to fall to the low watermark
+    bool closeRequested = false; // The session closed the client, done once its queued replies are written
+
+    // Zero copy sends: written replies are held until the kernel reports it no longer reads their pages
+    std::deque<std::pair<uint32_t, BufferSlice>> zeroCopyHeld; // Written replies, tagged with the sends they wait for
+    uint32_t zeroCopyIssued = 0; // Zero copy sends issued on this connection
+    uint32_t zeroCopyCompleted = 0; // Zero copy sends the kernel has finished with
+    bool zeroCopyEnabled = false; // epoll only: SO_ZEROCOPY is set on the socket, large batches are only sent without copying then
+    uint32_t zeroCopyBackoff = 0; // epoll only: large sends still copied after the kernel ran out of memory for zero copy
+
+    bool readPending = false; // epoll only: listed to be read again after using up its read budget
+
+    // io_uring only: the message header and vectors of the send in flight must outlive its submission
+    bool receiving = true; // The multishot recv is armed or its final completion is still to come
+    bool sending = false; // A send is in flight
+    bool closing = false; // Closed as soon as the send in flight completes
+    struct msghdr sendHeader = {}; // Header of the send in flight
+    struct iovec sendVectors[OUTBOUND_MAX_IOV]; // Vectors of the send in flight
+};
+
+#endif
@@ -0,0 +1,28 @@
+#include "ConnectionSession.h" // Including the header file to define the ConnectionSession class
+#include "IoLoop.h" // Including the event loop the session writes its replies through
+
+// Function to queue a reply to the client, written at the end of the loop's current wakeup.
+// Returns false if the client has left or was closed; queueing never blocks, see writeBlocked
+bool ConnectionSession::write(std::string_view payload)
+{
+    return loop->writeSession(id, payload);
+}
+
+// Function to check whether the client's queued replies exceed the high watermark, a session should then
+// stop writing until onWritable
+bool ConnectionSession::writeBlocked() const
+{
+    return loop->sessionBlocked(id);
+}
+
+// Function to have onWritable called once the queued replies have fallen to the low watermark
+void ConnectionSession::notifyWritable()
+{
+    loop->awaitWritable(id);
+}
+
+// Function to close the client once the replies queued so far are written, onClose follows
+void ConnectionSession::close()
+{
+    loop->closeSession(id);
+}
@@ -0,0 +1,43 @@
+#ifndef CONNECTION_SESSION_H
+#define CONNECTION_SESSION_H
+
+#include "BufferPool.h"
+#include "ClientId.h"
+#include <functional>
+#include <memory>
+#include <string_view>
+
+class IoLoop;
+
+// Handler of a single client that runs on the event loop serving it instead of on the worker pool, so a
+// handler can keep per-connection state and write its replies without any locking. Reactor modes only.
+// Every function is called by the loop thread, none of them may block
+class ConnectionSession
+{
+public:
+    ConnectionSession() : loop(NULL) {}
+    virtual ~ConnectionSession() {}
+    ConnectionSession(const ConnectionSession&) = delete;
+    ConnectionSession& operator=(const ConnectionSession&) = delete;
+
+    virtual void onOpen() = 0;
+    virtual void onMessage(BufferSlice&& message) = 0;
+    virtual void onWritable() = 0;
+    virtual void onClose() = 0;
+
+    ClientId client() const { return id; }
+    bool write(std::string_view payload);
+    bool writeBlocked() const;
+    void notifyWritable();
+    void close();
+
+private:
+    friend class IoLoop;
+
+    IoLoop* loop; // Loop serving the client
+    ClientId id; // Client of this session, stale once the client has left
+};
+
+using SessionFactory = std::function<std::unique_ptr<ConnectionSession>()>; // Creates the session of each new client
+
+#endif
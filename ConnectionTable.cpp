@@ -0,0 +1,97 @@
+#include "ConnectionTable.h" // Including the header file to define the ConnectionTable class
+
+// Constructor for the ConnectionTable class, taking the number of descriptors it can track
+ConnectionTable::ConnectionTable(size_t maxDescriptors)
+    : slotCount(maxDescriptors), chunkCount((maxDescriptors + CONNECTION_TABLE_CHUNK - 1) / CONNECTION_TABLE_CHUNK),
+      chunks(new std::atomic<ConnectionSlot*>[chunkCount])
+{
+    for(size_t i = 0; i < chunkCount; ++i)
+    {
+        chunks[i].store(NULL, std::memory_order_relaxed);
+    }
+}
+
+// Destructor for the ConnectionTable class
+ConnectionTable::~ConnectionTable()
+{
+    for(size_t i = 0; i < chunkCount; ++i)
+    {
+        delete[] chunks[i].load(std::memory_order_relaxed);
+    }
+}
+
+// Function to get the slot of a descriptor, allocating its chunk on first use; NULL if the descriptor is out of range
+ConnectionSlot* ConnectionTable::slot(int clientSocket)
+{
+    if(clientSocket < 0 || (size_t)clientSocket >= slotCount)
+    {
+        return NULL;
+    }
+
+    std::atomic<ConnectionSlot*>& chunk = chunks[clientSocket / CONNECTION_TABLE_CHUNK];
+    ConnectionSlot* slots = chunk.load(std::memory_order_acquire);
+    if(slots == NULL)
+    {
+        std::lock_guard<std::mutex> lock(growLock);
+        slots = chunk.load(std::memory_order_relaxed);
+        if(slots == NULL)
+        {
+            slots = new ConnectionSlot[CONNECTION_TABLE_CHUNK];
+            chunk.store(slots, std::memory_order_release); // Published once, readers never see it change
+        }
+    }
+    return &slots[clientSocket % CONNECTION_TABLE_CHUNK];
+}
+
+// Function to get the slot of a descriptor without allocating, NULL if it was never used
+ConnectionSlot* ConnectionTable::find(int clientSocket) const
+{
+    if(clientSocket < 0 || (size_t)clientSocket >= slotCount)
+    {
+        return NULL;
+    }
+
+    ConnectionSlot* slots = chunks[clientSocket / CONNECTION_TABLE_CHUNK].load(std::memory_order_acquire);
+    return slots == NULL ? NULL : &slots[clientSocket % CONNECTION_TABLE_CHUNK];
+}
+
+// Function to mark a descriptor as a connected client of the given owner and return its new identity.
+// The slot must exist and be free, which holds because the kernel only hands out closed descriptors
+ClientId ConnectionTable::open(int clientSocket, int owner)
+{
+    ConnectionSlot* entry = find(clientSocket);
+    ClientId client;
+    client.socket = clientSocket;
+    client.generation = entry->generation.fetch_add(1, std::memory_order_relaxed) + 1;
+    entry->stats.reset();
+    entry->owner.store(owner, std::memory_order_release); // Published after the generation, see ownerOf
+    return client;
+}
+
+// Function to mark a descriptor as no longer connected, call it before the descriptor is closed
+void ConnectionTable::close(int clientSocket)
+{
+    ConnectionSlot* entry = find(clientSocket);
+    if(entry != NULL)
+    {
+        entry->owner.store(NO_OWNER, std::memory_order_release);
+    }
+}
+
+// Function to get the owner of a client, NO_OWNER if it has disconnected or its descriptor was reused since.
+// The owner is read before the generation, so a reused slot is either seen with its new generation or not at all
+int ConnectionTable::ownerOf(ClientId client) const
+{
+    ConnectionSlot* entry = find(client.socket);
+    if(entry == NULL)
+    {
+        return NO_OWNER;
+    }
+
+    int owner = entry->owner.load(std::memory_order_acquire);
+    if(entry->generation.load(std::memory_order_acquire) != client.generation)
+    {
+        return NO_OWNER;
+    }
+    return owner;
+}
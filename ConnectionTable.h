@@ -0,0 +1,57 @@
+#ifndef CONNECTION_TABLE_H
+#define CONNECTION_TABLE_H
+
+#include "ClientId.h"
+#include "Connection.h"
+#include "HandlerTask.h"
+#include "Metrics.h"
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+#define CONNECTION_TABLE_CHUNK 1024 // Slots allocated at once, chunks are never moved or freed while the table lives
+#define NO_OWNER -1 // Owner of a slot whose descriptor is not a connected client
+
+// State of one descriptor, everything about a client lives here instead of in per-structure maps
+struct ConnectionSlot
+{
+    std::atomic<int> owner{NO_OWNER}; // Index of the loop serving the client, 0 for a client thread
+    std::atomic<uint32_t> generation{0}; // Bumped every time the descriptor becomes a client
+    std::optional<Connection> connection; // Reactor state, only touched by the owning loop
+    ConnectionStats stats; // Traffic of the client, reset when the descriptor becomes a client
+    std::atomic<uint32_t> queuedMessages{0}; // Messages of the descriptor queued for or in a worker, kept across clients
+    ClientStrand strand; // Messages of the descriptor waiting for their turn in ORDERED_WORK_STEALING mode, kept across clients
+    CompressorHandle compressor; // Thread-per-client mode: compresses the replies once negotiated, guarded by the client's send lock
+    std::atomic<int> shutdownHolds{0}; // Thread-per-client mode: shutdowns of the descriptor in progress, it is not closed meanwhile
+    pthread_t thread; // Thread serving the client in thread-per-client mode
+    bool hasThread = false; // Set while thread holds a handle that still has to be joined
+};
+
+// Dense table of connection slots indexed by descriptor. Lookups are a shift and two loads; slots
+// are allocated in chunks on first use so a high descriptor limit costs nothing until it is reached
+class ConnectionTable
+{
+public:
+    explicit ConnectionTable(size_t maxDescriptors);
+    ~ConnectionTable();
+    ConnectionTable(const ConnectionTable&) = delete;
+    ConnectionTable& operator=(const ConnectionTable&) = delete;
+
+    ConnectionSlot* slot(int clientSocket);
+    ConnectionSlot* find(int clientSocket) const;
+    ClientId open(int clientSocket, int owner);
+    void close(int clientSocket);
+    int ownerOf(ClientId client) const;
+    size_t capacity() const { return slotCount; }
+
+private:
+    size_t slotCount; // Largest descriptor tracked plus one
+    size_t chunkCount; // Number of chunk pointers
+    std::unique_ptr<std::atomic<ConnectionSlot*>[]> chunks; // Slot chunks, NULL until first used
+    std::mutex growLock; // Serialises chunk allocation, lookups never take it
+};
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef COROUTINE_CONNECTION_H
+#define COROUTINE_CONNECTION_H
+
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "CoroutineConnection.h needs C++20 coroutines, compile with -std=c++20"
+#endif
+
+#include "ConnectionSession.h"
+#include "Logger.h"
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+// Coroutine serving one connection, created by the handler and owned by the connection it serves
+class ConnectionTask
+{
+public:
+    struct promise_type
+    {
+        ConnectionTask get_return_object() { return ConnectionTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; } // Started by the connection once it is attached
+        std::suspend_always final_suspend() noexcept { return {}; } // The connection destroys the finished frame
+        void return_void() {}
+
+        // Function to log an exception escaping the handler, the connection is closed afterwards
+        void unhandled_exception()
+        {
+            try
+            {
+                throw;
+            }
+            catch(const std::exception& ex)
+            {
+                LOG_ERROR << "Connection handler failed: " << ex.what();
+            }
+            catch(...)
+            {
+                LOG_ERROR << "Connection handler failed.";
+            }
+        }
+    };
+
+    ConnectionTask() {}
+    explicit ConnectionTask(std::coroutine_handle<promise_type> handle) : coroutine(handle) {}
+    ConnectionTask(ConnectionTask&& other) noexcept : coroutine(std::exchange(other.coroutine, nullptr)) {}
+    ConnectionTask& operator=(ConnectionTask&& other) noexcept
+    {
+        std::swap(coroutine, other.coroutine);
+        return *this;
+    }
+    ~ConnectionTask()
+    {
+        if(coroutine)
+        {
+            coroutine.destroy(); // Also legal while suspended, e.g. in a read when the server shuts down
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle() const { return coroutine; }
+
+private:
+    std::coroutine_handle<promise_type> coroutine; // Frame of the handler, null once moved from
+};
+
+// Connection served by a coroutine on the event loop of the client, so handlers are written sequentially
+// without a thread per client:
+//
+//     ConnectionTask echo(CoroutineConnection& conn)
+//     {
+//         while(std::optional<BufferSlice> message = co_await conn.read())
+//         {
+//             co_await conn.write(message->view());
+//         }
+//     }
+//     server.setSessionFactory(CoroutineConnection::factory(echo));
+//
+// Awaiting suspends into the loop, which resumes the coroutine when a frame arrives or the queued replies
+// drain. The coroutine runs on the loop thread and must not block; returning from it closes the client
+class CoroutineConnection : public ConnectionSession
+{
+public:
+    using Handler = std::function<ConnectionTask(CoroutineConnection&)>;
+
+    // Awaiter of the next frame, empty once the client has left
+    struct ReadAwaiter
+    {
+        CoroutineConnection& connection;
+
+        bool await_ready() const noexcept { return !connection.inbox.empty() || connection.closed; }
+        void await_suspend(std::coroutine_handle<> handle) { connection.reader = handle; }
+        std::optional<BufferSlice> await_resume()
+        {
+            if(connection.inbox.empty())
+            {
+                return std::nullopt;
+            }
+            BufferSlice message = std::move(connection.inbox.front());
+            connection.inbox.pop_front();
+            return message;
+        }
+    };
+
+    // Awaiter of a queued reply, suspends while the client's replies are above the high watermark.
+    // Resumes with false if the client has left
+    struct WriteAwaiter
+    {
+        CoroutineConnection& connection;
+        bool queued;
+
+        bool await_ready() const { return !queued || connection.closed || !connection.writeBlocked(); }
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            connection.writer = handle;
+            connection.notifyWritable();
+        }
+        bool await_resume() const { return queued && !connection.closed; }
+    };
+
+    explicit CoroutineConnection(std::shared_ptr<const Handler> connectionHandler) : handler(std::move(connectionHandler)), closed(false) {}
+
+    // Function to wait for the next frame of the client, frames received meanwhile are kept in order
+    ReadAwaiter read() { return ReadAwaiter{*this}; }
+
+    // Function to queue a reply, the payload is copied right away so it need not outlive the call
+    WriteAwaiter write(std::string_view payload) { return WriteAwaiter{*this, !closed && ConnectionSession::write(payload)}; }
+
+    // Function to check whether the client is still connected
+    bool connected() const { return !closed; }
+
+    // Function to get a factory serving every client with a coroutine of the handler. The handler is shared by
+    // all connections and kept alive while any of them runs, so a capturing lambda may be used
+    static SessionFactory factory(Handler connectionHandler)
+    {
+        std::shared_ptr<const Handler> shared = std::make_shared<const Handler>(std::move(connectionHandler));
+        return [shared]() -> std::unique_ptr<ConnectionSession>
+        {
+            return std::make_unique<CoroutineConnection>(shared);
+        };
+    }
+
+private:
+    std::shared_ptr<const Handler> handler; // Function creating the coroutine, shared by every connection
+    ConnectionTask task; // Coroutine serving this connection
+    std::deque<BufferSlice> inbox; // Frames received while the coroutine was not reading
+    std::coroutine_handle<> reader; // Coroutine suspended in read, null if none
+    std::coroutine_handle<> writer; // Coroutine suspended in write, null if none
+    bool closed; // The client has left, every await completes at once
+
+    // Function to start the coroutine once the connection is attached to its loop
+    void onOpen() override
+    {
+        task = (*handler)(*this);
+        resume(task.handle());
+    }
+
+    // Function to hand a frame to the coroutine waiting for one, or keep it for the next read
+    void onMessage(BufferSlice&& message) override
+    {
+        inbox.push_back(std::move(message));
+        resume(std::exchange(reader, nullptr));
+    }
+
+    // Function to resume the coroutine waiting for its replies to drain
+    void onWritable() override
+    {
+        resume(std::exchange(writer, nullptr));
+    }
+
+    // Function to let the coroutine finish once the client has left, its reads return empty from here on
+    void onClose() override
+    {
+        closed = true;
+        inbox.clear();
+        resume(std::exchange(reader, nullptr));
+        resume(std::exchange(writer, nullptr));
+    }
+
+    // Function to continue the coroutine if it is suspended, closing the client once it has returned
+    void resume(std::coroutine_handle<> handle)
+    {
+        if(!handle)
+        {
+            return;
+        }
+        handle.resume();
+        if(task.handle().done() && !closed)
+        {
+            closed = true; // Nothing awaits anymore, the frame is destroyed with the connection
+            close();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "CpuTopology.h" // Including the header file to define the CpuTopology class
+#include "Logger.h" // Including the logger for placement warnings
+#include <algorithm> // This header file is included to keep the queue CPUs free of duplicates
+#include <cctype> // This header file is included to parse interrupt lines and CPU lists
+#include <cerrno> // This header file is included to tell an unusable CPU from other thread creation failures
+#include <cstdlib> // This header file is included for strtol
+#include <fstream> // This header file is included to read sysfs and procfs files
+#include <sstream> // This header file is included to split the lines of /proc/interrupts
+#include <dirent.h> // This header file is included to list sysfs directories
+#include <sched.h> // This header file is included for CPU sets
+#include <unistd.h> // This header file is included for syscall
+#include <sys/syscall.h> // This header file is included for the getcpu and mbind system call numbers
+#include <linux/mempolicy.h> // This header file is included for the memory policy modes, libnuma is not needed
+
+#define STATIC
+
+// Function to read the first line of a file, empty if it cannot be read
+static std::string readLine(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+// Function to list the numeric suffixes of the entries of a directory starting with prefix, e.g. the MSI vectors of a device
+static std::vector<int> listNumbered(const std::string& directory, const std::string& prefix)
+{
+    std::vector<int> numbers;
+    DIR* dir = opendir(directory.c_str());
+    if(dir == NULL)
+    {
+        return numbers;
+    }
+
+    while(struct dirent* entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if(name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 && isdigit((unsigned char)name[prefix.size()]))
+        {
+            numbers.push_back(atoi(name.c_str() + prefix.size()));
+        }
+    }
+    closedir(dir);
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+// Function to start a thread pinned to a CPU, or unpinned if cpu is negative. The affinity is set before the
+// thread runs, so all memory it touches first comes from its own NUMA node. A CPU that is offline or outside
+// the process's allowed set only costs the pinning. Returns the result of pthread_create
+STATIC int CpuTopology::startThread(pthread_t& thread, void* (*entry)(void*), void* arg, int cpu)
+{
+    if(cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+        return pthread_create(&thread, NULL, entry, arg);
+    }
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    pthread_attr_setaffinity_np(&attributes, sizeof(cpuSet), &cpuSet);
+    int result = pthread_create(&thread, &attributes, entry, arg);
+    pthread_attr_destroy(&attributes);
+
+    if(result == EINVAL)
+    {
+        LOG_WARNING << "Thread could not be pinned to CPU " << cpu << ", it is left to the scheduler.";
+        result = pthread_create(&thread, NULL, entry, arg);
+    }
+    return result;
+}
+
+// Function to get the NUMA node the calling thread runs on, -1 if unknown
+STATIC int CpuTopology::currentNode()
+{
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if(syscall(SYS_getcpu, &cpu, &node, NULL) == -1)
+    {
+        return -1;
+    }
+    return (int)node;
+}
+
+// Function to get the CPUs serving the receive queue interrupts of a network interface, in queue order.
+// The interrupts are found by name in /proc/interrupts ("eth0-TxRx-0", "eth0-rx-1"), or failing that as
+// the MSI vectors of the interface's device; each contributes the first CPU of its affinity.
+// Empty if the interface is unknown or its interrupts are not visible, e.g. for virtual interfaces
+STATIC std::vector<int> CpuTopology::interfaceQueueCpus(const std::string& interface)
+{
+    std::vector<int> irqs;
+    std::ifstream interrupts("/proc/interrupts");
+    std::string line;
+    while(std::getline(interrupts, line))
+    {
+        size_t start = line.find_first_not_of(' ');
+        if(start == std::string::npos || !isdigit((unsigned char)line[start]))
+        {
+            continue; // Header, or an architecture counter such as NMI
+        }
+
+        std::istringstream fields(line);
+        std::string field;
+        std::string name;
+        while(fields >> field)
+        {
+            name = field; // The last field is the name the driver gave the interrupt
+        }
+        bool ofInterface = name.compare(0, interface.size(), interface) == 0 &&
+                           (name.size() == interface.size() || name[interface.size()] == '-');
+        if(ofInterface && name.find("-tx-") == std::string::npos)
+        {
+            irqs.push_back(atoi(line.c_str() + start));
+        }
+    }
+    if(irqs.empty())
+    {
+        irqs = listNumbered("/sys/class/net/" + interface + "/device/msi_irqs", "");
+    }
+
+    std::vector<int> cpus;
+    for(int irq : irqs)
+    {
+        std::string base = "/proc/irq/" + std::to_string(irq);
+        std::vector<int> affinity = parseCpuList(readLine(base + "/effective_affinity_list"));
+        if(affinity.empty())
+        {
+            affinity = parseCpuList(readLine(base + "/smp_affinity_list"));
+        }
+        if(!affinity.empty() && std::find(cpus.begin(), cpus.end(), affinity.front()) == cpus.end())
+        {
+            cpus.push_back(affinity.front());
+        }
+    }
+    return cpus;
+}
+
+// Function to parse a kernel CPU list such as "0-3,8,10-11", malformed parts are skipped
+STATIC std::vector<int> CpuTopology::parseCpuList(const std::string& list)
+{
+    std::vector<int> cpus;
+    const char* position = list.c_str();
+    while(*position != '\0')
+    {
+        char* end;
+        long first = strtol(position, &end, 10);
+        if(end == position)
+        {
+            ++position; // Separator or stray character
+            continue;
+        }
+
+        long last = first;
+        if(*end == '-')
+        {
+            const char* rangeEnd = end + 1;
+            last = strtol(rangeEnd, &end, 10);
+            if(end == rangeEnd)
+            {
+                last = first;
+            }
+        }
+        for(long cpu = first; cpu <= last && cpu >= 0; ++cpu)
+        {
+            cpus.push_back((int)cpu);
+        }
+        position = end;
+    }
+    return cpus;
+}
+
+// Function to make the pages of a mapping come from the NUMA node of the calling thread once they are first
+// touched, e.g. receive buffers the kernel fills. Needs a page-aligned range; false if the policy could not be set
+STATIC bool CpuTopology::bindToLocalNode(void* memory, size_t length)
+{
+    int node = currentNode();
+    if(node < 0 || node >= CPU_TOPOLOGY_MAX_NODES)
+    {
+        return false;
+    }
+
+    unsigned long nodeMask = 1UL << node;
+    // Preferred rather than bound, a full node falls back to the others instead of failing the allocation
+    return syscall(SYS_mbind, memory, length, MPOL_PREFERRED, &nodeMask, CPU_TOPOLOGY_MAX_NODES + 1, 0) == 0;
+}
@@ -0,0 +1,23 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <pthread.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define CPU_TOPOLOGY_MAX_NODES 64 // NUMA nodes memory can be bound to, one word of node mask
+
+// Placement of threads and their memory on CPUs and NUMA nodes, read from sysfs and procfs so nothing
+// beyond the kernel is needed. Every function degrades to leaving placement to the kernel when it fails
+class CpuTopology
+{
+public:
+    static int startThread(pthread_t& thread, void* (*entry)(void*), void* arg, int cpu);
+    static int currentNode();
+    static std::vector<int> interfaceQueueCpus(const std::string& interface);
+    static std::vector<int> parseCpuList(const std::string& list);
+    static bool bindToLocalNode(void* memory, size_t length);
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include "DelimiterScan.h" // Including the header file to define the DelimiterScan class
+#if defined(__x86_64__)
+#include <immintrin.h> // This header file is included for the SSE2 and AVX2 intrinsics
+#elif defined(__aarch64__)
+#include <arm_neon.h> // This header file is included for the NEON intrinsics
+#endif
+
+#define STATIC
+#define PAGE_BYTES 4096 // Smallest page size, a load that stays within one page of a buffer cannot fault
+#define PAGE_SAFE __attribute__((no_sanitize_address)) // Reads past the end of the buffer but within its page, like memchr does
+
+// Function to keep the bits of a match mask that lie within the first length bytes
+static inline uint64_t maskLength(uint64_t mask, size_t length)
+{
+    return length >= 64 ? mask : mask & ((1ull << length) - 1);
+}
+
+// Function to check whether a load of size bytes from data stays within the page data starts in
+static inline bool withinPage(const char* data, size_t size)
+{
+    return ((uintptr_t)data & (PAGE_BYTES - 1)) <= PAGE_BYTES - size;
+}
+
+// Function to find the delimiter one byte at a time, for short tails and CPUs without a vector kernel.
+// Only covers the match itself in following
+static const char* findScalar(const char* data, size_t length, char delimiter, uint64_t& following)
+{
+    for(size_t i = 0; i < length; ++i)
+    {
+        if(data[i] == delimiter)
+        {
+            following = 1;
+            return data + i;
+        }
+    }
+    return NULL;
+}
+
+#if defined(__x86_64__)
+// Function to get the matches of the 64 bytes at data, which must all be readable
+PAGE_SAFE static inline uint64_t blockMaskSse2(const char* data, __m128i needle)
+{
+    const __m128i* block = reinterpret_cast<const __m128i*>(data);
+    uint64_t first = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block), needle));
+    uint64_t second = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 1), needle));
+    uint64_t third = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 2), needle));
+    uint64_t fourth = (uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(block + 3), needle));
+    return first | (second << 16) | (third << 32) | (fourth << 48);
+}
+
+// Function to find the delimiter 16 bytes at a time, SSE2 is part of every x86-64 CPU
+static const char* findSse2(const char* data, size_t length, char delimiter, uint64_t& following)
+{
+    const __m128i needle = _mm_set1_epi8(delimiter);
+    size_t i = 0;
+    for(; i + 16 <= length; i += 16)
+    {
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), needle));
+        if(mask != 0)
+        {
+            i += __builtin_ctz(mask);
+            size_t remaining = length - i;
+            following = remaining >= 64 || withinPage(data + i, 64) ? maskLength(blockMaskSse2(data + i, needle), remaining) : 1;
+            return data + i;
+        }
+    }
+    return findScalar(data + i, length - i, delimiter, following);
+}
+
+// Function to get the matches of the 64 bytes at data, which must all be readable
+__attribute__((target("avx2"))) PAGE_SAFE static inline uint64_t blockMaskAvx2(const char* data, __m256i needle)
+{
+    const __m256i* block = reinterpret_cast<const __m256i*>(data);
+    uint64_t low = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(block), needle));
+    uint64_t high = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(block + 1), needle));
+    return low | (high << 32);
+}
+
+// Function to report the match at data + i along with the matches of the 64 bytes starting there
+__attribute__((target("avx2"))) static inline const char* foundAvx2(const char* data, size_t length, size_t i, __m256i needle,
+                                                                    uint64_t& following)
+{
+    size_t remaining = length - i;
+    following = remaining >= 64 || withinPage(data + i, 64) ? maskLength(blockMaskAvx2(data + i, needle), remaining) : 1;
+    return data + i;
+}
+
+// Function to find the delimiter 128 bytes at a time. After a first unaligned block the loads are aligned,
+// so none of them splits a cache line; a buffer of at least 32 bytes ends with one more load overlapping
+// the bytes already searched. A shorter one is searched with a single block unless that crosses a page
+__attribute__((target("avx2"))) static const char* findAvx2(const char* data, size_t length, char delimiter, uint64_t& following)
+{
+    const __m256i needle = _mm256_set1_epi8(delimiter);
+    if(length < 32)
+    {
+        if(length == 0)
+        {
+            return NULL; // Not even the page data points into is known to be mapped
+        }
+        if(!withinPage(data, 64))
+        {
+            return findSse2(data, length, delimiter, following); // A whole block could reach into an unmapped page
+        }
+        // The block stays within the page of the buffer, the matches past its end are masked off
+        uint64_t mask = maskLength(blockMaskAvx2(data, needle), length);
+        if(mask == 0)
+        {
+            return NULL;
+        }
+        following = mask >> __builtin_ctzll(mask);
+        return data + __builtin_ctzll(mask);
+    }
+
+    unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data)), needle));
+    if(mask != 0)
+    {
+        return foundAvx2(data, length, __builtin_ctz(mask), needle, following);
+    }
+
+    // Continue from the next aligned address, the skipped bytes were part of the first block
+    size_t i = 32 - ((uintptr_t)data & 31);
+    for(; i + 128 <= length; i += 128)
+    {
+        // Four compares share one branch, a line of several hundred bytes costs a few iterations
+        const __m256i* block = reinterpret_cast<const __m256i*>(data + i);
+        __m256i first = _mm256_cmpeq_epi8(_mm256_load_si256(block), needle);
+        __m256i second = _mm256_cmpeq_epi8(_mm256_load_si256(block + 1), needle);
+        __m256i third = _mm256_cmpeq_epi8(_mm256_load_si256(block + 2), needle);
+        __m256i fourth = _mm256_cmpeq_epi8(_mm256_load_si256(block + 3), needle);
+        __m256i any = _mm256_or_si256(_mm256_or_si256(first, second), _mm256_or_si256(third, fourth));
+        if(!_mm256_testz_si256(any, any))
+        {
+            uint64_t low = (uint32_t)_mm256_movemask_epi8(first) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(second) << 32);
+            uint64_t high = (uint32_t)_mm256_movemask_epi8(third) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(fourth) << 32);
+            i += low != 0 ? __builtin_ctzll(low) : 64 + __builtin_ctzll(high);
+            return foundAvx2(data, length, i, needle, following);
+        }
+    }
+    for(; i < length; i += 32)
+    {
+        if(i + 32 > length)
+        {
+            i = length - 32; // Last block overlaps the previous one, a match in the overlap was already ruled out
+        }
+        mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), needle));
+        if(mask != 0)
+        {
+            return foundAvx2(data, length, i + __builtin_ctz(mask), needle, following);
+        }
+    }
+    return NULL;
+}
+#elif defined(__aarch64__)
+// Function to get the matches of 16 bytes as four bits per byte. NEON has no byte mask instruction,
+// narrowing the compare result leaves the mask in a 64-bit lane instead
+PAGE_SAFE static inline uint64_t nibbleMaskNeon(const char* data, uint8x16_t needle)
+{
+    uint8x16_t matches = vceqq_u8(vld1q_u8(reinterpret_cast<const uint8_t*>(data)), needle);
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0);
+}
+
+// Function to get the matches of the 64 bytes at data with one bit per byte, which must all be readable
+PAGE_SAFE static inline uint64_t blockMaskNeon(const char* data, uint8x16_t needle)
+{
+    uint64_t mask = 0;
+    for(int part = 0; part < 4; ++part)
+    {
+        uint64_t nibbles = nibbleMaskNeon(data + 16 * part, needle);
+        for(int byte = 0; nibbles != 0; ++byte, nibbles >>= 4)
+        {
+            mask |= (nibbles & 1) << (16 * part + byte);
+        }
+    }
+    return mask;
+}
+
+// Function to find the delimiter 16 bytes at a time
+static const char* findNeon(const char* data, size_t length, char delimiter, uint64_t& following)
+{
+    const uint8x16_t needle = vdupq_n_u8((uint8_t)delimiter);
+    size_t i = 0;
+    for(; i + 16 <= length; i += 16)
+    {
+        uint64_t mask = nibbleMaskNeon(data + i, needle);
+        if(mask != 0)
+        {
+            i += __builtin_ctzll(mask) >> 2;
+            size_t remaining = length - i;
+            following = remaining >= 64 || withinPage(data + i, 64) ? maskLength(blockMaskNeon(data + i, needle), remaining) : 1;
+            return data + i;
+        }
+    }
+    return findScalar(data + i, length - i, delimiter, following);
+}
+#endif
+
+// Function to pick the fastest kernel the CPU supports
+static DelimiterScan::Kernel selectKernel(const char*& name)
+{
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        name = "avx2";
+        return findAvx2;
+    }
+    name = "sse2";
+    return findSse2;
+#elif defined(__aarch64__)
+    name = "neon";
+    return findNeon;
+#else
+    name = "scalar";
+    return findScalar;
+#endif
+}
+
+static const char* selectedName = "scalar"; // Name of the kernel in use, for reports and benchmarks
+STATIC const DelimiterScan::Kernel DelimiterScan::kernel = selectKernel(selectedName); // Picked before main, never changes afterwards
+
+// Function to get the name of the kernel picked for this CPU
+STATIC const char* DelimiterScan::kernelName()
+{
+    return selectedName;
+}
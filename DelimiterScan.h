@@ -0,0 +1,29 @@
+#ifndef DELIMITER_SCAN_H
+#define DELIMITER_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Search of the receive buffers for a frame delimiter with the widest vector instructions of the CPU.
+// The kernel is picked once at startup: AVX2 or SSE2 on x86-64, NEON on AArch64, a scalar loop elsewhere.
+// Besides the first match a search returns the matches of the 64 bytes starting at it, for one more block
+// compare, so a buffer of short lines is searched once per 64 bytes instead of once per line
+class DelimiterScan
+{
+public:
+    typedef const char* (*Kernel)(const char* data, size_t length, char delimiter, uint64_t& following);
+
+    // Function to find the first delimiter in data, NULL if there is none. Bit i of following is then set if the
+    // byte i places after the match is a delimiter too. The kernel covers up to 64 bytes from the match on, never
+    // past length, and sets the bit of every delimiter among them; bit 0 is the match itself
+    static const char* find(const char* data, size_t length, char delimiter, uint64_t& following)
+    {
+        return kernel(data, length, delimiter, following);
+    }
+    static const char* kernelName();
+
+private:
+    static const Kernel kernel; // Search picked for the CPU
+};
+
+#endif
@@ -0,0 +1,401 @@
+#include "EventLoop.h" // Including the header file to define the EventLoop class
+#include "Server.h" // Including the Server class for its error type
+#include "Logger.h" // Including the logger for status and error messages
+#include <cerrno> // This header file is included to inspect errno after non-blocking calls
+#include <unistd.h> // This header file is included for POSIX operating system API, such as close
+#include <sys/epoll.h> // This header file is included for the epoll event notification interface
+#include <sys/socket.h> // This header file is included for socket-related functions such as accept4 and recv
+#include <netinet/in.h> // This header file is included for the IP level error queue messages
+#include <linux/errqueue.h> // This header file is included to decode zero copy completions
+
+// Constructor for the EventLoop class, taking the owning server and the index of the loop
+EventLoop::EventLoop(Server* srv, int loopIndex) : IoLoop(srv, loopIndex), listenerSocket(-1), acceptPending(false)
+{
+    if((epollFd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    {
+        throw TCPServerError("epoll instance could not be created."); // Throw an error if epoll creation fails
+    }
+
+    struct epoll_event event{};
+    event.events = EPOLLIN; // Level-triggered, the counter is cleared by the loop on every wakeup
+    event.data.fd = outboundNotifier.fd();
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, outboundNotifier.fd(), &event) == -1)
+    {
+        close(epollFd);
+        throw TCPServerError("Reply notifier could not be added to epoll."); // Throw an error if registration fails
+    }
+}
+
+// Destructor for the EventLoop class
+EventLoop::~EventLoop()
+{
+    close(epollFd);
+}
+
+// Function to register a non-blocking listening socket with this loop
+void EventLoop::watchListener(int listenSocket, bool shared)
+{
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLET;
+    if(shared)
+    {
+        event.events |= EPOLLEXCLUSIVE; // Wake only one of the loops sharing the listener
+    }
+    event.data.fd = listenSocket;
+
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSocket, &event) == -1)
+    {
+        throw TCPServerError("Listening socket could not be added to epoll."); // Throw an error if registration fails
+    }
+
+    listenerSocket = listenSocket;
+}
+
+// Function to wait for and dispatch socket events
+void EventLoop::run()
+{
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+
+    while(true)
+    {
+        // Announce the wait before checking the reply queue so a concurrent post either is seen here or notifies
+        int timeout = timerWaitMs();
+        outboundNotifier.prepareWait();
+        if(acceptPending || !readPending.empty() || !outboundQueue.empty() || !adoptQueue.empty())
+        {
+            outboundNotifier.cancelWait();
+            timeout = 0; // Connections, data, replies or handshaken clients already waiting, only collect the events that are ready
+        }
+
+        int eventCount = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, timeout);
+        outboundNotifier.cancelWait();
+        updateClock();
+        if(eventCount == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue; // Interrupted by a signal, wait again
+            }
+            LOG_ERROR << "Event loop " << index << " failed to wait for events.";
+            break;
+        }
+
+        for(int i = 0; i < eventCount; ++i)
+        {
+            int fd = events[i].data.fd;
+            if(fd == listenerSocket)
+            {
+                acceptPending = true; // Accepted after the client events, one batch per iteration
+            }
+            else if(fd == outboundNotifier.fd())
+            {
+                outboundNotifier.wait(); // Readable, so this only clears the counter
+            }
+            else if((events[i].events & EPOLLHUP) || ((events[i].events & EPOLLERR) && !readErrorQueue(fd)))
+            {
+                disconnectClient(fd); // Zero copy completions also raise EPOLLERR, only real errors disconnect
+            }
+            else
+            {
+                if(events[i].events & (EPOLLIN | EPOLLRDHUP))
+                {
+                    readClient(fd);
+                }
+                if(events[i].events & EPOLLOUT)
+                {
+                    writeClient(fd);
+                }
+            }
+        }
+
+        readPendingClients();
+
+        if(acceptPending)
+        {
+            acceptPending = acceptClients();
+        }
+
+        expireIdleClients();
+
+        drainOutboundQueue(); // Coalesce the replies posted since the last wakeup into one write per client
+
+        if(updateShutdown())
+        {
+            break; // Every client is closed
+        }
+    }
+}
+
+// Function to accept pending connections, at most one batch so existing clients are served during a
+// connection storm. Returns true if the batch filled up, edge-triggered notification then needs another call
+bool EventLoop::acceptClients()
+{
+    int batchSize = serverConfig().acceptBatchSize;
+    for(int accepted = 0; batchSize <= 0 || accepted < batchSize; ++accepted)
+    {
+        int clientSocket = accept4(listenerSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(clientSocket == -1)
+        {
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                LOG_ERROR << "Failed to accept request from a client."; // Log error message if accepting client fails
+            }
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false; // No more pending connections
+        }
+
+        if(!startHandshake(clientSocket))
+        {
+            adoptClient(clientSocket);
+        }
+    }
+    return true;
+}
+
+// Function to serve an accepted client, right after the accept or once its TLS handshake completed
+void EventLoop::adoptClient(int clientSocket)
+{
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET; // Registered once, edges make later changes unnecessary
+    event.data.fd = clientSocket;
+    if(epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &event) == -1)
+    {
+        LOG_ERROR << "Client " << clientSocket << " could not be added to epoll.";
+        close(clientSocket);
+        return;
+    }
+
+    int enable = 1;
+    bool zeroCopy = serverConfig().zeroCopyThreshold > 0;
+    if(zeroCopy && setsockopt(clientSocket, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable)) == -1)
+    {
+        LOG_WARNING << "Zero copy could not be enabled for client " << clientSocket << ", its replies are copied.";
+        zeroCopy = false; // MSG_ZEROCOPY would be ignored, and no completion would release the held replies
+    }
+
+    Connection* connection = addClient(clientSocket);
+    if(connection != NULL)
+    {
+        connection->zeroCopyEnabled = zeroCopy;
+    }
+}
+
+// Function to read everything available from a client until the socket would block
+void EventLoop::readClient(int clientSocket)
+{
+    Connection* connection = findClient(clientSocket);
+    if(connection == NULL || connection->readPaused || connection->readPending)
+    {
+        return; // Event of an already closed client, one that is paused, or one already listed to be read
+    }
+
+    for(int reads = 0; ; ++reads)
+    {
+        if(reads == READ_BUDGET)
+        {
+            connection->readPending = true; // A client sending faster than it is read must not starve the others
+            readPending.push_back(clientSocket);
+            break;
+        }
+
+        // Receive straight into the connection's buffer so frames never need an extra copy
+        size_t available;
+        char* space = connection->decoder.prepareWrite(RECV_BUFFER_SIZE, available);
+        ssize_t bytesRead = recv(clientSocket, space, available, 0);
+        if(bytesRead > 0)
+        {
+            connection->decoder.commitWrite(bytesRead);
+            serverConfig().tuning.rearmQuickAck(clientSocket);
+            if(!deliverFrames(*connection, NULL, 0)) // Push complete frames to the message queue
+            {
+                break; // Client was disconnected
+            }
+            if(connection->readPaused)
+            {
+                break; // Throttled or over a limit, resumeReading continues
+            }
+        }
+        else if(bytesRead == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        else if(bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            connection->decoder.releaseIfDrained(); // Idle connections keep no receive buffer
+            break; // Socket drained, wait for the next edge
+        }
+        else
+        {
+            disconnectClient(clientSocket); // Orderly shutdown or error on the connection
+            break;
+        }
+    }
+}
+
+// Function to continue reading the clients that used up their read budget in the previous iteration
+void EventLoop::readPendingClients()
+{
+    readBatch.swap(readPending);
+    for(int clientSocket : readBatch)
+    {
+        Connection* connection = findClient(clientSocket);
+        if(connection != NULL && connection->readPending)
+        {
+            connection->readPending = false;
+            readClient(clientSocket);
+        }
+    }
+    readBatch.clear();
+}
+
+// Function to remove a client from the loop and close its socket
+void EventLoop::disconnectClient(int clientSocket)
+{
+    if(findClient(clientSocket) == NULL)
+    {
+        return; // Already closed
+    }
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, NULL);
+    removeClient(clientSocket);
+}
+
+// Function to resume writing the queued replies of a client once its socket is writable again
+void EventLoop::writeClient(int clientSocket)
+{
+    Connection* connection = findClient(clientSocket);
+    if(connection != NULL && !connection->outbound.empty())
+    {
+        flushClient(*connection);
+    }
+}
+
+// Function to write as many queued replies as the socket accepts, several per system call
+void EventLoop::flushClient(Connection& connection)
+{
+    struct iovec vectors[OUTBOUND_MAX_IOV];
+    bool resume = false;
+    while(!connection.outbound.empty())
+    {
+        size_t batchBytes;
+        struct msghdr header{};
+        header.msg_iov = vectors;
+        header.msg_iovlen = collectOutbound(connection, vectors, OUTBOUND_MAX_IOV, batchBytes);
+
+        // Large batches, typically broadcasts, are sent from their own pages instead of being copied
+        bool zeroCopy = connection.zeroCopyEnabled && batchBytes >= serverConfig().zeroCopyThreshold;
+        if(zeroCopy && connection.zeroCopyBackoff > 0)
+        {
+            --connection.zeroCopyBackoff; // Copied while the kernel recovers the memory it pins for zero copy
+            zeroCopy = false;
+        }
+
+        ssize_t bytesWritten = sendmsg(connection.socket, &header, MSG_NOSIGNAL | (zeroCopy ? MSG_ZEROCOPY : 0));
+        if(bytesWritten >= 0)
+        {
+            if(zeroCopy)
+            {
+                ++connection.zeroCopyIssued; // Tags the replies written from here on
+            }
+            resume = consumeOutbound(connection, bytesWritten) || resume;
+        }
+        else if(errno == EINTR)
+        {
+            continue;
+        }
+        else if(errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            break; // Socket buffer full, the next EPOLLOUT edge resumes the flush
+        }
+        else if(errno == ENOBUFS && zeroCopy)
+        {
+            // Out of optmem or locked memory for the pinned pages, nothing was sent: retry the batch copied
+            connection.zeroCopyBackoff = ZERO_COPY_BACKOFF_SENDS;
+            continue;
+        }
+        else
+        {
+            disconnectClient(connection.socket);
+            return;
+        }
+    }
+
+    if(resume)
+    {
+        resumeReading(connection); // Last action, reading may disconnect the client
+    }
+}
+
+// Function to stop accepting when the server shuts down, pending connections stay in the listener's backlog
+void EventLoop::stopAccepting()
+{
+    if(listenerSocket != -1)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, listenerSocket, NULL);
+        listenerSocket = -1;
+    }
+    acceptPending = false;
+}
+
+// Function to stop reading a client, new data is simply left in the socket until reading resumes
+void EventLoop::pauseReading(Connection&)
+{
+}
+
+// Function to resume reading a client, reading right away because no new edge reports the data already pending.
+// Frames held back by the pause are delivered first
+void EventLoop::resumeReading(Connection& connection)
+{
+    if(connection.decoder.bufferedBytes() > 0 && (!deliverFrames(connection, NULL, 0) || connection.readPaused))
+    {
+        return; // Disconnected, or paused again by the frames held back
+    }
+    readClient(connection.socket);
+}
+
+// Function to read the error queue of a client, releasing the replies of completed zero copy sends.
+// Returns false if the socket reported a real error
+bool EventLoop::readErrorQueue(int clientSocket)
+{
+    Connection* connection = findClient(clientSocket);
+    if(connection == NULL)
+    {
+        return true; // Event of an already closed client
+    }
+
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) * 4];
+    while(true)
+    {
+        struct msghdr header{};
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+        if(recvmsg(clientSocket, &header, MSG_ERRQUEUE) == -1)
+        {
+            break; // EAGAIN once the queue is empty
+        }
+
+        for(struct cmsghdr* message = CMSG_FIRSTHDR(&header); message != NULL; message = CMSG_NXTHDR(&header, message))
+        {
+            bool ipError = (message->cmsg_level == SOL_IP && message->cmsg_type == IP_RECVERR) ||
+                           (message->cmsg_level == SOL_IPV6 && message->cmsg_type == IPV6_RECVERR);
+            if(!ipError)
+            {
+                continue;
+            }
+
+            const struct sock_extended_err* error = reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(message));
+            if(error->ee_origin != SO_EE_ORIGIN_ZEROCOPY || error->ee_errno != 0)
+            {
+                return false;
+            }
+            completeZeroCopy(*connection, error->ee_data + 1); // Sends ee_info to ee_data have completed
+        }
+    }
+
+    int socketError = 0;
+    socklen_t length = sizeof(socketError);
+    return getsockopt(clientSocket, SOL_SOCKET, SO_ERROR, &socketError, &length) == 0 && socketError == 0;
+}
@@ -0,0 +1,39 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "IoLoop.h"
+
+#define MAX_EPOLL_EVENTS 256 // Maximum number of events returned by a single epoll_wait call
+#define RECV_BUFFER_SIZE 4096 // Minimum free space in a client's receive buffer before each recv
+#define READ_BUDGET 16 // Receives from one client per wakeup, the rest is read after the other clients had their turn
+
+// Edge-triggered epoll event loop serving many non-blocking clients on one thread
+class EventLoop : public IoLoop
+{
+public:
+    EventLoop(Server* srv, int loopIndex);
+    ~EventLoop() override;
+    void watchListener(int listenSocket, bool shared) override;
+
+private:
+    int epollFd; // epoll instance of this loop
+    int listenerSocket; // Listening socket watched by this loop, -1 if none
+    bool acceptPending; // The listener may still hold connections, no new edge will report them
+    std::vector<int> readPending; // Clients that used up their read budget, no new edge will report their data
+    std::vector<int> readBatch; // Clients being read again, readPending collects the next ones meanwhile
+
+    void run() override;
+    bool acceptClients();
+    void adoptClient(int clientSocket) override;
+    void readClient(int clientSocket);
+    void readPendingClients();
+    void writeClient(int clientSocket);
+    bool readErrorQueue(int clientSocket);
+    void disconnectClient(int clientSocket) override;
+    void flushClient(Connection& connection) override;
+    void pauseReading(Connection& connection) override;
+    void resumeReading(Connection& connection) override;
+    void stopAccepting() override;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "EventNotifier.h" // Including the header file to define the EventNotifier class
+#include "Server.h" // Including the Server class for its error type
+#include <cerrno> // This header file is included to retry interrupted reads
+#include <cstdint> // This header file is included for the 64-bit eventfd counter
+#include <unistd.h> // This header file is included for POSIX operating system API, such as read, write and close
+#include <sys/eventfd.h> // This header file is included for the eventfd notification interface
+
+// Constructor for the EventNotifier class
+EventNotifier::EventNotifier() : sleeping(false)
+{
+    if((eventFd = eventfd(0, EFD_CLOEXEC)) == -1)
+    {
+        throw TCPServerError("eventfd could not be created."); // Throw an error if eventfd creation fails
+    }
+}
+
+// Destructor for the EventNotifier class
+EventNotifier::~EventNotifier()
+{
+    close(eventFd);
+}
+
+// Function called by producers after publishing work, wakes the consumer only if it is sleeping.
+// Returns whether this call woke it
+bool EventNotifier::notify()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst); // Order the publication before reading the flag
+    if(sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false, std::memory_order_acq_rel))
+    {
+        uint64_t one = 1;
+        while(write(eventFd, &one, sizeof(one)) == -1 && errno == EINTR)
+        {
+        }
+        return true;
+    }
+    return false;
+}
+
+// Function called by the consumer before its last emptiness check, producers start signalling from here on
+void EventNotifier::prepareWait()
+{
+    sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst); // Order the flag before re-checking the queue
+}
+
+// Function called by the consumer when the last emptiness check found work after all
+void EventNotifier::cancelWait()
+{
+    sleeping.store(false, std::memory_order_relaxed);
+}
+
+// Function to block the consumer until a producer calls notify
+void EventNotifier::wait()
+{
+    uint64_t count;
+    while(read(eventFd, &count, sizeof(count)) == -1 && errno == EINTR)
+    {
+    }
+}
+
+// Function to get the eventfd, e.g. to watch it from an event loop
+int EventNotifier::fd() const
+{
+    return eventFd;
+}
@@ -0,0 +1,27 @@
+#ifndef EVENT_NOTIFIER_H
+#define EVENT_NOTIFIER_H
+
+#include <atomic>
+
+// eventfd based wakeup for a consumer thread sleeping on an empty queue.
+// Producers only make a system call when the consumer announced it is going to sleep.
+class EventNotifier
+{
+public:
+    EventNotifier();
+    ~EventNotifier();
+    EventNotifier(const EventNotifier&) = delete;
+    EventNotifier& operator=(const EventNotifier&) = delete;
+
+    bool notify();
+    void prepareWait();
+    void cancelWait();
+    void wait();
+    int fd() const;
+
+private:
+    int eventFd; // eventfd the consumer blocks on
+    std::atomic<bool> sleeping; // Set by the consumer between prepareWait and wakeup
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "Framing.h" // Including the header file to define the FrameDecoder class
+#include <cstdint> // This header file is included for the 32-bit length prefix and block headers
+#include "DelimiterScan.h" // Including the vectorised search for the end of a line
+#include <cstring> // This header file is included to use memcpy and memmove
+
+#define DECOMPRESS_STEP_BYTES 16384 // Smallest free space a block is decompressed into at a time
+
+// Constructor for the FrameDecoder class, taking the framing mode, the largest accepted payload and the delimiter of NEWLINE mode
+FrameDecoder::FrameDecoder(FramingMode framingMode, size_t maximumFrameSize, char frameDelimiter)
+    : mode(framingMode), maxFrameSize(maximumFrameSize), delimiter(frameDelimiter), readPos(0), writePos(0), scanPos(0), delimiterMask(0),
+      maskBase(0), paused(false), wireReadPos(0), wireBytes(0), streamInvalid(false)
+{
+}
+
+// Function to get at least minimumSpace writable bytes for received data, at the end of the receive buffer
+// or, once the stream is compressed, at the end of the block in progress
+char* FrameDecoder::prepareWrite(size_t minimumSpace, size_t& available)
+{
+    if(!decompressor)
+    {
+        return reserve(minimumSpace, available);
+    }
+
+    if(wireBuffer.capacity() - wireBytes < minimumSpace)
+    {
+        // Only the decoder holds this buffer, the pending blocks move to its front or to a larger one
+        size_t pending = wireBytes - wireReadPos;
+        if(pending + minimumSpace <= wireBuffer.capacity())
+        {
+            memmove(wireBuffer.data(), wireBuffer.data() + wireReadPos, pending);
+        }
+        else
+        {
+            size_t newCapacity = wireBuffer.capacity() * 2;
+            if(newCapacity < pending + minimumSpace)
+            {
+                newCapacity = pending + minimumSpace;
+            }
+            PooledBuffer larger(newCapacity);
+            if(pending > 0)
+            {
+                memcpy(larger.data(), wireBuffer.data() + wireReadPos, pending);
+            }
+            wireBuffer = std::move(larger);
+        }
+        wireBytes = pending;
+        wireReadPos = 0;
+    }
+    available = wireBuffer.capacity() - wireBytes;
+    return wireBuffer.data() + wireBytes;
+}
+
+// Function to get at least minimumSpace writable bytes at the end of the receive buffer,
+// shifting the partial frame to the front or moving it to a larger pooled buffer if needed
+char* FrameDecoder::reserve(size_t minimumSpace, size_t& available)
+{
+    if(buffer.capacity() - writePos < minimumSpace)
+    {
+        size_t pending = writePos - readPos;
+        if(pending + minimumSpace <= buffer.capacity() && buffer.unique())
+        {
+            // Only the undelivered tail is moved, delivered frames are simply dropped
+            memmove(buffer.data(), buffer.data() + readPos, pending);
+        }
+        else
+        {
+            // Frames still referenced by queued messages must not be overwritten, so the partial frame
+            // moves to a fresh buffer and the old one is freed by the last message using it
+            size_t newCapacity = buffer.capacity() * 2;
+            if(pending + minimumSpace <= buffer.capacity())
+            {
+                newCapacity = buffer.capacity();
+            }
+            if(newCapacity < pending + minimumSpace)
+            {
+                newCapacity = pending + minimumSpace;
+            }
+            PooledBuffer larger(newCapacity);
+            if(pending > 0)
+            {
+                memcpy(larger.data(), buffer.data() + readPos, pending);
+            }
+            buffer = std::move(larger); // The smaller buffer goes back to the pool
+        }
+        maskBase -= readPos; // The found delimiters moved along with the bytes
+        writePos = pending;
+        readPos = 0;
+    }
+
+    available = buffer.capacity() - writePos;
+    return buffer.data() + writePos;
+}
+
+// Function to account for bytes written into the space returned by prepareWrite
+void FrameDecoder::commitWrite(size_t length)
+{
+    if(!decompressor)
+    {
+        writePos += length;
+        return;
+    }
+    wireBytes += length; // Decompressed by decode, block by block as the frames are delivered
+}
+
+// Function to get the number of received bytes not delivered as a frame yet
+size_t FrameDecoder::bufferedBytes() const
+{
+    return writePos - readPos + wireBytes - wireReadPos;
+}
+
+// Function to treat every byte from the current frame on as compressed blocks, once the client and the server
+// agreed on a codec. Bytes already received after the frame that asked for it are the first compressed ones.
+// Returns false if handle is NULL, the stream then stays plain
+bool FrameDecoder::startDecompression(DecompressorHandle&& handle)
+{
+    if(!handle)
+    {
+        return false;
+    }
+
+    decompressor = std::move(handle);
+    delimiterMask = 0; // Found in bytes that are about to be decompressed
+    size_t pending = writePos - readPos;
+    if(pending > 0)
+    {
+        size_t available;
+        char* destination = prepareWrite(pending, available);
+        memcpy(destination, buffer.data() + readPos, pending);
+        writePos = readPos;
+        commitWrite(pending);
+    }
+    return true;
+}
+
+// Function to decompress the first complete block of the received bytes into the receive buffer, called by decode
+// once only a partial frame is left. Returns false if no block is complete, or the block is invalid
+bool FrameDecoder::decompressNextBlock()
+{
+    if(streamInvalid || wireBytes - wireReadPos < COMPRESSION_BLOCK_HEADER_SIZE)
+    {
+        return false;
+    }
+    const unsigned char* header = reinterpret_cast<const unsigned char*>(wireBuffer.data() + wireReadPos);
+    uint32_t value = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+    size_t size = value & ~COMPRESSION_BLOCK_COMPRESSED;
+    if(size > COMPRESSION_MAX_WIRE_BLOCK || ((value & COMPRESSION_BLOCK_COMPRESSED) == 0 && size > COMPRESSION_MAX_BLOCK_SIZE))
+    {
+        streamInvalid = true;
+        return false;
+    }
+    if(wireBytes - wireReadPos - COMPRESSION_BLOCK_HEADER_SIZE < size)
+    {
+        return false; // Block is still incomplete
+    }
+
+    const char* block = wireBuffer.data() + wireReadPos + COMPRESSION_BLOCK_HEADER_SIZE;
+    if(value & COMPRESSION_BLOCK_COMPRESSED)
+    {
+        streamInvalid = !decompressBlock(block, size);
+    }
+    else if(size > 0)
+    {
+        // Stored block, too small to be worth compressing; it is not part of the compressed stream's history
+        size_t available;
+        memcpy(reserve(size, available), block, size);
+        writePos += size;
+    }
+    wireReadPos += COMPRESSION_BLOCK_HEADER_SIZE + size;
+    if(wireReadPos == wireBytes)
+    {
+        wireReadPos = wireBytes = 0;
+    }
+    return !streamInvalid;
+}
+
+// Function to append the decompressed content of a block to the receive buffer.
+// Returns false if the block is corrupt or decompresses to more than COMPRESSION_MAX_BLOCK_SIZE bytes
+bool FrameDecoder::decompressBlock(const char* block, size_t size)
+{
+    size_t offset = 0;
+    size_t total = 0;
+    while(true)
+    {
+        size_t available;
+        char* destination = reserve(size > DECOMPRESS_STEP_BYTES ? size : DECOMPRESS_STEP_BYTES, available);
+        size_t consumed = 0;
+        size_t produced = 0;
+        if(!decompressor->decompress(block + offset, size - offset, consumed, destination, available, produced))
+        {
+            return false;
+        }
+        offset += consumed;
+        writePos += produced;
+        total += produced;
+        if(total > COMPRESSION_MAX_BLOCK_SIZE)
+        {
+            return false;
+        }
+        if(offset == size && produced < available)
+        {
+            return true; // Input used up and the output not limited by the space, the block is done
+        }
+        if(consumed == 0 && produced == 0)
+        {
+            return false; // No progress, the block is truncated
+        }
+    }
+}
+
+// Function to find the first complete frame in data.
+// Returns 1 and sets the payload and the bytes it spans if found, 0 if more bytes are needed, -1 if it is too large
+int FrameDecoder::findFrame(const char* data, size_t length, const char*& frame, size_t& frameLength, size_t& frameEnd)
+{
+    if(length == 0)
+    {
+        return 0;
+    }
+
+    switch(mode)
+    {
+        case FramingMode::RAW:
+            frame = data;
+            frameLength = frameEnd = length;
+            return 1;
+
+        case FramingMode::LENGTH_PREFIXED:
+        {
+            if(length < FRAME_LENGTH_PREFIX_SIZE)
+            {
+                return 0;
+            }
+            const unsigned char* header = reinterpret_cast<const unsigned char*>(data);
+            uint32_t payloadLength = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | header[3];
+            if(payloadLength > maxFrameSize)
+            {
+                return -1;
+            }
+            if(length - FRAME_LENGTH_PREFIX_SIZE < payloadLength)
+            {
+                return 0;
+            }
+            frame = data + FRAME_LENGTH_PREFIX_SIZE;
+            frameLength = payloadLength;
+            frameEnd = FRAME_LENGTH_PREFIX_SIZE + payloadLength;
+            return 1;
+        }
+
+        case FramingMode::NEWLINE:
+        {
+            if(delimiterMask != 0)
+            {
+                // A previous search already found the end of this line
+                frame = data;
+                frameLength = maskBase + __builtin_ctzll(delimiterMask) - readPos;
+                delimiterMask &= delimiterMask - 1;
+            }
+            else
+            {
+                // Resume the search where the previous chunk ended instead of rescanning the partial line
+                size_t searchFrom = scanPos < length ? scanPos : length;
+                uint64_t following;
+                const char* end = DelimiterScan::find(data + searchFrom, length - searchFrom, delimiter, following);
+                if(end == NULL)
+                {
+                    scanPos = length;
+                    return length > maxFrameSize ? -1 : 0;
+                }
+                frame = data;
+                frameLength = end - data;
+                maskBase = readPos + frameLength;
+                delimiterMask = following & ~1ull; // The ends of the next short lines, bit 0 is this one
+            }
+            frameEnd = frameLength + 1;
+            return frameLength > maxFrameSize ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+// Function to copy bytes at the end of the buffer
+void FrameDecoder::append(const char* data, size_t length)
+{
+    if(length == 0)
+    {
+        return;
+    }
+
+    size_t available;
+    char* destination = prepareWrite(length, available);
+    memcpy(destination, data, length);
+    commitWrite(length);
+}
+
+// Function to give the buffer back to the pool once every received byte has been delivered
+void FrameDecoder::releaseIfDrained()
+{
+    if(readPos != writePos)
+    {
+        return;
+    }
+
+    readPos = writePos = scanPos = 0;
+    delimiterMask = 0;
+    buffer.reset();
+    if(wireBytes == 0)
+    {
+        wireBuffer.reset();
+    }
+}
@@ -0,0 +1,129 @@
+#ifndef FRAMING_H
+#define FRAMING_H
+
+#include "BufferPool.h"
+#include "Compression.h"
+#include <cstddef>
+#include <cstdint>
+
+#define FRAME_LENGTH_PREFIX_SIZE 4 // Size of the big-endian length header in LENGTH_PREFIXED mode
+#define DEFAULT_MAX_FRAME_SIZE (1024 * 1024) // Default upper bound of a single frame's payload
+#define DEFAULT_FRAME_DELIMITER '\n' // Default end of a message in NEWLINE mode
+
+// How the byte stream of a connection is split into messages
+enum class FramingMode
+{
+    RAW,             // Every received chunk is a message, as TCP happened to deliver it
+    LENGTH_PREFIXED, // A 4-byte big-endian payload length followed by the payload
+    NEWLINE          // Messages end with a delimiter, '\n' unless configured, which is not part of the message
+};
+
+// Result of decoding the buffered bytes of a connection
+enum class DecodeResult
+{
+    OK,             // Every complete frame was delivered, a partial one may remain buffered
+    STOPPED,        // The frame callback asked to stop
+    PAUSED,         // The frame callback paused decoding, the remaining frames stay buffered
+    FRAME_TOO_LARGE, // A frame exceeds the maximum frame size, the connection should be dropped
+    INVALID_STREAM  // The compressed stream could not be decompressed, the connection should be dropped
+};
+
+// Per-connection reassembly of frames from a growable pooled receive buffer.
+// Data is received straight into the buffer and frames are handed out as reference-counted slices of it,
+// so bytes are only moved when a partial frame has to be shifted to make room.
+// The decoder drops its reference whenever the buffer is drained, idle connections hold none.
+// Once the connection negotiated compression, received bytes go to a second buffer instead, and a complete
+// block is only decompressed into the receive buffer once the frames before it are delivered. Frames are still
+// sliced from plain bytes, and the receive buffer holds at most a partial frame and one block of them.
+class FrameDecoder
+{
+public:
+    FrameDecoder(FramingMode framingMode, size_t maximumFrameSize, char frameDelimiter = DEFAULT_FRAME_DELIMITER);
+
+    char* prepareWrite(size_t minimumSpace, size_t& available);
+    void commitWrite(size_t length);
+
+    // Function to deliver every complete frame of the buffered bytes to onFrame(BufferSlice&&) -> bool.
+    // Each frame is a slice sharing the receive buffer, no payload bytes are copied.
+    template <typename Callback>
+    DecodeResult decode(Callback&& onFrame)
+    {
+        while(true)
+        {
+            if(streamInvalid)
+            {
+                return DecodeResult::INVALID_STREAM;
+            }
+            const char* frame;
+            size_t frameLength;
+            size_t frameEnd;
+            int found = findFrame(buffer.data() + readPos, writePos - readPos, frame, frameLength, frameEnd);
+            if(found < 0)
+            {
+                return DecodeResult::FRAME_TOO_LARGE;
+            }
+            if(found == 0)
+            {
+                if(decompressor && (decompressNextBlock() || streamInvalid))
+                {
+                    continue; // The next block may complete the partial frame, an invalid one ends the stream
+                }
+                break; // Only a partial frame is left
+            }
+
+            readPos += frameEnd;
+            scanPos = 0;
+            if(!onFrame(BufferSlice(buffer.share(), frame, frameLength)))
+            {
+                return DecodeResult::STOPPED;
+            }
+            if(paused)
+            {
+                paused = false;
+                return DecodeResult::PAUSED;
+            }
+        }
+
+        releaseIfDrained();
+        return DecodeResult::OK;
+    }
+
+    // Function to decode bytes received outside of the buffer, e.g. into a kernel-provided buffer that
+    // is recycled right away. The chunk is copied once into the receive buffer and sliced from there.
+    template <typename Callback>
+    DecodeResult decode(const char* data, size_t length, Callback&& onFrame)
+    {
+        append(data, length);
+        return decode(onFrame);
+    }
+
+    void append(const char* data, size_t length);
+    void pause() { paused = true; } // Called by the frame callback to stop after the current frame
+    size_t bufferedBytes() const;
+    void releaseIfDrained();
+    bool startDecompression(DecompressorHandle&& handle);
+
+private:
+    FramingMode mode; // Framing of the connection
+    size_t maxFrameSize; // Largest accepted payload
+    char delimiter; // End of a message in NEWLINE mode
+    PooledBuffer buffer; // Receive buffer, only held while bytes are pending
+    size_t readPos; // Start of the first undelivered byte
+    size_t writePos; // End of the received bytes
+    size_t scanPos; // Bytes after readPos already searched for a delimiter
+    uint64_t delimiterMask; // Delimiters found by the last search and not delivered yet, bit k is the byte at maskBase + k
+    size_t maskBase; // Buffer offset of bit 0 of delimiterMask
+    bool paused; // Set by pause, decode returns after the current frame
+    DecompressorHandle decompressor; // Stream of a connection that negotiated compression, NULL otherwise
+    PooledBuffer wireBuffer; // Received compressed bytes not decompressed yet, only held while some are pending
+    size_t wireReadPos; // Start of the first block in wireBuffer that is not decompressed
+    size_t wireBytes; // End of the received bytes in wireBuffer
+    bool streamInvalid; // A block could not be decompressed, decode fails from here on
+
+    char* reserve(size_t minimumSpace, size_t& available);
+    bool decompressNextBlock();
+    bool decompressBlock(const char* block, size_t size);
+    int findFrame(const char* data, size_t length, const char*& frame, size_t& frameLength, size_t& frameEnd);
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef HANDLER_TASK_H
+#define HANDLER_TASK_H
+
+#include "Message.h"
+#include "BufferPool.h"
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+struct ClientStrand;
+
+// Unit of work of the work-stealing workers: a single message, or a client strand to continue
+struct HandlerTask
+{
+    Message message; // Message to handle, unused by the task of a strand
+    ClientStrand* strand = NULL; // Strand this task runs, NULL for a single message
+    HandlerTask* next = NULL; // Next message of the same strand
+};
+
+static_assert(alignof(HandlerTask) <= alignof(BufferBlock), "Tasks are placed right behind a buffer header");
+
+// Function to get the task of a message from the buffer pool. Tasks are taken by the reader and freed by a worker,
+// the pool's thread caches and depots move them back without a heap allocation per message
+inline HandlerTask* acquireHandlerTask()
+{
+    return new (BufferPool::acquire(sizeof(HandlerTask)) + 1) HandlerTask;
+}
+
+// Function to give a task back to the buffer pool
+inline void releaseHandlerTask(HandlerTask* task)
+{
+    task->~HandlerTask();
+    BufferPool::release(reinterpret_cast<BufferBlock*>(task) - 1);
+}
+
+// Messages of one client in ORDERED_WORK_STEALING mode, kept as a list of their tasks. Any worker may run the
+// strand, but it is only ever queued once, so the client's messages are handled one at a time and in order
+struct ClientStrand
+{
+    ClientStrand() { task.strand = this; }
+    ClientStrand(const ClientStrand&) = delete;
+    ClientStrand& operator=(const ClientStrand&) = delete;
+
+    std::mutex lock; // Shared by the client's reader appending and the worker running the strand
+    HandlerTask* head = NULL; // Oldest message not handled yet
+    HandlerTask* tail = NULL; // Newest message
+    size_t count = 0; // Messages in the list
+    bool scheduled = false; // Set while the strand's task is queued or running
+    HandlerTask task; // Task queued for the strand, so scheduling it allocates nothing
+};
+
+#endif
@@ -0,0 +1,912 @@
+#include "IoLoop.h" // Including the header file to define the IoLoop class
+#include "Server.h" // Including the Server class to hand received messages over to it
+#include "Logger.h" // Including the logger for status and error messages
+#include "CpuTopology.h" // Including the thread placement to pin the loop thread
+#include "TlsAcceptor.h" // Including the TLS handshake of accepted clients
+#include <unistd.h> // This header file is included for POSIX operating system API, such as close
+#include <cstring> // This header file is included to use memcpy and strlen for the compressed replies
+#include <string> // This header file is included to build the answer to an offer of codecs
+#include <time.h> // This header file is included to read the monotonic clock driving the timeouts
+
+#define STATIC
+
+// Constructor for the IoLoop class, taking the owning server and the index of the loop
+IoLoop::IoLoop(Server* srv, int loopIndex)
+    : server(srv), index(loopIndex), outboundQueue(srv->config.messageQueueCapacity),
+      adoptQueue(ADOPT_QUEUE_CAPACITY), now(0), phase(LoopPhase::RUNNING),
+      clientsClosed(false)
+{
+    updateClock();
+    idleTimers.advance(now / IDLE_TIMER_TICK_MS, [](int) {}); // Start the wheel at the current tick
+}
+
+// Destructor for the IoLoop class
+IoLoop::~IoLoop()
+{
+    closeRemainingClients();
+}
+
+// Function to get the configuration of the owning server, which derived loops cannot reach directly
+const ServerConfig& IoLoop::serverConfig() const
+{
+    return server->config;
+}
+
+// Function to start the loop in its own thread, pinned to the given CPU unless it is negative
+void IoLoop::start(int cpu)
+{
+    if(CpuTopology::startThread(thread, runWrapper, (void *)this, cpu) != 0)
+    {
+        throw TCPServerError("Event Loop Thread could not be created."); // Throw an error if thread creation fails
+    }
+}
+
+// Function to wait until the loop thread returns
+void IoLoop::join()
+{
+    if(pthread_join(thread, NULL) != 0)
+    {
+        LOG_ERROR << "Failed to join thread."; // Log error message if joining thread fails
+    }
+    closeRemainingClients(); // The loop itself stays, other threads may still post replies to it
+}
+
+// Function to close all clients that are still served by this loop, once its thread has returned
+void IoLoop::closeRemainingClients()
+{
+    while(!clientSockets.empty())
+    {
+        removeClient(clientSockets.back());
+    }
+
+    int clientSocket;
+    while(adoptQueue.tryPop(clientSocket))
+    {
+        close(clientSocket); // Handed over after the loop stopped
+    }
+}
+
+// Static function wrapper for running the loop in a separate thread
+STATIC void* IoLoop::runWrapper(void* arg)
+{
+    IoLoop* instance = reinterpret_cast<IoLoop*>(arg);
+    instance->run(); // Call the backend specific loop
+    if(instance->phase != LoopPhase::CLOSING)
+    {
+        instance->server->stop(); // The loop failed, its clients cannot be served anymore
+    }
+    return NULL;
+}
+
+// Function to register a client accepted by the backend, returns NULL and closes the socket if the
+// descriptor does not fit the connection table
+Connection* IoLoop::addClient(int clientSocket)
+{
+    ConnectionSlot* slot = server->connections.slot(clientSocket);
+    if(slot == NULL)
+    {
+        LOG_WARNING << "Client " << clientSocket << " is rejected, its descriptor exceeds the connection table.";
+        close(clientSocket);
+        return NULL;
+    }
+    if(!server->admitClient(clientSocket))
+    {
+        return NULL;
+    }
+
+    server->config.tuning.applyToClient(clientSocket);
+    ClientId id = server->connections.open(clientSocket, index); // Route replies for this client to this loop
+    Connection& connection = slot->connection.emplace(clientSocket, server->config.framing, server->config.maxFrameSize,
+                                                      server->config.frameDelimiter);
+    connection.id = id;
+    connection.negotiating = !server->config.compressionCodecs.empty();
+    connection.listIndex = clientSockets.size();
+    connection.lastActivity = now;
+    connection.idleTimer.owner = clientSocket;
+    scheduleIdleTimer(connection);
+    clientSockets.push_back(clientSocket);
+    LOG_INFO << "Client " << clientSocket << " connected."; // Log client connection message
+    if(server->sessionFactory)
+    {
+        openSession(connection);
+    }
+    return &connection;
+}
+
+// Function to pass an accepted client to the TLS handshake thread if the server terminates TLS. Returns false
+// if it does not, the caller then serves the client right away; otherwise the client is handed back through
+// handOver once its session runs in the kernel, or closed here if no handshake can be started
+bool IoLoop::startHandshake(int clientSocket)
+{
+    TlsAcceptor* tls = server->tls.get();
+    if(tls == NULL)
+    {
+        return false;
+    }
+    if(!tls->submit(clientSocket, this))
+    {
+        LOG_WARNING << "Client " << clientSocket << " is rejected, too many TLS handshakes are in progress.";
+        close(clientSocket);
+    }
+    return true;
+}
+
+// Function to serve the clients handed back by the TLS handshake thread since the last wakeup
+void IoLoop::adoptHandshakenClients()
+{
+    int clientSocket;
+    while(adoptQueue.tryPop(clientSocket))
+    {
+        if(phase != LoopPhase::RUNNING)
+        {
+            close(clientSocket); // The shutdown started during the handshake
+            continue;
+        }
+        adoptClient(clientSocket);
+    }
+}
+
+// Function to look up a client of this loop, returns NULL if it is not connected
+Connection* IoLoop::findClient(int clientSocket)
+{
+    // Only this loop hands a slot it owns back, so the owner cannot change under the loop thread
+    ConnectionSlot* slot = server->connections.find(clientSocket);
+    if(slot == NULL || slot->owner.load(std::memory_order_relaxed) != index || !slot->connection)
+    {
+        return NULL;
+    }
+    return &*slot->connection;
+}
+
+// Function to look up a client of this loop by identity, returns NULL if it left, even if its descriptor was reused
+Connection* IoLoop::findClient(ClientId client)
+{
+    Connection* connection = findClient(client.socket);
+    return connection == NULL || connection->id != client ? NULL : connection;
+}
+
+// Function to push every complete frame of a client to the message queue, decoding either the bytes
+// already in its receive buffer (data is NULL) or an external chunk.
+// Returns false once the client has been disconnected, the connection must not be used afterwards
+bool IoLoop::deliverFrames(Connection& connection, const char* data, size_t length)
+{
+    int clientSocket = connection.socket;
+    ClientId client = connection.id;
+    uint64_t throttleNs = 0; // Time the client has to wait after the frames decoded here
+    bool queueFull = false; // The client reached its limit of queued messages
+    auto onFrame = [this, client, &connection, &throttleNs, &queueFull](BufferSlice&& frame)
+    {
+        if(connection.negotiating)
+        {
+            connection.negotiating = false;
+            if(isCompressionOffer(frame.view()))
+            {
+                startCompression(connection, frame.view()); // Answered by the server, never handed to a handler
+                return true;
+            }
+        }
+
+        throttleNs = server->throttle(connection.rateLimit);
+        if(connection.session)
+        {
+            server->countReceived(client, frame.size());
+            connection.session->onMessage(std::move(frame)); // Sessions only defer closing, the connection stays valid
+            Metrics::add(Counter::MESSAGES_HANDLED); // Handled right here, it never waits in a queue
+        }
+        else if(!server->enqueueMessage(client, std::move(frame), this))
+        {
+            return false;
+        }
+        else if(server->clientQueueFull(client))
+        {
+            queueFull = true;
+        }
+
+        if(throttleNs > 0 || queueFull)
+        {
+            connection.decoder.pause(); // The rest of a large read stays buffered until the client may go on
+        }
+        return true;
+    };
+
+    connection.lastActivity = now;
+    DecodeResult result = data == NULL ? connection.decoder.decode(onFrame) : connection.decoder.decode(data, length, onFrame);
+    if(result == DecodeResult::OK || result == DecodeResult::PAUSED)
+    {
+        if(throttleNs > 0)
+        {
+            throttleClient(connection, throttleNs);
+        }
+        if(queueFull && !connection.queueLimited)
+        {
+            limitClient(connection);
+        }
+        if(result == DecodeResult::PAUSED || connection.decoder.bufferedBytes() == 0)
+        {
+            connection.partialSince = 0; // Frames held back by a pause are complete, no read deadline applies
+        }
+        else if(connection.partialSince == 0)
+        {
+            connection.partialSince = now; // An incomplete frame is waiting for the rest of its bytes
+            if(server->config.readTimeoutMs > 0)
+            {
+                scheduleIdleTimer(connection); // The read deadline may come before the idle one
+            }
+        }
+        return true;
+    }
+
+    if(result == DecodeResult::STOPPED)
+    {
+        LOG_INFO << "Client " << clientSocket << " is disconnected, message queue is full.";
+    }
+    else if(result == DecodeResult::INVALID_STREAM)
+    {
+        LOG_INFO << "Client " << clientSocket << " is disconnected, its compressed stream is invalid.";
+    }
+    else
+    {
+        LOG_INFO << "Client " << clientSocket << " is disconnected, frame is too large.";
+    }
+    disconnectClient(clientSocket);
+    return false;
+}
+
+// Function to forget a client and close its socket, returns false if it was already closed
+bool IoLoop::removeClient(int clientSocket)
+{
+    Connection* connection = findClient(clientSocket);
+    if(connection == NULL)
+    {
+        return false; // Already closed
+    }
+
+    // Swap the last client into the freed position to keep the list dense
+    size_t position = connection->listIndex;
+    int lastSocket = clientSockets.back();
+    clientSockets[position] = lastSocket;
+    findClient(lastSocket)->listIndex = position;
+    clientSockets.pop_back();
+
+    idleTimers.cancel(connection->idleTimer);
+    std::unique_ptr<ConnectionSession> session = std::move(connection->session);
+    server->connections.find(clientSocket)->connection.reset();
+    server->connections.close(clientSocket); // Stop routing replies before the descriptor can be reused
+    close(clientSocket);
+    server->releaseClient();
+    LOG_INFO << "Client " << clientSocket << " disconnected.";
+    if(session)
+    {
+        session->onClose(); // Last call, the client is gone so writes from here on fail
+    }
+    return true;
+}
+
+// Function to post a reply for a client of this loop, returns false if the queue is full; safe from any thread
+bool IoLoop::post(Message&& message)
+{
+    if(!outboundQueue.tryPush(message))
+    {
+        return false;
+    }
+
+    outboundNotifier.notify(); // Only costs a system call when the loop is waiting for events
+    return true;
+}
+
+// Function to give the loop a client whose TLS session now runs in the kernel, safe from any thread.
+// Returns false if the loop cannot take more clients right now, the caller still owns the descriptor then
+bool IoLoop::handOver(int clientSocket)
+{
+    if(!adoptQueue.tryPush(clientSocket))
+    {
+        return false;
+    }
+
+    outboundNotifier.notify(); // Woken like for a reply, the client is served in the same pass
+    return true;
+}
+
+// Function to move every posted reply to its connection's queue, then flush each connection once
+// so all replies that arrived in this wakeup are coalesced into as few writes as possible
+void IoLoop::drainOutboundQueue()
+{
+    adoptHandshakenClients();
+    releaseLimitedClients();
+    takeOutboundQueue();
+    do
+    {
+        wakeWritableSessions(); // Sessions writing more replies are flushed in the same wakeup
+        flushOutbound();
+    }
+    while(!writableList.empty());
+    closeSessions();
+}
+
+// Function to move every posted reply to its connection's queue without writing anything. Also called
+// by the server while this loop waits for a full worker queue, so a worker blocked replying to a client
+// of this loop can always make progress
+void IoLoop::takeOutboundQueue()
+{
+    Message message;
+    while(outboundQueue.tryPop(message))
+    {
+        if(message.client.socket == BROADCAST_SOCKET)
+        {
+            // Every client gets a reference to the same bytes, the payload is never copied per client
+            for(int clientSocket : clientSockets)
+            {
+                queueOutbound(*findClient(clientSocket), message.payload.share());
+            }
+            message.payload.reset();
+            continue;
+        }
+
+        Connection* connection = findClient(message.client);
+        if(connection == NULL)
+        {
+            continue; // Client left before its reply, the payload is simply released
+        }
+        queueOutbound(*connection, std::move(message.payload));
+    }
+}
+
+// Function to append a reply to a connection's queue and list the connection for the next flush.
+// Replies to a compressed connection wait for the flush, which compresses them together
+void IoLoop::queueOutbound(Connection& connection, BufferSlice&& payload)
+{
+    if(connection.compressor)
+    {
+        connection.uncompressedBytes += payload.size();
+        connection.uncompressed.push_back(std::move(payload));
+    }
+    else
+    {
+        connection.outboundBytes += payload.size();
+        connection.outbound.push_back(std::move(payload));
+    }
+    if(!connection.flushPending)
+    {
+        connection.flushPending = true;
+        flushList.push_back(connection.socket);
+    }
+}
+
+// Function to flush each connection that received replies since the last flush
+void IoLoop::flushOutbound()
+{
+    for(int clientSocket : flushList)
+    {
+        Connection* connection = findClient(clientSocket);
+        if(connection == NULL)
+        {
+            continue;
+        }
+        connection->flushPending = false;
+
+        if(!connection->uncompressed.empty() && !compressOutbound(*connection))
+        {
+            LOG_WARNING << "Client " << clientSocket << " is disconnected, its replies could not be compressed.";
+            disconnectClient(clientSocket);
+            continue;
+        }
+
+        if(connection->outboundBytes > server->config.maxOutboundBytes)
+        {
+            LOG_INFO << "Client " << clientSocket << " is disconnected, it does not read its replies.";
+            disconnectClient(clientSocket);
+            continue;
+        }
+
+        if(connection->outboundBytes > server->config.outboundHighWatermark && !connection->readPaused)
+        {
+            connection->readPaused = true; // Stop taking requests from a client that does not keep up with replies
+            pauseReading(*connection);
+        }
+
+        flushClient(*connection);
+    }
+    flushList.clear();
+}
+
+// Function to turn the replies queued for a compressed connection into blocks on its outbound queue, each taking
+// up to COMPRESSION_MAX_BLOCK_SIZE bytes of consecutive replies. Blocks below the compression threshold are
+// stored as they are. Returns false if the compressor failed, its stream cannot be continued then
+bool IoLoop::compressOutbound(Connection& connection)
+{
+    size_t index = 0; // Reply the next block starts in
+    size_t offset = 0; // Bytes of that reply already in a block
+    while(connection.uncompressedBytes > 0)
+    {
+        size_t blockSize = connection.uncompressedBytes < COMPRESSION_MAX_BLOCK_SIZE ? connection.uncompressedBytes : COMPRESSION_MAX_BLOCK_SIZE;
+        while(offset == connection.uncompressed[index].size())
+        {
+            ++index; // Replies used up by the previous block, or empty
+            offset = 0;
+        }
+
+        // A block within one reply is encoded in place, replies coalesced in this wakeup are gathered first
+        const char* input = connection.uncompressed[index].data() + offset;
+        PooledBuffer gathered;
+        if(connection.uncompressed[index].size() - offset >= blockSize)
+        {
+            offset += blockSize;
+        }
+        else
+        {
+            gathered = PooledBuffer(blockSize);
+            input = gathered.data();
+            for(size_t copied = 0; copied < blockSize;)
+            {
+                const BufferSlice& reply = connection.uncompressed[index];
+                if(offset == reply.size())
+                {
+                    ++index;
+                    offset = 0;
+                    continue;
+                }
+                size_t length = reply.size() - offset < blockSize - copied ? reply.size() - offset : blockSize - copied;
+                memcpy(gathered.data() + copied, reply.data() + offset, length);
+                copied += length;
+                offset += length;
+            }
+        }
+
+        PooledBuffer block;
+        StreamCompressor* compressor = blockSize >= server->config.compressionThreshold ? connection.compressor.get() : NULL;
+        if(!encodeCompressionBlock(compressor, input, blockSize, block))
+        {
+            return false;
+        }
+        connection.uncompressedBytes -= blockSize;
+        connection.outboundBytes += block.size();
+        const char* data = block.data();
+        size_t size = block.size();
+        connection.outbound.emplace_back(std::move(block), data, size);
+    }
+    connection.uncompressed.clear(); // Their bytes are in the blocks, the receive buffers they share may be reused
+    return true;
+}
+
+// Function to answer a client's offer of codecs and switch both directions of its stream to the chosen one.
+// The answer is the last plain reply; the client compresses what it sends after reading it, so only the bytes
+// of a client that did not wait for it are decompressed right away
+void IoLoop::startCompression(Connection& connection, std::string_view offer)
+{
+    const ServerConfig& config = server->config;
+    CompressionCodec codec = CompressionPool::negotiate(offer.substr(strlen(COMPRESSION_OFFER_PREFIX)), config.compressionCodecs);
+    CompressorHandle compressor;
+    DecompressorHandle decompressor;
+    if(codec != CompressionCodec::NONE)
+    {
+        compressor = CompressionPool::acquireCompressor(codec, config.compressionLevel);
+        decompressor = CompressionPool::acquireDecompressor(codec);
+        if(!compressor || !decompressor)
+        {
+            LOG_WARNING << "Client " << connection.socket << " stays uncompressed, no " << CompressionPool::name(codec) << " context could be set up.";
+            codec = CompressionCodec::NONE;
+        }
+    }
+
+    queueOutbound(connection, server->frameReply(std::string(COMPRESSION_OFFER_PREFIX) + CompressionPool::name(codec)));
+    if(codec != CompressionCodec::NONE)
+    {
+        connection.compressor = std::move(compressor);
+        connection.decoder.startDecompression(std::move(decompressor));
+        LOG_INFO << "Client " << connection.socket << " switched to " << CompressionPool::name(codec) << " compression.";
+    }
+}
+
+// Function to describe the queued replies of a connection as I/O vectors, returns the number of vectors used
+// and their total length in batchBytes
+int IoLoop::collectOutbound(Connection& connection, struct iovec* vectors, int maxVectors, size_t& batchBytes)
+{
+    int count = 0;
+    size_t offset = connection.outboundOffset;
+    batchBytes = 0;
+    for(auto it = connection.outbound.begin(); it != connection.outbound.end() && count < maxVectors; ++it)
+    {
+        vectors[count].iov_base = const_cast<char*>(it->data()) + offset;
+        vectors[count].iov_len = it->size() - offset;
+        batchBytes += vectors[count].iov_len;
+        offset = 0;
+        ++count;
+    }
+    return count;
+}
+
+// Function to drop the written bytes from a connection's queue, including partially written replies.
+// Returns true if reading was paused and the queue has now fallen below the low watermark
+bool IoLoop::consumeOutbound(Connection& connection, size_t written)
+{
+    connection.outboundBytes -= written;
+    if(written > 0)
+    {
+        connection.lastActivity = now; // A client reading its replies is not idle
+        Metrics::add(Counter::BYTES_SENT, written);
+        server->connections.find(connection.socket)->stats.bytesSent.add(written);
+    }
+    while(written > 0)
+    {
+        size_t remaining = connection.outbound.front().size() - connection.outboundOffset;
+        if(written < remaining)
+        {
+            connection.outboundOffset += written; // Partial write, resume inside this reply
+            break;
+        }
+
+        written -= remaining;
+        connection.outboundOffset = 0;
+        if(zeroCopyPending(connection))
+        {
+            // The kernel may still read its pages, keep it until every send issued so far has completed
+            connection.zeroCopyHeld.emplace_back(connection.zeroCopyIssued, std::move(connection.outbound.front()));
+        }
+        connection.outbound.pop_front(); // Reply fully written, its buffer may return to the pool
+    }
+
+    if(connection.awaitingWritable && connection.outboundBytes <= server->config.outboundLowWatermark)
+    {
+        connection.awaitingWritable = false;
+        writableList.push_back(connection.id); // Told after the flush, never while the backend is writing
+    }
+
+    if(mayResumeReading(connection))
+    {
+        connection.readPaused = false;
+        return true;
+    }
+    return false;
+}
+
+// Function to create the session of a new client and let it start, e.g. by writing a greeting
+void IoLoop::openSession(Connection& connection)
+{
+    connection.session = server->sessionFactory();
+    connection.session->loop = this;
+    connection.session->id = connection.id;
+    connection.session->onOpen();
+}
+
+// Function to tell the sessions waiting for their replies to drain that they may write again
+void IoLoop::wakeWritableSessions()
+{
+    writableBatch.swap(writableList);
+    for(ClientId client : writableBatch)
+    {
+        Connection* connection = findClient(client);
+        if(connection != NULL && connection->session)
+        {
+            connection->session->onWritable();
+        }
+    }
+    writableBatch.clear();
+}
+
+// Function to disconnect the clients closed by their session once every queued reply has been written
+void IoLoop::closeSessions()
+{
+    size_t kept = 0;
+    for(ClientId client : closeList)
+    {
+        Connection* connection = findClient(client);
+        if(connection == NULL)
+        {
+            continue; // Left meanwhile
+        }
+        if(!connection->outbound.empty())
+        {
+            closeList[kept++] = client; // Still writing, the completion of the write wakes the loop again
+            continue;
+        }
+        disconnectClient(client.socket);
+    }
+    closeList.resize(kept);
+}
+
+// Function to queue a reply of a session, framed like replies from the workers.
+// Returns false if the client has left or its session closed it
+bool IoLoop::writeSession(ClientId client, std::string_view payload)
+{
+    Connection* connection = findClient(client);
+    if(connection == NULL || connection->closeRequested)
+    {
+        return false;
+    }
+    if(server->config.framing == FramingMode::LENGTH_PREFIXED && payload.size() > UINT32_MAX)
+    {
+        return false; // Does not fit the length prefix
+    }
+
+    Metrics::add(Counter::REPLIES_QUEUED);
+    queueOutbound(*connection, server->frameReply(payload)); // Written by the flush at the end of this wakeup
+    return true;
+}
+
+// Function to check whether a session has queued more replies than the high watermark
+bool IoLoop::sessionBlocked(ClientId client)
+{
+    Connection* connection = findClient(client);
+    return connection != NULL && connection->outboundBytes > server->config.outboundHighWatermark;
+}
+
+// Function to have a session told once its queued replies have fallen to the low watermark
+void IoLoop::awaitWritable(ClientId client)
+{
+    Connection* connection = findClient(client);
+    if(connection == NULL)
+    {
+        return;
+    }
+    if(connection->outboundBytes <= server->config.outboundLowWatermark)
+    {
+        writableList.push_back(client); // Already drained, told in the next flush
+        return;
+    }
+    connection->awaitingWritable = true;
+}
+
+// Function to close a client on behalf of its session after the replies queued so far
+void IoLoop::closeSession(ClientId client)
+{
+    Connection* connection = findClient(client);
+    if(connection != NULL && !connection->closeRequested)
+    {
+        connection->closeRequested = true;
+        closeList.push_back(client);
+    }
+}
+
+// Function to record that the kernel has finished with the first completed zero copy sends of a connection
+// and release the replies that only waited for them; TCP reports zero copy completions in order
+void IoLoop::completeZeroCopy(Connection& connection, uint32_t completed)
+{
+    connection.zeroCopyCompleted = completed;
+    while(!connection.zeroCopyHeld.empty() && (int32_t)(completed - connection.zeroCopyHeld.front().first) >= 0)
+    {
+        connection.zeroCopyHeld.pop_front();
+    }
+}
+
+// Function to refresh the loop time, coarse because timeouts only need the resolution of a tick
+void IoLoop::updateClock()
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+    now = (uint64_t)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+// Function to get the time a client times out at, 0 if no timeout applies to it
+uint64_t IoLoop::clientDeadline(const Connection& connection) const
+{
+    const ServerConfig& config = server->config;
+    uint64_t deadline = 0;
+    if(config.idleTimeoutMs > 0)
+    {
+        deadline = connection.lastActivity + config.idleTimeoutMs;
+    }
+    if(config.readTimeoutMs > 0 && connection.partialSince != 0)
+    {
+        uint64_t readDeadline = connection.partialSince + config.readTimeoutMs;
+        deadline = deadline == 0 || readDeadline < deadline ? readDeadline : deadline;
+    }
+    if(connection.throttledUntil != 0 && (deadline == 0 || connection.throttledUntil < deadline))
+    {
+        deadline = connection.throttledUntil; // Not a timeout, the timer resumes reading
+    }
+    return deadline;
+}
+
+// Function to check whether a paused client may be read again: its replies have drained and neither its
+// rate, its queue limit nor the shutdown hold it
+bool IoLoop::mayResumeReading(const Connection& connection) const
+{
+    return connection.readPaused && connection.throttledUntil == 0 && !connection.queueLimited &&
+           phase == LoopPhase::RUNNING && connection.outboundBytes <= server->config.outboundLowWatermark;
+}
+
+// Function to stop reading a client whose queued messages reached the limit, so it cannot fill the queue
+// of a worker shared with other clients; releaseLimitedClients resumes it
+void IoLoop::limitClient(Connection& connection)
+{
+    connection.queueLimited = true;
+    if(!connection.readPaused)
+    {
+        connection.readPaused = true;
+        pauseReading(connection);
+    }
+    limitedClients.push_back(connection.socket);
+}
+
+// Function to resume the limited clients the workers have caught up with, called on every wakeup
+void IoLoop::releaseLimitedClients()
+{
+    if(limitedClients.empty())
+    {
+        return;
+    }
+
+    limitedBatch.swap(limitedClients);
+    for(int clientSocket : limitedBatch)
+    {
+        Connection* connection = findClient(clientSocket);
+        if(connection == NULL || !connection->queueLimited)
+        {
+            continue; // Left meanwhile, or its descriptor was reused
+        }
+        if(!server->clientQueueDrained(connection->id))
+        {
+            limitedClients.push_back(clientSocket);
+            continue;
+        }
+
+        connection->queueLimited = false;
+        if(mayResumeReading(*connection))
+        {
+            connection->readPaused = false;
+            resumeReading(*connection); // May limit the client again or disconnect it
+        }
+    }
+    limitedBatch.clear();
+}
+
+// Function to stop reading a client that exceeded its message rate until its token bucket has refilled,
+// at the resolution of the timer tick
+void IoLoop::throttleClient(Connection& connection, uint64_t waitNs)
+{
+    connection.throttledUntil = now + (waitNs + 999999) / 1000000;
+    if(!connection.readPaused)
+    {
+        connection.readPaused = true; // Further data waits in the socket, which throttles the sender
+        pauseReading(connection);
+    }
+    scheduleIdleTimer(connection);
+}
+
+// Function to schedule the timer of a client at its deadline, rounded up to the next tick
+void IoLoop::scheduleIdleTimer(Connection& connection)
+{
+    uint64_t deadline = clientDeadline(connection);
+    if(deadline != 0)
+    {
+        idleTimers.schedule(connection.idleTimer, (deadline + IDLE_TIMER_TICK_MS - 1) / IDLE_TIMER_TICK_MS);
+    }
+}
+
+// Function to run the timers that are due; a client that was active since its timer was scheduled
+// gets its timer moved to the new deadline, which keeps activity itself free of any timer work
+void IoLoop::expireIdleClients()
+{
+    updateClock();
+    idleTimers.advance(now / IDLE_TIMER_TICK_MS, [this](int clientSocket)
+    {
+        Connection* connection = findClient(clientSocket);
+        if(connection == NULL)
+        {
+            return;
+        }
+
+        bool resume = false;
+        if(connection->throttledUntil != 0 && connection->throttledUntil <= now)
+        {
+            connection->throttledUntil = 0; // Refilled, reading resumes unless something else holds it
+            resume = mayResumeReading(*connection);
+            connection->readPaused = !resume && connection->readPaused;
+        }
+
+        uint64_t deadline = clientDeadline(*connection);
+        if(deadline == 0 || deadline > now)
+        {
+            scheduleIdleTimer(*connection);
+            if(resume)
+            {
+                resumeReading(*connection); // Last action, reading may disconnect the client
+            }
+            return;
+        }
+
+        unsigned idleTimeout = server->config.idleTimeoutMs;
+        bool idle = idleTimeout > 0 && connection->lastActivity + idleTimeout <= now;
+        LOG_INFO << "Client " << clientSocket << " is disconnected, " << (idle ? "idle timeout." : "read timeout.");
+        disconnectClient(clientSocket);
+    });
+}
+
+// Function to get how long the loop may wait for events before the next tick is due, -1 without timers
+int IoLoop::timerWaitMs() const
+{
+    if(phase != LoopPhase::RUNNING || requestedPhase.load(std::memory_order_relaxed) != LoopPhase::RUNNING)
+    {
+        return SHUTDOWN_POLL_MS; // Check the drain deadline regularly
+    }
+    if(!limitedClients.empty())
+    {
+        return QUEUE_LIMIT_POLL_MS; // The workers do not wake the loop when they catch up
+    }
+    if(idleTimers.empty())
+    {
+        return -1;
+    }
+    return (int)(IDLE_TIMER_TICK_MS - now % IDLE_TIMER_TICK_MS);
+}
+
+// Function to ask the loop to stop accepting and reading, replies keep being written; safe from any thread
+void IoLoop::requestDrain()
+{
+    requestedPhase.store(LoopPhase::DRAINING, std::memory_order_release);
+    outboundNotifier.notify();
+}
+
+// Function to ask the loop to write its remaining replies until the deadline, close its clients and return;
+// safe from any thread
+void IoLoop::requestClose(uint64_t deadlineMs)
+{
+    closeDeadlineMs.store(deadlineMs, std::memory_order_relaxed);
+    requestedPhase.store(LoopPhase::CLOSING, std::memory_order_release);
+    outboundNotifier.notify();
+}
+
+// Function to check whether the loop has stopped accepting and reading since requestDrain
+bool IoLoop::stoppedReading() const
+{
+    return readingStopped.load(std::memory_order_acquire);
+}
+
+// Function to carry out the shutdown stage requested by the server, called once per loop iteration.
+// Returns true once the loop has closed its clients and should return
+bool IoLoop::updateShutdown()
+{
+    LoopPhase requested = requestedPhase.load(std::memory_order_acquire);
+    if(phase == LoopPhase::RUNNING && requested != LoopPhase::RUNNING)
+    {
+        phase = LoopPhase::DRAINING;
+        stopAccepting();
+        for(int clientSocket : clientSockets)
+        {
+            Connection* connection = findClient(clientSocket);
+            if(!connection->readPaused)
+            {
+                connection->readPaused = true; // Stays paused, consumeOutbound no longer resumes reading
+                pauseReading(*connection);
+            }
+        }
+        readingStopped.store(true, std::memory_order_release);
+    }
+    if(phase == LoopPhase::DRAINING && requested == LoopPhase::CLOSING)
+    {
+        phase = LoopPhase::CLOSING;
+    }
+    if(phase != LoopPhase::CLOSING)
+    {
+        return false;
+    }
+
+    uint64_t deadline = closeDeadlineMs.load(std::memory_order_relaxed);
+    if(!clientsClosed)
+    {
+        bool flushed = true;
+        for(int clientSocket : clientSockets)
+        {
+            if(!findClient(clientSocket)->outbound.empty())
+            {
+                flushed = false;
+                break;
+            }
+        }
+        if(!flushed && now < deadline)
+        {
+            return false; // Replies are still being written
+        }
+
+        // Disconnecting may remove the client from the list right away, so walk a copy
+        std::vector<int> remaining = clientSockets;
+        for(int clientSocket : remaining)
+        {
+            disconnectClient(clientSocket);
+        }
+        clientsClosed = true;
+    }
+
+    // Backends that close asynchronously release their clients once the kernel is done with them
+    return clientSockets.empty() || now >= deadline + SHUTDOWN_GRACE_MS;
+}
@@ -0,0 +1,121 @@
+#ifndef IO_LOOP_H
+#define IO_LOOP_H
+
+#include "Connection.h"
+#include "Message.h"
+#include "MessageRing.h"
+#include "EventNotifier.h"
+#include "TimerWheel.h"
+#include <pthread.h>
+#include <atomic>
+#include <string_view>
+#include <cstddef>
+#include <vector>
+
+#define IDLE_TIMER_TICK_MS 100 // Resolution of the idle and read timeouts
+#define BROADCAST_SOCKET -2 // Client socket of a posted message addressed to every client of the loop
+#define SHUTDOWN_POLL_MS 10 // Longest wait of a stopping loop, so it notices its drain deadline
+#define SHUTDOWN_GRACE_MS 1000 // Time after the drain deadline a loop waits for its closed clients to be released
+#define QUEUE_LIMIT_POLL_MS 1 // Longest wait of a loop with clients over their queue limit, so they resume promptly
+#define ADOPT_QUEUE_CAPACITY 1024 // Clients a loop takes back from the TLS handshake thread per wakeup
+
+// Stage of a loop's shutdown, requested by the server and carried out by the loop thread
+enum class LoopPhase
+{
+    RUNNING, // Accepting and reading clients
+    DRAINING, // No longer accepting or reading, replies are still written
+    CLOSING // Writing the last replies until the deadline, then closing every client and returning
+};
+
+class Server;
+struct ServerConfig;
+
+// Base class of the I/O backends, one instance per loop thread serving its own clients
+class IoLoop
+{
+public:
+    IoLoop(Server* srv, int loopIndex);
+    virtual ~IoLoop();
+    virtual void watchListener(int listenSocket, bool shared) = 0;
+    void start(int cpu);
+    void join();
+    bool post(Message&& message);
+    bool handOver(int clientSocket);
+    void takeOutboundQueue();
+    void requestDrain();
+    void requestClose(uint64_t deadlineMs);
+    bool stoppedReading() const;
+
+protected:
+    Server* server; // Server that owns this loop and consumes its messages
+    int index; // Index of this loop among the server's loops
+    std::vector<int> clientSockets; // Clients owned by this loop, their state lives in the server's connection table
+    MessageRing<Message> outboundQueue; // Replies posted by other threads for clients of this loop
+    MessageRing<int> adoptQueue; // Clients whose TLS handshake completed, to be served by this loop
+    EventNotifier outboundNotifier; // Wakes the loop when replies are posted while it waits for events
+    TimerWheel idleTimers; // Idle and read timeouts of the clients of this loop
+    uint64_t now; // Monotonic time in milliseconds, refreshed once per loop iteration
+    LoopPhase phase; // Shutdown stage the loop has reached, only touched by the loop thread
+
+    virtual void run() = 0;
+    virtual void disconnectClient(int clientSocket) = 0;
+    virtual void flushClient(Connection& connection) = 0;
+    virtual void pauseReading(Connection& connection) = 0;
+    virtual void resumeReading(Connection& connection) = 0;
+    virtual void stopAccepting() = 0;
+    virtual void adoptClient(int clientSocket) = 0;
+    const ServerConfig& serverConfig() const;
+    Connection* addClient(int clientSocket);
+    bool startHandshake(int clientSocket);
+    void adoptHandshakenClients();
+    Connection* findClient(int clientSocket);
+    Connection* findClient(ClientId client);
+    bool deliverFrames(Connection& connection, const char* data, size_t length);
+    bool removeClient(int clientSocket);
+    void drainOutboundQueue();
+    void flushOutbound();
+    int collectOutbound(Connection& connection, struct iovec* vectors, int maxVectors, size_t& batchBytes);
+    bool consumeOutbound(Connection& connection, size_t written);
+    void queueOutbound(Connection& connection, BufferSlice&& payload);
+    bool compressOutbound(Connection& connection);
+    void startCompression(Connection& connection, std::string_view offer);
+    void completeZeroCopy(Connection& connection, uint32_t completed);
+    void updateClock();
+    uint64_t clientDeadline(const Connection& connection) const;
+    void scheduleIdleTimer(Connection& connection);
+    void throttleClient(Connection& connection, uint64_t waitNs);
+    void limitClient(Connection& connection);
+    void releaseLimitedClients();
+    bool mayResumeReading(const Connection& connection) const;
+    void expireIdleClients();
+    int timerWaitMs() const;
+    bool updateShutdown();
+    static bool zeroCopyPending(const Connection& connection) { return connection.zeroCopyIssued != connection.zeroCopyCompleted; }
+
+private:
+    friend class ConnectionSession;
+
+    pthread_t thread; // Thread running the loop
+    std::vector<int> flushList; // Clients that received replies in the current wakeup
+    std::vector<ClientId> writableList; // Sessions whose replies fell to the low watermark, told in the next flush
+    std::vector<ClientId> writableBatch; // Sessions being told, writableList collects the next ones meanwhile
+    std::vector<ClientId> closeList; // Clients closed by their session, disconnected once their replies are written
+    std::vector<int> limitedClients; // Clients over their queue limit, checked on every wakeup
+    std::vector<int> limitedBatch; // Clients being checked, limitedClients collects the ones still over the limit
+    std::atomic<LoopPhase> requestedPhase{LoopPhase::RUNNING}; // Shutdown stage requested by the server
+    std::atomic<bool> readingStopped{false}; // Set by the loop once it accepts and reads nothing anymore
+    std::atomic<uint64_t> closeDeadlineMs{0}; // Time the remaining replies are given up at, set before CLOSING
+    bool clientsClosed; // Every client was told to disconnect while closing
+
+    void openSession(Connection& connection);
+    void wakeWritableSessions();
+    void closeSessions();
+    bool writeSession(ClientId client, std::string_view payload);
+    bool sessionBlocked(ClientId client);
+    void awaitWritable(ClientId client);
+    void closeSession(ClientId client);
+    void closeRemainingClients();
+    static void* runWrapper(void* arg);
+};
+
+#endif
@@ -0,0 +1,276 @@
+#include "ListenerHandoff.h" // Including the header file to define the ListenerHandoff class
+#include "Logger.h" // Including the logger for status and error messages
+#include <cerrno> // This header file is included to retry interrupted calls and tell a missing server from a failure
+#include <cstdint> // This header file is included for the fixed-size fields of the handoff message
+#include <cstdlib> // This header file is included to read and clear the socket activation environment
+#include <cstring> // This header file is included for memset and memcpy
+#include <unistd.h> // This header file is included for POSIX operating system API, such as close and unlink
+#include <fcntl.h> // This header file is included to mark inherited descriptors close-on-exec
+#include <poll.h> // This header file is included to wait for the confirmation and the stop request together
+#include <sys/socket.h> // This header file is included for Unix domain sockets and SCM_RIGHTS
+#include <sys/time.h> // This header file is included for the send and receive timeouts
+#include <sys/un.h> // This header file is included for the Unix domain socket address
+
+#define STATIC
+
+// Header of the handoff message, the descriptors travel in its control data
+struct HandoffMessage
+{
+    uint32_t magic; // HANDOFF_MAGIC
+    uint32_t count; // Number of descriptors attached
+};
+
+// Function to fill a Unix socket address, returns false if the path does not fit
+static bool makeAddress(const std::string& path, struct sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        LOG_WARNING << "Handoff path " << path << " is not a valid Unix socket path.";
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// Function to take the listening sockets passed by systemd socket activation. The variables are cleared
+// afterwards so child processes do not take the sockets for their own. Returns false if none were passed
+STATIC bool ListenerHandoff::fromSystemd(std::vector<int>& sockets)
+{
+    const char* pid = getenv("LISTEN_PID");
+    const char* fds = getenv("LISTEN_FDS");
+    if(pid == NULL || fds == NULL)
+    {
+        return false;
+    }
+
+    bool forThisProcess = strtol(pid, NULL, 10) == (long)getpid(); // Set for the process systemd started, not its children
+    int count = atoi(fds);
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    unsetenv("LISTEN_FDNAMES");
+    if(!forThisProcess || count <= 0)
+    {
+        return false;
+    }
+
+    for(int fd = SYSTEMD_LISTEN_FDS_START; fd < SYSTEMD_LISTEN_FDS_START + count; ++fd)
+    {
+        if(!isListener(fd))
+        {
+            LOG_WARNING << "Descriptor " << fd << " passed by systemd is not a listening TCP socket, it is ignored.";
+            continue;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC); // systemd passes them inheritable
+        sockets.push_back(fd);
+    }
+    return !sockets.empty();
+}
+
+// Function to connect to the handoff socket of a running server.
+// Returns -1 if no server is listening there, which is the normal case for the first start
+STATIC int ListenerHandoff::connectToServer(const std::string& path)
+{
+    struct sockaddr_un address;
+    if(!makeAddress(path, address))
+    {
+        return -1;
+    }
+
+    int server = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(server == -1)
+    {
+        LOG_WARNING << "Handoff socket could not be created.";
+        return -1;
+    }
+
+    if(::connect(server, (struct sockaddr *)&address, sizeof(address)) == -1)
+    {
+        if(errno != ENOENT && errno != ECONNREFUSED)
+        {
+            LOG_WARNING << "Could not connect to the running server at " << path << ".";
+        }
+        close(server);
+        return -1; // A stale path left by a server that crashed refuses the connection
+    }
+
+    // A server that answers must send its listeners promptly, a hung one must not hold up the start
+    struct timeval timeout;
+    timeout.tv_sec = HANDOFF_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (HANDOFF_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(server, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(server, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return server;
+}
+
+// Function to receive the listening sockets sent by the running server, appending them to sockets
+STATIC bool ListenerHandoff::receiveListeners(int server, std::vector<int>& sockets)
+{
+    HandoffMessage message{};
+    struct iovec vector = {&message, sizeof(message)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_SOCKETS)];
+    struct msghdr header{};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = sizeof(control);
+
+    ssize_t bytesRead;
+    while((bytesRead = recvmsg(server, &header, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+    {
+    }
+    bool valid = bytesRead == (ssize_t)sizeof(message) && message.magic == HANDOFF_MAGIC && !(header.msg_flags & MSG_CTRUNC);
+
+    // Every attached descriptor is now open in this process, close the ones not kept
+    size_t received = sockets.size();
+    for(struct cmsghdr* part = CMSG_FIRSTHDR(&header); part != NULL; part = CMSG_NXTHDR(&header, part))
+    {
+        if(part->cmsg_level != SOL_SOCKET || part->cmsg_type != SCM_RIGHTS)
+        {
+            continue;
+        }
+        size_t count = (part->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for(size_t i = 0; i < count; ++i)
+        {
+            int fd;
+            memcpy(&fd, CMSG_DATA(part) + i * sizeof(int), sizeof(fd));
+            if(valid && isListener(fd))
+            {
+                sockets.push_back(fd);
+            }
+            else
+            {
+                close(fd);
+            }
+        }
+    }
+
+    if(!valid || sockets.size() - received != message.count || message.count == 0)
+    {
+        for(size_t i = received; i < sockets.size(); ++i)
+        {
+            close(sockets[i]);
+        }
+        sockets.resize(received);
+        return false;
+    }
+    return true;
+}
+
+// Function to tell the previous server that the listeners are served here now, so it can drain and exit
+STATIC bool ListenerHandoff::confirm(int server)
+{
+    char ready = 'R';
+    ssize_t bytesWritten;
+    while((bytesWritten = ::send(server, &ready, 1, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+    {
+    }
+    return bytesWritten == 1;
+}
+
+// Function to open the handoff socket the next server process connects to, replacing a stale one.
+// Returns -1 on failure, the server then still runs but a restart has to bind the port again
+STATIC int ListenerHandoff::listenForSuccessor(const std::string& path)
+{
+    struct sockaddr_un address;
+    if(!makeAddress(path, address))
+    {
+        return -1;
+    }
+
+    int listenSocket = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(listenSocket == -1)
+    {
+        return -1;
+    }
+
+    unlink(path.c_str()); // Left by the previous server, which handed its listeners over and no longer listens there
+    if(bind(listenSocket, (struct sockaddr *)&address, sizeof(address)) == -1 || ::listen(listenSocket, 1) == -1)
+    {
+        close(listenSocket);
+        return -1;
+    }
+    return listenSocket;
+}
+
+// Function to send this server's listening sockets to a new server process connected to the handoff socket
+STATIC bool ListenerHandoff::sendListeners(int successor, const std::vector<int>& sockets)
+{
+    if(sockets.empty() || sockets.size() > HANDOFF_MAX_SOCKETS)
+    {
+        return false;
+    }
+
+    HandoffMessage message{HANDOFF_MAGIC, (uint32_t)sockets.size()};
+    struct iovec vector = {&message, sizeof(message)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * HANDOFF_MAX_SOCKETS)];
+    struct msghdr header{};
+    header.msg_iov = &vector;
+    header.msg_iovlen = 1;
+    header.msg_control = control;
+    header.msg_controllen = CMSG_SPACE(sizeof(int) * sockets.size());
+
+    struct cmsghdr* part = CMSG_FIRSTHDR(&header);
+    part->cmsg_level = SOL_SOCKET;
+    part->cmsg_type = SCM_RIGHTS;
+    part->cmsg_len = CMSG_LEN(sizeof(int) * sockets.size());
+    memcpy(CMSG_DATA(part), sockets.data(), sizeof(int) * sockets.size());
+
+    ssize_t bytesWritten;
+    while((bytesWritten = sendmsg(successor, &header, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+    {
+    }
+    return bytesWritten == (ssize_t)sizeof(message);
+}
+
+// Function to wait until the new server process confirms it serves the listeners. Returns false if it
+// closed the connection first, e.g. because it failed to start, or if stopFd became readable
+STATIC bool ListenerHandoff::awaitConfirmation(int successor, int stopFd)
+{
+    struct pollfd watched[2] = {{successor, POLLIN, 0}, {stopFd, POLLIN, 0}};
+    while(true)
+    {
+        // No timeout, the new process may take a while to initialise and both serve the listeners meanwhile
+        if(poll(watched, 2, -1) == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        if(watched[1].revents & POLLIN)
+        {
+            return false;
+        }
+
+        char ready;
+        ssize_t bytesRead = recv(successor, &ready, 1, MSG_DONTWAIT);
+        if(bytesRead == -1 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            continue;
+        }
+        return bytesRead == 1 && ready == 'R';
+    }
+}
+
+// Function to check that a descriptor is a listening TCP socket
+STATIC bool ListenerHandoff::isListener(int socket)
+{
+    int value = 0;
+    socklen_t length = sizeof(value);
+    if(getsockopt(socket, SOL_SOCKET, SO_ACCEPTCONN, &value, &length) == -1 || value != 1)
+    {
+        return false;
+    }
+
+    length = sizeof(value);
+    if(getsockopt(socket, SOL_SOCKET, SO_DOMAIN, &value, &length) == -1 || (value != AF_INET && value != AF_INET6))
+    {
+        return false;
+    }
+
+    length = sizeof(value);
+    return getsockopt(socket, SOL_SOCKET, SO_TYPE, &value, &length) == 0 && value == SOCK_STREAM;
+}
@@ -0,0 +1,28 @@
+#ifndef LISTENER_HANDOFF_H
+#define LISTENER_HANDOFF_H
+
+#include <string>
+#include <vector>
+
+#define HANDOFF_MAX_SOCKETS 256 // Most listening sockets passed in one handoff
+#define HANDOFF_TIMEOUT_MS 5000 // How long either side of a handoff waits for the other
+#define HANDOFF_MAGIC 0x54435048 // "TCPH", marks a handoff message so stray connections are told apart
+#define SYSTEMD_LISTEN_FDS_START 3 // First descriptor passed by systemd socket activation
+
+// Passing listening sockets to a new server process so a restart never refuses connections: the running
+// server hands its listeners over a Unix socket with SCM_RIGHTS, or systemd passes them with LISTEN_FDS.
+// The kernel keeps one accept queue per listener, whichever process holds it, so nothing queued is lost
+class ListenerHandoff
+{
+public:
+    static bool fromSystemd(std::vector<int>& sockets);
+    static int connectToServer(const std::string& path);
+    static bool receiveListeners(int server, std::vector<int>& sockets);
+    static bool confirm(int server);
+    static int listenForSuccessor(const std::string& path);
+    static bool sendListeners(int successor, const std::vector<int>& sockets);
+    static bool awaitConfirmation(int successor, int stopFd);
+    static bool isListener(int socket);
+};
+
+#endif
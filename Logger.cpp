@@ -0,0 +1,254 @@
+#include "Logger.h" // Including the header file to define the Logger class
+#include <cstring> // This header file is included to copy text into records
+#include <ctime> // This header file is included to read the clock and format time stamps
+#include <unistd.h> // This header file is included for write and usleep
+
+#define STATIC
+#define LOG_OUTPUT_SIZE 65536 // Bytes the writer thread collects before each write system call
+
+std::atomic<LogLevel> Logger::currentLevel{LogLevel::INFO};
+
+// Holder of the calling thread's buffer, retires it when the thread exits
+struct LogBufferHolder
+{
+    LogBuffer* buffer = NULL;
+    ~LogBufferHolder()
+    {
+        if(buffer != NULL)
+        {
+            buffer->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local LogBufferHolder logBufferHolder;
+static thread_local LogRecord scratchRecord; // Formats lines that do not fit the buffer, they are dropped
+
+// Constructor for the Logger class, starting the writer thread
+Logger::Logger() : buffers(NULL), running(true), passes(0), droppedLines(0)
+{
+    if(pthread_create(&thread, NULL, writeRecordsWrapper, (void *)this) != 0)
+    {
+        running.store(false); // Lines are kept in the buffers but never written
+    }
+}
+
+// Destructor for the Logger class, writing every remaining line before the process exits
+Logger::~Logger()
+{
+    if(running.exchange(false))
+    {
+        pthread_join(thread, NULL);
+    }
+}
+
+// Function to get the logger, created on first use so its writer thread only runs if something logs
+Logger& Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+// Function to set the lowest level that is logged
+STATIC void Logger::setLevel(LogLevel level)
+{
+    currentLevel.store(level, std::memory_order_relaxed);
+}
+
+// Function to wait until every line logged before the call has been written, e.g. before prompting the user
+STATIC void Logger::flush()
+{
+    Logger& logger = instance();
+    if(!logger.running.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    // The second pass from now has started after this call, so it has seen every earlier line
+    uint64_t target = logger.passes.load(std::memory_order_acquire) + 2;
+    while(logger.passes.load(std::memory_order_acquire) < target)
+    {
+        usleep(LOG_FLUSH_INTERVAL_US / 10);
+    }
+}
+
+// Function to get the number of lines lost because the buffer of their thread was full
+STATIC uint64_t Logger::dropped()
+{
+    return instance().droppedLines.load(std::memory_order_relaxed);
+}
+
+// Function to get the calling thread's buffer, registering it on first use
+STATIC LogBuffer* Logger::localBuffer()
+{
+    if(logBufferHolder.buffer == NULL)
+    {
+        logBufferHolder.buffer = new LogBuffer();
+        instance().registerBuffer(logBufferHolder.buffer);
+    }
+    return logBufferHolder.buffer;
+}
+
+// Function to add a buffer to the list drained by the writer thread
+void Logger::registerBuffer(LogBuffer* buffer)
+{
+    std::lock_guard<std::mutex> lock(buffersLock);
+    buffer->next = buffers;
+    buffers = buffer;
+}
+
+// Function to get the next free record of the calling thread, NULL if its buffer is full
+STATIC LogRecord* Logger::beginRecord()
+{
+    LogBuffer* buffer = localBuffer();
+    size_t tail = buffer->tail.load(std::memory_order_relaxed);
+    if(tail - buffer->head.load(std::memory_order_acquire) >= LOG_RING_CAPACITY)
+    {
+        instance().droppedLines.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    return &buffer->records[tail & (LOG_RING_CAPACITY - 1)];
+}
+
+// Function to hand the record returned by beginRecord to the writer thread
+STATIC void Logger::commitRecord()
+{
+    LogBuffer* buffer = logBufferHolder.buffer;
+    buffer->tail.store(buffer->tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+// Function to append a record as a text line to an output buffer, writing the buffer out when it is full
+static void appendRecord(int fd, char* output, size_t& used, const LogRecord& record)
+{
+    static const char* const levelNames[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+    if(used + LOG_RECORD_SIZE + 32 > LOG_OUTPUT_SIZE)
+    {
+        ssize_t ignored = write(fd, output, used);
+        (void)ignored;
+        used = 0;
+    }
+
+    time_t seconds = (time_t)record.seconds;
+    struct tm local;
+    localtime_r(&seconds, &local);
+    used += strftime(output + used, 16, "%H:%M:%S", &local);
+    used += snprintf(output + used, 32, ".%06d %s ", record.nanoseconds / 1000, levelNames[(int)record.level]);
+    memcpy(output + used, record.text, record.length);
+    used += record.length;
+    output[used++] = '\n';
+}
+
+// Function to write out every buffered line once, freeing the buffers of exited threads.
+// Returns true if anything was written
+bool Logger::writePass()
+{
+    static char standardOutput[LOG_OUTPUT_SIZE];
+    static char errorOutput[LOG_OUTPUT_SIZE];
+    size_t outputUsed = 0;
+    size_t errorUsed = 0;
+    bool wrote = false;
+
+    std::lock_guard<std::mutex> lock(buffersLock);
+    for(LogBuffer** link = &buffers; *link != NULL;)
+    {
+        LogBuffer* buffer = *link;
+        bool retired = buffer->retired.load(std::memory_order_acquire); // Read first, so no line is committed after the drain
+        size_t head = buffer->head.load(std::memory_order_relaxed);
+        size_t tail = buffer->tail.load(std::memory_order_acquire);
+        for(; head != tail; ++head)
+        {
+            const LogRecord& record = buffer->records[head & (LOG_RING_CAPACITY - 1)];
+            if(record.level >= LogLevel::WARNING)
+            {
+                appendRecord(STDERR_FILENO, errorOutput, errorUsed, record);
+            }
+            else
+            {
+                appendRecord(STDOUT_FILENO, standardOutput, outputUsed, record);
+            }
+            wrote = true;
+        }
+        buffer->head.store(head, std::memory_order_release);
+
+        if(retired)
+        {
+            *link = buffer->next;
+            delete buffer;
+        }
+        else
+        {
+            link = &buffer->next;
+        }
+    }
+
+    ssize_t ignored = 0;
+    if(outputUsed > 0)
+    {
+        ignored = write(STDOUT_FILENO, standardOutput, outputUsed);
+    }
+    if(errorUsed > 0)
+    {
+        ignored = write(STDERR_FILENO, errorOutput, errorUsed);
+    }
+    (void)ignored;
+    return wrote;
+}
+
+// Function to write out the buffers until the logger is destroyed
+void* Logger::writeRecords()
+{
+    while(running.load(std::memory_order_acquire))
+    {
+        bool wrote = writePass();
+        passes.fetch_add(1, std::memory_order_release);
+        if(!wrote)
+        {
+            usleep(LOG_FLUSH_INTERVAL_US); // Nothing logged, do not spin
+        }
+    }
+
+    writePass(); // Lines logged while stopping
+    return NULL;
+}
+
+// Static function wrapper for running the writer in a separate thread
+STATIC void* Logger::writeRecordsWrapper(void* arg)
+{
+    Logger* instance = reinterpret_cast<Logger*>(arg);
+    return instance->writeRecords();
+}
+
+// Constructor for the LogLine class, stamping the line with the current time
+LogLine::LogLine(LogLevel level) : record(Logger::beginRecord()), buffered(record != NULL)
+{
+    if(record == NULL)
+    {
+        record = &scratchRecord;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now); // Served from the vDSO, no system call
+    record->seconds = now.tv_sec;
+    record->nanoseconds = (int32_t)now.tv_nsec;
+    record->level = level;
+    record->length = 0;
+}
+
+// Destructor for the LogLine class, publishing the line
+LogLine::~LogLine()
+{
+    if(buffered)
+    {
+        Logger::commitRecord();
+    }
+}
+
+// Function to append text to the line, truncating it at the record size
+LogLine& LogLine::operator<<(std::string_view text)
+{
+    size_t room = sizeof(record->text) - record->length;
+    size_t length = text.size() < room ? text.size() : room;
+    memcpy(record->text + record->length, text.data(), length);
+    record->length += length;
+    return *this;
+}
@@ -0,0 +1,126 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "MessageRing.h"
+#include <pthread.h>
+#include <atomic>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#define LOG_RECORD_SIZE 256 // Bytes of one log record including its header, longer lines are truncated
+#define LOG_RING_CAPACITY 1024 // Records buffered per logging thread, must be a power of two
+#define LOG_FLUSH_INTERVAL_US 1000 // Time the writer thread sleeps once every buffer is empty
+
+// Severity of a log line, lines below the configured level cost a single load
+enum class LogLevel
+{
+    DEBUG,
+    INFO,
+    WARNING,
+    ERROR,
+    NONE // Disables logging
+};
+
+// One formatted line waiting in a thread's buffer
+struct LogRecord
+{
+    int64_t seconds; // Wall clock time the line was logged at
+    int32_t nanoseconds;
+    LogLevel level;
+    uint16_t length; // Used bytes of text
+    char text[LOG_RECORD_SIZE - 20]; // Line without its newline
+};
+
+// Single-producer/single-consumer ring of one logging thread, drained by the writer thread
+struct LogBuffer
+{
+    LogRecord records[LOG_RING_CAPACITY];
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0}; // Next record to write out, advanced by the writer thread
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0}; // Next record to fill, advanced by the owning thread
+    std::atomic<bool> retired{false}; // Owning thread exited, the writer frees the buffer once it is drained
+    LogBuffer* next = NULL; // Next registered buffer
+};
+
+// Asynchronous logger: threads format lines into their own lock-free buffer and a background thread
+// writes them out, so logging never waits for the terminal. A full buffer drops the line and counts it
+class Logger
+{
+public:
+    static void setLevel(LogLevel level);
+    static bool enabled(LogLevel level) { return level >= currentLevel.load(std::memory_order_relaxed) && level != LogLevel::NONE; }
+    static void flush();
+    static uint64_t dropped();
+
+    static LogRecord* beginRecord();
+    static void commitRecord();
+
+private:
+    Logger();
+    ~Logger();
+    static Logger& instance();
+    static LogBuffer* localBuffer();
+
+    static std::atomic<LogLevel> currentLevel; // Lines below this level are skipped before formatting
+
+    std::mutex buffersLock; // Guards the list of buffers, only taken when a thread logs for the first time
+    LogBuffer* buffers; // Buffers of every thread that logged
+    std::atomic<bool> running; // Cleared to stop the writer thread once it drained every buffer
+    std::atomic<uint64_t> passes; // Completed passes of the writer over every buffer
+    std::atomic<uint64_t> droppedLines; // Lines lost because their buffer was full
+    pthread_t thread; // Writer thread
+
+    void registerBuffer(LogBuffer* buffer);
+    bool writePass();
+    void* writeRecords();
+    static void* writeRecordsWrapper(void* arg);
+};
+
+// Line being formatted into the logging thread's buffer, committed when it goes out of scope
+class LogLine
+{
+public:
+    explicit LogLine(LogLevel level);
+    ~LogLine();
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    LogLine& operator<<(std::string_view text);
+    LogLine& operator<<(const char* text) { return *this << std::string_view(text); }
+    LogLine& operator<<(const std::string& text) { return *this << std::string_view(text); }
+    LogLine& operator<<(char character) { return *this << std::string_view(&character, 1); }
+    LogLine& operator<<(bool value) { return *this << (value ? "true" : "false"); }
+
+    // Function to append an integer without going through a locale aware stream
+    template<typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+    LogLine& operator<<(T value)
+    {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        return *this << std::string_view(digits, result.ptr - digits);
+    }
+
+private:
+    LogRecord* record; // Record in the buffer, or a scratch record if the buffer is full
+    bool buffered; // The record is in the buffer and has to be committed
+};
+
+// Turns the conditional expression of the logging macros into void so they work as statements
+struct LogVoidify
+{
+    void operator&(const LogLine&) {}
+};
+
+// Logging macros, the line is only formatted if its level is enabled:
+//     LOG_INFO << "Client " << clientSocket << " connected.";
+#define LOG_AT(level) !Logger::enabled(level) ? (void)0 : LogVoidify() & LogLine(level)
+#define LOG_DEBUG LOG_AT(LogLevel::DEBUG)
+#define LOG_INFO LOG_AT(LogLevel::INFO)
+#define LOG_WARNING LOG_AT(LogLevel::WARNING)
+#define LOG_ERROR LOG_AT(LogLevel::ERROR)
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include "BufferPool.h"
+#include "ClientId.h"
+#include <atomic>
+#include <cstdint>
+
+// Message received from a client, moved from the event loop to its handler without copying the payload
+struct Message
+{
+    Message() {}
+    Message(ClientId id, BufferSlice&& slice) : client(id), payload(std::move(slice)) {}
+
+    ClientId client; // Client the message came from or goes to
+    BufferSlice payload; // Frame bytes, shared with the connection's receive buffer
+    uint64_t queuedAt = 0; // Monotonic time in nanoseconds a received message was queued at
+    std::atomic<uint32_t>* queuedCount = NULL; // Queued messages of the client, decremented once this one is handled
+};
+
+#endif
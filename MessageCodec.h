@@ -0,0 +1,312 @@
+#ifndef MESSAGE_CODEC_H
+#define MESSAGE_CODEC_H
+
+#include "ClientId.h"
+#include "Logger.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#define CODEC_TYPE_SIZE 2 // Size of the big-endian message type that starts every encoded message
+
+// Binary messages described by C++ structs, decoded from the frames the framing layer delivers.
+// A message type is declared by specialising MessageSchema with its type number and the members in wire order:
+//
+//     struct Order { uint64_t id; int32_t quantity; Side side; std::array<char, 8> symbol; std::string_view note; };
+//     template <> struct MessageSchema<Order>
+//     {
+//         static constexpr uint16_t type = 7;
+//         static constexpr auto fields = std::make_tuple(&Order::id, &Order::quantity, &Order::side, &Order::symbol, &Order::note);
+//     };
+//
+// On the wire a message is its type followed by its fields without padding: integers, enums and floating point
+// numbers big-endian, byte arrays as they are, and an optional std::string_view last that takes the rest of the frame.
+// Offsets and sizes are compile-time constants, so decoding is a length check and one load per field; nothing is
+// allocated, and a std::string_view field points into the frame, valid as long as the frame is.
+template <typename T>
+struct MessageSchema;
+
+// Result of decoding a frame
+enum class CodecResult
+{
+    OK,           // The frame was decoded and handed to the visitor
+    TOO_SHORT,    // The frame is shorter than the fixed part of its message type
+    UNKNOWN_TYPE  // No message type of the codec has the frame's type number
+};
+
+// Unsigned integer with the size of a wire field, what its bytes are swapped as
+template <size_t Size> struct WireBits;
+template <> struct WireBits<1> { typedef uint8_t type; };
+template <> struct WireBits<2> { typedef uint16_t type; };
+template <> struct WireBits<4> { typedef uint32_t type; };
+template <> struct WireBits<8> { typedef uint64_t type; };
+
+inline uint8_t byteSwap(uint8_t value) { return value; }
+inline uint16_t byteSwap(uint16_t value) { return __builtin_bswap16(value); }
+inline uint32_t byteSwap(uint32_t value) { return __builtin_bswap32(value); }
+inline uint64_t byteSwap(uint64_t value) { return __builtin_bswap64(value); }
+
+// Function to read a big-endian scalar from unaligned bytes, compiles to a load and a byte swap
+template <typename T>
+inline T loadBigEndian(const char* data)
+{
+    typename WireBits<sizeof(T)>::type bits;
+    memcpy(&bits, data, sizeof(bits));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    bits = byteSwap(bits);
+#endif
+    T value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Function to write a scalar as big-endian bytes to unaligned memory
+template <typename T>
+inline void storeBigEndian(char* data, T value)
+{
+    typename WireBits<sizeof(T)>::type bits;
+    memcpy(&bits, &value, sizeof(bits));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    bits = byteSwap(bits);
+#endif
+    memcpy(data, &bits, sizeof(bits));
+}
+
+// Wire format of one field type: its fixed size, whether it takes the rest of the frame, and how it is copied
+template <typename T, typename Enable = void>
+struct WireField
+{
+    static_assert(sizeof(T) == 0, "Message fields must be arithmetic, enums, byte arrays or a trailing std::string_view");
+};
+
+// Integers, enums and floating point numbers, big-endian
+template <typename T>
+struct WireField<T, std::enable_if_t<(std::is_arithmetic_v<T> || std::is_enum_v<T>) && !std::is_same_v<T, bool>>>
+{
+    static constexpr size_t size = sizeof(T);
+    static constexpr bool variable = false;
+    static void load(const char* data, size_t, T& value) { value = loadBigEndian<T>(data); }
+    static void store(char* data, const T& value) { storeBigEndian<T>(data, value); }
+    static size_t encodedSize(const T&) { return size; }
+};
+
+// Booleans, one byte where anything but zero is true
+template <>
+struct WireField<bool>
+{
+    static constexpr size_t size = 1;
+    static constexpr bool variable = false;
+    static void load(const char* data, size_t, bool& value) { value = *data != 0; }
+    static void store(char* data, const bool& value) { *data = value ? 1 : 0; }
+    static size_t encodedSize(const bool&) { return size; }
+};
+
+// Fixed-size byte arrays such as symbols or identifiers, copied as they are
+template <typename Byte, size_t Length>
+struct WireField<std::array<Byte, Length>, std::enable_if_t<sizeof(Byte) == 1 && std::is_trivially_copyable_v<Byte>>>
+{
+    static constexpr size_t size = Length;
+    static constexpr bool variable = false;
+    static void load(const char* data, size_t, std::array<Byte, Length>& value) { memcpy(value.data(), data, Length); }
+    static void store(char* data, const std::array<Byte, Length>& value) { memcpy(data, value.data(), Length); }
+    static size_t encodedSize(const std::array<Byte, Length>&) { return size; }
+};
+
+// Rest of the frame after the fixed fields, a view into the frame instead of a copy
+template <>
+struct WireField<std::string_view>
+{
+    static constexpr size_t size = 0;
+    static constexpr bool variable = true;
+    static void load(const char* data, size_t remaining, std::string_view& value) { value = std::string_view(data, remaining); }
+    static void store(char* data, const std::string_view& value) { memcpy(data, value.data(), value.size()); }
+    static size_t encodedSize(const std::string_view& value) { return value.size(); }
+};
+
+// Type of the member a member pointer refers to
+template <typename Member> struct MemberType;
+template <typename Class, typename Field> struct MemberType<Field Class::*> { typedef Field type; };
+
+// Fields of a message type in wire order, as declared by its schema
+template <typename T>
+using SchemaFields = std::remove_cv_t<decltype(MessageSchema<T>::fields)>;
+
+// Type of field I of a message type
+template <typename T, size_t I>
+using SchemaFieldType = typename MemberType<std::tuple_element_t<I, SchemaFields<T>>>::type;
+
+// Function to get the wire offset of field I from the start of the fields
+template <typename T, size_t I>
+constexpr size_t fieldOffset()
+{
+    if constexpr(I == 0)
+    {
+        return 0;
+    }
+    else
+    {
+        return fieldOffset<T, I - 1>() + WireField<SchemaFieldType<T, I - 1>>::size;
+    }
+}
+
+// Function to check that only the last field of a message type takes the rest of the frame
+template <typename T, size_t... I>
+constexpr bool variableFieldLast(std::index_sequence<I...>)
+{
+    return ((!WireField<SchemaFieldType<T, I>>::variable || I + 1 == sizeof...(I)) && ...);
+}
+
+// Compile-time layout of a message type, derived from its schema
+template <typename T>
+struct MessageLayout
+{
+    static constexpr size_t fieldCount = std::tuple_size_v<SchemaFields<T>>;
+    static constexpr size_t fixedSize = fieldOffset<T, fieldCount>(); // Bytes of the fields, without the type
+    static_assert(fieldCount > 0, "A message schema needs at least one field");
+    static_assert(variableFieldLast<T>(std::make_index_sequence<fieldCount>()), "Only the last field of a message may be a std::string_view");
+};
+
+// Function to check whether every message type of a codec has its own type number
+template <typename... Messages>
+constexpr bool messageTypesDistinct()
+{
+    uint16_t types[] = {MessageSchema<Messages>::type...};
+    for(size_t i = 0; i < sizeof...(Messages); ++i)
+    {
+        for(size_t j = i + 1; j < sizeof...(Messages); ++j)
+        {
+            if(types[i] == types[j])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Decoding and encoding of a set of message types, dispatched on the type number at the start of each frame
+template <typename... Messages>
+class MessageCodec
+{
+    static_assert(sizeof...(Messages) > 0, "A codec needs at least one message type");
+    static_assert(messageTypesDistinct<Messages...>(), "Every message type of a codec needs its own type number");
+
+public:
+    // Function to decode a frame into its message type and call visitor(const Message&) -> void with it
+    template <typename Visitor>
+    static CodecResult decode(std::string_view frame, Visitor&& visitor)
+    {
+        if(frame.size() < CODEC_TYPE_SIZE)
+        {
+            return CodecResult::TOO_SHORT;
+        }
+
+        uint16_t type = loadBigEndian<uint16_t>(frame.data());
+        std::string_view fields = frame.substr(CODEC_TYPE_SIZE);
+        CodecResult result = CodecResult::UNKNOWN_TYPE;
+        // Compared one type after the other, the compiler turns the chain into a jump table where it pays off
+        (void)((type == MessageSchema<Messages>::type && (result = decodeAs<Messages>(fields, visitor), true)) || ...);
+        return result;
+    }
+
+    // Function to decode a frame as one known message type, without the type number; false if it is too short
+    template <typename T>
+    static bool decodeFields(std::string_view fields, T& message)
+    {
+        if(fields.size() < MessageLayout<T>::fixedSize)
+        {
+            return false;
+        }
+        loadFields(fields.data(), fields.size(), message, std::make_index_sequence<MessageLayout<T>::fieldCount>());
+        return true;
+    }
+
+    // Function to get the encoded size of a message including its type number
+    template <typename T>
+    static size_t encodedSize(const T& message)
+    {
+        static_assert((std::is_same_v<T, Messages> || ...), "The message type is not part of this codec");
+        return CODEC_TYPE_SIZE + MessageLayout<T>::fixedSize + variableSize(message, std::make_index_sequence<MessageLayout<T>::fieldCount>());
+    }
+
+    // Function to encode a message with its type number into output, which must hold encodedSize(message) bytes.
+    // Returns the number of bytes written
+    template <typename T>
+    static size_t encode(const T& message, char* output)
+    {
+        static_assert((std::is_same_v<T, Messages> || ...), "The message type is not part of this codec");
+        storeBigEndian<uint16_t>(output, MessageSchema<T>::type);
+        storeFields(output + CODEC_TYPE_SIZE, message, std::make_index_sequence<MessageLayout<T>::fieldCount>());
+        return encodedSize(message);
+    }
+
+    // Function to build a message handler for Server::setMessageHandler decoding every frame and calling
+    // visitor(ClientId, const Message&) -> void; frames that do not decode go to onError(ClientId, CodecResult) -> void
+    template <typename Visitor, typename ErrorHandler>
+    static std::function<void(ClientId, std::string_view)> handler(Visitor visitor, ErrorHandler onError)
+    {
+        return [visitor, onError](ClientId client, std::string_view frame) mutable
+        {
+            CodecResult result = decode(frame, [&visitor, client](const auto& message) { visitor(client, message); });
+            if(result != CodecResult::OK)
+            {
+                onError(client, result);
+            }
+        };
+    }
+
+    // Function to build a message handler that logs and drops frames which do not decode
+    template <typename Visitor>
+    static std::function<void(ClientId, std::string_view)> handler(Visitor visitor)
+    {
+        return handler(std::move(visitor), [](ClientId client, CodecResult result)
+        {
+            LOG_WARNING << "Message from Client " << client.socket << " is dropped, "
+                        << (result == CodecResult::TOO_SHORT ? "it is too short." : "its type is unknown.");
+        });
+    }
+
+private:
+    // Function to decode the fields of a frame of type T and visit the message
+    template <typename T, typename Visitor>
+    static CodecResult decodeAs(std::string_view fields, Visitor& visitor)
+    {
+        T message;
+        if(!decodeFields(fields, message))
+        {
+            return CodecResult::TOO_SHORT;
+        }
+        visitor(static_cast<const T&>(message));
+        return CodecResult::OK;
+    }
+
+    // Function to load every field from its compile-time offset
+    template <typename T, size_t... I>
+    static void loadFields(const char* data, size_t size, T& message, std::index_sequence<I...>)
+    {
+        (WireField<SchemaFieldType<T, I>>::load(data + fieldOffset<T, I>(), size - fieldOffset<T, I>(), message.*std::get<I>(MessageSchema<T>::fields)), ...);
+    }
+
+    // Function to store every field at its compile-time offset
+    template <typename T, size_t... I>
+    static void storeFields(char* data, const T& message, std::index_sequence<I...>)
+    {
+        (WireField<SchemaFieldType<T, I>>::store(data + fieldOffset<T, I>(), message.*std::get<I>(MessageSchema<T>::fields)), ...);
+    }
+
+    // Function to get the bytes of the trailing field beyond the fixed size, 0 without one
+    template <typename T, size_t... I>
+    static size_t variableSize(const T& message, std::index_sequence<I...>)
+    {
+        return ((WireField<SchemaFieldType<T, I>>::variable ?
+                 WireField<SchemaFieldType<T, I>>::encodedSize(message.*std::get<I>(MessageSchema<T>::fields)) : 0) + ... + 0);
+    }
+};
+
+#endif
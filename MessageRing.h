@@ -0,0 +1,121 @@
+#ifndef MESSAGE_RING_H
+#define MESSAGE_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#define CACHE_LINE_SIZE 64 // Size of a cache line, used to keep producer and consumer indices apart
+
+// Bounded lock-free multi-producer/single-consumer ring buffer.
+// Every slot carries a sequence number telling producers and the consumer whose turn it is, so
+// producers only contend on a compare-and-swap of the tail and the consumer never writes shared indices.
+template <typename T>
+class MessageRing
+{
+public:
+    // Capacity is rounded up to the next power of two
+    explicit MessageRing(size_t minimumCapacity) : mask(roundUpToPowerOfTwo(minimumCapacity) - 1), slots(new Slot[mask + 1])
+    {
+        for(size_t i = 0; i <= mask; ++i)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MessageRing(const MessageRing&) = delete;
+    MessageRing& operator=(const MessageRing&) = delete;
+
+    // Function to append an item, returns false without touching the item if the ring is full; safe from any thread
+    bool tryPush(T& item)
+    {
+        size_t position = tail.value.load(std::memory_order_relaxed);
+        while(true)
+        {
+            Slot& slot = slots[position & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if(difference == 0)
+            {
+                // Slot is free for this position, claim it
+                if(tail.value.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.value = std::move(item);
+                    slot.sequence.store(position + 1, std::memory_order_release); // Publish the item to the consumer
+                    return true;
+                }
+            }
+            else if(difference < 0)
+            {
+                return false; // The consumer has not freed this slot yet, the ring is full
+            }
+            else
+            {
+                position = tail.value.load(std::memory_order_relaxed); // Another producer claimed it, retry
+            }
+        }
+    }
+
+    // Function to remove the oldest item, returns false if the ring is empty; consumer thread only
+    bool tryPop(T& item)
+    {
+        Slot& slot = slots[head.value & mask];
+        size_t sequence = slot.sequence.load(std::memory_order_acquire);
+        if(sequence != head.value + 1)
+        {
+            return false; // Nothing published at the head yet
+        }
+
+        item = std::move(slot.value);
+        slot.sequence.store(head.value + mask + 1, std::memory_order_release); // Free the slot for the next lap
+        ++head.value;
+        return true;
+    }
+
+    // Function to check whether the ring looks empty, exact only on the consumer thread
+    bool empty() const
+    {
+        return slots[head.value & mask].sequence.load(std::memory_order_acquire) != head.value + 1;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> sequence; // Position + 1 once filled, position + capacity once consumed
+        T value; // Stored item
+    };
+
+    struct alignas(CACHE_LINE_SIZE) ProducerIndex
+    {
+        std::atomic<size_t> value{0}; // Next position to be claimed by a producer
+    };
+
+    struct alignas(CACHE_LINE_SIZE) ConsumerIndex
+    {
+        size_t value = 0; // Next position to be read by the consumer
+    };
+
+    const size_t mask; // Capacity - 1
+    std::unique_ptr<Slot[]> slots; // Storage of the ring
+    ProducerIndex tail; // Written by producers only
+    ConsumerIndex head; // Written by the consumer only
+
+    static size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t capacity = 2;
+        while(capacity < value)
+        {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+};
+
+#endif
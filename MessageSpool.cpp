@@ -0,0 +1,684 @@
+#include "MessageSpool.h" // Including the header file to define the MessageSpool class
+#include "Server.h" // Including the Server class for its error type
+#include "Metrics.h" // Including the monotonic clock for the messages of an earlier server
+#include <algorithm> // This header file is included for std::max
+#include <cerrno> // This header file is included to tell an existing spool directory from a failure
+#include <cinttypes> // This header file is included to format and parse the hexadecimal offsets in segment names
+#include <cstdio> // This header file is included for snprintf and sscanf
+#include <cstring> // This header file is included to use memcpy
+#include <dirent.h> // This header file is included to find the segments of an earlier server
+#include <fcntl.h> // This header file is included to open, preallocate and zero the segment files
+#include <unistd.h> // This header file is included for POSIX operating system API, such as pwrite, fdatasync and usleep
+#include <sys/mman.h> // This header file is included to map the segments and sync them
+#include <sys/stat.h> // This header file is included to create the spool directory and size the segments
+
+#define STATIC
+#define SPOOL_SEGMENT_SUFFIX ".spool" // Segment files are named by their base offset in hexadecimal and this suffix
+#define SPOOL_OFFSET_FILE "consumer.offset" // File storing the offset up to which every message is handled
+
+// Consumer offset as stored in its file, the complement tells a torn write from a valid offset
+struct SpoolConsumerOffset
+{
+    uint64_t offset;
+    uint64_t complement;
+};
+
+// Function to round a record size up to the alignment of the records
+static size_t alignRecord(size_t size)
+{
+    return (size + SPOOL_RECORD_ALIGNMENT - 1) & ~(size_t)(SPOOL_RECORD_ALIGNMENT - 1);
+}
+
+// Function to round a size up to whole pages
+static size_t alignPage(size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+// Function to compute the checksum of a record, with the checksum field of the header 0. FNV-1a over 64-bit
+// words: it only has to catch records torn by a crash, and must not slow down the appends
+static uint32_t recordChecksum(const SpoolRecordHeader& header, const char* payload, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    uint64_t words[sizeof(SpoolRecordHeader) / sizeof(uint64_t)];
+    memcpy(words, &header, sizeof(words));
+    for(uint64_t word : words)
+    {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        uint64_t word;
+        memcpy(&word, payload + i, sizeof(word));
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    uint64_t last = 0;
+    memcpy(&last, payload + i, size - i);
+    hash = (hash ^ last ^ size) * 1099511628211ull;
+    return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// Constructor for the MessageSpool class, opening the spool of the configured directory and recovering the
+// messages an earlier server did not handle. Throws TCPServerError if the directory cannot be used
+MessageSpool::MessageSpool(const ServerConfig& config)
+    : directory(config.spoolDirectory), segmentSize(alignPage(config.spoolSegmentSize)), maxBytes(config.spoolMaxBytes),
+      commitIntervalUs(config.spoolCommitIntervalUs), offsetFd(-1), directoryFd(-1), tail(NULL), recoveredEnd(0),
+      readOffset(0), handedCount(0), handledCount(0), storedHandled(0), started(false)
+{
+    for(auto& slot : inFlight)
+    {
+        slot.store(0, std::memory_order_relaxed);
+    }
+
+    if(mkdir(directory.c_str(), 0755) == -1 && errno != EEXIST)
+    {
+        throw TCPServerError("Spool directory could not be created."); // Throw an error if the directory cannot be created
+    }
+    if((directoryFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    {
+        throw TCPServerError("Spool directory could not be opened."); // Throw an error if the path is no directory
+    }
+    if((offsetFd = open((directory + "/" SPOOL_OFFSET_FILE).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1)
+    {
+        close(directoryFd);
+        throw TCPServerError("Spool consumer offset could not be opened."); // Throw an error if the directory is not writable
+    }
+
+    try
+    {
+        recover();
+    }
+    catch(const TCPServerError&)
+    {
+        for(auto& segment : segments)
+        {
+            closeSegment(segment.second, false);
+        }
+        close(offsetFd);
+        close(directoryFd);
+        throw; // Re-throw the exception
+    }
+}
+
+// Destructor for the MessageSpool class, the segments stay on disk for the next server
+MessageSpool::~MessageSpool()
+{
+    stop();
+    for(auto& segment : segments)
+    {
+        closeSegment(segment.second, false);
+    }
+    close(offsetFd);
+    close(directoryFd);
+}
+
+// Function to append a received message to the log, safe from any thread. The message is handed to the workers
+// once it is durable. Returns false if the spool is full, or a segment could not be created
+bool MessageSpool::append(ClientId client, std::string_view payload, uint64_t appendedAt)
+{
+    size_t recordSize = alignRecord(sizeof(SpoolRecordHeader) + payload.size());
+    std::lock_guard<std::mutex> lock(appendLock);
+    uint64_t offset = appended.load(std::memory_order_relaxed);
+    if(offset + recordSize - handled.load(std::memory_order_acquire) > maxBytes &&
+       offset + recordSize - advanceHandled() > maxBytes)
+    {
+        return false;
+    }
+
+    if(tail == NULL || offset + recordSize > tail->base + tail->size)
+    {
+        uint64_t base = offset;
+        if(tail != NULL)
+        {
+            base = tail->base + tail->size;
+            if(offset < base)
+            {
+                uint32_t end = SPOOL_SEGMENT_END; // There are always 8 bytes left, records are aligned to them
+                memcpy(tail->data + (offset - tail->base), &end, sizeof(end));
+            }
+        }
+        SpoolSegment* next = openSegment(segmentPath(base), base, std::max(segmentSize, alignPage(recordSize)), true);
+        if(next == NULL)
+        {
+            return false; // The end marker is written again by the next attempt
+        }
+        tail = next;
+        offset = base;
+    }
+
+    SpoolRecordHeader header;
+    header.length = (uint32_t)payload.size();
+    header.checksum = 0;
+    header.socket = client.socket;
+    header.generation = client.generation;
+    header.appendedAt = appendedAt;
+    header.checksum = recordChecksum(header, payload.data(), payload.size());
+
+    char* record = tail->data + (offset - tail->base);
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), payload.data(), payload.size());
+    appended.store(offset + recordSize, std::memory_order_release);
+    appendNotifier.notify(); // Only a system call if the committer is idle
+    return true;
+}
+
+// Function to start handing the durable messages to the workers through delivery, the recovered ones first
+void MessageSpool::start(SpoolDelivery delivery)
+{
+    deliver = std::move(delivery);
+    if(pthread_create(&committerThread, NULL, runCommitterWrapper, (void *)this) != 0)
+    {
+        throw TCPServerError("Spool committer thread could not be created."); // Throw an error if thread creation fails
+    }
+    if(pthread_create(&readerThread, NULL, runReaderWrapper, (void *)this) != 0)
+    {
+        stopping.store(true);
+        appendNotifier.notify();
+        pthread_join(committerThread, NULL);
+        throw TCPServerError("Spool reader thread could not be created."); // Throw an error if thread creation fails
+    }
+    started = true;
+}
+
+// Function to check whether every appended message is handled, e.g. while the server drains
+bool MessageSpool::settled()
+{
+    return advanceHandled() == appended.load(std::memory_order_acquire);
+}
+
+// Function to stop handing messages to the workers. Everything appended is synced and the handled offset is
+// stored, messages not handled by now are handed to the workers of the next server
+void MessageSpool::stop()
+{
+    if(!started)
+    {
+        return;
+    }
+    started = false;
+    stopping.store(true);
+    commitNotifier.notify();
+    appendNotifier.notify();
+    pthread_join(readerThread, NULL);
+    pthread_join(committerThread, NULL);
+}
+
+// Function to get the bytes of the log that are not handled yet
+uint64_t MessageSpool::pendingBytes() const
+{
+    return appended.load(std::memory_order_relaxed) - handled.load(std::memory_order_relaxed);
+}
+
+// Function to read the consumer offset and map the segments behind it, appending goes on past the last valid record
+void MessageSpool::recover()
+{
+    SpoolConsumerOffset stored;
+    uint64_t consumerOffset = 0;
+    ssize_t length = pread(offsetFd, &stored, sizeof(stored), 0);
+    if(length == (ssize_t)sizeof(stored) && stored.complement == ~stored.offset)
+    {
+        consumerOffset = stored.offset;
+    }
+    else if(length != 0)
+    {
+        LOG_WARNING << "Spool consumer offset is damaged, every message in the spool is handled again.";
+    }
+
+    uint64_t end = recoverSegments(consumerOffset);
+    readOffset = segments.empty() ? end : std::max(consumerOffset, segments.begin()->first);
+    handled.store(readOffset);
+    storedHandled = consumerOffset;
+    appended.store(end);
+    durable.store(end);
+    recoveredEnd = end;
+    tail = segments.empty() ? NULL : &segments.rbegin()->second;
+    if(end > readOffset)
+    {
+        LOG_INFO << "Spool holds " << end - readOffset << " bytes of messages that were not handled, they are handled again.";
+    }
+}
+
+// Function to map the segments of an earlier server that are not handled completely, deleting the others, and
+// to find the end of the log: the first record that is not complete. Returns the log offset past the last record
+uint64_t MessageSpool::recoverSegments(uint64_t consumerOffset)
+{
+    DIR* listing = opendir(directory.c_str());
+    if(listing == NULL)
+    {
+        throw TCPServerError("Spool directory could not be read."); // Throw an error if the directory cannot be listed
+    }
+    std::map<uint64_t, std::string> found;
+    while(struct dirent* entry = readdir(listing))
+    {
+        uint64_t base;
+        char suffix[16];
+        if(sscanf(entry->d_name, "%16" SCNx64 "%15s", &base, suffix) == 2 && strcmp(suffix, SPOOL_SEGMENT_SUFFIX) == 0)
+        {
+            found[base] = directory + "/" + entry->d_name;
+        }
+    }
+    closedir(listing);
+
+    for(auto& file : found)
+    {
+        struct stat status;
+        if(stat(file.second.c_str(), &status) == -1 || (uint64_t)status.st_size < sizeof(SpoolRecordHeader) ||
+           file.first + status.st_size <= consumerOffset)
+        {
+            unlink(file.second.c_str()); // Every message in it is handled
+        }
+        else if(openSegment(file.second, file.first, status.st_size, false) == NULL)
+        {
+            throw TCPServerError("Spool segment could not be mapped."); // Throw an error, its messages would be lost
+        }
+    }
+    if(segments.empty())
+    {
+        return consumerOffset;
+    }
+
+    // Walk the records from the consumer offset; a crash may have torn the records after the last commit
+    uint64_t end = std::max(consumerOffset, segments.begin()->first);
+    auto current = std::prev(segments.upper_bound(end));
+    while(true)
+    {
+        SpoolSegment& segment = current->second;
+        size_t position = end - segment.base;
+        bool nextSegment = false;
+        while(position < segment.size)
+        {
+            SpoolRecordHeader header;
+            memcpy(&header.length, segment.data + position, sizeof(header.length));
+            if(header.length == SPOOL_SEGMENT_END)
+            {
+                nextSegment = true;
+                break;
+            }
+            if(segment.size - position < sizeof(header) || header.length > segment.size - position - sizeof(header))
+            {
+                break;
+            }
+            memcpy(&header, segment.data + position, sizeof(header));
+            uint32_t checksum = header.checksum;
+            header.checksum = 0;
+            if(checksum != recordChecksum(header, segment.data + position + sizeof(header), header.length))
+            {
+                break;
+            }
+            position += alignRecord(sizeof(header) + header.length);
+            end = segment.base + position;
+        }
+        if(position == segment.size)
+        {
+            nextSegment = true; // Filled exactly by its records, no end marker was written
+        }
+
+        auto following = segments.find(segment.base + segment.size);
+        if(!nextSegment || following == segments.end())
+        {
+            break;
+        }
+        end = following->first;
+        current = following;
+    }
+
+    // Segments past the end only hold torn records, the rest of the last one is zeroed, so no stale record
+    // is found behind the next appends after another crash
+    while(segments.rbegin()->first > end)
+    {
+        closeSegment(segments.rbegin()->second, true);
+        segments.erase(std::prev(segments.end()));
+    }
+    SpoolSegment& last = segments.rbegin()->second;
+    size_t position = end - last.base;
+    if(position < last.size)
+    {
+        size_t pageEnd = std::min(alignPage(position), last.size);
+        memset(last.data + position, 0, pageEnd - position);
+        if(pageEnd < last.size && fallocate(last.fd, FALLOC_FL_ZERO_RANGE, pageEnd, last.size - pageEnd) == -1)
+        {
+            memset(last.data + pageEnd, 0, last.size - pageEnd); // The file system cannot zero a range, write the zeros
+        }
+        msync(last.data, last.size, MS_SYNC);
+    }
+    return end;
+}
+
+// Function to map a segment file, creating and preallocating it if create is set, so a full disk fails here and
+// not on a store into the mapping. Returns NULL if it cannot be mapped
+SpoolSegment* MessageSpool::openSegment(const std::string& path, uint64_t base, size_t size, bool create)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if(fd == -1)
+    {
+        LOG_ERROR << "Spool segment " << path << " could not be opened.";
+        return NULL;
+    }
+    if(create && posix_fallocate(fd, 0, size) != 0)
+    {
+        LOG_ERROR << "Spool segment " << path << " could not be allocated, the disk may be full.";
+        close(fd);
+        unlink(path.c_str());
+        return NULL;
+    }
+    void* data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+    {
+        LOG_ERROR << "Spool segment " << path << " could not be mapped.";
+        close(fd);
+        if(create)
+        {
+            unlink(path.c_str());
+        }
+        return NULL;
+    }
+    if(create)
+    {
+        fsync(directoryFd); // The new file survives a crash along with the records synced into it
+    }
+
+    std::lock_guard<std::mutex> lock(segmentLock);
+    SpoolSegment& segment = segments[base];
+    segment.base = base;
+    segment.size = size;
+    segment.data = static_cast<char*>(data);
+    segment.fd = fd;
+    segment.path = path;
+    return &segment;
+}
+
+// Function to unmap a segment, deleting its file if every message in it is handled
+void MessageSpool::closeSegment(SpoolSegment& segment, bool remove)
+{
+    munmap(segment.data, segment.size);
+    close(segment.fd);
+    if(remove)
+    {
+        unlink(segment.path.c_str());
+    }
+}
+
+// Function to find the segment holding a log offset, an empty segment if there is none
+SpoolSegment MessageSpool::segmentAt(uint64_t offset)
+{
+    std::lock_guard<std::mutex> lock(segmentLock);
+    auto it = segments.upper_bound(offset);
+    if(it == segments.begin() || offset >= std::prev(it)->first + std::prev(it)->second.size)
+    {
+        return SpoolSegment();
+    }
+    return std::prev(it)->second;
+}
+
+// Function to get the path of the segment starting at a log offset
+std::string MessageSpool::segmentPath(uint64_t base) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 SPOOL_SEGMENT_SUFFIX, base);
+    return directory + "/" + name;
+}
+
+// Function to sync the records appended since the last commit, all of them at once, and let the reader hand them on.
+// Returns false if a segment could not be synced, the records from there on stay undurable until a later commit
+bool MessageSpool::commit()
+{
+    uint64_t end = appended.load(std::memory_order_acquire);
+    uint64_t start = durable.load(std::memory_order_relaxed);
+    if(end == start)
+    {
+        return true;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    uint64_t synced = start;
+    while(synced < end)
+    {
+        // Segments are only removed once handled, so the ones not synced yet stay mapped
+        SpoolSegment segment = segmentAt(synced);
+        if(segment.data == NULL)
+        {
+            break;
+        }
+        size_t from = (synced - segment.base) / page * page;
+        size_t to = std::min(end - segment.base, (uint64_t)segment.size);
+        if(msync(segment.data + from, to - from, MS_SYNC) == -1)
+        {
+            if(!syncFailing)
+            {
+                LOG_ERROR << "Spool segment " << segment.path << " could not be synced, retrying.";
+                syncFailing = true;
+            }
+            break;
+        }
+        synced = std::min(segment.base + segment.size, end);
+    }
+
+    if(synced != start)
+    {
+        durable.store(synced, std::memory_order_release);
+        commitNotifier.notify();
+    }
+    if(synced != end)
+    {
+        return false;
+    }
+    if(syncFailing)
+    {
+        LOG_INFO << "Spool segments are synced again.";
+        syncFailing = false;
+    }
+    return true;
+}
+
+// Function to store the offset up to which every message is handled, a restarted server continues from there
+void MessageSpool::storeConsumerOffset()
+{
+    uint64_t offset = advanceHandled();
+    if(offset == storedHandled)
+    {
+        return;
+    }
+
+    SpoolConsumerOffset stored;
+    stored.offset = offset;
+    stored.complement = ~offset;
+    if(pwrite(offsetFd, &stored, sizeof(stored), 0) != (ssize_t)sizeof(stored) || fdatasync(offsetFd) == -1)
+    {
+        LOG_WARNING << "Spool consumer offset could not be stored, handled messages may be handled again after a restart.";
+        return;
+    }
+    storedHandled = offset;
+}
+
+// Function to delete the segments whose messages are all handled and stored as such; the tail stays for the appends
+void MessageSpool::removeHandledSegments()
+{
+    std::lock_guard<std::mutex> lock(segmentLock);
+    while(segments.size() > 1 && segments.begin()->first + segments.begin()->second.size <= storedHandled)
+    {
+        closeSegment(segments.begin()->second, true);
+        segments.erase(segments.begin());
+    }
+}
+
+// Function to move the handled offset past the messages the workers are done with, in log order.
+// Returns the offset up to which every message is handled
+uint64_t MessageSpool::advanceHandled()
+{
+    std::lock_guard<std::mutex> lock(progressLock);
+    while(handledCount < handedCount && inFlight[handledCount % SPOOL_IN_FLIGHT].load(std::memory_order_acquire) == 0)
+    {
+        handled.store(inFlightEnds[handledCount % SPOOL_IN_FLIGHT], std::memory_order_release);
+        ++handledCount;
+    }
+    return handled.load(std::memory_order_relaxed);
+}
+
+// Function to read the record at the reader's offset into a message, moving the offset past it.
+// Returns false at the end of a segment, the reader then goes on in the next one
+bool MessageSpool::readRecord(Message& message, uint64_t& next)
+{
+    if(reading.data == NULL || readOffset >= reading.base + reading.size)
+    {
+        reading = segmentAt(readOffset);
+        if(reading.data == NULL)
+        {
+            LOG_ERROR << "Spool segment of offset " << readOffset << " is missing.";
+            return false;
+        }
+    }
+
+    const char* record = reading.data + (readOffset - reading.base);
+    uint32_t length;
+    memcpy(&length, record, sizeof(length));
+    if(length == SPOOL_SEGMENT_END)
+    {
+        readOffset = reading.base + reading.size;
+        return false;
+    }
+
+    SpoolRecordHeader header;
+    memcpy(&header, record, sizeof(header));
+    PooledBuffer payload(header.length);
+    memcpy(payload.data(), record + sizeof(header), header.length);
+    payload.setSize(header.length);
+    const char* data = payload.data();
+    message = Message(ClientId(), BufferSlice(std::move(payload), data, header.length));
+    if(readOffset >= recoveredEnd)
+    {
+        message.client.socket = header.socket;
+        message.client.generation = header.generation;
+        message.queuedAt = header.appendedAt;
+    }
+    else
+    {
+        message.queuedAt = Metrics::nowNs(); // Clients and clock of an earlier server, replies cannot reach anyone
+    }
+    next = readOffset + alignRecord(sizeof(header) + header.length);
+    readOffset = next;
+    return true;
+}
+
+// Function run by the committer thread: syncs the appends in groups and stores the handled offset with each
+STATIC void* MessageSpool::runCommitterWrapper(void* arg)
+{
+    return static_cast<MessageSpool*>(arg)->runCommitter();
+}
+
+void* MessageSpool::runCommitter()
+{
+    while(true)
+    {
+        if(appended.load(std::memory_order_acquire) == durable.load(std::memory_order_relaxed))
+        {
+            storeConsumerOffset();
+            removeHandledSegments();
+            if(stopping.load())
+            {
+                break;
+            }
+            if(storedHandled != durable.load(std::memory_order_relaxed))
+            {
+                usleep(SPOOL_PROGRESS_INTERVAL_US); // The workers are still at it, a crash replays less the more often it is stored
+                continue;
+            }
+
+            appendNotifier.prepareWait();
+            if(appended.load(std::memory_order_acquire) != durable.load(std::memory_order_relaxed) || stopping.load())
+            {
+                appendNotifier.cancelWait();
+                continue;
+            }
+            appendNotifier.wait();
+            continue;
+        }
+
+        bool committed = commit(); // Appends meanwhile go into the next group
+        storeConsumerOffset();
+        removeHandledSegments();
+        if(!committed)
+        {
+            if(stopping.load())
+            {
+                LOG_ERROR << "Spool stopped with unsynced records, a restart recovers only those written back by then.";
+                break;
+            }
+            usleep(SPOOL_SYNC_RETRY_US);
+        }
+        else if(commitIntervalUs > 0 && !stopping.load())
+        {
+            usleep(commitIntervalUs);
+        }
+    }
+    return NULL;
+}
+
+// Function run by the reader thread: hands every durable record to the workers in log order, keeping at most
+// SPOOL_IN_FLIGHT of them unhandled
+STATIC void* MessageSpool::runReaderWrapper(void* arg)
+{
+    return static_cast<MessageSpool*>(arg)->runReader();
+}
+
+void* MessageSpool::runReader()
+{
+    while(!stopping.load())
+    {
+        if(readOffset >= durable.load(std::memory_order_acquire))
+        {
+            commitNotifier.prepareWait();
+            if(readOffset < durable.load(std::memory_order_acquire) || stopping.load())
+            {
+                commitNotifier.cancelWait();
+                continue;
+            }
+            commitNotifier.wait();
+            continue;
+        }
+
+        Message message;
+        uint64_t next;
+        if(!readRecord(message, next))
+        {
+            continue;
+        }
+
+        // The slot is cleared by the worker once the message is handled, like the queued count of a client
+        for(;;)
+        {
+            advanceHandled();
+            {
+                std::lock_guard<std::mutex> lock(progressLock);
+                if(handedCount - handledCount < SPOOL_IN_FLIGHT)
+                {
+                    break;
+                }
+            }
+            if(stopping.load())
+            {
+                return NULL;
+            }
+            usleep(SPOOL_RETRY_US);
+        }
+        std::atomic<uint32_t>& slot = inFlight[handedCount % SPOOL_IN_FLIGHT];
+        {
+            std::lock_guard<std::mutex> lock(progressLock);
+            inFlightEnds[handedCount % SPOOL_IN_FLIGHT] = next;
+        }
+        slot.store(1, std::memory_order_relaxed);
+        message.queuedCount = &slot;
+        while(!deliver(message))
+        {
+            if(stopping.load())
+            {
+                return NULL; // Not handed on, the next server handles it
+            }
+            usleep(SPOOL_RETRY_US);
+        }
+        std::lock_guard<std::mutex> lock(progressLock);
+        ++handedCount;
+    }
+    return NULL;
+}
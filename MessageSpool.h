@@ -0,0 +1,120 @@
+#ifndef MESSAGE_SPOOL_H
+#define MESSAGE_SPOOL_H
+
+#include "ServerConfig.h"
+#include "EventNotifier.h"
+#include "Message.h"
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#define SPOOL_RECORD_ALIGNMENT 8 // Records start at multiples of this, so their headers are read in place
+#define SPOOL_SEGMENT_END 0xffffffffu // Record length marking the unused end of a segment, the next record is in the next one
+#define SPOOL_IN_FLIGHT 4096 // Spooled messages handed to the workers and not handled yet, the reader waits beyond
+#define SPOOL_RETRY_US 100 // Step the reader polls full worker queues and a full in-flight window in
+#define SPOOL_PROGRESS_INTERVAL_US 10000 // Step the committer stores the handled offset in while no messages arrive
+#define SPOOL_SYNC_RETRY_US 100000 // Wait of the committer before it syncs again after a failed sync
+
+// Hands a message read from the spool to the workers, returns false if they have no room for it right now
+typedef std::function<bool(Message& message)> SpoolDelivery;
+
+// Header of every record in a segment; the checksum covers the header and the payload that follows
+struct SpoolRecordHeader
+{
+    uint32_t length; // Payload bytes, SPOOL_SEGMENT_END past the last record of a segment
+    uint32_t checksum; // Computed with this field 0
+    int32_t socket; // Client the message came from
+    uint32_t generation;
+    uint64_t appendedAt; // Monotonic time in nanoseconds the message was appended
+};
+
+// One file of the log, mapped as a whole
+struct SpoolSegment
+{
+    uint64_t base = 0; // Log offset of the first byte
+    size_t size = 0; // Bytes of the file and its mapping
+    char* data = NULL; // Mapping of the file, NULL for no segment
+    int fd = -1; // Descriptor of the file
+    std::string path; // Path of the file, removed once every message in it is handled
+};
+
+// Durable queue of received messages: a segmented append-only log of memory-mapped files. Appending is a copy
+// into the mapping; a committer thread syncs what was appended since its last sync at once (group commit),
+// and a reader thread hands every synced record, in log order, to the workers. Records are addressed by their
+// log offset, and the offset up to which every message was handled is stored with each commit, so a restarted
+// server hands the messages that were not handled to the workers again; segments behind it are deleted.
+// Memory holds at most the in-flight window, the unhandled rest waits in the page cache and on disk
+class MessageSpool
+{
+public:
+    explicit MessageSpool(const ServerConfig& config);
+    ~MessageSpool();
+    MessageSpool(const MessageSpool&) = delete;
+    MessageSpool& operator=(const MessageSpool&) = delete;
+
+    bool append(ClientId client, std::string_view payload, uint64_t appendedAt);
+    void start(SpoolDelivery delivery);
+    bool settled();
+    void stop();
+    uint64_t pendingBytes() const;
+
+private:
+    std::string directory; // Directory of the segments and the consumer offset
+    size_t segmentSize; // Size of new segments
+    size_t maxBytes; // Appended bytes not handled yet above which append fails
+    unsigned commitIntervalUs; // Shortest time between two commits
+    int offsetFd; // File storing the consumer offset
+    int directoryFd; // Directory, synced after a segment is created
+    SpoolDelivery deliver; // Hands the records to the workers
+
+    std::mutex segmentLock; // Guards segments; append only takes it when it starts a new segment
+    std::map<uint64_t, SpoolSegment> segments; // Mapped segments by base offset, the last one is appended to
+    std::mutex appendLock; // Serialises the appends
+    SpoolSegment* tail; // Segment appended to, NULL after a failure to create one
+    std::atomic<uint64_t> appended{0}; // Log offset past the last appended record
+    std::atomic<uint64_t> durable{0}; // Log offset up to which the records are synced
+    uint64_t recoveredEnd; // Records before this were appended by an earlier server, their clients are gone
+
+    uint64_t readOffset; // Next record the reader hands to the workers, reader thread only
+    SpoolSegment reading; // Copy of the segment holding readOffset, reader thread only; it may be removed once
+                          // the reader is past it, so only the copy is looked at then
+    std::mutex progressLock; // Guards inFlightEnds, handedCount and handledCount
+    std::atomic<uint32_t> inFlight[SPOOL_IN_FLIGHT]; // 1 while the message handed in this slot is not handled
+    uint64_t inFlightEnds[SPOOL_IN_FLIGHT]; // Log offset past the record handed in each slot
+    uint64_t handedCount; // Messages handed to the workers
+    uint64_t handledCount; // Messages handed and handled in order, the slots of the others are still in flight
+    std::atomic<uint64_t> handled{0}; // Log offset up to which every message is handled
+    uint64_t storedHandled; // Consumer offset in the offset file, committer thread only
+    bool syncFailing = false; // The last commit could not sync a segment, committer thread only
+
+    EventNotifier appendNotifier; // Wakes the committer when a record is appended
+    EventNotifier commitNotifier; // Wakes the reader when records became durable
+    pthread_t committerThread;
+    pthread_t readerThread;
+    bool started; // Whether the threads were started and have to be joined
+    std::atomic<bool> stopping{false}; // Set to stop the threads, the committer commits once more before it returns
+
+    void recover();
+    uint64_t recoverSegments(uint64_t consumerOffset);
+    SpoolSegment* openSegment(const std::string& path, uint64_t base, size_t size, bool create);
+    void closeSegment(SpoolSegment& segment, bool remove);
+    SpoolSegment segmentAt(uint64_t offset);
+    std::string segmentPath(uint64_t base) const;
+    bool commit();
+    void storeConsumerOffset();
+    void removeHandledSegments();
+    uint64_t advanceHandled();
+    bool readRecord(Message& message, uint64_t& next);
+    void* runCommitter();
+    void* runReader();
+    static void* runCommitterWrapper(void* arg);
+    static void* runReaderWrapper(void* arg);
+};
+
+#endif
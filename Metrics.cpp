@@ -0,0 +1,222 @@
+#include "Metrics.h" // Including the header file to define the metrics classes
+#include <cstdio> // This header file is included to format the metrics report
+#include <ctime> // This header file is included to read the monotonic clock
+#include <mutex> // This header file is included to guard the list of shards
+
+#define STATIC
+
+static std::mutex shardsLock; // Guards the list of shards, only taken when a thread first records and by readers
+static MetricsShard* shards = NULL; // Shards of every thread that recorded
+static MetricsShard exitedTotals; // Metrics of threads that have exited, guarded by shardsLock
+
+// Holder of the calling thread's shard, retires it when the thread exits
+struct MetricsShardHolder
+{
+    MetricsShard* shard = NULL;
+    ~MetricsShardHolder()
+    {
+        if(shard != NULL)
+        {
+            shard->retired.store(true, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local MetricsShardHolder metricsShardHolder;
+
+// Function to get the bucket a value is counted in: values below LATENCY_SUB_BUCKETS get their own bucket,
+// larger ones are bucketed by their highest bit and the LATENCY_SUB_BUCKET_BITS bits below it
+STATIC size_t LatencyHistogram::bucketOf(uint64_t value)
+{
+    if(value < LATENCY_SUB_BUCKETS)
+    {
+        return value;
+    }
+    int shift = 63 - __builtin_clzll(value) - LATENCY_SUB_BUCKET_BITS;
+    return ((size_t)(shift + 1) << LATENCY_SUB_BUCKET_BITS) + ((value >> shift) & (LATENCY_SUB_BUCKETS - 1));
+}
+
+// Function to get the largest value counted in a bucket
+STATIC uint64_t LatencyHistogram::bucketLimit(size_t bucket)
+{
+    if(bucket < LATENCY_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    int shift = (int)(bucket >> LATENCY_SUB_BUCKET_BITS) - 1;
+    uint64_t lowest = (uint64_t)(LATENCY_SUB_BUCKETS + (bucket & (LATENCY_SUB_BUCKETS - 1))) << shift;
+    return lowest + ((uint64_t)1 << shift) - 1;
+}
+
+// Function to get the value below which the given fraction of the recorded values lie, 0 if nothing was recorded
+uint64_t HistogramSnapshot::percentile(double fraction) const
+{
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(fraction * count);
+    if(rank == 0)
+    {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for(size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+    {
+        seen += buckets[i];
+        if(seen >= rank)
+        {
+            return LatencyHistogram::bucketLimit(i);
+        }
+    }
+    return max();
+}
+
+// Function to get the largest recorded value, within the bucket precision
+uint64_t HistogramSnapshot::max() const
+{
+    for(size_t i = LATENCY_BUCKET_COUNT; i > 0; --i)
+    {
+        if(buckets[i - 1] > 0)
+        {
+            return LatencyHistogram::bucketLimit(i - 1);
+        }
+    }
+    return 0;
+}
+
+// Function to remove the values of an earlier snapshot of the same histogram
+void HistogramSnapshot::subtract(const HistogramSnapshot& earlier)
+{
+    for(size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+    {
+        buckets[i] -= earlier.buckets[i];
+    }
+    count -= earlier.count;
+}
+
+// Function to read the monotonic clock in nanoseconds
+STATIC uint64_t Metrics::nowNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now); // Served from the vDSO, no system call
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Function to create and register the calling thread's shard
+STATIC MetricsShard* Metrics::registerShard()
+{
+    MetricsShard* shard = new MetricsShard();
+    metricsShardHolder.shard = shard;
+
+    std::lock_guard<std::mutex> lock(shardsLock);
+    shard->next = shards;
+    shards = shard;
+    return shard;
+}
+
+// Function to add one shard's metrics to another
+static void accumulate(uint64_t* counters, HistogramSnapshot* histograms, const MetricsShard& shard)
+{
+    for(size_t i = 0; i < (size_t)Counter::COUNT; ++i)
+    {
+        counters[i] += shard.counters[i].get();
+    }
+    for(size_t h = 0; h < (size_t)Histogram::COUNT; ++h)
+    {
+        for(size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+        {
+            uint64_t count = shard.histograms[h].buckets[i].get();
+            histograms[h].buckets[i] += count;
+            histograms[h].count += count;
+        }
+    }
+}
+
+// Function to move the metrics of an exited thread into the totals of exited threads
+static void foldShard(const MetricsShard& shard)
+{
+    for(size_t i = 0; i < (size_t)Counter::COUNT; ++i)
+    {
+        exitedTotals.counters[i].add(shard.counters[i].get());
+    }
+    for(size_t h = 0; h < (size_t)Histogram::COUNT; ++h)
+    {
+        for(size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+        {
+            exitedTotals.histograms[h].buckets[i].add(shard.histograms[h].buckets[i].get());
+        }
+    }
+}
+
+// Function to sum the metrics of every thread; threads keep recording meanwhile, so the sum is not
+// one instant but every counter is exact up to the moment it was read
+STATIC MetricsSnapshot Metrics::snapshot()
+{
+    MetricsSnapshot result;
+    result.takenAtNs = nowNs();
+
+    std::lock_guard<std::mutex> lock(shardsLock);
+    for(MetricsShard** link = &shards; *link != NULL;)
+    {
+        MetricsShard* shard = *link;
+        if(shard->retired.load(std::memory_order_acquire))
+        {
+            foldShard(*shard); // The thread is gone, its shard no longer changes
+            *link = shard->next;
+            delete shard;
+            continue;
+        }
+        accumulate(result.counters, result.histograms, *shard);
+        link = &shard->next;
+    }
+    accumulate(result.counters, result.histograms, exitedTotals);
+    return result;
+}
+
+// Function to describe the metrics as three report lines: traffic, queue latency and handler latency.
+// With an earlier snapshot, rates and latencies since then are reported instead of totals
+std::string MetricsSnapshot::format(const MetricsSnapshot* previous) const
+{
+    double seconds = 0;
+    if(previous != NULL && takenAtNs > previous->takenAtNs)
+    {
+        seconds = (takenAtNs - previous->takenAtNs) / 1e9;
+    }
+    auto amount = [this, previous, seconds](Counter which)
+    {
+        uint64_t value = counter(which);
+        return seconds > 0 ? (value - previous->counter(which)) / seconds : (double)value;
+    };
+
+    HistogramSnapshot queue = histogram(Histogram::QUEUE_LATENCY);
+    HistogramSnapshot handler = histogram(Histogram::HANDLER_LATENCY);
+    if(seconds > 0)
+    {
+        queue.subtract(previous->histogram(Histogram::QUEUE_LATENCY)); // Latencies of this interval only
+        handler.subtract(previous->histogram(Histogram::HANDLER_LATENCY));
+    }
+    char report[512];
+    snprintf(report, sizeof(report),
+             "connections %zu (+%llu -%llu, %llu rejected), queued %zu, %s: received %.0f msg %.0f B, handled %.0f msg, "
+             "stolen %.0f, dropped %.0f msg, replies %.0f, sent %.0f B\nqueue latency us p50 %.1f p99 %.1f p999 %.1f max %.1f\n"
+             "handler latency us p50 %.1f p99 %.1f p999 %.1f max %.1f",
+             connections, (unsigned long long)counter(Counter::CONNECTIONS_ACCEPTED),
+             (unsigned long long)counter(Counter::CONNECTIONS_CLOSED), (unsigned long long)counter(Counter::CONNECTIONS_REJECTED),
+             queuedMessages, seconds > 0 ? "per second" : "total",
+             amount(Counter::MESSAGES_RECEIVED), amount(Counter::BYTES_RECEIVED), amount(Counter::MESSAGES_HANDLED),
+             amount(Counter::TASKS_STOLEN), amount(Counter::MESSAGES_DROPPED), amount(Counter::REPLIES_QUEUED), amount(Counter::BYTES_SENT),
+             queue.percentile(0.5) / 1e3, queue.percentile(0.99) / 1e3, queue.percentile(0.999) / 1e3, queue.max() / 1e3,
+             handler.percentile(0.5) / 1e3, handler.percentile(0.99) / 1e3, handler.percentile(0.999) / 1e3, handler.max() / 1e3);
+    return report;
+}
+
+// Function to clear the counters of a connection slot for a new client
+void ConnectionStats::reset()
+{
+    messagesReceived.value.store(0, std::memory_order_relaxed);
+    bytesReceived.value.store(0, std::memory_order_relaxed);
+    bytesSent.value.store(0, std::memory_order_relaxed);
+    connectedAtNs.store(Metrics::nowNs(), std::memory_order_relaxed);
+}
@@ -0,0 +1,133 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "MessageRing.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define LATENCY_SUB_BUCKET_BITS 4 // Every power of two is split into 1 << bits buckets, values are kept within 1/16
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS) // Buckets per power of two
+#define LATENCY_BUCKET_COUNT ((64 - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS) // Buckets covering every 64-bit value
+
+// Counters kept by every thread, summed when metrics are read
+enum class Counter
+{
+    CONNECTIONS_ACCEPTED, // Clients that passed the connection limit
+    CONNECTIONS_REJECTED, // Clients closed right away because of the connection limit
+    CONNECTIONS_CLOSED, // Accepted clients that have since disconnected
+    MESSAGES_RECEIVED, // Frames pushed towards the workers, including dropped ones
+    BYTES_RECEIVED, // Payload bytes of these frames
+    MESSAGES_DROPPED, // Frames discarded because the message queue was full
+    MESSAGES_HANDLED, // Frames the handler has finished with
+    TASKS_STOLEN, // Tasks a work-stealing worker took from another worker's deque
+    REPLIES_QUEUED, // Replies handed to send, broadcasts count once
+    BYTES_SENT, // Bytes written to client sockets
+    COUNT // Number of counters
+};
+
+// Latency distributions kept by every thread
+enum class Histogram
+{
+    QUEUE_LATENCY, // Nanoseconds from a frame being queued to its handler starting
+    HANDLER_LATENCY, // Nanoseconds spent in the message handler
+    COUNT // Number of histograms
+};
+
+// Counter updated by one thread at a time and read by any, so updates need no locked instruction
+struct MetricCounter
+{
+    std::atomic<uint64_t> value{0};
+
+    void add(uint64_t amount) { value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+// Log-linear histogram in the style of HdrHistogram: recording is an index computation and one counter update
+struct LatencyHistogram
+{
+    MetricCounter buckets[LATENCY_BUCKET_COUNT];
+
+    void record(uint64_t value) { buckets[bucketOf(value)].add(1); }
+    static size_t bucketOf(uint64_t value);
+    static uint64_t bucketLimit(size_t bucket);
+};
+
+// Counters and histograms of one thread, written without contention
+struct MetricsShard
+{
+    alignas(CACHE_LINE_SIZE) MetricCounter counters[(size_t)Counter::COUNT];
+    LatencyHistogram histograms[(size_t)Histogram::COUNT];
+    std::atomic<bool> retired{false}; // Owning thread exited, folded into the totals of exited threads on the next read
+    MetricsShard* next = NULL; // Next registered shard
+};
+
+// Sum of every shard's histogram at the time it was read
+struct HistogramSnapshot
+{
+    uint64_t buckets[LATENCY_BUCKET_COUNT] = {};
+    uint64_t count = 0; // Recorded values
+
+    uint64_t percentile(double fraction) const;
+    uint64_t max() const;
+    void subtract(const HistogramSnapshot& earlier);
+};
+
+// Process-wide metrics at the time they were read, plus gauges filled in by the server
+struct MetricsSnapshot
+{
+    uint64_t counters[(size_t)Counter::COUNT] = {};
+    HistogramSnapshot histograms[(size_t)Histogram::COUNT];
+    uint64_t takenAtNs = 0; // Monotonic time the snapshot was taken at
+    size_t connections = 0; // Connected clients
+    size_t queuedMessages = 0; // Frames received but not handled yet
+
+    uint64_t counter(Counter which) const { return counters[(size_t)which]; }
+    const HistogramSnapshot& histogram(Histogram which) const { return histograms[(size_t)which]; }
+    std::string format(const MetricsSnapshot* previous = NULL) const;
+};
+
+// Per-thread metrics: every thread updates its own shard, readers sum all shards on demand
+class Metrics
+{
+public:
+    static void add(Counter which, uint64_t amount = 1) { localShard().counters[(size_t)which].add(amount); }
+    static void record(Histogram which, uint64_t nanoseconds) { localShard().histograms[(size_t)which].record(nanoseconds); }
+    static uint64_t nowNs();
+    static MetricsSnapshot snapshot();
+
+private:
+    static MetricsShard& localShard()
+    {
+        static thread_local MetricsShard* shard = NULL;
+        if(shard == NULL)
+        {
+            shard = registerShard();
+        }
+        return *shard;
+    }
+    static MetricsShard* registerShard();
+};
+
+// Counters of a single connection, written by the thread reading it and the one writing to it
+struct ConnectionStats
+{
+    MetricCounter messagesReceived; // Frames received from the client
+    MetricCounter bytesReceived; // Payload bytes of these frames
+    MetricCounter bytesSent; // Bytes written to the client
+    std::atomic<uint64_t> connectedAtNs{0}; // Monotonic time the client connected at
+
+    void reset();
+};
+
+// Copy of a connection's counters
+struct ClientStats
+{
+    uint64_t messagesReceived = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t bytesSent = 0;
+    uint64_t connectedForNs = 0; // Time since the client connected
+};
+
+#endif
@@ -1,7 +1,23 @@
 #include "Server.h" // Including the header file to define the Server class and related errors
-#include <iostream> // Including the library for standard input/output operations
+#include "EventLoop.h" // Including the epoll event loop used in reactor mode
+#include "UringLoop.h" // Including the io_uring event loop used in io_uring mode
+#include "ListenerHandoff.h" // Including the listener handoff between server processes for restarts
+#include "CpuTopology.h" // Including the thread placement to follow the receive queue interrupts
+#include "TlsAcceptor.h" // Including the TLS termination of the clients
+#include "TopicRouter.h" // Including the topic subscriptions of the clients
+#include "MessageSpool.h" // Including the durable log of the received messages
+#include <cerrno> // This header file is included to retry interrupted writes
 #include <cstring> // This header file is included to use C-style string manipulation functions like memset
 #include <unistd.h> // This header file is included for POSIX operating system API, which is used for functions like usleep
+#include <sched.h> // This header file is included to yield while waiting for space in the message queue
+#include <fcntl.h> // This header file is included to switch the listening socket to non-blocking mode
+#include <poll.h> // This header file is included to wait for connections and the stop request together
+#include <signal.h> // This header file is included to stop the server on SIGINT and SIGTERM
+#include <sys/eventfd.h> // This header file is included for the stop notification
+#include <sys/resource.h> // This header file is included to size the descriptor table from the open file limit
+#include <sys/uio.h> // This header file is included to write a framed reply with a single writev
+#include <limits.h> // This header file is included for IOV_MAX, the vectors a compressed reply is written in at most at once
+#include <sys/time.h> // This header file is included for the receive timeout of client threads
 #include <sys/socket.h> // This header file is included for socket-related functions and structures used in network programming, 
                         // such as socket, bind, listen, and accept
 
@@ -10,64 +26,348 @@
 // Structure to hold data for POSIX threads
 struct PosixThreadData
 {
-    PosixThreadData(Server* srv, int clientSocket) : server(srv), clientSoc(clientSocket) {}
+    PosixThreadData(Server* srv, ClientId clientId) : server(srv), client(clientId) {}
     Server* server; // Pointer to a Server object
-    int clientSoc; // Client socket descriptor
+    ClientId client; // Client served by the thread
 };
 
-// Constructor for the Server class, taking a port number as argument
-Server::Server(int Port) : serverPort(Port)
+// Function to limit how long a client thread's recv blocks, 0 blocks forever
+static void setReceiveTimeout(int clientSocket, unsigned timeoutMs)
+{
+    struct timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    if(setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == -1)
+    {
+        LOG_WARNING << "Receive timeout could not be set for client " << clientSocket << ".";
+    }
+}
+
+static std::atomic<Server*> stopSignalTarget{NULL}; // Server stopped by SIGINT and SIGTERM
+static struct sigaction previousInterrupt; // Handlers replaced while the server handles the signals
+static struct sigaction previousTerminate;
+
+// Function handling SIGINT and SIGTERM while a server runs, only async-signal-safe calls are made
+static void handleStopSignal(int)
+{
+    Server* server = stopSignalTarget.load();
+    if(server != NULL)
+    {
+        server->stop();
+    }
+}
+
+// Function to route SIGINT and SIGTERM to a server, remembering the handlers they replace
+static void installStopSignals(Server* server)
+{
+    stopSignalTarget.store(server);
+    struct sigaction action{};
+    action.sa_handler = handleStopSignal;
+    action.sa_flags = SA_RESTART; // Blocking calls elsewhere in the process are not interrupted
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &previousInterrupt);
+    sigaction(SIGTERM, &action, &previousTerminate);
+}
+
+// Function to give SIGINT and SIGTERM back to the handlers installStopSignals replaced
+static void restoreStopSignals()
+{
+    sigaction(SIGINT, &previousInterrupt, NULL);
+    sigaction(SIGTERM, &previousTerminate, NULL);
+    stopSignalTarget.store(NULL);
+}
+
+// Function to poll a condition until it holds or the deadline in monotonic milliseconds has passed
+template <typename Condition>
+static bool waitUntil(Condition condition, uint64_t deadlineMs)
+{
+    while(!condition())
+    {
+        if(Metrics::nowNs() / 1000000 >= deadlineMs)
+        {
+            return false;
+        }
+        usleep(SHUTDOWN_WAIT_STEP_US);
+    }
+    return true;
+}
+
+// Function to take back the count of a message that was not queued, spooled messages are not counted
+static void unqueue(Message& message)
+{
+    if(message.queuedCount != NULL)
+    {
+        message.queuedCount->fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+// Constructor for the Server class, taking a port number and the server configuration as arguments
+Server::Server(int Port, const ServerConfig& serverConfig)
+    : serverPort(Port), config(serverConfig), serverSocket(-1), connections(maxDescriptors()),
+      workerPool(serverConfig.workerThreads, serverConfig.messageQueueCapacity, serverConfig.fairQuantumBytes, serverConfig.scheduling),
+      rateIntervalNs(0), rateCapacityNs(0), drained(false), handlersDone(false),
+      hasStatsThread(false), handoffPeer(-1), handoffListener(-1), hasHandoffThread(false)
 {   
-    try
+    Logger::setLevel(config.logLevel);
+
+    if(config.clientMessageRate > 0)
     {
-        createAndBindSocket(); // Creating and binding the socket for the server
+        // Without a configured burst a bucket holds a tenth of a second, the resolution the loops throttle at
+        unsigned burst = config.clientMessageBurst > 0 ? config.clientMessageBurst : config.clientMessageRate / 10;
+        rateIntervalNs = 1000000000ull / config.clientMessageRate;
+        rateIntervalNs = rateIntervalNs > 0 ? rateIntervalNs : 1;
+        rateCapacityNs = rateIntervalNs * (burst > 0 ? burst : 1);
+    }
+
+    if(!config.tlsCertificateFile.empty() || !config.tlsPrivateKeyFile.empty())
+    {
+        tls = std::make_unique<TlsAcceptor>(config); // Loaded before anything is bound, a bad certificate fails right here
+        if(config.zeroCopyThreshold > 0)
+        {
+            LOG_WARNING << "Zero copy sends are disabled, the kernel cannot encrypt them in place.";
+            config.zeroCopyThreshold = 0; // kTLS sockets reject MSG_ZEROCOPY
+        }
+    }
+
+    if(!config.compressionCodecs.empty())
+    {
+        // Codecs that are not compiled in are never picked, there is nothing to negotiate without any
+        std::vector<CompressionCodec> usable;
+        for(CompressionCodec codec : config.compressionCodecs)
+        {
+            if(CompressionPool::available(codec))
+            {
+                usable.push_back(codec);
+            }
+            else
+            {
+                LOG_WARNING << "Compression codec " << CompressionPool::name(codec) << " is not compiled in.";
+            }
+        }
+        if(config.framing == FramingMode::RAW && !usable.empty())
+        {
+            LOG_WARNING << "Compression is disabled, RAW framing cannot carry the offer of a client.";
+            usable.clear();
+        }
+        config.compressionCodecs = usable;
+    }
+
+    if(!config.spoolDirectory.empty())
+    {
+        spool = std::make_unique<MessageSpool>(config); // Recovers the messages an earlier server did not handle
+    }
+
+    if((stopFd = eventfd(0, EFD_CLOEXEC)) == -1)
+    {
+        throw TCPServerError("Stop notification could not be created."); // Throw an error if eventfd creation fails
+    }
+
+    topicRouter = std::make_unique<TopicRouter>(*this);
 
-        // Creating a thread for handling the message queue
-        if(pthread_create(&messageQueueThread, NULL, handleMessageQueueWrapper, (void *)this) != 0)
+    // Logging every message unless the application registers its own handler, the echo can be turned off
+    // so benchmarks do not measure the log. Topic commands are served first if they are turned on
+    bool echo = config.echoMessages;
+    TopicRouter* router = config.topicCommands ? topicRouter.get() : NULL;
+    workerPool.setHandler([echo, router](ClientId client, std::string_view message)
+    {
+        if(router != NULL && router->handleCommand(client, message))
+        {
+            return;
+        }
+        if(!echo)
+        {
+            return;
+        }
+        if(!message.empty() && message.back() == '\n')
         {
-            throw TCPServerError("Message Queue Thread could not be created."); // Throw an error if thread creation fails
+            message.remove_suffix(1); // Raw chunks usually carry the newline, the log adds its own
         }
+        LOG_INFO << "Message from Client " << client.socket << " : " << message;
+    });
+
+    try
+    {
+        createAndBindSocket(); // Creating and binding the socket for the server
     }
     catch(const TCPServerError& ex)
     {
-        close(serverSocket); // Clean up resources in case of exception
+        if(handoffPeer != -1)
+        {
+            close(handoffPeer); // The running server sees the connection close and serves on
+        }
+        close(stopFd);
         throw; // Re-throw the exception
     }
 }
 
+// Function to register the handler run by the workers for every received message, call it before startServer
+void Server::setMessageHandler(MessageHandler handler)
+{
+    workerPool.setHandler(std::move(handler));
+}
+
+// Function to serve every client with its own session running on the event loop instead of the message
+// handler, reactor modes only; call it before startServer
+void Server::setSessionFactory(SessionFactory factory)
+{
+    sessionFactory = std::move(factory);
+}
+
 // Destructor for the Server class
 Server::~Server()
 {
-    // Join threads for all connected clients
-    for(auto& [socket, thread]: clientsMap)
+    if(!drained)
     {
-        if(pthread_join(thread, NULL) != 0)
-        {
-            std::cerr << "Failed to join thread.\n"; // Print error message if joining thread fails
-        }
+        drain(); // startServer did not run to completion, still stop every thread of the server
+    }
+    eventLoops.clear(); // Every thread that could post a reply is joined
 
-        close(socket);
+    if(hasStatsThread)
+    {
+        reportingStats.store(false);
+        pthread_join(statsThread, NULL);
     }
-  
-    if(pthread_join(messageQueueThread, NULL) != 0)
+
+    if(handoffPeer != -1)
     {
-        std::cerr << "Failed to join thread.\n"; // Print error message if joining thread fails
+        close(handoffPeer); // Never served the inherited listeners, the previous server keeps them
     }
-  
-    close(serverSocket); // Closing the server socket when the Server object is destroyed
+    closeListeningSockets(); // Closing the server sockets when the Server object is destroyed
+    close(stopFd);
 }
 
 // Function to create and bind the socket for the server
 void Server::createAndBindSocket()
 {
-    close(serverSocket); // Closing any existing socket before creating and binding a new one
+    closeListeningSockets(); // Closing any existing socket before creating and binding a new one
+
+    if(inheritListeners())
+    {
+        return; // Serving the listeners of the previous server, nothing to bind
+    }
+
+    for(size_t i = 0; i < listenerCount(); ++i)
+    {
+        try
+        {
+            listenSockets.push_back(openListeningSocket());
+        }
+        catch(const TCPServerError& ex)
+        {
+            closeListeningSockets(); // Do not keep a partial set of listeners
+            throw; // Re-throw the exception
+        }
+    }
+
+    serverSocket = listenSockets.front();
+}
+
+// Function to get the number of listening sockets, in SO_REUSEPORT modes every event loop gets its own
+// listener bound to the same port
+size_t Server::listenerCount() const
+{
+    if(usesReusePort() && config.reactorThreads > 1)
+    {
+        return config.reactorThreads;
+    }
+    return 1;
+}
+
+// Function to take over the listening sockets of a previous server instead of binding new ones, either from
+// systemd socket activation or from a server running at the handoff path. Connections keep queuing on them
+// meanwhile, so a restart never refuses one. Returns false if there is nothing to inherit
+bool Server::inheritListeners()
+{
+    const char* source = "systemd";
+    if(!config.socketActivation || !ListenerHandoff::fromSystemd(listenSockets))
+    {
+        if(config.handoffPath.empty() || (handoffPeer = ListenerHandoff::connectToServer(config.handoffPath)) == -1)
+        {
+            return false; // No previous server, bind as usual
+        }
+        if(!ListenerHandoff::receiveListeners(handoffPeer, listenSockets))
+        {
+            throw TCPServerError("Listening sockets could not be received from the running server."); // Throw an error if the handoff fails
+        }
+        source = "the running server";
+    }
+
+    // Serve the port of the inherited listeners, it is what clients connect to
+    struct sockaddr_storage address;
+    socklen_t addressLength = sizeof(address);
+    if(getsockname(listenSockets.front(), (struct sockaddr *)&address, &addressLength) == 0)
+    {
+        serverPort = ntohs(address.ss_family == AF_INET6 ? ((struct sockaddr_in6 *)&address)->sin6_port
+                                                        : ((struct sockaddr_in *)&address)->sin_port);
+    }
+    LOG_INFO << "Inherited " << listenSockets.size() << " listening sockets on Port " << serverPort << " from " << source << ".";
+
+    // A listener without a loop would still get its share of the connections, which would never be accepted
+    if(listenSockets.size() > listenerCount())
+    {
+        LOG_WARNING << "Closing " << listenSockets.size() - listenerCount() << " inherited listeners, connections queued on them are reset.";
+    }
+    while(listenSockets.size() > listenerCount())
+    {
+        close(listenSockets.back());
+        listenSockets.pop_back();
+    }
+
+    for(int listenSocket: listenSockets)
+    {
+        if(fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK) == -1)
+        {
+            closeListeningSockets();
+            throw TCPServerError("Unable to make socket non-blocking."); // Throw an error if the flag cannot be set
+        }
+    }
+
+    // More loops than before, the extra SO_REUSEPORT listeners join the inherited ones on their port
+    try
+    {
+        while(listenSockets.size() < listenerCount())
+        {
+            listenSockets.push_back(openListeningSocket());
+        }
+    }
+    catch(const TCPServerError& ex)
+    {
+        closeListeningSockets(); // Do not keep a partial set of listeners
+        throw; // Re-throw the exception
+    }
+
+    serverSocket = listenSockets.front();
+    return true;
+}
+
+// Function to create, configure and bind a single listening socket
+int Server::openListeningSocket()
+{
+    int listenSocket;
 
     // Creating a socket for communication using IPv4 and TCP protocol
-    if((serverSocket = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+    if((listenSocket = socket(AF_INET, SOCK_STREAM, 0)) == -1)
     {
         throw TCPServerError("Socket could not be created."); // Throw an error if socket creation fails
     }
 
+    // Allowing the port to be bound again while connections of a previous server are in TIME_WAIT
+    int enable = 1;
+    if(setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == -1)
+    {
+        close(listenSocket);
+        throw TCPServerError("Unable to set SO_REUSEADDR on socket."); // Throw an error if the option cannot be set
+    }
+
+    // Allowing several sockets to bind the same port so the kernel shards connections between them
+    if(usesReusePort() && setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1)
+    {
+        close(listenSocket);
+        throw TCPServerError("Unable to set SO_REUSEPORT on socket."); // Throw an error if the option cannot be set
+    }
+
+    config.tuning.applyToListener(listenSocket); // Before bind and listen, so accepted sockets inherit it
+
     // Initializing the server address structure
     memset(&serverAddr, 0, sizeof(serverAddr));
     serverAddr.sin_family = AF_INET; // Using IPv4
@@ -75,147 +375,1112 @@ void Server::createAndBindSocket()
     serverAddr.sin_port = htons(serverPort); // Setting the server port
 
     // Binding the socket to the server address
-    if(bind(serverSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) == -1)
+    if(bind(listenSocket, (struct sockaddr *)&serverAddr, sizeof(serverAddr)) == -1)
     {
-        close(serverSocket);
+        close(listenSocket);
         throw TCPServerError("Unable to bind socket."); // Throw an error if binding fails
     }
+
+    // Event loops accept until the backlog is drained, the accept loop must not block after poll reported a
+    // connection that was reset meanwhile
+    if(fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL, 0) | O_NONBLOCK) == -1)
+    {
+        close(listenSocket);
+        throw TCPServerError("Unable to make socket non-blocking."); // Throw an error if the flag cannot be set
+    }
+
+    return listenSocket;
+}
+
+// Function to close every listening socket of the server
+void Server::closeListeningSockets()
+{
+    for(int listenSocket: listenSockets)
+    {
+        close(listenSocket);
+    }
+    listenSockets.clear();
+    serverSocket = -1;
+}
+
+// Function to check whether clients are served by event loops
+bool Server::isReactorMode() const
+{
+    return config.mode != ServerMode::THREAD_PER_CLIENT;
+}
+
+// Function to check whether every event loop owns a SO_REUSEPORT listener
+bool Server::usesReusePort() const
+{
+    return config.mode == ServerMode::REUSEPORT_REACTOR || config.mode == ServerMode::IO_URING_REACTOR;
 }
 
-// Function to start the server
+// Function to start the server and serve clients until stop is called or, with stopOnSignals, SIGINT or SIGTERM
+// arrives; the server is drained before this returns. Throws TCPServerError if the server cannot start
 void Server::startServer()
 {
-    bool dec = true; // Decision variable
-    
-    // Main loop to start and restart the server
-    while(dec)
+    if(sessionFactory && !isReactorMode())
     {
-        try
-        {
-            startListening(); // Starting to listen for incoming connections
-        }
-        catch(const TCPServerError ex)
-        {
-            std::cerr << ex.what() << '\n'; // Printing error message if an exception is caught
-        }
-        
-        std::cout << "Do you want to try to start the server again? [Y/N]";
-        std::string ans{}; // Answer
-        int counter = 0;
-        while(ans != "Y" && ans != "y" && ans != "N" && ans != "n")    
-        {
-            if(counter >= 1)
-            {
-                std::cout << "Invalid answer, please enter your answer again: ";
-            }
-            std::cin >> ans; // Getting user input for restarting the server
-            ++counter;
-        }
-        
-        if(ans == "Y" || ans == "y")
+        throw TCPServerError("Sessions need a reactor mode."); // Throw an error, client threads have no loop to run them on
+    }
+
+    workerPool.start(config.workerCpus); // Starting the message handler threads with the registered handler
+    if(spool)
+    {
+        spool->start([this](Message& message) { return deliverSpooled(message); });
+    }
+    if(tls && isReactorMode())
+    {
+        tls->start(); // Client threads shake hands themselves, reactor clients on the handshake thread
+    }
+
+    if(config.statsIntervalMs > 0)
+    {
+        reportingStats.store(true);
+        if(pthread_create(&statsThread, NULL, reportStatsWrapper, (void *)this) == 0)
         {
-            dec = true; // Setting decision to true for restarting the server
-            clientsMap.clear(); // Clearing the map of connected clients
-            createAndBindSocket(); // Recreating and binding the socket 
+            hasStatsThread = true;
         }
         else
         {
-            dec = false; // Setting decision to false for shutting down the server
-            std::cout << "Server is shutting down.\n"; // Printing shutdown message
+            LOG_WARNING << "Metrics report thread could not be started.";
         }
-    }  
-}
+    }
 
-// Function to handle the message queue in a separate thread
-void* Server::handleMessageQueue()
-{
-    while(true)
+    if(config.stopOnSignals)
+    {
+        installStopSignals(this);
+    }
+
+    try
+    {
+        startListening(); // Serving clients until the stop request
+    }
+    catch(const TCPServerError&)
     {
-        while(messageQueue.empty())
-            usleep(10000); // Sleep for 10ms
+        drain(); // Stop the threads already started, the caller reports the error
+        if(config.stopOnSignals)
+        {
+            restoreStopSignals();
+        }
+        throw; // Re-throw the exception
+    }
 
-        // Retrieve and process messages from the message queue
-        pthread_mutex_lock(&mutex); // Lock mutex before accessing shared resources
-        std::pair<int, std::string> clientMessagePair = messageQueue.front();
-        messageQueue.pop();
-        pthread_mutex_unlock(&mutex); // Unlock mutex after accessing shared resources
-        std::cout << "Message from Client " << clientMessagePair.first << " : " << clientMessagePair.second;
+    drain();
+    if(config.stopOnSignals)
+    {
+        restoreStopSignals();
     }
 }
 
-// Static function wrapper for handling the message queue in a separate thread
-STATIC void* Server::handleMessageQueueWrapper(void* arg)
+// Function to ask the server to stop gracefully; returns at once, startServer drains and returns.
+// Safe from any thread and from signal handlers
+void Server::stop()
 {
-    Server* instance = reinterpret_cast<Server*>(arg);
-    instance->handleMessageQueue(); // Call the non-static member function to handle the message queue
+    stopRequested.store(true);
+    uint64_t one = 1;
+    ssize_t ignored = write(stopFd, &one, sizeof(one)); // The counter only grows, a failed write means it is already set
+    (void)ignored;
 }
 
-// Function to start listening for incoming connections
+// Function to start listening for incoming connections and serve them until the stop request
 void Server::startListening()
 {
-    if (listen(serverSocket, MAX_CLIENTS) == -1) 
+    for(int listenSocket: listenSockets)
     {
-        throw TCPServerError("Listening error."); // Throw an error if listening fails
+        if (listen(listenSocket, config.listenBacklog) == -1) 
+        {
+            throw TCPServerError("Listening error."); // Throw an error if listening fails
+        }
     }
 
-    std::cout << "Server is listening for connections on Port " << serverPort << "\n"; // Print listening message
+    LOG_INFO << "Server is listening for connections on Port " << serverPort; // Log listening message
+
+    if(isReactorMode())
+    {
+        startEventLoops(); // Serve clients from the event loops instead of one thread per client
+        startHandoff();
+        waitForStop();
+        return;
+    }
 
     struct sockaddr_in clientAddr;
     socklen_t clientAddrLen = sizeof(clientAddr);
+    struct pollfd watched[2] = {{serverSocket, POLLIN, 0}, {stopFd, POLLIN, 0}};
+    startHandoff();
 
     // Accept incoming client connections and spawn threads to handle them
-    while(true)
+    while(!stopRequested.load())
     {
-        int clientSocket = accept(serverSocket, (struct sockaddr *)&clientAddr, &clientAddrLen);
+        if(poll(watched, 2, -1) == -1 || (watched[1].revents & POLLIN))
+        {
+            continue; // Interrupted, or the stop request ends the loop
+        }
+
+        int clientSocket = accept4(serverSocket, (struct sockaddr *)&clientAddr, &clientAddrLen, SOCK_CLOEXEC);
         if(clientSocket == -1)
         {
-            std::cerr << "Failed to accept request from a client." << "\n"; // Print error message if accepting client fails
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+            {
+                LOG_ERROR << "Failed to accept request from a client."; // Log error message if accepting client fails
+            }
+            continue;
         }
-        else
+
+        ConnectionSlot* slot = connections.slot(clientSocket);
+        if(slot == NULL)
+        {
+            LOG_WARNING << "Client " << clientSocket << " is rejected, its descriptor exceeds the connection table.";
+            close(clientSocket);
+            continue;
+        }
+        if(!admitClient(clientSocket))
         {
-            std::cout << "Client " << clientSocket << " connected.\n"; // Print client connection message
+            continue;
         }
+        LOG_INFO << "Client " << clientSocket << " connected."; // Log client connection message
+        config.tuning.applyToClient(clientSocket);
 
-        pthread_t thread;
-        PosixThreadData threadData(this, clientSocket); // Create thread data structure
-        if(pthread_create(&thread, NULL, handleClientWrapper, (void *)&threadData) != 0)
+        // The previous client of this descriptor closed it just before its thread returned
+        if(slot->hasThread && pthread_join(slot->thread, NULL) != 0)
         {
-            throw TCPServerError("Thread could not be created."); // Throw an error if thread creation fails
+            LOG_ERROR << "Failed to join thread."; // Log error message if joining thread fails
+        }
+        slot->hasThread = false;
+
+        // Client threads write their replies directly, owner 0 only marks the client as connected.
+        // A TLS client is marked by its thread once the handshake completed, replies must not reach it before
+        ClientId client;
+        client.socket = clientSocket;
+        if(!tls)
+        {
+            client = connections.open(clientSocket, 0);
+        }
+        PosixThreadData* threadData = new PosixThreadData(this, client); // Owned by the client thread
+        activeReaders.fetch_add(1);
+        if(pthread_create(&slot->thread, NULL, handleClientWrapper, (void *)threadData) != 0)
+        {
+            activeReaders.fetch_sub(1);
+            connections.close(clientSocket);
+            releaseClient();
+            delete threadData;
             close(clientSocket); // Close client socket if thread creation fails
+            throw TCPServerError("Thread could not be created."); // Throw an error if thread creation fails
+        }
+        slot->hasThread = true;
+    }
+}
+
+// Function to serve clients from the event loops of the configured backend
+void Server::startEventLoops()
+{
+    int loopCount = config.reactorThreads > 0 ? config.reactorThreads : DEFAULT_REACTOR_THREADS;
+    for(int i = 0; i < loopCount; ++i)
+    {
+        if(config.mode == ServerMode::IO_URING_REACTOR)
+        {
+            eventLoops.push_back(std::make_unique<UringLoop>(this, i));
+        }
+        else
+        {
+            eventLoops.push_back(std::make_unique<EventLoop>(this, i));
+        }
+
+        if(usesReusePort() && i < (int)listenSockets.size())
+        {
+            eventLoops.back()->watchListener(listenSockets[i], false); // Each loop owns its own listener
         }
         else
         {
-            clientsMap[clientSocket] = thread; // Add client socket and thread to the map
+            eventLoops.back()->watchListener(serverSocket, true); // EPOLLEXCLUSIVE lets each connection be accepted by one loop only
+        }
+    }
+
+    // Explicit CPUs come first, then those taking the interface's receive interrupts, so each loop reads
+    // the packets its CPU has just processed
+    std::vector<int> cpus = config.reactorCpus;
+    if(cpus.empty() && !config.nicQueueInterface.empty())
+    {
+        cpus = CpuTopology::interfaceQueueCpus(config.nicQueueInterface);
+        if(cpus.empty())
+        {
+            LOG_WARNING << "No receive queue interrupts found for " << config.nicQueueInterface << ", event loops are placed as usual.";
         }
     }
+
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+    for(int i = 0; i < loopCount; ++i)
+    {
+        int cpu = !cpus.empty() ? cpus[i % cpus.size()] : (config.pinReactorThreads && cpuCount > 0 ? (int)(i % cpuCount) : -1);
+        if(usesReusePort() && i < (int)listenSockets.size())
+        {
+            config.tuning.applyIncomingCpu(listenSockets[i], cpu); // Keep each connection on the CPU of its loop
+        }
+        eventLoops[i]->start(cpu);
+    }
+    publishedLoops.store(eventLoops.size(), std::memory_order_release); // Never changes again, replies may be posted from here on
+
 }
 
-// Function to handle a client connection
-void* Server::handleClient(int clientSocket)
+// Function to block until stop is called, the counter is left set so every thread polling stopFd wakes
+void Server::waitForStop()
 {
-    char buffer[256]; // Buffer to store received data
-    int bytesRead = 0; // Number of bytes read
+    struct pollfd watched = {stopFd, POLLIN, 0};
+    while(!stopRequested.load())
+    {
+        poll(&watched, 1, -1);
+    }
+}
 
-    // Receive data from the client until connection is closed
-    while((bytesRead = recv(clientSocket, buffer, sizeof(buffer) - 1, 0)) > 0)
+// Function to tell the previous server, if any, that its listeners are served here now, and to open the
+// handoff socket for the next server process
+void Server::startHandoff()
+{
+    if(handoffPeer != -1)
+    {
+        if(ListenerHandoff::confirm(handoffPeer))
+        {
+            LOG_INFO << "Took over the listeners, the previous server is draining.";
+        }
+        else
+        {
+            LOG_WARNING << "The previous server could not be told to stop, both serve the listeners.";
+        }
+        close(handoffPeer);
+        handoffPeer = -1;
+    }
+
+    if(config.handoffPath.empty())
+    {
+        return;
+    }
+    if((handoffListener = ListenerHandoff::listenForSuccessor(config.handoffPath)) == -1)
+    {
+        LOG_WARNING << "Handoff socket could not be opened at " << config.handoffPath << ", a restart has to bind the port again.";
+        return;
+    }
+    if(pthread_create(&handoffThread, NULL, serveHandoffWrapper, (void *)this) == 0)
     {
-        pthread_mutex_lock(&mutex); // Lock mutex before accessing shared resources
-        messageQueue.push(std::make_pair(clientSocket, buffer)); // Push received data to the message queue
-        pthread_mutex_unlock(&mutex); // Unlock mutex after accessing shared resources
-        memset(buffer, 0, sizeof(buffer)); // Clear the buffer
+        hasHandoffThread = true;
     }
+    else
+    {
+        LOG_WARNING << "Handoff thread could not be started.";
+        close(handoffListener);
+        unlink(config.handoffPath.c_str());
+        handoffListener = -1;
+    }
+}
 
-    if(bytesRead <= 0)
+// Function to stop handing the listeners out, the drain closes them next
+void Server::stopHandoff()
+{
+    if(hasHandoffThread)
     {
-        std::cout << "Client " << clientSocket << " disconnected." << "\n";
+        stop(); // Wakes the thread, also when the drain was not started by a stop request
+        pthread_join(handoffThread, NULL);
+        hasHandoffThread = false;
     }
+}
 
-    close(clientSocket);
+// Function to shut the server down gracefully: stop accepting and reading, handle every message already
+// received, write the replies, then close the clients; each step is bounded by the drain timeout, and
+// the loops and client threads close their clients in parallel
+void Server::drain()
+{
+    drained = true;
+    draining.store(true); // Producers waiting for a full queue give up instead of holding up the shutdown
+    uint64_t deadline = Metrics::nowNs() / 1000000 + config.drainTimeoutMs;
+    LOG_INFO << "Server is shutting down, draining " << connectionCount.load() << " clients."; // Logging shutdown message
+    stopHandoff();
+    if(tls)
+    {
+        tls->stop(); // Clients still shaking hands are closed, none is handed to a loop anymore
+    }
+
+    // Stop taking requests, already received ones are still delivered
+    for(auto& loop: eventLoops)
+    {
+        loop->requestDrain();
+    }
+    shutdownClientThreads(SHUT_RD); // A blocked recv returns, the socket stays writable for the replies
+    waitUntil([this]()
+    {
+        for(auto& loop: eventLoops)
+        {
+            if(!loop->stoppedReading())
+            {
+                return false;
+            }
+        }
+        return activeReaders.load() == 0;
+    }, deadline);
+
+    // Hand the rest of the spool to the workers; what they cannot take in time is handled after the next start
+    if(spool)
+    {
+        if(!waitUntil([this]() { return spool->settled(); }, deadline))
+        {
+            LOG_WARNING << "Spool still holds " << spool->pendingBytes() << " bytes of messages, they are handled after a restart.";
+        }
+        spool->stop();
+    }
+
+    // Handle everything queued, the workers return once their queues are empty
+    workerPool.stop();
+    if(!waitUntil([this]() { return workerPool.finished(); }, deadline))
+    {
+        LOG_WARNING << "Message handlers did not finish within the drain timeout, the remaining messages are dropped.";
+        workerPool.abandon();
+    }
+
+    // Write the remaining replies, then close every client
+    closingClients.store(true);
+    for(auto& loop: eventLoops)
+    {
+        loop->requestClose(deadline);
+    }
+    {
+        std::lock_guard<std::mutex> lock(drainLock);
+        handlersDone = true;
+    }
+    drainDone.notify_all(); // Client threads waiting for the handlers close their sockets
+    if(!workerPool.finished())
+    {
+        shutdownClientThreads(SHUT_RDWR); // Unblock handlers stuck writing to clients that do not read
+    }
+
+    for(auto& loop: eventLoops)
+    {
+        loop->join(); // Closes its remaining clients, handlers still running may post to it until it is destroyed
+    }
+    joinClientThreads();
+    workerPool.join(); // Join the message handler threads
+
+    closeListeningSockets();
+    LOG_INFO << "Server stopped.";
+}
+
+// Function to shut down the sockets of every client thread, e.g. SHUT_RD to end their blocking recv
+void Server::shutdownClientThreads(int how)
+{
+    if(isReactorMode())
+    {
+        return;
+    }
+
+    for(size_t clientSocket = 0; clientSocket < connections.capacity(); ++clientSocket)
+    {
+        ConnectionSlot* slot = connections.find(clientSocket);
+        if(slot == NULL)
+        {
+            clientSocket += CONNECTION_TABLE_CHUNK - 1; // Chunk never used
+            continue;
+        }
+
+        // The hold keeps the client thread from closing the descriptor, which might then be reused, meanwhile.
+        // Not the send lock: a handler may hold it in a write that only this shutdown ends
+        slot->shutdownHolds.fetch_add(1);
+        if(slot->owner.load() != NO_OWNER)
+        {
+            shutdown(clientSocket, how);
+        }
+        slot->shutdownHolds.fetch_sub(1);
+    }
+}
+
+// Function to join the threads of every client, each thread closes its own socket
+void Server::joinClientThreads()
+{
+    for(size_t clientSocket = 0; clientSocket < connections.capacity(); clientSocket += CONNECTION_TABLE_CHUNK)
+    {
+        if(connections.find(clientSocket) == NULL)
+        {
+            continue; // Chunk never used
+        }
+
+        for(size_t i = clientSocket; i < clientSocket + CONNECTION_TABLE_CHUNK && i < connections.capacity(); ++i)
+        {
+            ConnectionSlot* slot = connections.find(i);
+            if(slot->hasThread && pthread_join(slot->thread, NULL) != 0)
+            {
+                LOG_ERROR << "Failed to join thread."; // Log error message if joining thread fails
+            }
+            slot->hasThread = false;
+        }
+    }
+}
+
+// Function to push a message received from a client to the message queue, or to append it to the spool,
+// returns false if the queue is full and the backpressure policy asks to disconnect the client
+bool Server::enqueueMessage(ClientId client, BufferSlice&& payload, IoLoop* loop)
+{
+    Message message(client, std::move(payload)); // Moved through the queue, the payload is never copied
+    countReceived(client, message.payload.size());
+
+    // Counted before the push, the worker may handle the message before tryPush returns. A spooled message
+    // is copied into the log and not counted, the spool's size limit takes the place of the client's
+    ConnectionSlot* slot = connections.find(client.socket);
+    if(!spool)
+    {
+        message.queuedCount = &slot->queuedMessages;
+        message.queuedCount->fetch_add(1, std::memory_order_relaxed);
+    }
+    message.queuedAt = Metrics::nowNs();
+    while(spool ? !spool->append(client, message.payload.view(), message.queuedAt) : !workerPool.tryPush(message, slot->strand))
+    {
+        switch(config.backpressure)
+        {
+            case BackpressurePolicy::BLOCK:
+                if(draining.load(std::memory_order_relaxed))
+                {
+                    unqueue(message);
+                    return false; // The workers may already have stopped, disconnect instead of waiting
+                }
+                if(loop != NULL)
+                {
+                    loop->takeOutboundQueue(); // The consumer may itself wait for room in the loop's reply queue
+                }
+                sched_yield(); // Let the consumer catch up
+                break;
+            case BackpressurePolicy::DROP:
+                Metrics::add(Counter::MESSAGES_DROPPED);
+                unqueue(message);
+                return true; // Message is discarded, the client stays connected
+            case BackpressurePolicy::DISCONNECT:
+                unqueue(message);
+                return false;
+        }
+    }
+    return true;
+}
+
+// Function run by the spool's reader for every durable message, pushes it to the workers in its client's order.
+// Returns false if they have no room for it, the reader retries
+bool Server::deliverSpooled(Message& message)
+{
+    ClientStrand& strand = message.client.socket < 0 ? recoveredStrand : connections.find(message.client.socket)->strand;
+    return workerPool.tryPush(message, strand);
+}
+
+// Function to take a token from a client's bucket for a received message, returns how long the client
+// has to wait before it is read again, 0 while it is within its rate or without a rate limit
+uint64_t Server::throttle(TokenBucket& bucket) const
+{
+    return rateIntervalNs == 0 ? 0 : bucket.take(Metrics::nowNs(), rateIntervalNs, rateCapacityNs);
+}
+
+// Function to check whether a client has reached its limit of messages queued for the workers
+bool Server::clientQueueFull(ClientId client) const
+{
+    return config.clientQueueLimit > 0 &&
+           connections.find(client.socket)->queuedMessages.load(std::memory_order_relaxed) >= config.clientQueueLimit;
+}
+
+// Function to check whether a client that reached its queue limit is down to half of it, reading then resumes
+bool Server::clientQueueDrained(ClientId client) const
+{
+    return connections.find(client.socket)->queuedMessages.load(std::memory_order_relaxed) <= config.clientQueueLimit / 2;
+}
+
+// Function to count a message received from a client in the server and client metrics
+void Server::countReceived(ClientId client, size_t size)
+{
+    Metrics::add(Counter::MESSAGES_RECEIVED);
+    Metrics::add(Counter::BYTES_RECEIVED, size);
+    ConnectionStats& stats = connections.find(client.socket)->stats;
+    stats.messagesReceived.add(1);
+    stats.bytesReceived.add(size);
+}
+
+// Function to count a new client against the connection limit, closing it if the server is full
+bool Server::admitClient(int clientSocket)
+{
+    size_t count = connectionCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    if(config.maxConnections == 0 || count <= config.maxConnections)
+    {
+        Metrics::add(Counter::CONNECTIONS_ACCEPTED);
+        return true;
+    }
+
+    connectionCount.fetch_sub(1, std::memory_order_relaxed);
+    Metrics::add(Counter::CONNECTIONS_REJECTED);
+    LOG_WARNING << "Client " << clientSocket << " is rejected, the server is at its connection limit.";
+    close(clientSocket); // Closed at once so the backlog keeps draining during a reconnect storm
+    return false;
+}
+
+// Function to release the connection limit slot of a disconnected client
+void Server::releaseClient()
+{
+    connectionCount.fetch_sub(1, std::memory_order_relaxed);
+    Metrics::add(Counter::CONNECTIONS_CLOSED);
+}
+
+// Function to read the metrics of every thread along with the current number of clients and queued messages
+MetricsSnapshot Server::stats() const
+{
+    MetricsSnapshot snapshot = Metrics::snapshot();
+    snapshot.connections = connectionCount.load(std::memory_order_relaxed);
+
+    // Counters are read one after another, so the handled count may already include a message counted as not received
+    uint64_t settled = snapshot.counter(Counter::MESSAGES_HANDLED) + snapshot.counter(Counter::MESSAGES_DROPPED);
+    uint64_t received = snapshot.counter(Counter::MESSAGES_RECEIVED);
+    snapshot.queuedMessages = received > settled ? received - settled : 0;
+    return snapshot;
+}
+
+// Function to read the traffic counters of a connected client, returns false if it has disconnected
+bool Server::clientStats(ClientId client, ClientStats& result) const
+{
+    if(connections.ownerOf(client) == NO_OWNER)
+    {
+        return false;
+    }
+
+    const ConnectionStats& stats = connections.find(client.socket)->stats;
+    result.messagesReceived = stats.messagesReceived.get();
+    result.bytesReceived = stats.bytesReceived.get();
+    result.bytesSent = stats.bytesSent.get();
+    result.connectedForNs = Metrics::nowNs() - stats.connectedAtNs.load(std::memory_order_relaxed);
+    return connections.ownerOf(client) != NO_OWNER; // Still the same client, the counters were not reset meanwhile
+}
+
+// Function to log a metrics report with the rates of the last interval until the server is destroyed
+void* Server::reportStats()
+{
+    MetricsSnapshot previous = stats();
+    while(reportingStats.load())
+    {
+        // Sleep in short steps so the destructor does not wait for a whole interval
+        uint64_t due = previous.takenAtNs + (uint64_t)config.statsIntervalMs * 1000000;
+        while(reportingStats.load() && Metrics::nowNs() < due)
+        {
+            usleep(STATS_POLL_INTERVAL_US);
+        }
+        if(!reportingStats.load())
+        {
+            break;
+        }
+
+        MetricsSnapshot current = stats();
+        std::string report = current.format(&previous);
+        for(size_t start = 0; start < report.size();)
+        {
+            size_t end = report.find('\n', start);
+            end = end == std::string::npos ? report.size() : end;
+            LOG_INFO << "Stats: " << std::string_view(report).substr(start, end - start); // One log line each
+            start = end + 1;
+        }
+        previous = current;
+    }
+    return NULL;
+}
+
+// Static function wrapper for running the metrics report in a separate thread
+STATIC void* Server::reportStatsWrapper(void* arg)
+{
+    Server* instance = reinterpret_cast<Server*>(arg);
+    return instance->reportStats();
+}
+
+// Function to hand the listening sockets to the next server process connecting to the handoff socket, then
+// stop this server once it confirms it serves them; both accept from the listeners until then
+void* Server::serveHandoff()
+{
+    bool handedOff = false; // The listeners were sent, the path now belongs to the new process
+    bool takenOver = false;
+    struct pollfd watched[2] = {{handoffListener, POLLIN, 0}, {stopFd, POLLIN, 0}};
+    while(!takenOver && !stopRequested.load())
+    {
+        if(poll(watched, 2, -1) == -1 || (watched[1].revents & POLLIN))
+        {
+            continue; // Interrupted, or the stop request ends the loop
+        }
+
+        int successor = accept4(handoffListener, NULL, NULL, SOCK_CLOEXEC);
+        if(successor == -1)
+        {
+            continue;
+        }
+
+        LOG_INFO << "A new server process asked for the listening sockets.";
+        if(ListenerHandoff::sendListeners(successor, listenSockets))
+        {
+            handedOff = true;
+            takenOver = ListenerHandoff::awaitConfirmation(successor, stopFd);
+        }
+        if(!takenOver && !stopRequested.load())
+        {
+            LOG_WARNING << "The new server process did not take over, serving on.";
+        }
+        close(successor);
+    }
+
+    close(handoffListener);
+    handoffListener = -1;
+    if(!handedOff)
+    {
+        unlink(config.handoffPath.c_str());
+    }
+    if(takenOver)
+    {
+        LOG_INFO << "Listening sockets handed over to the new server process.";
+        stop();
+    }
+    return NULL;
+}
+
+// Static function wrapper for running the listener handoff in a separate thread
+STATIC void* Server::serveHandoffWrapper(void* arg)
+{
+    Server* instance = reinterpret_cast<Server*>(arg);
+    return instance->serveHandoff();
+}
+
+// Function to get the number of descriptors the process may open, which bounds the connection table
+STATIC size_t Server::maxDescriptors()
+{
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < MAX_TRACKED_DESCRIPTORS)
+    {
+        return limit.rlim_cur;
+    }
+    return MAX_TRACKED_DESCRIPTORS;
+}
+
+// Function to copy a reply into a pooled buffer, framed the same way as the client's requests
+BufferSlice Server::frameReply(std::string_view payload) const
+{
+    size_t headerSize = config.framing == FramingMode::LENGTH_PREFIXED ? FRAME_LENGTH_PREFIX_SIZE : 0;
+    size_t trailerSize = config.framing == FramingMode::NEWLINE ? 1 : 0;
+    size_t size = headerSize + payload.size() + trailerSize;
+
+    PooledBuffer buffer(size);
+    char* out = buffer.data();
+    if(headerSize > 0)
+    {
+        uint32_t length = htonl((uint32_t)payload.size()); // Big-endian length prefix
+        memcpy(out, &length, FRAME_LENGTH_PREFIX_SIZE);
+    }
+    memcpy(out + headerSize, payload.data(), payload.size());
+    if(trailerSize > 0)
+    {
+        out[size - 1] = config.frameDelimiter;
+    }
+    buffer.setSize(size);
+
+    const char* data = buffer.data();
+    return BufferSlice(std::move(buffer), data, size);
+}
+
+// Function to send a reply to a client, safe to call from any thread such as a message handler.
+// In reactor mode the reply is queued to the client's loop, which coalesces it with the other
+// replies of the same wakeup; a full reply queue is handled like a full message queue, so
+// returns false if the client is unknown or the reply could not be queued without blocking
+bool Server::send(ClientId client, std::string_view payload)
+{
+    if(config.framing == FramingMode::LENGTH_PREFIXED && payload.size() > UINT32_MAX)
+    {
+        return false; // Does not fit the length prefix
+    }
+
+    Metrics::add(Counter::REPLIES_QUEUED);
+    if(!isReactorMode())
+    {
+        return sendFromThread(client, payload);
+    }
+
+    int owner = connections.ownerOf(client);
+    if(owner == NO_OWNER || (size_t)owner >= publishedLoops.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    return postReply(*eventLoops[owner], Message(client, frameReply(payload))); // The loop drops it if the client leaves meanwhile
+}
+
+// Function to send one payload to every connected client, safe to call from any thread.
+// The payload is framed and copied once; in reactor mode each loop receives a reference
+// and queues it to its own clients, so no shared structure is walked under a lock.
+// Returns false if a loop could not take the payload without blocking
+bool Server::broadcast(std::string_view payload)
+{
+    if(config.framing == FramingMode::LENGTH_PREFIXED && payload.size() > UINT32_MAX)
+    {
+        return false; // Does not fit the length prefix
+    }
+
+    Metrics::add(Counter::REPLIES_QUEUED);
+    if(!isReactorMode())
+    {
+        for(size_t clientSocket = 0; clientSocket < connections.capacity(); ++clientSocket)
+        {
+            ConnectionSlot* slot = connections.find(clientSocket);
+            if(slot == NULL)
+            {
+                clientSocket += CONNECTION_TABLE_CHUNK - 1; // Chunk never used
+                continue;
+            }
+
+            ClientId client;
+            client.socket = clientSocket;
+            client.generation = slot->generation.load(std::memory_order_acquire);
+            sendFromThread(client, payload); // Skipped under the lock if the client is not connected
+        }
+        return true;
+    }
+
+    BufferSlice framed = frameReply(payload);
+    ClientId everyone;
+    everyone.socket = BROADCAST_SOCKET;
+    bool queued = true;
+    size_t loopCount = publishedLoops.load(std::memory_order_acquire);
+    for(size_t i = 0; i < loopCount; ++i)
+    {
+        queued = postReply(*eventLoops[i], Message(everyone, framed.share())) && queued;
+    }
+    return queued;
+}
+
+// Function to send one payload to each of the given clients, safe to call from any thread.
+// Like a broadcast the payload is framed and copied once and every client's loop receives a reference.
+// Returns the number of clients it was queued to, unknown clients and full reply queues are skipped
+size_t Server::multicast(const ClientId* clients, size_t count, std::string_view payload)
+{
+    if(count == 0)
+    {
+        return 0;
+    }
+    if(config.framing == FramingMode::LENGTH_PREFIXED && payload.size() > UINT32_MAX)
+    {
+        return 0; // Does not fit the length prefix
+    }
+
+    Metrics::add(Counter::REPLIES_QUEUED, count);
+    size_t queued = 0;
+    if(!isReactorMode())
+    {
+        for(size_t i = 0; i < count; ++i)
+        {
+            queued += sendFromThread(clients[i], payload) ? 1 : 0;
+        }
+        return queued;
+    }
+
+    BufferSlice framed = frameReply(payload);
+    size_t loopCount = publishedLoops.load(std::memory_order_acquire);
+    for(size_t i = 0; i < count; ++i)
+    {
+        int owner = connections.ownerOf(clients[i]);
+        if(owner != NO_OWNER && (size_t)owner < loopCount && postReply(*eventLoops[owner], Message(clients[i], framed.share())))
+        {
+            ++queued;
+        }
+    }
+    return queued;
+}
+
+// Function to queue a framed reply to a loop, waiting for room only under the BLOCK policy and before the
+// clients are closed. The loop takes its replies even while it waits for room in a worker queue
+bool Server::postReply(IoLoop& loop, Message&& message)
+{
+    while(!loop.post(std::move(message)))
+    {
+        if(config.backpressure != BackpressurePolicy::BLOCK || closingClients.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        sched_yield();
+    }
+    return true;
+}
+
+// Function to check whether a client is still connected, a later client on the same descriptor is a different one
+bool Server::connected(ClientId client) const
+{
+    return connections.ownerOf(client) != NO_OWNER;
+}
+
+// Function to get the topic subscriptions of the clients, publishing is safe from any thread
+TopicRouter& Server::topics()
+{
+    return *topicRouter;
+}
+
+// Function to write a reply straight to the socket of a client thread, blocking until it is written
+bool Server::sendFromThread(ClientId client, std::string_view payload)
+{
+    int clientSocket = client.socket;
+    uint32_t length = htonl((uint32_t)payload.size());
+    char delimiter = config.frameDelimiter;
+    struct iovec vectors[3];
+    int count = 0;
+    if(config.framing == FramingMode::LENGTH_PREFIXED)
+    {
+        vectors[count++] = {&length, FRAME_LENGTH_PREFIX_SIZE};
+    }
+    vectors[count++] = {const_cast<char*>(payload.data()), payload.size()};
+    if(config.framing == FramingMode::NEWLINE)
+    {
+        vectors[count++] = {&delimiter, 1};
+    }
+
+    // The lock keeps concurrent replies from interleaving and the client thread from closing the socket meanwhile
+    std::lock_guard<std::mutex> lock(clientSendLocks[(unsigned)clientSocket % CLIENT_SEND_LOCKS]);
+    if(connections.ownerOf(client) == NO_OWNER)
+    {
+        return false;
+    }
+
+    StreamCompressor* compressor = connections.find(clientSocket)->compressor.get();
+    if(compressor == NULL)
+    {
+        return writeToThreadClient(clientSocket, vectors, count);
+    }
+
+    // Compressed under the lock as well, the blocks have to reach the client in the order of the stream
+    BufferSlice framed = frameReply(payload);
+    std::vector<PooledBuffer> blocks;
+    std::vector<struct iovec> blockVectors;
+    for(size_t offset = 0; offset < framed.size() || blocks.empty(); offset += COMPRESSION_MAX_BLOCK_SIZE)
+    {
+        size_t size = framed.size() - offset < COMPRESSION_MAX_BLOCK_SIZE ? framed.size() - offset : COMPRESSION_MAX_BLOCK_SIZE;
+        blocks.emplace_back();
+        if(!encodeCompressionBlock(size >= config.compressionThreshold ? compressor : NULL, framed.data() + offset, size, blocks.back()))
+        {
+            LOG_WARNING << "Client " << clientSocket << " is shut down, its replies could not be compressed.";
+            shutdown(clientSocket, SHUT_RDWR); // Its thread sees the end of the stream and closes it
+            return false;
+        }
+        blockVectors.push_back({blocks.back().data(), blocks.back().size()});
+    }
+    return writeToThreadClient(clientSocket, blockVectors.data(), (int)blockVectors.size());
+}
+
+// Function to write vectors to the socket of a client thread, blocking until they are written.
+// The caller holds the client's send lock
+bool Server::writeToThreadClient(int clientSocket, struct iovec* vectors, int count)
+{
+    struct msghdr header{};
+    header.msg_iov = vectors;
+    header.msg_iovlen = count > IOV_MAX ? IOV_MAX : count;
+    int remaining = count - (int)header.msg_iovlen; // Vectors beyond the limit of one sendmsg
+    while(header.msg_iovlen > 0)
+    {
+        ssize_t bytesWritten = sendmsg(clientSocket, &header, MSG_NOSIGNAL);
+        if(bytesWritten == -1)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        Metrics::add(Counter::BYTES_SENT, bytesWritten);
+        connections.find(clientSocket)->stats.bytesSent.add(bytesWritten); // Written under the lock, one thread at a time
+
+        // Skip the written vectors and resume inside a partially written one
+        while(header.msg_iovlen > 0 && (size_t)bytesWritten >= header.msg_iov->iov_len)
+        {
+            bytesWritten -= header.msg_iov->iov_len;
+            ++header.msg_iov;
+            --header.msg_iovlen;
+        }
+        if(header.msg_iovlen > 0)
+        {
+            header.msg_iov->iov_base = static_cast<char*>(header.msg_iov->iov_base) + bytesWritten;
+            header.msg_iov->iov_len -= bytesWritten;
+        }
+        else if(remaining > 0)
+        {
+            header.msg_iovlen = remaining > IOV_MAX ? IOV_MAX : remaining;
+            remaining -= (int)header.msg_iovlen;
+        }
+    }
+    return true;
+}
+
+// Function to answer a client thread's offer of codecs and switch its stream to the chosen one. The answer is
+// written and the compressor installed under the send lock, so no reply slips in between in the wrong form
+void Server::startThreadCompression(ClientId client, FrameDecoder& decoder, std::string_view offer)
+{
+    int clientSocket = client.socket;
+    CompressionCodec codec = CompressionPool::negotiate(offer.substr(strlen(COMPRESSION_OFFER_PREFIX)), config.compressionCodecs);
+    CompressorHandle compressor;
+    DecompressorHandle decompressor;
+    if(codec != CompressionCodec::NONE)
+    {
+        compressor = CompressionPool::acquireCompressor(codec, config.compressionLevel);
+        decompressor = CompressionPool::acquireDecompressor(codec);
+        if(!compressor || !decompressor)
+        {
+            LOG_WARNING << "Client " << clientSocket << " stays uncompressed, no " << CompressionPool::name(codec) << " context could be set up.";
+            codec = CompressionCodec::NONE;
+        }
+    }
+
+    BufferSlice answer = frameReply(std::string(COMPRESSION_OFFER_PREFIX) + CompressionPool::name(codec));
+    struct iovec vector = {const_cast<char*>(answer.data()), answer.size()};
+    {
+        std::lock_guard<std::mutex> lock(clientSendLocks[(unsigned)clientSocket % CLIENT_SEND_LOCKS]);
+        if(connections.ownerOf(client) == NO_OWNER || !writeToThreadClient(clientSocket, &vector, 1) || codec == CompressionCodec::NONE)
+        {
+            return;
+        }
+        connections.find(clientSocket)->compressor = std::move(compressor);
+    }
+    decoder.startDecompression(std::move(decompressor));
+    LOG_INFO << "Client " << clientSocket << " switched to " << CompressionPool::name(codec) << " compression.";
+}
+
+// Function to close the socket of a client thread once no reply is being written to it
+void Server::closeClientThreadSocket(ClientId client)
+{
+    int clientSocket = client.socket;
+    {
+        std::lock_guard<std::mutex> lock(clientSendLocks[(unsigned)clientSocket % CLIENT_SEND_LOCKS]);
+        connections.close(clientSocket);
+        connections.find(clientSocket)->compressor.reset(); // Back to this thread's pool, no reply uses it anymore
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst); // A shutdown either sees the client gone or is waited for
+    while(connections.find(clientSocket)->shutdownHolds.load() != 0)
+    {
+        sched_yield();
+    }
+    close(clientSocket);
+    releaseClient();
+}
+
+// Function to handle a client connection
+void* Server::handleClient(ClientId client)
+{
+    int clientSocket = client.socket;
+    if(tls)
+    {
+        if(!tls->handshake(clientSocket))
+        {
+            activeReaders.fetch_sub(1);
+            close(clientSocket);
+            releaseClient();
+            return NULL;
+        }
+        client = connections.open(clientSocket, 0);
+        if(draining.load())
+        {
+            shutdown(clientSocket, SHUT_RD); // The shutdown skipped the client while it was still shaking hands
+        }
+    }
+
+    FrameDecoder decoder(config.framing, config.maxFrameSize, config.frameDelimiter); // Reassembles frames from the received bytes
+    ssize_t bytesRead = 0; // Number of bytes read
+    size_t available = 0; // Free space in the decoder's buffer
+    char* buffer = decoder.prepareWrite(CLIENT_RECV_SIZE, available); // Buffer to store received data
+    TokenBucket bucket; // Rate limit of the client
+    bool negotiating = !config.compressionCodecs.empty(); // The next frame may still offer codecs, only the first one can
+
+    // A blocking thread needs no timer, the kernel ends a recv that waits longer than the timeout
+    unsigned timeoutMs = config.idleTimeoutMs; // Timeout currently set on the socket
+    if(timeoutMs > 0)
+    {
+        setReceiveTimeout(clientSocket, timeoutMs);
+    }
+
+    // Receive data from the client until connection is closed
+    while((bytesRead = recv(clientSocket, buffer, available, 0)) > 0)
+    {
+        decoder.commitWrite(bytesRead);
+        config.tuning.rearmQuickAck(clientSocket);
+        uint64_t throttleNs = 0;
+        auto onFrame = [this, client, &decoder, &bucket, &throttleNs, &negotiating](BufferSlice&& frame)
+        {
+            if(negotiating)
+            {
+                negotiating = false;
+                if(isCompressionOffer(frame.view()))
+                {
+                    startThreadCompression(client, decoder, frame.view()); // Answered here, never handed to a handler
+                    return true;
+                }
+            }
+            throttleNs = throttle(bucket);
+            if(!enqueueMessage(client, std::move(frame))) // Push complete frames to the message queue
+            {
+                return false;
+            }
+            if(clientQueueFull(client))
+            {
+                decoder.pause(); // The rest stays buffered, a compressed stream is not decompressed any further
+            }
+            return true;
+        };
+
+        // A client with too many queued messages waits for the workers instead of filling their queue
+        DecodeResult result;
+        while((result = decoder.decode(onFrame)) == DecodeResult::PAUSED)
+        {
+            while(!clientQueueDrained(client) && !draining.load())
+            {
+                usleep(QUEUE_LIMIT_STEP_US);
+            }
+        }
+
+        if(result != DecodeResult::OK)
+        {
+            LOG_INFO << "Client " << clientSocket << " disconnected, "
+                      << (result == DecodeResult::STOPPED ? "message queue is full." :
+                          result == DecodeResult::INVALID_STREAM ? "its compressed stream is invalid." : "frame is too large.");
+            activeReaders.fetch_sub(1);
+            closeClientThreadSocket(client);
+            return NULL;
+        }
+        buffer = decoder.prepareWrite(CLIENT_RECV_SIZE, available);
+
+        // A client over its rate is not read for a while, its socket buffer then throttles the sender
+        uint64_t resumeAt = Metrics::nowNs() + throttleNs;
+        for(uint64_t time = Metrics::nowNs(); throttleNs > 0 && time < resumeAt && !draining.load(); time = Metrics::nowNs())
+        {
+            uint64_t remainingUs = (resumeAt - time + 999) / 1000;
+            usleep(remainingUs < THROTTLE_STEP_US ? remainingUs : THROTTLE_STEP_US);
+        }
+
+        // An incomplete frame has to be finished within the read timeout
+        unsigned wantedMs = config.idleTimeoutMs;
+        if(config.readTimeoutMs > 0 && decoder.bufferedBytes() > 0 && (wantedMs == 0 || config.readTimeoutMs < wantedMs))
+        {
+            wantedMs = config.readTimeoutMs;
+        }
+        if(wantedMs != timeoutMs)
+        {
+            timeoutMs = wantedMs;
+            setReceiveTimeout(clientSocket, timeoutMs);
+        }
+    }
+
+    if(bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        LOG_INFO << "Client " << clientSocket << " is disconnected, " << (decoder.bufferedBytes() > 0 ? "read" : "idle") << " timeout.";
+    }
+    else if(bytesRead <= 0)
+    {
+        LOG_INFO << "Client " << clientSocket << " disconnected.";
+    }
+
+    activeReaders.fetch_sub(1);
+    if(draining.load())
+    {
+        // Stopped by the shutdown, the replies to the requests read so far are still written to the socket
+        std::unique_lock<std::mutex> lock(drainLock);
+        drainDone.wait(lock, [this]() { return handlersDone; });
+    }
+    closeClientThreadSocket(client);
+    return NULL;
 }
 
 // Static function wrapper for handling client connections
 STATIC void* Server::handleClientWrapper(void* arg)
 {
     PosixThreadData* threadData = reinterpret_cast<PosixThreadData*>(arg);
-    threadData->server->handleClient(threadData->clientSoc);
+    threadData->server->handleClient(threadData->client);
+    delete threadData; // Thread data is allocated by startListening for this thread only
+    return NULL;
 }
@@ -1,11 +1,22 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+#include "ServerConfig.h"
+#include "WorkerPool.h"
+#include "ConnectionTable.h"
+#include "Metrics.h"
+#include "TokenBucket.h"
+#include "ConnectionSession.h"
+#include <pthread.h>
 #include <arpa/inet.h>
-#include <map>
-#include <queue>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 class TCPServerError : public std::exception
 {
@@ -21,31 +32,111 @@ private:
 };
 
 struct PosixThreadData;
+class IoLoop;
+class TlsAcceptor;
+class TopicRouter;
+class MessageSpool;
 
-#define MAX_CLIENTS 10
+#define CLIENT_RECV_SIZE 256 // Minimum free space before each recv of a client thread
+#define MAX_TRACKED_DESCRIPTORS (1 << 20) // Upper bound of the connection table, descriptors above it are rejected
+#define CLIENT_SEND_LOCKS 64 // Number of locks serialising the replies of client threads, picked by descriptor
+#define SHUTDOWN_WAIT_STEP_US 1000 // Step a stopping server polls the progress of its threads in
+#define STATS_POLL_INTERVAL_US 100000 // Step the metrics report thread sleeps in while waiting for the next report
+#define THROTTLE_STEP_US 10000 // Longest sleep of a throttled client thread, so it notices the shutdown
+#define QUEUE_LIMIT_STEP_US 1000 // Step a client thread over its queue limit polls its queued messages in
 
 class Server
 {
 public:
-    Server(int Port);
+    Server(int Port, const ServerConfig& serverConfig = ServerConfig());
     ~Server();
     void startServer();
+    void stop();
+    void setMessageHandler(MessageHandler handler);
+    void setSessionFactory(SessionFactory factory);
+    bool send(ClientId client, std::string_view payload);
+    bool broadcast(std::string_view payload);
+    size_t multicast(const ClientId* clients, size_t count, std::string_view payload);
+    bool connected(ClientId client) const;
+    TopicRouter& topics();
+    MetricsSnapshot stats() const;
+    bool clientStats(ClientId client, ClientStats& result) const;
     
 private:
+    friend class IoLoop;
+    friend class TopicRouter;
+
     int serverPort;
+    ServerConfig config;
     int serverSocket;
+    std::vector<int> listenSockets; // Every listening socket of the server, serverSocket is the first one
     struct sockaddr_in serverAddr;
-    std::map<int, pthread_t> clientsMap;
-    std::queue<std::pair<int, std::string>> messageQueue;
-    pthread_t messageQueueThread;
-    pthread_mutex_t mutex;
+    ConnectionTable connections; // State of every client, indexed by descriptor
+    std::atomic<size_t> connectionCount{0}; // Connected clients of every loop or client thread
+    std::vector<std::unique_ptr<IoLoop>> eventLoops; // Created once by startEventLoops and kept until the server is destroyed
+    std::atomic<size_t> publishedLoops{0}; // Loops other threads may use, set once eventLoops is complete
+    WorkerPool workerPool; // Handler threads consuming the received messages
+    SessionFactory sessionFactory; // Creates a loop-local session per client instead of using the workers, if set
+    std::unique_ptr<TlsAcceptor> tls; // Handshakes of the clients if TLS is configured, NULL for plain TCP
+    std::unique_ptr<TopicRouter> topicRouter; // Subscriptions of the clients to topics
+    std::unique_ptr<MessageSpool> spool; // Durable log the received messages pass through, NULL without a spool directory
+    ClientStrand recoveredStrand; // Orders the spooled messages of an earlier server's clients, ORDERED_WORK_STEALING only
+    uint64_t rateIntervalNs; // Refill time of one token of a client's bucket, 0 without a rate limit
+    uint64_t rateCapacityNs; // Refill time of a whole bucket
+    std::mutex clientSendLocks[CLIENT_SEND_LOCKS]; // Keep replies of client threads whole and apart from the close
+    int stopFd; // eventfd signalled by stop, wakes the thread waiting in startServer
+    std::atomic<bool> stopRequested{false}; // stop was called
+    std::atomic<bool> draining{false}; // Shutdown started, producers no longer wait for room in full queues
+    std::atomic<bool> closingClients{false}; // Handlers are done or out of time, replies no longer wait for room
+    bool drained; // Shutdown completed, the threads of the server are joined
+    std::atomic<int> activeReaders{0}; // Client threads still reading their socket
+    std::mutex drainLock; // Guards handlersDone
+    std::condition_variable drainDone; // Signalled when client threads may close their sockets
+    bool handlersDone; // Queued messages are handled, client threads waiting to close may proceed
+    pthread_t statsThread; // Thread logging the periodic metrics report
+    bool hasStatsThread; // Whether statsThread was started and has to be joined
+    std::atomic<bool> reportingStats{false}; // Cleared to stop the report thread
+    int handoffPeer; // Connection to the server the listeners were received from until it is told to stop, -1 if none
+    int handoffListener; // Unix socket the next server process connects to for the listeners, -1 if none
+    pthread_t handoffThread; // Thread handing the listeners to the next server process
+    bool hasHandoffThread; // Whether handoffThread was started and has to be joined
 
     void createAndBindSocket();
-    void* handleMessageQueue();
-    static void* handleMessageQueueWrapper(void* arg);
+    size_t listenerCount() const;
+    bool inheritListeners();
+    int openListeningSocket();
+    void closeListeningSockets();
+    bool isReactorMode() const;
+    bool usesReusePort() const;
     void startListening();
-    void* handleClient(int clientSocket);
+    void startEventLoops();
+    void startHandoff();
+    void stopHandoff();
+    void waitForStop();
+    void drain();
+    void shutdownClientThreads(int how);
+    void joinClientThreads();
+    bool enqueueMessage(ClientId client, BufferSlice&& payload, IoLoop* loop = NULL);
+    bool deliverSpooled(Message& message);
+    void countReceived(ClientId client, size_t size);
+    uint64_t throttle(TokenBucket& bucket) const;
+    bool clientQueueFull(ClientId client) const;
+    bool clientQueueDrained(ClientId client) const;
+    bool admitClient(int clientSocket);
+    void releaseClient();
+    BufferSlice frameReply(std::string_view payload) const;
+    bool postReply(IoLoop& loop, Message&& message);
+    bool sendFromThread(ClientId client, std::string_view payload);
+    bool writeToThreadClient(int clientSocket, struct iovec* vectors, int count);
+    void startThreadCompression(ClientId client, FrameDecoder& decoder, std::string_view offer);
+    void closeClientThreadSocket(ClientId client);
+    void* handleClient(ClientId client);
+    void* reportStats();
+    void* serveHandoff();
+    static size_t maxDescriptors();
     static void* handleClientWrapper(void* arg);
+    static void* reportStatsWrapper(void* arg);
+    static void* serveHandoffWrapper(void* arg);
 };
 
 #endif
\ No newline at end of file
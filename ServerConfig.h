@@ -0,0 +1,116 @@
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+#include "Compression.h"
+#include "Framing.h"
+#include "Logger.h"
+#include "SocketTuning.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define DEFAULT_REACTOR_THREADS 1 // Default number of event loop threads in reactor mode
+#define DEFAULT_WORKER_THREADS 1 // Default number of message handler threads
+#define DEFAULT_MESSAGE_QUEUE_CAPACITY 65536 // Default number of messages the queue of each worker can hold
+#define DEFAULT_LISTEN_BACKLOG 4096 // Default pending connections per listener, the kernel caps it at net.core.somaxconn
+#define DEFAULT_MAX_CONNECTIONS 0 // Default limit of connected clients, 0 leaves only the descriptor limit
+#define DEFAULT_ACCEPT_BATCH_SIZE 64 // Default number of connections an event loop accepts before serving its clients again
+#define DEFAULT_IDLE_TIMEOUT_MS 0 // Default idle timeout, 0 keeps silent clients connected forever
+#define DEFAULT_READ_TIMEOUT_MS 0 // Default time limit for receiving the rest of a started frame, 0 for none
+#define DEFAULT_OUTBOUND_HIGH_WATERMARK (1024 * 1024) // Queued reply bytes above which a client's requests stop being read
+#define DEFAULT_OUTBOUND_LOW_WATERMARK (256 * 1024) // Queued reply bytes at or below which reading resumes
+#define DEFAULT_MAX_OUTBOUND_BYTES (64 * 1024 * 1024) // Queued reply bytes above which a client is disconnected
+#define DEFAULT_ZERO_COPY_THRESHOLD 0 // Zero copy sends are disabled unless a threshold is configured
+#define DEFAULT_STATS_INTERVAL_MS 0 // Metrics are only reported on request unless an interval is configured
+#define DEFAULT_DRAIN_TIMEOUT_MS 5000 // Default time a stopping server gives queued messages and replies
+#define DEFAULT_FAIR_QUANTUM_BYTES 1024 // Default bytes of one client's messages a worker handles before the next client's turn
+#define DEFAULT_CLIENT_MESSAGE_RATE 0 // Default messages per second a client may send, 0 for no limit
+#define DEFAULT_CLIENT_QUEUE_LIMIT 1024 // Default messages of one client queued for the workers before it is no longer read
+#define DEFAULT_TLS_HANDSHAKE_TIMEOUT_MS 5000 // Default time a TLS client has to complete its handshake
+#define DEFAULT_SPOOL_SEGMENT_SIZE (64 * 1024 * 1024) // Default size of one file of the message spool
+#define DEFAULT_SPOOL_MAX_BYTES (1024 * 1024 * 1024) // Default bytes of unhandled messages the spool holds before it is full
+#define DEFAULT_SPOOL_COMMIT_INTERVAL_US 1000 // Default shortest time between two group commits of the spool
+
+// I/O model used by the server to serve its clients
+enum class ServerMode
+{
+    THREAD_PER_CLIENT, // One blocking POSIX thread per accepted client
+    EPOLL_REACTOR,     // Edge-triggered epoll event loops with non-blocking sockets sharing one listener
+    REUSEPORT_REACTOR, // One SO_REUSEPORT listener per event loop, load-balanced across loops by the kernel
+    IO_URING_REACTOR   // io_uring loops with multishot accept/recv, one SO_REUSEPORT listener per loop
+};
+
+// What producers do when the message queue is full
+enum class BackpressurePolicy
+{
+    BLOCK,     // Wait until the consumer frees a slot, which stops reading from the client meanwhile
+    DROP,      // Discard the message
+    DISCONNECT // Close the client that could not be queued
+};
+
+// How the received messages are spread over the worker threads
+enum class WorkerScheduling
+{
+    CLIENT_AFFINITY,      // Every client is hashed to one worker, which handles its messages in order
+    WORK_STEALING,        // Messages go to any worker and idle workers steal queued ones; a client's messages may overlap
+    ORDERED_WORK_STEALING // As WORK_STEALING, but each client's messages are handled one at a time in arrival order
+};
+
+// Runtime configuration of a Server instance, selected at construction
+struct ServerConfig
+{
+    ServerMode mode = ServerMode::THREAD_PER_CLIENT; // I/O model of the server
+    LogLevel logLevel = LogLevel::INFO; // Lowest level written by the asynchronous logger
+    bool echoMessages = true; // Log every received message with the default handler, disable it for load tests
+    bool topicCommands = false; // The default handler serves SUBSCRIBE, UNSUBSCRIBE and PUBLISH messages through topics()
+    unsigned statsIntervalMs = DEFAULT_STATS_INTERVAL_MS; // Log a metrics report with rates this often, 0 disables
+    int listenBacklog = DEFAULT_LISTEN_BACKLOG; // Backlog passed to listen() for every listening socket
+    size_t maxConnections = DEFAULT_MAX_CONNECTIONS; // Clients accepted beyond this are closed right away, 0 for no limit
+    int acceptBatchSize = DEFAULT_ACCEPT_BATCH_SIZE; // Accepts per loop iteration in epoll modes, 0 accepts until the backlog is empty
+    unsigned idleTimeoutMs = DEFAULT_IDLE_TIMEOUT_MS; // Disconnect clients that neither sent nor read anything for this long
+    unsigned readTimeoutMs = DEFAULT_READ_TIMEOUT_MS; // Disconnect clients that leave a frame incomplete for this long
+    unsigned drainTimeoutMs = DEFAULT_DRAIN_TIMEOUT_MS; // On stop, handle queued messages and write replies for at most this long
+    bool stopOnSignals = true; // SIGINT and SIGTERM stop the server gracefully while startServer runs
+    std::string handoffPath; // Unix socket where a running server hands its listeners to its replacement, empty disables
+    bool socketActivation = true; // Serve the listening sockets passed by systemd in LISTEN_FDS instead of binding
+    SocketTuning tuning; // Socket options, kernel defaults unless a preset such as SocketTuning::latency() is chosen
+    int reactorThreads = DEFAULT_REACTOR_THREADS; // Number of event loop threads (reactor modes only)
+    bool pinReactorThreads = true; // Pin event loop i to CPU i modulo the number of online CPUs
+    std::vector<int> reactorCpus; // Pin event loop i to reactorCpus[i] modulo their number instead, e.g. the CPUs of one socket
+    std::string nicQueueInterface; // Without reactorCpus, pin the loops to the CPUs taking this interface's receive interrupts
+    int workerThreads = DEFAULT_WORKER_THREADS; // Number of message handler threads
+    WorkerScheduling scheduling = WorkerScheduling::CLIENT_AFFINITY; // How messages are spread over the workers
+    std::vector<int> workerCpus; // Pin worker i to workerCpus[i] modulo their number, empty leaves them to the scheduler
+    size_t messageQueueCapacity = DEFAULT_MESSAGE_QUEUE_CAPACITY; // Per worker, rounded up to a power of two;
+                                                                  // also the limit of one client's strand when ordered
+    BackpressurePolicy backpressure = BackpressurePolicy::BLOCK; // Behaviour when a worker's queue is full
+    size_t fairQuantumBytes = DEFAULT_FAIR_QUANTUM_BYTES; // Deficit round-robin quantum of the workers, 0 handles messages in arrival order;
+                                                          // CLIENT_AFFINITY only, strands take turns by message count
+    unsigned clientQueueLimit = DEFAULT_CLIENT_QUEUE_LIMIT; // Pause reading a client with this many queued messages, 0 for no limit;
+                                                            // keeps one client from filling a worker queue shared with others
+    unsigned clientMessageRate = DEFAULT_CLIENT_MESSAGE_RATE; // Token bucket rate per client, reading pauses once it is exceeded
+    unsigned clientMessageBurst = 0; // Token bucket size in messages, 0 for a tenth of the rate
+    FramingMode framing = FramingMode::RAW; // How the byte stream of each client is split into messages
+    char frameDelimiter = DEFAULT_FRAME_DELIMITER; // End of every message and reply in NEWLINE mode
+    size_t maxFrameSize = DEFAULT_MAX_FRAME_SIZE; // Clients sending larger frames are disconnected
+    size_t outboundHighWatermark = DEFAULT_OUTBOUND_HIGH_WATERMARK; // Pause reading a client with this many queued reply bytes
+    size_t outboundLowWatermark = DEFAULT_OUTBOUND_LOW_WATERMARK; // Resume reading once its queue has drained to this
+    size_t maxOutboundBytes = DEFAULT_MAX_OUTBOUND_BYTES; // Disconnect a client whose queued replies exceed this
+    size_t zeroCopyThreshold = DEFAULT_ZERO_COPY_THRESHOLD; // Reactor sends this large are made without copying, 0 disables;
+                                                            // page pinning only pays off from roughly 10 KB
+    std::vector<CompressionCodec> compressionCodecs; // Codecs a client may switch its connection to, most preferred first;
+                                                     // empty disables the negotiation, RAW framing cannot carry it
+    int compressionLevel = 0; // Level of the negotiated codec, 0 for the codec's default
+    size_t compressionThreshold = DEFAULT_COMPRESSION_THRESHOLD; // Replies written together below this size are not compressed
+    std::string tlsCertificateFile; // PEM certificate chain, TLS is terminated on every client if this and the key are set
+    std::string tlsPrivateKeyFile; // PEM private key of the certificate
+    unsigned tlsHandshakeTimeoutMs = DEFAULT_TLS_HANDSHAKE_TIMEOUT_MS; // Disconnect TLS clients that take longer to shake hands
+    std::string spoolDirectory; // Received messages go through a memory-mapped log in this directory and survive a crash,
+                                // empty queues them in memory only; sessions bypass it
+    size_t spoolSegmentSize = DEFAULT_SPOOL_SEGMENT_SIZE; // Size of one log file, raised to hold the largest frame
+    size_t spoolMaxBytes = DEFAULT_SPOOL_MAX_BYTES; // A full spool is handled like a full worker queue; replaces clientQueueLimit
+    unsigned spoolCommitIntervalUs = DEFAULT_SPOOL_COMMIT_INTERVAL_US; // Messages are synced to disk in groups at most this often
+                                                                        // and handed to the workers once they are
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "SocketTuning.h" // Including the header file to define the SocketTuning structure
+#include "Logger.h" // Including the logger for status and error messages
+#include <netinet/in.h> // This header file is included for the IPPROTO_TCP option level
+#include <netinet/tcp.h> // This header file is included for the TCP level socket options
+#include <sys/socket.h> // This header file is included for setsockopt and the socket level options
+
+// Function to set one integer socket option, logging instead of failing since every option is a tuning only
+static void setOption(int socket, int level, int option, int value, const char* name)
+{
+    if(setsockopt(socket, level, option, &value, sizeof(value)) == -1)
+    {
+        LOG_WARNING << "Socket option " << name << " could not be set on socket " << socket << ".";
+    }
+}
+
+// Function to get the preset for request/response traffic where every reply should leave at once
+SocketTuning SocketTuning::latency()
+{
+    SocketTuning tuning;
+    tuning.noDelay = true;
+    tuning.quickAck = true;
+    tuning.busyPollMicros = 50;
+    tuning.fastOpenQueue = 256;
+    tuning.incomingCpu = true;
+    return tuning;
+}
+
+// Function to get the preset for bulk traffic where fewer, fuller segments and wakeups matter most
+SocketTuning SocketTuning::throughput()
+{
+    SocketTuning tuning;
+    tuning.receiveBuffer = 4 * 1024 * 1024;
+    tuning.sendBuffer = 4 * 1024 * 1024;
+    tuning.deferAcceptSeconds = 1;
+    tuning.incomingCpu = true;
+    return tuning;
+}
+
+// Function to tune a listening socket before it is bound; buffer sizes are inherited by accepted
+// sockets and must be set before listen() so the window scale of the handshake matches them
+void SocketTuning::applyToListener(int listenSocket) const
+{
+    if(receiveBuffer > 0)
+    {
+        setOption(listenSocket, SOL_SOCKET, SO_RCVBUF, receiveBuffer, "SO_RCVBUF");
+    }
+    if(sendBuffer > 0)
+    {
+        setOption(listenSocket, SOL_SOCKET, SO_SNDBUF, sendBuffer, "SO_SNDBUF");
+    }
+    if(deferAcceptSeconds > 0)
+    {
+        setOption(listenSocket, IPPROTO_TCP, TCP_DEFER_ACCEPT, deferAcceptSeconds, "TCP_DEFER_ACCEPT");
+    }
+    if(fastOpenQueue > 0)
+    {
+        setOption(listenSocket, IPPROTO_TCP, TCP_FASTOPEN, fastOpenQueue, "TCP_FASTOPEN");
+    }
+}
+
+// Function to tie an SO_REUSEPORT listener to the CPU of the loop accepting from it
+void SocketTuning::applyIncomingCpu(int listenSocket, int cpu) const
+{
+    if(incomingCpu && cpu >= 0)
+    {
+        setOption(listenSocket, SOL_SOCKET, SO_INCOMING_CPU, cpu, "SO_INCOMING_CPU");
+    }
+}
+
+// Function to tune an accepted client socket
+void SocketTuning::applyToClient(int clientSocket) const
+{
+    if(noDelay)
+    {
+        setOption(clientSocket, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+    }
+    if(busyPollMicros > 0)
+    {
+        setOption(clientSocket, SOL_SOCKET, SO_BUSY_POLL, busyPollMicros, "SO_BUSY_POLL");
+    }
+    if(keepAliveIdleSeconds > 0)
+    {
+        // Finds peers that vanished without a FIN even while the idle timeout is disabled
+        setOption(clientSocket, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+        setOption(clientSocket, IPPROTO_TCP, TCP_KEEPIDLE, keepAliveIdleSeconds, "TCP_KEEPIDLE");
+        if(keepAliveIntervalSeconds > 0)
+        {
+            setOption(clientSocket, IPPROTO_TCP, TCP_KEEPINTVL, keepAliveIntervalSeconds, "TCP_KEEPINTVL");
+        }
+        if(keepAliveProbes > 0)
+        {
+            setOption(clientSocket, IPPROTO_TCP, TCP_KEEPCNT, keepAliveProbes, "TCP_KEEPCNT");
+        }
+    }
+    rearmQuickAck(clientSocket);
+}
+
+// Function to turn quick acknowledgements on again, the kernel falls back to delayed ones on its own
+void SocketTuning::rearmQuickAck(int clientSocket) const
+{
+    if(quickAck)
+    {
+        setOption(clientSocket, IPPROTO_TCP, TCP_QUICKACK, 1, "TCP_QUICKACK");
+    }
+}
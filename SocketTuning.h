@@ -0,0 +1,30 @@
+#ifndef SOCKET_TUNING_H
+#define SOCKET_TUNING_H
+
+// Socket options applied to the listening sockets and to every accepted client.
+// Zero or false keeps the kernel default; setting an option that fails only logs,
+// the server keeps working with a kernel that lacks it
+struct SocketTuning
+{
+    int receiveBuffer = 0; // SO_RCVBUF in bytes, a fixed size disables receive buffer autotuning
+    int sendBuffer = 0; // SO_SNDBUF in bytes, a fixed size disables send buffer autotuning
+    bool noDelay = false; // TCP_NODELAY, send small replies at once instead of coalescing them (Nagle)
+    bool quickAck = false; // TCP_QUICKACK, acknowledge at once; the kernel clears it, so it is set again after each read
+    int busyPollMicros = 0; // SO_BUSY_POLL, spin on the device queue this long before sleeping in a blocking read
+    int deferAcceptSeconds = 0; // TCP_DEFER_ACCEPT, only hand over connections once their first data arrived
+    int fastOpenQueue = 0; // TCP_FASTOPEN, pending fast open requests, accepting data in the SYN saves a round trip
+    bool incomingCpu = false; // SO_INCOMING_CPU, steer connections to the SO_REUSEPORT listener of the CPU handling them
+    int keepAliveIdleSeconds = 0; // SO_KEEPALIVE with TCP_KEEPIDLE, probe clients silent for this long to find dead peers
+    int keepAliveIntervalSeconds = 0; // TCP_KEEPINTVL, time between probes, kernel default if 0
+    int keepAliveProbes = 0; // TCP_KEEPCNT, unanswered probes before the connection is reset, kernel default if 0
+
+    static SocketTuning latency();
+    static SocketTuning throughput();
+
+    void applyToListener(int listenSocket) const;
+    void applyIncomingCpu(int listenSocket, int cpu) const;
+    void applyToClient(int clientSocket) const;
+    void rearmQuickAck(int clientSocket) const;
+};
+
+#endif
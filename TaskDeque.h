@@ -0,0 +1,108 @@
+#ifndef TASK_DEQUE_H
+#define TASK_DEQUE_H
+
+#include "MessageRing.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded Chase-Lev work-stealing deque of task pointers.
+// The owning thread pushes and pops at the bottom without any locked instruction except when it races for
+// the last task; other threads steal the oldest task from the top with a compare-and-swap of the top index.
+// Capacity must be a power of two, pushing into a full deque fails instead of growing it
+template <typename T, size_t Capacity>
+class TaskDeque
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "TaskDeque capacity must be a power of two");
+
+public:
+    TaskDeque()
+    {
+        for(size_t i = 0; i < Capacity; ++i)
+        {
+            slots[i].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    TaskDeque(const TaskDeque&) = delete;
+    TaskDeque& operator=(const TaskDeque&) = delete;
+
+    // Function to add a task at the bottom, returns false if the deque is full; owner thread only
+    bool push(T* task)
+    {
+        int64_t b = bottom.value.load(std::memory_order_relaxed);
+        int64_t t = top.value.load(std::memory_order_acquire);
+        if(b - t >= (int64_t)Capacity)
+        {
+            return false;
+        }
+
+        slots[b & (Capacity - 1)].store(task, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release); // Publish the task before the new bottom
+        bottom.value.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Function to take the newest task, returns NULL if the deque is empty; owner thread only
+    T* pop()
+    {
+        int64_t b = bottom.value.load(std::memory_order_relaxed) - 1;
+        bottom.value.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // Thieves must see the reserved bottom before top is read
+        int64_t t = top.value.load(std::memory_order_relaxed);
+        if(t > b)
+        {
+            bottom.value.store(b + 1, std::memory_order_relaxed); // Was empty
+            return NULL;
+        }
+
+        T* task = slots[b & (Capacity - 1)].load(std::memory_order_relaxed);
+        if(t == b)
+        {
+            // Last task, a thief may be taking it at the same time
+            if(!top.value.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                task = NULL;
+            }
+            bottom.value.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    // Function to take the oldest task, returns NULL if the deque is empty or another thread won the race; any thread
+    T* steal()
+    {
+        int64_t t = top.value.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.value.load(std::memory_order_acquire);
+        if(t >= b)
+        {
+            return NULL;
+        }
+
+        T* task = slots[t & (Capacity - 1)].load(std::memory_order_relaxed);
+        if(!top.value.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return NULL; // The owner or another thief took it
+        }
+        return task;
+    }
+
+    // Function to check whether the deque looks empty, a hint for other threads
+    bool empty() const
+    {
+        return bottom.value.load(std::memory_order_acquire) <= top.value.load(std::memory_order_acquire);
+    }
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Index
+    {
+        std::atomic<int64_t> value{0};
+    };
+
+    Index top; // Next task to steal, only ever incremented
+    Index bottom; // Next free slot, written by the owner only
+    std::atomic<T*> slots[Capacity]; // Storage of the deque
+};
+
+#endif
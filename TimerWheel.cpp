@@ -0,0 +1,94 @@
+#include "TimerWheel.h" // Including the header file to define the TimerWheel class
+
+// Constructor for the TimerWheel class
+TimerWheel::TimerWheel() : current(0), count(0)
+{
+    for(int level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        for(int slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot)
+        {
+            slots[level][slot] = NULL;
+        }
+    }
+}
+
+// Function to schedule a timer, or move it if it is already scheduled; past ticks fire on the next tick
+void TimerWheel::schedule(TimerEntry& entry, uint64_t expiryTick)
+{
+    cancel(entry);
+
+    // Timers beyond the span of the wheel are clamped, their owner checks the real deadline when they fire
+    const uint64_t span = (uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS);
+    if(expiryTick <= current)
+    {
+        expiryTick = current + 1;
+    }
+    else if(expiryTick - current >= span)
+    {
+        expiryTick = current + span - 1;
+    }
+
+    entry.expiry = expiryTick;
+    insert(entry);
+    ++count;
+}
+
+// Function to unschedule a timer, does nothing if it is not scheduled
+void TimerWheel::cancel(TimerEntry& entry)
+{
+    if(!entry.scheduled())
+    {
+        return;
+    }
+
+    *entry.link = entry.next;
+    if(entry.next != NULL)
+    {
+        entry.next->link = entry.link;
+    }
+    entry.next = NULL;
+    entry.link = NULL;
+    --count;
+}
+
+// Function to put a timer into the slot of the lowest level whose range covers its distance
+void TimerWheel::insert(TimerEntry& entry)
+{
+    uint64_t distance = entry.expiry - current;
+    int level = 0;
+    while(level < TIMER_WHEEL_LEVELS - 1 && distance >= ((uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))))
+    {
+        ++level;
+    }
+
+    TimerEntry*& slot = slots[level][(entry.expiry >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+    entry.next = slot;
+    entry.link = &slot;
+    if(slot != NULL)
+    {
+        slot->link = &entry.next;
+    }
+    slot = &entry;
+}
+
+// Function to move the timers of the higher level slots that have come into range one level down,
+// called after each step of the current tick and before its bottom slot runs
+void TimerWheel::cascade()
+{
+    for(int level = 1; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        if((current & (((uint64_t)1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0)
+        {
+            break; // The lower level has not wrapped around
+        }
+
+        TimerEntry* entry = slots[level][(current >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+        slots[level][(current >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)] = NULL;
+        while(entry != NULL)
+        {
+            TimerEntry* next = entry->next;
+            insert(*entry); // Count is unchanged, the timer only moves
+            entry = next;
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define TIMER_WHEEL_BITS 6 // Slots per level are 1 << TIMER_WHEEL_BITS
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS) // Slots per level
+#define TIMER_WHEEL_LEVELS 4 // Levels, the wheel spans TIMER_WHEEL_SLOTS ^ TIMER_WHEEL_LEVELS ticks
+
+// Timer embedded in the object it belongs to, so scheduling never allocates
+struct TimerEntry
+{
+    TimerEntry* next = NULL; // Next entry of the same slot
+    TimerEntry** link = NULL; // Pointer that points at this entry, NULL while not scheduled
+    uint64_t expiry = 0; // Tick the timer fires at
+    int owner = -1; // Identifies the object the timer belongs to, e.g. a client socket
+
+    bool scheduled() const { return link != NULL; }
+};
+
+// Hierarchical timer wheel: scheduling and cancelling are O(1), and every tick only touches one slot,
+// plus one slot of a higher level every TIMER_WHEEL_SLOTS ticks to move its timers closer to the bottom
+class TimerWheel
+{
+public:
+    TimerWheel();
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    void schedule(TimerEntry& entry, uint64_t expiryTick);
+    void cancel(TimerEntry& entry);
+    bool empty() const { return count == 0; }
+    uint64_t currentTick() const { return current; }
+
+    // Function to run every tick up to nowTick, handing each expired timer to onExpire(owner).
+    // The timer is unscheduled before the call, so the callback may schedule it again
+    template<typename Callback>
+    void advance(uint64_t nowTick, Callback&& onExpire)
+    {
+        while(current < nowTick)
+        {
+            if(count == 0)
+            {
+                current = nowTick; // Nothing to run, skip the idle ticks at once
+                break;
+            }
+
+            ++current;
+            cascade();
+
+            TimerEntry*& slot = slots[0][current & (TIMER_WHEEL_SLOTS - 1)];
+            while(slot != NULL)
+            {
+                TimerEntry* entry = slot;
+                cancel(*entry);
+                onExpire(entry->owner);
+            }
+        }
+    }
+
+private:
+    TimerEntry* slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS]; // Singly linked timers of every slot
+    uint64_t current; // Last tick that has been run
+    size_t count; // Scheduled timers
+
+    void insert(TimerEntry& entry);
+    void cascade();
+};
+
+#endif
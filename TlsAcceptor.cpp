@@ -0,0 +1,507 @@
+#include "TlsAcceptor.h" // Including the header file to define the TlsAcceptor class
+#include "Server.h" // Including the Server class for its error type and configuration
+#include "IoLoop.h" // Including the loops the reactor clients are handed back to
+#include "Metrics.h" // Including the monotonic clock of the handshake timeouts
+#include <openssl/err.h> // This header file is included to clear the error queue of failed handshakes
+#include <openssl/kdf.h> // This header file is included to derive the TLS 1.3 receive key for the kernel
+#include <cerrno> // This header file is included to retry interrupted polls
+#include <cstring> // This header file is included for memcpy and strlen
+#include <cstdlib> // This header file is included to parse the hex secrets of the key log
+#include <fcntl.h> // This header file is included to make the handshakes non-blocking
+#include <poll.h> // This header file is included to wait for the handshake of a client thread
+#include <unistd.h> // This header file is included for close
+#include <sys/epoll.h> // This header file is included to wait for the reactor handshakes
+#include <sys/socket.h> // This header file is included for setsockopt and SOL_TLS
+#include <linux/tls.h> // This header file is included for the kernel TLS key structures
+
+#define STATIC
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+// Client application traffic secret of a TLS 1.3 session, captured from the key log
+struct TrafficSecret
+{
+    unsigned char data[EVP_MAX_MD_SIZE];
+    size_t length = 0;
+};
+
+static int secretIndex = -1; // Ex data index of the sessions' TrafficSecret, allocated by the first acceptor
+
+// Function to free the TrafficSecret of a session along with it
+static void freeSecret(void*, void* pointer, CRYPTO_EX_DATA*, int, long, void*)
+{
+    TrafficSecret* secret = static_cast<TrafficSecret*>(pointer);
+    if(secret != NULL)
+    {
+        OPENSSL_cleanse(secret, sizeof(*secret));
+        delete secret;
+    }
+}
+
+// Function to derive a key or IV from a traffic secret with HKDF-Expand-Label of RFC 8446, with an empty context
+static bool expandLabel(const EVP_MD* digest, const TrafficSecret& secret, const char* label, unsigned char* output, size_t length)
+{
+    static const char prefix[] = "tls13 ";
+    size_t labelLength = strlen(prefix) + strlen(label);
+    unsigned char info[2 + 1 + 255 + 1];
+    info[0] = (unsigned char)(length >> 8);
+    info[1] = (unsigned char)length;
+    info[2] = (unsigned char)labelLength;
+    memcpy(info + 3, prefix, strlen(prefix));
+    memcpy(info + 3 + strlen(prefix), label, strlen(label));
+    info[3 + labelLength] = 0; // Context length
+
+    EVP_PKEY_CTX* kdf = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, NULL);
+    bool derived = kdf != NULL && EVP_PKEY_derive_init(kdf) > 0 &&
+                   EVP_PKEY_CTX_set_hkdf_mode(kdf, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+                   EVP_PKEY_CTX_set_hkdf_md(kdf, digest) > 0 &&
+                   EVP_PKEY_CTX_set1_hkdf_key(kdf, secret.data, (int)secret.length) > 0 &&
+                   EVP_PKEY_CTX_add1_hkdf_info(kdf, info, (int)(4 + labelLength)) > 0 &&
+                   EVP_PKEY_derive(kdf, output, &length) > 0;
+    EVP_PKEY_CTX_free(kdf);
+    return derived;
+}
+
+// Function to make a descriptor non-blocking for the handshake, returns its previous flags or -1
+static int makeNonBlocking(int clientSocket)
+{
+    int flags = fcntl(clientSocket, F_GETFL, 0);
+    if(flags == -1 || fcntl(clientSocket, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        return -1;
+    }
+    return flags;
+}
+
+// Constructor for the TlsAcceptor class, loads the certificate chain and private key of the configuration
+TlsAcceptor::TlsAcceptor(const ServerConfig& config)
+    : context(NULL), timeoutMs(config.tlsHandshakeTimeoutMs), epollFd(-1), hasThread(false)
+{
+#ifdef OPENSSL_NO_KTLS
+    throw TCPServerError("OpenSSL was built without kernel TLS support."); // Throw an error, sessions could not be offloaded
+#endif
+    if(secretIndex == -1)
+    {
+        secretIndex = SSL_get_ex_new_index(0, NULL, NULL, NULL, freeSecret);
+    }
+
+    context = SSL_CTX_new(TLS_server_method());
+    if(context == NULL)
+    {
+        throw TCPServerError("TLS context could not be created."); // Throw an error if OpenSSL cannot be initialised
+    }
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+    SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION);
+    SSL_CTX_set_num_tickets(context, 0); // Tickets would be written after the kernel took the session over
+    SSL_CTX_set_cipher_list(context, "ECDHE+AESGCM:ECDHE+CHACHA20"); // TLS 1.2 suites the kernel can encrypt;
+                                                                      // every TLS 1.3 default suite already can
+    SSL_CTX_set_keylog_callback(context, logKey); // OpenSSL 3.0 only offloads sending for TLS 1.3, see installReceiveKey
+
+    if(SSL_CTX_use_certificate_chain_file(context, config.tlsCertificateFile.c_str()) != 1 ||
+       SSL_CTX_use_PrivateKey_file(context, config.tlsPrivateKeyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+       SSL_CTX_check_private_key(context) != 1)
+    {
+        SSL_CTX_free(context);
+        throw TCPServerError("TLS certificate or private key could not be loaded."); // Throw an error if the files do not match
+    }
+
+    if((epollFd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    {
+        SSL_CTX_free(context);
+        throw TCPServerError("TLS handshake epoll instance could not be created."); // Throw an error if epoll creation fails
+    }
+    struct epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = submitNotifier.fd();
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, submitNotifier.fd(), &event);
+}
+
+// Destructor for the TlsAcceptor class
+TlsAcceptor::~TlsAcceptor()
+{
+    stop();
+    close(epollFd);
+    SSL_CTX_free(context);
+}
+
+// Function to start the thread shaking hands with reactor clients
+void TlsAcceptor::start()
+{
+    running.store(true);
+    if(pthread_create(&thread, NULL, runWrapper, (void *)this) != 0)
+    {
+        running.store(false);
+        throw TCPServerError("TLS handshake thread could not be created."); // Throw an error if thread creation fails
+    }
+    hasThread = true;
+}
+
+// Function to stop the handshake thread, clients still shaking hands are disconnected
+void TlsAcceptor::stop()
+{
+    if(!hasThread)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(submitLock);
+        running.store(false); // Under the lock, so no submission comes in after the thread took the last ones
+    }
+    submitNotifier.notify();
+    pthread_join(thread, NULL);
+    hasThread = false;
+
+    for(const Submission& submission : submitted)
+    {
+        close(submission.clientSocket);
+    }
+    submitted.clear();
+    for(auto& entry : handshakes)
+    {
+        SSL_free(entry.second.ssl);
+        close(entry.first);
+    }
+    handshakes.clear();
+    handshakeCount.store(0);
+}
+
+// Function to hand an accepted reactor client to the handshake thread, the client is passed to the loop's
+// handOver once its session runs in the kernel. Returns false if too many handshakes are in progress or the
+// acceptor is stopped, the caller still owns the descriptor then
+bool TlsAcceptor::submit(int clientSocket, IoLoop* loop)
+{
+    if(handshakeCount.fetch_add(1) >= TLS_MAX_HANDSHAKES)
+    {
+        handshakeCount.fetch_sub(1);
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(submitLock);
+        if(!running.load())
+        {
+            handshakeCount.fetch_sub(1);
+            return false;
+        }
+        submitted.push_back({clientSocket, loop});
+    }
+    submitNotifier.notify();
+    return true;
+}
+
+// Function to shake hands with a client on the calling thread, blocking for at most the handshake timeout.
+// Returns true once the kernel took the session over, the socket is then used as it was before
+bool TlsAcceptor::handshake(int clientSocket)
+{
+    int flags = makeNonBlocking(clientSocket);
+    SSL* ssl = flags == -1 ? NULL : newSession(clientSocket);
+    if(ssl == NULL)
+    {
+        if(flags != -1)
+        {
+            fcntl(clientSocket, F_SETFL, flags);
+        }
+        return false;
+    }
+
+    uint64_t deadlineMs = Metrics::nowNs() / 1000000 + timeoutMs;
+    bool completed = false;
+    while(true)
+    {
+        int result = SSL_accept(ssl);
+        if(result == 1)
+        {
+            completed = offload(ssl, clientSocket);
+            break;
+        }
+
+        int error = SSL_get_error(ssl, result);
+        uint64_t nowMs = Metrics::nowNs() / 1000000;
+        if(error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+        {
+            LOG_INFO << "Client " << clientSocket << " disconnected, TLS handshake failed.";
+            break;
+        }
+        if(nowMs >= deadlineMs)
+        {
+            LOG_INFO << "Client " << clientSocket << " is disconnected, TLS handshake timeout.";
+            break;
+        }
+        struct pollfd watched = {clientSocket, (short)(error == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT), 0};
+        if(poll(&watched, 1, (int)(deadlineMs - nowMs)) == -1 && errno != EINTR)
+        {
+            break;
+        }
+    }
+
+    ERR_clear_error();
+    SSL_free(ssl); // The socket BIO does not close the descriptor, and no close_notify is sent
+    fcntl(clientSocket, F_SETFL, flags);
+    return completed;
+}
+
+// Function to run the reactor handshakes until stop is called
+void* TlsAcceptor::run()
+{
+    struct epoll_event events[TLS_MAX_HANDSHAKE_EVENTS];
+    uint64_t nextTickMs = Metrics::nowNs() / 1000000 + TLS_HANDSHAKE_TICK_MS;
+    while(running.load())
+    {
+        // Announce the wait before checking for submissions so a concurrent submit either is seen here or notifies
+        int timeout = handshakes.empty() ? -1 : TLS_HANDSHAKE_TICK_MS;
+        submitNotifier.prepareWait();
+        bool pending;
+        {
+            std::lock_guard<std::mutex> lock(submitLock);
+            pending = !submitted.empty();
+        }
+        if(pending || !running.load())
+        {
+            submitNotifier.cancelWait();
+            timeout = 0;
+        }
+
+        int eventCount = epoll_wait(epollFd, events, TLS_MAX_HANDSHAKE_EVENTS, timeout);
+        submitNotifier.cancelWait();
+        for(int i = 0; i < eventCount; ++i)
+        {
+            if(events[i].data.fd == submitNotifier.fd())
+            {
+                submitNotifier.wait(); // Readable, so this only clears the counter
+            }
+            else
+            {
+                continueHandshake(events[i].data.fd);
+            }
+        }
+
+        startHandshakes();
+
+        uint64_t nowMs = Metrics::nowNs() / 1000000;
+        if(nowMs >= nextTickMs)
+        {
+            expireHandshakes(nowMs);
+            nextTickMs = nowMs + TLS_HANDSHAKE_TICK_MS;
+        }
+    }
+    return NULL;
+}
+
+// Function to start the handshakes of the clients submitted since the last call
+void TlsAcceptor::startHandshakes()
+{
+    {
+        std::lock_guard<std::mutex> lock(submitLock);
+        submitBatch.swap(submitted);
+    }
+
+    uint64_t deadlineMs = Metrics::nowNs() / 1000000 + timeoutMs;
+    for(const Submission& submission : submitBatch)
+    {
+        int clientSocket = submission.clientSocket;
+        int flags = makeNonBlocking(clientSocket);
+        SSL* ssl = flags == -1 ? NULL : newSession(clientSocket);
+        struct epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET; // Every edge retries the handshake, which reads until it would block
+        event.data.fd = clientSocket;
+        if(ssl == NULL || epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSocket, &event) == -1)
+        {
+            LOG_ERROR << "TLS handshake of client " << clientSocket << " could not be started.";
+            SSL_free(ssl);
+            close(clientSocket);
+            handshakeCount.fetch_sub(1);
+            continue;
+        }
+        handshakes[clientSocket] = {ssl, submission.loop, deadlineMs, flags};
+        continueHandshake(clientSocket); // The ClientHello is usually there already
+    }
+    submitBatch.clear();
+}
+
+// Function to make progress on a reactor handshake after its socket became ready
+void TlsAcceptor::continueHandshake(int clientSocket)
+{
+    auto entry = handshakes.find(clientSocket);
+    if(entry == handshakes.end())
+    {
+        return; // Event of a handshake finished earlier in the same batch
+    }
+
+    int result = SSL_accept(entry->second.ssl);
+    if(result == 1)
+    {
+        finishHandshake(clientSocket, offload(entry->second.ssl, clientSocket));
+        return;
+    }
+
+    int error = SSL_get_error(entry->second.ssl, result);
+    if(error != SSL_ERROR_WANT_READ && error != SSL_ERROR_WANT_WRITE)
+    {
+        LOG_INFO << "Client " << clientSocket << " disconnected, TLS handshake failed.";
+        finishHandshake(clientSocket, false);
+    }
+}
+
+// Function to disconnect the clients whose handshake outlasted the timeout
+void TlsAcceptor::expireHandshakes(uint64_t nowMs)
+{
+    std::vector<int> expired;
+    for(const auto& entry : handshakes)
+    {
+        if(entry.second.deadlineMs <= nowMs)
+        {
+            expired.push_back(entry.first);
+        }
+    }
+    for(int clientSocket : expired)
+    {
+        LOG_INFO << "Client " << clientSocket << " is disconnected, TLS handshake timeout.";
+        finishHandshake(clientSocket, false);
+    }
+}
+
+// Function to end a reactor handshake, handing the client to its loop if its session now runs in the kernel
+void TlsAcceptor::finishHandshake(int clientSocket, bool completed)
+{
+    auto entry = handshakes.find(clientSocket);
+    Handshake handshake = entry->second;
+    handshakes.erase(entry);
+    handshakeCount.fetch_sub(1);
+
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, clientSocket, NULL);
+    ERR_clear_error();
+    SSL_free(handshake.ssl); // The socket BIO does not close the descriptor, and no close_notify is sent
+    fcntl(clientSocket, F_SETFL, handshake.flags);
+    if(!completed || !handshake.loop->handOver(clientSocket))
+    {
+        close(clientSocket);
+    }
+}
+
+// Function to create the OpenSSL state of a client's handshake, NULL if it could not be created
+SSL* TlsAcceptor::newSession(int clientSocket)
+{
+    SSL* ssl = SSL_new(context);
+    if(ssl == NULL)
+    {
+        return NULL;
+    }
+    if(SSL_set_fd(ssl, clientSocket) != 1 || SSL_set_ex_data(ssl, secretIndex, new TrafficSecret()) != 1)
+    {
+        SSL_free(ssl);
+        return NULL;
+    }
+    return ssl;
+}
+
+// Function to check that the kernel took over a completed session, installing the receive key if OpenSSL
+// only offloaded sending. The session must not have buffered anything past the handshake, those bytes were
+// already decrypted by OpenSSL and the kernel would never see them
+bool TlsAcceptor::offload(SSL* ssl, int clientSocket)
+{
+    bool offloaded = false;
+#ifndef OPENSSL_NO_KTLS
+    offloaded = BIO_get_ktls_send(SSL_get_wbio(ssl)) && !SSL_has_pending(ssl) &&
+                (BIO_get_ktls_recv(SSL_get_rbio(ssl)) || (SSL_version(ssl) == TLS1_3_VERSION && installReceiveKey(ssl, clientSocket)));
+#endif
+    if(!offloaded)
+    {
+        LOG_WARNING << "Client " << clientSocket << " is disconnected, its TLS session could not be handed to the kernel.";
+    }
+    return offloaded;
+}
+
+// Function to install the client's TLS 1.3 application key as the kernel's receive key. OpenSSL 3.0 offloads
+// the receive side for TLS 1.2 only, so the key is derived here from the traffic secret caught by the key log;
+// nothing was received under it yet, so its record sequence starts at zero
+STATIC bool TlsAcceptor::installReceiveKey(SSL* ssl, int clientSocket)
+{
+    const TrafficSecret* secret = static_cast<const TrafficSecret*>(SSL_get_ex_data(ssl, secretIndex));
+    const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl);
+    if(secret == NULL || secret->length == 0 || cipher == NULL)
+    {
+        return false;
+    }
+
+    uint16_t suite = SSL_CIPHER_get_protocol_id(cipher);
+    size_t keyLength = suite == 0x1301 ? TLS_CIPHER_AES_GCM_128_KEY_SIZE : TLS_CIPHER_AES_GCM_256_KEY_SIZE; // Also the ChaCha20 key size
+    unsigned char key[TLS_CIPHER_AES_GCM_256_KEY_SIZE];
+    unsigned char iv[TLS_CIPHER_AES_GCM_128_SALT_SIZE + TLS_CIPHER_AES_GCM_128_IV_SIZE]; // 12 bytes for every TLS 1.3 suite
+    const EVP_MD* digest = SSL_CIPHER_get_handshake_digest(cipher);
+    if(digest == NULL || !expandLabel(digest, *secret, "key", key, keyLength) || !expandLabel(digest, *secret, "iv", iv, sizeof(iv)))
+    {
+        return false;
+    }
+
+    union
+    {
+        struct tls12_crypto_info_aes_gcm_128 aes128;
+        struct tls12_crypto_info_aes_gcm_256 aes256;
+        struct tls12_crypto_info_chacha20_poly1305 chacha20;
+    } info;
+    memset(&info, 0, sizeof(info)); // The record sequence starts at zero
+    socklen_t infoLength = 0;
+    switch(suite)
+    {
+        case 0x1301: // TLS_AES_128_GCM_SHA256, the IV is split into the salt and the explicit part
+            info.aes128.info = {TLS_1_3_VERSION, TLS_CIPHER_AES_GCM_128};
+            memcpy(info.aes128.salt, iv, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+            memcpy(info.aes128.iv, iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+            memcpy(info.aes128.key, key, keyLength);
+            infoLength = sizeof(info.aes128);
+            break;
+        case 0x1302: // TLS_AES_256_GCM_SHA384
+            info.aes256.info = {TLS_1_3_VERSION, TLS_CIPHER_AES_GCM_256};
+            memcpy(info.aes256.salt, iv, TLS_CIPHER_AES_GCM_256_SALT_SIZE);
+            memcpy(info.aes256.iv, iv + TLS_CIPHER_AES_GCM_256_SALT_SIZE, TLS_CIPHER_AES_GCM_256_IV_SIZE);
+            memcpy(info.aes256.key, key, keyLength);
+            infoLength = sizeof(info.aes256);
+            break;
+        case 0x1303: // TLS_CHACHA20_POLY1305_SHA256, the whole IV is the nonce
+            info.chacha20.info = {TLS_1_3_VERSION, TLS_CIPHER_CHACHA20_POLY1305};
+            memcpy(info.chacha20.iv, iv, TLS_CIPHER_CHACHA20_POLY1305_IV_SIZE);
+            memcpy(info.chacha20.key, key, keyLength);
+            infoLength = sizeof(info.chacha20);
+            break;
+        default:
+            break;
+    }
+
+    bool installed = infoLength > 0 && setsockopt(clientSocket, SOL_TLS, TLS_RX, &info, infoLength) == 0;
+    OPENSSL_cleanse(&info, sizeof(info));
+    OPENSSL_cleanse(key, sizeof(key));
+    OPENSSL_cleanse(iv, sizeof(iv));
+    return installed;
+}
+
+// Function called by OpenSSL with every secret of a handshake, keeps the client application traffic secret
+STATIC void TlsAcceptor::logKey(const SSL* ssl, const char* line)
+{
+    static const char label[] = "CLIENT_TRAFFIC_SECRET_0 ";
+    TrafficSecret* secret = static_cast<TrafficSecret*>(SSL_get_ex_data(ssl, secretIndex));
+    if(secret == NULL || strncmp(line, label, strlen(label)) != 0)
+    {
+        return;
+    }
+
+    // The line is the label, the client random and the secret, both in hex
+    const char* hex = strrchr(line, ' ') + 1;
+    size_t length = strlen(hex) / 2;
+    if(length > sizeof(secret->data))
+    {
+        return;
+    }
+    for(size_t i = 0; i < length; ++i)
+    {
+        char byte[3] = {hex[2 * i], hex[2 * i + 1], '\0'};
+        secret->data[i] = (unsigned char)strtoul(byte, NULL, 16);
+    }
+    secret->length = length;
+}
+
+// Static function wrapper for running the handshake thread
+STATIC void* TlsAcceptor::runWrapper(void* arg)
+{
+    return reinterpret_cast<TlsAcceptor*>(arg)->run();
+}
@@ -0,0 +1,81 @@
+#ifndef TLS_ACCEPTOR_H
+#define TLS_ACCEPTOR_H
+
+#include "EventNotifier.h"
+#include <openssl/ssl.h>
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define TLS_MAX_HANDSHAKES 1024 // Handshakes in progress at once, clients accepted beyond this are closed
+#define TLS_MAX_HANDSHAKE_EVENTS 64 // Maximum number of events returned by a single epoll_wait of the handshake thread
+#define TLS_HANDSHAKE_TICK_MS 100 // Resolution of the handshake timeout
+
+class IoLoop;
+struct ServerConfig;
+
+// TLS termination of accepted clients. The handshake runs in user space with OpenSSL, then the session keys
+// are installed into the kernel's TLS layer (TCP_ULP "tls") and OpenSSL lets go of the socket: the loops and
+// client threads keep reading and writing plaintext on the same descriptor and the kernel encrypts the records.
+// Reactor clients shake hands on a thread of their own, so a slow client or the key exchange never stalls a loop;
+// client threads shake hands on their own thread. A client whose session cannot be offloaded is disconnected
+class TlsAcceptor
+{
+public:
+    explicit TlsAcceptor(const ServerConfig& config);
+    ~TlsAcceptor();
+    TlsAcceptor(const TlsAcceptor&) = delete;
+    TlsAcceptor& operator=(const TlsAcceptor&) = delete;
+
+    void start();
+    void stop();
+    bool submit(int clientSocket, IoLoop* loop);
+    bool handshake(int clientSocket);
+
+private:
+    // Handshake of a reactor client in progress on the handshake thread
+    struct Handshake
+    {
+        SSL* ssl; // OpenSSL state of the handshake, freed once the keys are in the kernel
+        IoLoop* loop; // Loop the client is handed to once the handshake completed
+        uint64_t deadlineMs; // Time the client is disconnected at if the handshake has not completed
+        int flags; // File status flags of the descriptor before it was made non-blocking
+    };
+
+    // Client waiting for the handshake thread to take it
+    struct Submission
+    {
+        int clientSocket; // Accepted descriptor
+        IoLoop* loop; // Loop that accepted it
+    };
+
+    SSL_CTX* context; // Certificate, key and protocol settings shared by every handshake
+    unsigned timeoutMs; // Time a client has to complete its handshake
+    int epollFd; // Sockets of the handshakes in progress, only used by the handshake thread
+    EventNotifier submitNotifier; // Wakes the handshake thread when clients are submitted
+    std::mutex submitLock; // Guards submitted
+    std::vector<Submission> submitted; // Clients submitted since the handshake thread last took them
+    std::vector<Submission> submitBatch; // Clients being started, submitted collects the next ones meanwhile
+    std::unordered_map<int, Handshake> handshakes; // Handshakes in progress by descriptor, only used by the handshake thread
+    std::atomic<size_t> handshakeCount{0}; // Submitted and in progress handshakes, bounds submit
+    std::atomic<bool> running{false}; // Cleared to stop the handshake thread
+    pthread_t thread; // Thread running the reactor handshakes
+    bool hasThread; // Whether thread was started and has to be joined
+
+    void* run();
+    void startHandshakes();
+    void continueHandshake(int clientSocket);
+    void expireHandshakes(uint64_t nowMs);
+    void finishHandshake(int clientSocket, bool completed);
+    SSL* newSession(int clientSocket);
+    bool offload(SSL* ssl, int clientSocket);
+    static bool installReceiveKey(SSL* ssl, int clientSocket);
+    static void logKey(const SSL* ssl, const char* line);
+    static void* runWrapper(void* arg);
+};
+
+#endif
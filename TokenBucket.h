@@ -0,0 +1,23 @@
+#ifndef TOKEN_BUCKET_H
+#define TOKEN_BUCKET_H
+
+#include <cstdint>
+
+// Token bucket limiting the message rate of one client. Instead of a token count it keeps the time the
+// bucket would be full again, so taking a token is a few additions and no refill has to run in between
+struct TokenBucket
+{
+    uint64_t fullAt = 0; // Monotonic nanoseconds the bucket is full again at, in the past while it is full
+
+    // Function to take a token for a message that is already received; intervalNs is the refill time of one
+    // token and capacityNs that of the whole bucket. Returns how long the client has to wait before it may
+    // send again, 0 while tokens are left
+    uint64_t take(uint64_t nowNs, uint64_t intervalNs, uint64_t capacityNs)
+    {
+        fullAt = (fullAt > nowNs ? fullAt : nowNs) + intervalNs;
+        uint64_t refill = fullAt - nowNs;
+        return refill > capacityNs ? refill - capacityNs : 0;
+    }
+};
+
+#endif
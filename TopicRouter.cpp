@@ -0,0 +1,412 @@
+#include "TopicRouter.h" // Including the header file to define the TopicRouter class
+#include "Server.h" // Including the Server class to deliver published payloads to its clients
+#include <algorithm> // This header file is included to find a client in a subscriber list
+#include <functional> // This header file is included to hash the topic names
+#include <limits> // This header file is included for the epoch of an index nobody reads
+#include <string> // This header file is included to build the delivered messages
+#include <unordered_map> // This header file is included for the topic tables of the shards
+
+// Snapshot of the index freed through the reclamation, deleted with its own type
+struct RetiredObject
+{
+    virtual ~RetiredObject() {}
+};
+
+// Subscribers of a topic at one point in time, never changed once published
+struct SubscriberList : RetiredObject
+{
+    std::vector<ClientId> clients; // Subscribed clients in subscription order
+};
+
+// Topic of a shard; its subscriber list is replaced on every subscription change, the entry stays
+struct TopicEntry : RetiredObject
+{
+    std::string name; // Name of the topic
+    std::atomic<const SubscriberList*> subscribers{NULL}; // Current subscribers, owned by the entry
+
+    ~TopicEntry() override
+    {
+        delete subscribers.load(std::memory_order_relaxed);
+    }
+};
+
+// Topics of a shard at one point in time, never changed once published. Consecutive tables share their entries
+struct TopicTable : RetiredObject
+{
+    std::unordered_multimap<uint64_t, TopicEntry*> topics; // Entries by hash of their name
+};
+
+// Announcement of a thread reading the index, every thread that ever published has one
+struct alignas(CACHE_LINE_SIZE) ReaderSlot
+{
+    std::atomic<uint64_t> epoch{0}; // Global epoch when the current read started, 0 while the thread does not read
+    std::atomic<bool> inUse{true}; // Owned by a live thread, slots of exited threads are taken over by new ones
+    ReaderSlot* next = NULL; // Next slot, the list only ever grows
+};
+
+static std::atomic<ReaderSlot*> readerSlots{NULL}; // Slots of every reading thread
+static std::atomic<uint64_t> globalEpoch{1}; // Advanced every time a snapshot is replaced
+
+// Holder of the calling thread's slot, hands it back when the thread exits
+struct ReaderSlotHolder
+{
+    ReaderSlot* slot = NULL;
+    ~ReaderSlotHolder()
+    {
+        if(slot != NULL)
+        {
+            slot->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local ReaderSlotHolder readerSlotHolder;
+
+// Function to get the calling thread's slot, taking over a free one or adding one on the first read
+static ReaderSlot* readerSlot()
+{
+    if(readerSlotHolder.slot != NULL)
+    {
+        return readerSlotHolder.slot;
+    }
+
+    for(ReaderSlot* slot = readerSlots.load(std::memory_order_acquire); slot != NULL; slot = slot->next)
+    {
+        bool expected = false;
+        if(slot->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+        {
+            return readerSlotHolder.slot = slot;
+        }
+    }
+    ReaderSlot* slot = new ReaderSlot(); // Never freed, there is one per concurrently running thread at most
+    slot->next = readerSlots.load(std::memory_order_relaxed);
+    while(!readerSlots.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    return readerSlotHolder.slot = slot;
+}
+
+// Read of the index: while it lasts, no snapshot the thread may have loaded is freed. Entering is a store of the
+// epoch into the thread's own slot and a fence, readers never write shared memory
+class ReadSection
+{
+public:
+    ReadSection() : slot(readerSlot())
+    {
+        slot->epoch.store(globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst); // The epoch is visible before any snapshot is loaded
+    }
+    ~ReadSection()
+    {
+        slot->epoch.store(0, std::memory_order_release);
+    }
+    ReadSection(const ReadSection&) = delete;
+    ReadSection& operator=(const ReadSection&) = delete;
+
+private:
+    ReaderSlot* slot; // Slot of the calling thread
+};
+
+// Function to hash a topic name, which picks its shard and its bucket in the shard's table
+static uint64_t topicHash(std::string_view topic)
+{
+    return std::hash<std::string_view>()(topic);
+}
+
+// Function to find a topic in a table, NULL if it has no subscribers
+static TopicEntry* findTopic(const TopicTable* table, uint64_t hash, std::string_view topic)
+{
+    if(table == NULL)
+    {
+        return NULL;
+    }
+    auto range = table->topics.equal_range(hash);
+    for(auto it = range.first; it != range.second; ++it)
+    {
+        if(it->second->name == topic)
+        {
+            return it->second;
+        }
+    }
+    return NULL;
+}
+
+// Constructor for the TopicRouter class, routing between the clients of owner
+TopicRouter::TopicRouter(Server& owner) : server(owner)
+{
+}
+
+// Destructor of the TopicRouter class, nothing may publish anymore
+TopicRouter::~TopicRouter()
+{
+    retired.clear();
+    for(Shard& shard : shards)
+    {
+        const TopicTable* table = shard.table.load(std::memory_order_acquire);
+        if(table != NULL)
+        {
+            for(auto& topic : table->topics)
+            {
+                delete topic.second;
+            }
+            delete table;
+        }
+    }
+}
+
+// Function to subscribe a client to a topic, returns false if the topic name is empty or too long
+bool TopicRouter::subscribe(std::string_view topic, ClientId client)
+{
+    return update(topic, client, true);
+}
+
+// Function to end a client's subscription to a topic, returns false if it was not subscribed
+bool TopicRouter::unsubscribe(std::string_view topic, ClientId client)
+{
+    return update(topic, client, false);
+}
+
+// Function to send a payload to every subscriber of a topic as "MESSAGE <topic> <payload>", safe from any thread.
+// The subscribers are read without a lock and the message is framed once for all of them.
+// Returns the number of subscribers it was queued to
+size_t TopicRouter::publish(std::string_view topic, std::string_view payload)
+{
+    uint64_t hash = topicHash(topic);
+    size_t delivered = 0;
+    bool undelivered = false;
+    std::string message;
+    std::vector<ClientId> subscribers; // Thread-per-client mode only
+    {
+        ReadSection section;
+        const TopicEntry* entry = findTopic(shardOf(hash).table.load(std::memory_order_acquire), hash, topic);
+        const SubscriberList* list = entry == NULL ? NULL : entry->subscribers.load(std::memory_order_acquire);
+        if(list == NULL || list->clients.empty())
+        {
+            return 0;
+        }
+
+        message.reserve(sizeof(TOPIC_DELIVERY_PREFIX) + topic.size() + payload.size());
+        message.append(TOPIC_DELIVERY_PREFIX).append(topic).append(1, ' ').append(payload);
+        if(!server.isReactorMode())
+        {
+            // Client threads are written to with blocking sends; a stalled subscriber must not hold the
+            // read open, delaying every reclamation, so the subscribers are copied and written afterwards
+            subscribers = list->clients;
+        }
+        else
+        {
+            delivered = server.multicast(list->clients.data(), list->clients.size(), message);
+            undelivered = delivered < list->clients.size();
+        }
+    }
+    if(!subscribers.empty())
+    {
+        delivered = server.multicast(subscribers.data(), subscribers.size(), message);
+        undelivered = delivered < subscribers.size();
+    }
+
+    if(undelivered)
+    {
+        prune(topic); // Some subscribers may have disconnected since they subscribed
+    }
+    return delivered;
+}
+
+// Function to get the number of subscribers of a topic
+size_t TopicRouter::subscriberCount(std::string_view topic) const
+{
+    uint64_t hash = topicHash(topic);
+    ReadSection section;
+    const TopicEntry* entry = findTopic(shardOf(hash).table.load(std::memory_order_acquire), hash, topic);
+    const SubscriberList* list = entry == NULL ? NULL : entry->subscribers.load(std::memory_order_acquire);
+    return list == NULL ? 0 : list->clients.size();
+}
+
+// Function to serve a client's SUBSCRIBE, UNSUBSCRIBE or PUBLISH message; a subscription change is answered with
+// "SUBSCRIBED <topic>", "UNSUBSCRIBED <topic>" or "REJECTED <topic>". Returns false if the message is no command
+bool TopicRouter::handleCommand(ClientId client, std::string_view message)
+{
+    while(!message.empty() && (message.back() == '\n' || message.back() == '\r'))
+    {
+        message.remove_suffix(1); // RAW chunks and CRLF clients carry the line end
+    }
+
+    std::string_view subscribeCommand(TOPIC_SUBSCRIBE_COMMAND);
+    std::string_view unsubscribeCommand(TOPIC_UNSUBSCRIBE_COMMAND);
+    std::string_view publishCommand(TOPIC_PUBLISH_COMMAND);
+    if(message.compare(0, publishCommand.size(), publishCommand) == 0)
+    {
+        std::string_view rest = message.substr(publishCommand.size());
+        size_t space = rest.find(' ');
+        publish(rest.substr(0, space), space == std::string_view::npos ? std::string_view() : rest.substr(space + 1));
+        return true;
+    }
+
+    std::string reply;
+    if(message.compare(0, subscribeCommand.size(), subscribeCommand) == 0)
+    {
+        std::string_view topic = message.substr(subscribeCommand.size());
+        reply.append(subscribe(topic, client) ? "SUBSCRIBED " : "REJECTED ").append(topic);
+    }
+    else if(message.compare(0, unsubscribeCommand.size(), unsubscribeCommand) == 0)
+    {
+        std::string_view topic = message.substr(unsubscribeCommand.size());
+        unsubscribe(topic, client);
+        reply.append("UNSUBSCRIBED ").append(topic); // Also when it was not subscribed, the client's view holds either way
+    }
+    else
+    {
+        return false;
+    }
+    server.send(client, reply);
+    return true;
+}
+
+// Function to add a subscriber to or remove one from a topic. The subscriber list is copied, changed and swapped
+// in; a topic's entry is added with its first subscriber and removed with its last, which swaps the shard's table
+bool TopicRouter::update(std::string_view topic, ClientId client, bool add)
+{
+    if(topic.empty() || topic.size() > TOPIC_MAX_NAME)
+    {
+        return false;
+    }
+
+    uint64_t hash = topicHash(topic);
+    Shard& shard = shardOf(hash);
+    std::lock_guard<std::mutex> lock(shard.writeLock);
+    const TopicTable* table = shard.table.load(std::memory_order_relaxed);
+    TopicEntry* entry = findTopic(table, hash, topic);
+    if(entry == NULL)
+    {
+        if(!add)
+        {
+            return false;
+        }
+        entry = new TopicEntry();
+        entry->name = std::string(topic);
+        TopicTable* next = table == NULL ? new TopicTable() : new TopicTable(*table);
+        next->topics.emplace(hash, entry);
+        shard.table.store(next, std::memory_order_release);
+        if(table != NULL)
+        {
+            retire(const_cast<TopicTable*>(table));
+        }
+        table = next;
+    }
+
+    const SubscriberList* list = entry->subscribers.load(std::memory_order_relaxed);
+    std::vector<ClientId> clients;
+    if(list != NULL)
+    {
+        clients = list->clients;
+    }
+    auto it = std::find(clients.begin(), clients.end(), client);
+    if(add)
+    {
+        if(it != clients.end())
+        {
+            return true; // Already subscribed
+        }
+        clients.push_back(client);
+    }
+    else
+    {
+        if(it == clients.end())
+        {
+            return false;
+        }
+        clients.erase(it); // Order kept, subscribers receive in subscription order
+    }
+
+    if(clients.empty())
+    {
+        // Readers of the old table may still reach the entry, it is freed along with the table
+        TopicTable* next = new TopicTable(*table);
+        auto range = next->topics.equal_range(hash);
+        for(auto position = range.first; position != range.second; ++position)
+        {
+            if(position->second == entry)
+            {
+                next->topics.erase(position);
+                break;
+            }
+        }
+        shard.table.store(next, std::memory_order_release);
+        retire(const_cast<TopicTable*>(table));
+        retire(entry);
+        return true;
+    }
+
+    SubscriberList* next = new SubscriberList();
+    next->clients = std::move(clients);
+    entry->subscribers.store(next, std::memory_order_release);
+    if(list != NULL)
+    {
+        retire(const_cast<SubscriberList*>(list));
+    }
+    return true;
+}
+
+// Function to drop the subscribers of a topic that have disconnected
+void TopicRouter::prune(std::string_view topic)
+{
+    std::vector<ClientId> gone;
+    {
+        ReadSection section;
+        uint64_t hash = topicHash(topic);
+        const TopicEntry* entry = findTopic(shardOf(hash).table.load(std::memory_order_acquire), hash, topic);
+        const SubscriberList* list = entry == NULL ? NULL : entry->subscribers.load(std::memory_order_acquire);
+        if(list == NULL)
+        {
+            return;
+        }
+        for(ClientId client : list->clients)
+        {
+            if(!server.connected(client))
+            {
+                gone.push_back(client);
+            }
+        }
+    }
+    for(ClientId client : gone)
+    {
+        update(topic, client, false); // A descriptor reused meanwhile has a new generation, only the old client goes
+    }
+}
+
+// Function to free a replaced snapshot once no reader can still hold it. The epoch is advanced after the
+// snapshot was unlinked, so a reader that entered later can only have loaded its replacement
+void TopicRouter::retire(RetiredObject* object)
+{
+    uint64_t epoch = globalEpoch.fetch_add(1, std::memory_order_seq_cst);
+    std::lock_guard<std::mutex> lock(retireLock);
+    retired.emplace_back(epoch, std::unique_ptr<RetiredObject>(object));
+    reclaim();
+}
+
+// Function to free the retired snapshots that every running read started after; called with retireLock held
+void TopicRouter::reclaim()
+{
+    // Pairs with the fence of ReadSection: the swapped-in replacements are visible before the slots are read,
+    // so a reader whose epoch is missed here cannot have loaded a retired snapshot
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldestRead = std::numeric_limits<uint64_t>::max();
+    for(ReaderSlot* slot = readerSlots.load(std::memory_order_acquire); slot != NULL; slot = slot->next)
+    {
+        uint64_t epoch = slot->epoch.load(std::memory_order_seq_cst);
+        if(epoch != 0 && epoch < oldestRead)
+        {
+            oldestRead = epoch;
+        }
+    }
+
+    size_t kept = 0;
+    for(auto& object : retired)
+    {
+        if(object.first >= oldestRead)
+        {
+            retired[kept++] = std::move(object); // A read that started in or before its epoch may still use it
+        }
+    }
+    retired.resize(kept); // Frees the others
+}
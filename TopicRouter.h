@@ -0,0 +1,69 @@
+#ifndef TOPIC_ROUTER_H
+#define TOPIC_ROUTER_H
+
+#include "ClientId.h"
+#include "MessageRing.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#define TOPIC_SHARDS 64 // Independent parts of the topic index, subscriptions to topics of different shards never contend
+#define TOPIC_MAX_NAME 256 // Longest topic name, longer ones are rejected
+#define TOPIC_SUBSCRIBE_COMMAND "SUBSCRIBE " // Client message subscribing to the topic that follows
+#define TOPIC_UNSUBSCRIBE_COMMAND "UNSUBSCRIBE " // Client message ending a subscription
+#define TOPIC_PUBLISH_COMMAND "PUBLISH " // Client message "PUBLISH <topic> <payload>"
+#define TOPIC_DELIVERY_PREFIX "MESSAGE " // Subscribers receive "MESSAGE <topic> <payload>"
+
+class Server;
+struct TopicEntry;
+struct TopicTable;
+struct RetiredObject;
+
+// Topic to subscriber index routing published payloads between clients. Lookups are read-mostly and take no
+// lock: every shard publishes an immutable table of its topics and every topic an immutable list of its
+// subscribers, and a subscription change copies the one it touches and swaps it in under the shard's lock.
+// Replaced snapshots are freed once no publish that may still read them is running (epoch-based reclamation).
+// A publish frames its payload once and hands every subscriber's loop a reference, like a broadcast. In
+// thread-per-client mode it writes to the subscribers in turn and blocks on a slow one like send does, but only
+// after the read of the index ended, so other publishes and the reclamation go on meanwhile.
+// Subscriptions of disconnected clients are dropped by the first publish that cannot deliver to them
+class TopicRouter
+{
+public:
+    explicit TopicRouter(Server& owner);
+    ~TopicRouter();
+    TopicRouter(const TopicRouter&) = delete;
+    TopicRouter& operator=(const TopicRouter&) = delete;
+
+    bool subscribe(std::string_view topic, ClientId client);
+    bool unsubscribe(std::string_view topic, ClientId client);
+    size_t publish(std::string_view topic, std::string_view payload);
+    size_t subscriberCount(std::string_view topic) const;
+    bool handleCommand(ClientId client, std::string_view message);
+
+private:
+    // Part of the index holding the topics whose name hashes to it
+    struct alignas(CACHE_LINE_SIZE) Shard
+    {
+        std::atomic<const TopicTable*> table{NULL}; // Current topics, replaced as a whole when one is added or removed
+        std::mutex writeLock; // Serialises the changes of this shard, publishes never take it
+    };
+
+    Server& server; // Server whose clients subscribe and receive
+    Shard shards[TOPIC_SHARDS]; // Topics by hash of their name
+    std::mutex retireLock; // Guards retired
+    std::vector<std::pair<uint64_t, std::unique_ptr<RetiredObject>>> retired; // Replaced snapshots and the epoch they were replaced in
+
+    Shard& shardOf(uint64_t hash) { return shards[hash % TOPIC_SHARDS]; }
+    const Shard& shardOf(uint64_t hash) const { return shards[hash % TOPIC_SHARDS]; }
+    bool update(std::string_view topic, ClientId client, bool add);
+    void prune(std::string_view topic);
+    void retire(RetiredObject* object);
+    void reclaim();
+};
+
+#endif
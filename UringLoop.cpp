@@ -0,0 +1,612 @@
+#include "UringLoop.h" // Including the header file to define the UringLoop class
+#include "Server.h" // Including the Server class for its error type
+#include "Logger.h" // Including the logger for status and error messages
+#include "CpuTopology.h" // Including the NUMA placement of the receive buffers
+#include <cerrno> // This header file is included to inspect the error codes returned in completions
+#include <cstdint> // This header file is included for fixed width integers used in user data
+#include <cstring> // This header file is included to use memset on submission entries
+#include <unistd.h> // This header file is included for POSIX operating system API, such as close and syscall
+#include <sys/mman.h> // This header file is included to map the rings shared with the kernel
+#include <sys/socket.h> // This header file is included for the SOCK_CLOEXEC accept flag
+#include <sys/syscall.h> // This header file is included for the io_uring system call numbers
+
+#define URING_OP_ACCEPT 1 // User data tag of the multishot accept request
+#define URING_OP_RECV 2 // User data tag of multishot recv requests
+#define URING_OP_SEND 3 // User data tag of reply sends
+#define URING_OP_WAKE 4 // User data tag of the read of the reply notifier
+#define URING_OP_CANCEL 5 // User data tag of recv cancellations
+#define URING_OP_TIMER 6 // User data tag of the timeout waking the loop for its idle timers
+
+// Function to build the user data of a request from its tag and file descriptor
+static inline uint64_t makeUserData(uint32_t op, int fd)
+{
+    return ((uint64_t)op << 32) | (uint32_t)fd;
+}
+
+// Constructor for the UringLoop class, taking the owning server and the index of the loop
+UringLoop::UringLoop(Server* srv, int loopIndex)
+    : IoLoop(srv, loopIndex), ringFd(-1), listenerSocket(-1), sqRing(MAP_FAILED), sqRingSize(0), sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)),
+      sqesSize(0), pendingSubmissions(0), cqRing(MAP_FAILED), cqRingSize(0), bufferRing(static_cast<struct io_uring_buf_ring*>(MAP_FAILED)),
+      bufferRingSize(0), bufferMemory(NULL), bufferTail(0), wakeValue(0), timerWait{}, timerArmed(false),
+      zeroCopy(serverConfig().zeroCopyThreshold > 0)
+{
+    try
+    {
+        setupRing(); // Creating the io_uring instance and mapping its queues
+        setupBufferRing(); // Registering the receive buffers the kernel picks from
+        armWake(); // Waking up for replies posted by other threads
+    }
+    catch(const TCPServerError& ex)
+    {
+        destroyRing(); // Clean up resources in case of exception
+        throw; // Re-throw the exception
+    }
+}
+
+// Destructor for the UringLoop class
+UringLoop::~UringLoop()
+{
+    destroyRing(); // Closing the ring also cancels every pending request
+}
+
+// Function to create the io_uring instance and map the submission and completion queues
+void UringLoop::setupRing()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = URING_QUEUE_DEPTH * 4; // Multishot requests post many completions per submission
+
+    if((ringFd = syscall(__NR_io_uring_setup, URING_QUEUE_DEPTH, &params)) < 0)
+    {
+        ringFd = -1;
+        throw TCPServerError("io_uring instance could not be created."); // Throw an error if the kernel refuses io_uring
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        sqRingSize = cqRingSize = sqRingSize > cqRingSize ? sqRingSize : cqRingSize; // Both rings live in one mapping
+    }
+
+    sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if(sqRing == MAP_FAILED)
+    {
+        throw TCPServerError("io_uring submission ring could not be mapped."); // Throw an error if mapping fails
+    }
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        cqRing = sqRing;
+    }
+    else if((cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+    {
+        throw TCPServerError("io_uring completion ring could not be mapped."); // Throw an error if mapping fails
+    }
+
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe*>(mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+    if(sqes == MAP_FAILED)
+    {
+        throw TCPServerError("io_uring submission entries could not be mapped."); // Throw an error if mapping fails
+    }
+
+    char* sqBase = static_cast<char*>(sqRing);
+    sqHead = reinterpret_cast<unsigned*>(sqBase + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sqBase + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_mask);
+    sqEntries = *reinterpret_cast<unsigned*>(sqBase + params.sq_off.ring_entries);
+    sqArray = reinterpret_cast<unsigned*>(sqBase + params.sq_off.array);
+
+    char* cqBase = static_cast<char*>(cqRing);
+    cqHead = reinterpret_cast<unsigned*>(cqBase + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cqBase + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cqBase + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cqBase + params.cq_off.cqes);
+}
+
+// Function to allocate the receive buffers and register them as a provided buffer ring
+void UringLoop::setupBufferRing()
+{
+    bufferRingSize = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    bufferRing = static_cast<struct io_uring_buf_ring*>(mmap(NULL, bufferRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if(bufferRing == MAP_FAILED)
+    {
+        throw TCPServerError("io_uring buffer ring could not be allocated."); // Throw an error if allocation fails
+    }
+
+    // Mapped rather than allocated so the pages stay untouched until run binds them to the loop's node
+    void* memory = mmap(NULL, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED)
+    {
+        throw TCPServerError("io_uring receive buffers could not be allocated."); // Throw an error if allocation fails
+    }
+    bufferMemory = static_cast<char*>(memory);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufferRing;
+    reg.ring_entries = URING_BUFFER_COUNT;
+    reg.bgid = URING_BUFFER_GROUP;
+    if(syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        throw TCPServerError("io_uring buffer ring could not be registered."); // Throw an error if the kernel lacks provided buffer rings
+    }
+
+    // Hand every buffer to the kernel
+    for(unsigned short bufferId = 0; bufferId < URING_BUFFER_COUNT; ++bufferId)
+    {
+        recycleBuffer(bufferId);
+    }
+    publishBuffers();
+}
+
+// Function to release the ring, its mappings and the receive buffers
+void UringLoop::destroyRing()
+{
+    if(ringFd != -1)
+    {
+        close(ringFd);
+        ringFd = -1;
+    }
+    if(sqes != MAP_FAILED)
+    {
+        munmap(sqes, sqesSize);
+        sqes = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    }
+    if(cqRing != MAP_FAILED && cqRing != sqRing)
+    {
+        munmap(cqRing, cqRingSize);
+    }
+    cqRing = MAP_FAILED;
+    if(sqRing != MAP_FAILED)
+    {
+        munmap(sqRing, sqRingSize);
+        sqRing = MAP_FAILED;
+    }
+    if(bufferRing != MAP_FAILED)
+    {
+        munmap(bufferRing, bufferRingSize);
+        bufferRing = static_cast<struct io_uring_buf_ring*>(MAP_FAILED);
+    }
+    if(bufferMemory != NULL)
+    {
+        munmap(bufferMemory, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+        bufferMemory = NULL;
+    }
+}
+
+// Function to start accepting from a listening socket with a single multishot request
+void UringLoop::watchListener(int listenSocket, bool shared)
+{
+    (void)shared; // Every ring posting its own multishot accept already hands each connection to one loop only
+    listenerSocket = listenSocket;
+    armAccept();
+}
+
+// Function to reserve the next submission entry, submitting queued entries first if the ring is full
+struct io_uring_sqe* UringLoop::getSqe()
+{
+    unsigned tail = *sqTail;
+    while(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+    {
+        submitAndWait(0);
+    }
+
+    unsigned sqIndex = tail & sqMask;
+    struct io_uring_sqe* sqe = &sqes[sqIndex];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[sqIndex] = sqIndex;
+
+    // Without SQPOLL the kernel only reads entries inside io_uring_enter, so publishing before filling is safe
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++pendingSubmissions;
+    return sqe;
+}
+
+// Function to submit every queued entry and wait for completions in one system call
+int UringLoop::submitAndWait(unsigned waitCount)
+{
+    unsigned flags = waitCount > 0 ? IORING_ENTER_GETEVENTS : 0;
+    long submitted = syscall(__NR_io_uring_enter, ringFd, pendingSubmissions, waitCount, flags, NULL, 0);
+    if(submitted < 0)
+    {
+        return -errno;
+    }
+
+    pendingSubmissions -= submitted;
+    return 0;
+}
+
+// Function to queue a multishot accept on the listening socket
+void UringLoop::armAccept()
+{
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenerSocket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT; // One request keeps accepting until it is cancelled
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = makeUserData(URING_OP_ACCEPT, listenerSocket);
+}
+
+// Function to queue a multishot recv on a client, the kernel picks buffers from the provided ring
+void UringLoop::armRecv(int clientSocket)
+{
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = clientSocket;
+    sqe->ioprio = IORING_RECV_MULTISHOT; // One request posts a completion for every chunk received
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = makeUserData(URING_OP_RECV, clientSocket);
+}
+
+// Function to queue a read of the reply notifier, completing when another thread posts a reply
+void UringLoop::armWake()
+{
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = outboundNotifier.fd();
+    sqe->addr = (uint64_t)(uintptr_t)&wakeValue;
+    sqe->len = sizeof(wakeValue);
+    sqe->user_data = makeUserData(URING_OP_WAKE, outboundNotifier.fd());
+}
+
+// Function to queue a timeout completing at the next tick of the idle timers
+void UringLoop::armTimer()
+{
+    int waitMs = timerWaitMs();
+    timerWait.tv_sec = waitMs / 1000;
+    timerWait.tv_nsec = (long long)(waitMs % 1000) * 1000000;
+
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)&timerWait;
+    sqe->len = 1;
+    sqe->user_data = makeUserData(URING_OP_TIMER, 0);
+    timerArmed = true;
+}
+
+// Function to give a consumed buffer back to the kernel, made visible by publishBuffers
+void UringLoop::recycleBuffer(unsigned short bufferId)
+{
+    // Index the entries by hand, in C++ the flexible array of the kernel header is shifted by its empty struct member
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(bufferRing) + (bufferTail & (URING_BUFFER_COUNT - 1));
+    buf->addr = (uint64_t)(uintptr_t)(bufferMemory + (size_t)bufferId * URING_BUFFER_SIZE);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bufferId;
+    ++bufferTail;
+}
+
+// Function to publish every recycled buffer to the kernel at once
+void UringLoop::publishBuffers()
+{
+    __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+}
+
+// Function to submit pending requests, wait for completions and dispatch them in batches
+void UringLoop::run()
+{
+    // Only the kernel's receives touch the buffers, so the policy set from the loop's own CPU decides their node
+    CpuTopology::bindToLocalNode(bufferMemory, (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE);
+
+    while(true)
+    {
+        // Announce the wait before checking the reply queue so a concurrent post either is seen here or notifies
+        unsigned waitCount = 1;
+        if(!timerArmed && timerWaitMs() >= 0)
+        {
+            armTimer(); // Wake up for the next tick even if no client does anything
+        }
+        outboundNotifier.prepareWait();
+        if(!outboundQueue.empty() || !adoptQueue.empty())
+        {
+            outboundNotifier.cancelWait();
+            waitCount = 0; // Replies or handshaken clients already posted, only submit
+        }
+
+        int ret = submitAndWait(waitCount);
+        outboundNotifier.cancelWait();
+        updateClock();
+        if(ret < 0)
+        {
+            if(ret == -EINTR)
+            {
+                continue; // Interrupted by a signal, wait again
+            }
+            LOG_ERROR << "io_uring loop " << index << " failed to wait for completions.";
+            break;
+        }
+
+        // Drain every available completion before the next submission
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for(; head != tail; ++head)
+        {
+            const struct io_uring_cqe* cqe = &cqes[head & cqMask];
+            switch(cqe->user_data >> 32)
+            {
+                case URING_OP_ACCEPT:
+                    handleAccept(cqe);
+                    break;
+                case URING_OP_RECV:
+                    handleRecv(cqe);
+                    break;
+                case URING_OP_SEND:
+                    handleSend(cqe);
+                    break;
+                case URING_OP_WAKE:
+                    armWake(); // The replies themselves are collected below
+                    break;
+                case URING_OP_TIMER:
+                    timerArmed = false; // The timers themselves are run below
+                    break;
+                default:
+                    break; // Cancellations report nothing the loop acts on
+            }
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+        expireIdleClients();
+        drainOutboundQueue(); // Coalesce the replies posted since the last wakeup into one send per client
+
+        publishBuffers(); // Return the buffers of this batch before submitting new receives
+
+        if(updateShutdown())
+        {
+            break; // Every client is closed, destroying the ring cancels what is left
+        }
+    }
+}
+
+// Function to handle a completion of the multishot accept
+void UringLoop::handleAccept(const struct io_uring_cqe* cqe)
+{
+    if(listenerSocket == -1)
+    {
+        if(cqe->res >= 0)
+        {
+            close(cqe->res); // Accepted just before the cancellation took effect
+        }
+        return; // Accepting was stopped, the multishot request is not posted again
+    }
+
+    if(cqe->res >= 0)
+    {
+        if(!startHandshake(cqe->res))
+        {
+            adoptClient(cqe->res);
+        }
+    }
+    else if(cqe->res != -EAGAIN && cqe->res != -EINTR)
+    {
+        LOG_ERROR << "Failed to accept request from a client."; // Log error message if accepting client fails
+    }
+
+    if(!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        armAccept(); // The kernel ended the multishot request, post a new one
+    }
+}
+
+// Function to serve an accepted client, right after the accept or once its TLS handshake completed
+void UringLoop::adoptClient(int clientSocket)
+{
+    if(addClient(clientSocket) != NULL)
+    {
+        armRecv(clientSocket);
+    }
+}
+
+// Function to handle a completion of a client's multishot recv
+void UringLoop::handleRecv(const struct io_uring_cqe* cqe)
+{
+    int clientSocket = (int)(uint32_t)cqe->user_data;
+    Connection* connection = findClient(clientSocket);
+    bool known = connection != NULL;
+
+    if(cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        unsigned short bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if(cqe->res > 0 && known)
+        {
+            // The provided buffer is recycled right away, so the chunk is copied once into the connection's
+            // receive buffer that frames are sliced from; a disconnected client stays known until its final completion
+            serverConfig().tuning.rearmQuickAck(clientSocket);
+            const char* data = bufferMemory + (size_t)bufferId * URING_BUFFER_SIZE;
+            if(connection->readPaused)
+            {
+                // Completions of a cancelled recv keep coming, decoding them would bypass the pause
+                connection->decoder.append(data, cqe->res);
+                connection->lastActivity = now;
+            }
+            else
+            {
+                deliverFrames(*connection, data, cqe->res);
+            }
+        }
+        recycleBuffer(bufferId);
+    }
+
+    if(!(cqe->flags & IORING_CQE_F_MORE) && known)
+    {
+        if(cqe->res > 0 || cqe->res == -ENOBUFS || cqe->res == -ECANCELED)
+        {
+            // Request ended without a disconnect, e.g. the buffer ring ran dry or reading was paused
+            if(connection->readPaused)
+            {
+                connection->receiving = false; // Armed again by resumeReading
+            }
+            else
+            {
+                armRecv(clientSocket);
+            }
+        }
+        else if(connection->sending || zeroCopyPending(*connection))
+        {
+            connection->receiving = false;
+            connection->closing = true; // The send in flight still uses the connection, its completion closes it
+        }
+        else
+        {
+            removeClient(clientSocket); // Orderly shutdown or error on the connection
+        }
+    }
+}
+
+// Function to handle the completion of a reply send and queue the next one
+void UringLoop::handleSend(const struct io_uring_cqe* cqe)
+{
+    Connection* connection = findClient((int)(uint32_t)cqe->user_data);
+    if(connection == NULL)
+    {
+        return;
+    }
+
+    if(cqe->flags & IORING_CQE_F_NOTIF)
+    {
+        // The kernel no longer reads the pages of a zero copy send
+        completeZeroCopy(*connection, connection->zeroCopyCompleted + 1);
+        if(connection->closing && !inFlight(*connection))
+        {
+            removeClient(connection->socket);
+        }
+        return;
+    }
+
+    connection->sending = false;
+    bool zeroCopySend = connection->sendHeader.msg_flags != 0;
+    if(zeroCopySend && !(cqe->flags & IORING_CQE_F_MORE))
+    {
+        --connection->zeroCopyIssued; // No notification follows, nothing is held for this send
+    }
+
+    if(connection->closing)
+    {
+        if(!inFlight(*connection))
+        {
+            removeClient(connection->socket); // Final recv completion already arrived
+        }
+        return;
+    }
+
+    if(cqe->res < 0)
+    {
+        if(zeroCopySend && (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP))
+        {
+            zeroCopy = false; // Kernel without zero copy sends, fall back to copying
+            flushClient(*connection);
+        }
+        else if(cqe->res == -EINTR || cqe->res == -EAGAIN)
+        {
+            flushClient(*connection); // Nothing was written, try again
+        }
+        else
+        {
+            disconnectClient(connection->socket);
+        }
+        return;
+    }
+
+    bool resume = consumeOutbound(*connection, cqe->res);
+    flushClient(*connection);
+    if(resume)
+    {
+        resumeReading(*connection);
+    }
+}
+
+// Function to check whether the kernel still has a request referencing a connection
+bool UringLoop::inFlight(const Connection& connection) const
+{
+    return connection.receiving || connection.sending || zeroCopyPending(connection);
+}
+
+// Function to send the queued replies of a client, one send in flight per client keeps them in order
+void UringLoop::flushClient(Connection& connection)
+{
+    if(connection.sending || connection.closing || connection.outbound.empty())
+    {
+        return;
+    }
+
+    // The header and vectors live in the connection, so they stay valid until the completion
+    connection.sendHeader = {};
+    connection.sendHeader.msg_iov = connection.sendVectors;
+    size_t batchBytes;
+    connection.sendHeader.msg_iovlen = collectOutbound(connection, connection.sendVectors, OUTBOUND_MAX_IOV, batchBytes);
+
+    // Large batches, typically broadcasts, are sent from their own pages instead of being copied;
+    // msg_flags is ignored by the kernel and only remembers the kind of send for its completion
+    bool zeroCopySend = zeroCopy && batchBytes >= serverConfig().zeroCopyThreshold;
+    connection.sendHeader.msg_flags = zeroCopySend ? MSG_ZEROCOPY : 0;
+    if(zeroCopySend)
+    {
+        ++connection.zeroCopyIssued; // Tags the replies written by this send
+    }
+
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = zeroCopySend ? IORING_OP_SENDMSG_ZC : IORING_OP_SENDMSG;
+    sqe->fd = connection.socket;
+    sqe->addr = (uint64_t)(uintptr_t)&connection.sendHeader;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = makeUserData(URING_OP_SEND, connection.socket);
+    connection.sending = true;
+}
+
+// Function to stop reading a client by cancelling its multishot recv; already received chunks are still delivered
+void UringLoop::pauseReading(Connection& connection)
+{
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(URING_OP_RECV, connection.socket);
+    sqe->user_data = makeUserData(URING_OP_CANCEL, connection.socket);
+}
+
+// Function to stop accepting when the server shuts down by cancelling the multishot accept
+void UringLoop::stopAccepting()
+{
+    if(listenerSocket == -1)
+    {
+        return;
+    }
+
+    struct io_uring_sqe* sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = makeUserData(URING_OP_ACCEPT, listenerSocket);
+    sqe->user_data = makeUserData(URING_OP_CANCEL, listenerSocket);
+    listenerSocket = -1;
+}
+
+// Function to resume reading a client: data received while it was paused is decoded first, then the recv is
+// armed again unless its cancellation has not completed yet
+void UringLoop::resumeReading(Connection& connection)
+{
+    if(connection.decoder.bufferedBytes() > 0 && (!deliverFrames(connection, NULL, 0) || connection.readPaused))
+    {
+        return; // Disconnected, or paused again by the frames received meanwhile
+    }
+    if(!connection.receiving && !connection.closing)
+    {
+        connection.receiving = true;
+        armRecv(connection.socket);
+    }
+}
+
+// Function to disconnect a client; the socket is only shut down here and closed once its multishot
+// recv and its send have posted their final completions, so a reused descriptor never receives stale completions
+void UringLoop::disconnectClient(int clientSocket)
+{
+    Connection* connection = findClient(clientSocket);
+    if(connection != NULL && !inFlight(*connection))
+    {
+        removeClient(clientSocket); // Reading was paused and nothing is in flight, close right away
+        return;
+    }
+    shutdown(clientSocket, SHUT_RDWR);
+}
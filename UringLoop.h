@@ -0,0 +1,81 @@
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+#include "IoLoop.h"
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#define URING_QUEUE_DEPTH 4096 // Number of submission queue entries of each ring
+#define URING_BUFFER_COUNT 1024 // Number of kernel-provided receive buffers per loop, must be a power of two
+#define URING_BUFFER_SIZE 4096 // Size of each kernel-provided receive buffer
+#define URING_BUFFER_GROUP 0 // Buffer group id of the provided buffer ring
+
+// io_uring event loop using multishot accept, multishot recv and a provided buffer ring,
+// talking to the kernel through the raw system calls so no extra library is needed
+class UringLoop : public IoLoop
+{
+public:
+    UringLoop(Server* srv, int loopIndex);
+    ~UringLoop() override;
+    void watchListener(int listenSocket, bool shared) override;
+
+private:
+    int ringFd; // File descriptor of the io_uring instance
+    int listenerSocket; // Listening socket accepted from by this loop, -1 if none
+
+    // Submission queue, shared with the kernel
+    void* sqRing; // Mapping of the submission ring
+    size_t sqRingSize; // Size of the submission ring mapping
+    unsigned* sqHead; // Consumed by the kernel
+    unsigned* sqTail; // Produced by this loop
+    unsigned sqMask; // Mask turning a ring position into an index
+    unsigned sqEntries; // Number of submission entries
+    unsigned* sqArray; // Indirection array from ring positions to entries
+    struct io_uring_sqe* sqes; // Submission entries
+    size_t sqesSize; // Size of the submission entries mapping
+    unsigned pendingSubmissions; // Entries queued since the last io_uring_enter call
+
+    // Completion queue, shared with the kernel
+    void* cqRing; // Mapping of the completion ring, equal to sqRing with a single mmap
+    size_t cqRingSize; // Size of the completion ring mapping
+    unsigned* cqHead; // Consumed by this loop
+    unsigned* cqTail; // Produced by the kernel
+    unsigned cqMask; // Mask turning a ring position into an index
+    struct io_uring_cqe* cqes; // Completion entries
+
+    // Provided buffer ring, the kernel picks a buffer when data arrives instead of us passing one per recv
+    struct io_uring_buf_ring* bufferRing; // Ring of buffers available to the kernel
+    size_t bufferRingSize; // Size of the buffer ring mapping
+    char* bufferMemory; // Backing memory of all provided buffers
+    unsigned short bufferTail; // Local tail, published to the kernel once per completion batch
+    uint64_t wakeValue; // Counter read from the reply notifier when it wakes the loop
+    struct __kernel_timespec timerWait; // Timeout of the pending timer request, read by the kernel at submission
+    bool timerArmed; // A timer request is pending, it wakes the loop for the next tick of the idle timers
+    bool zeroCopy; // Large replies are sent with IORING_OP_SENDMSG_ZC, cleared if the kernel lacks it
+
+    void run() override;
+    void setupRing();
+    void setupBufferRing();
+    void destroyRing();
+    struct io_uring_sqe* getSqe();
+    int submitAndWait(unsigned waitCount);
+    void armAccept();
+    void armRecv(int clientSocket);
+    void armWake();
+    void armTimer();
+    void recycleBuffer(unsigned short bufferId);
+    void publishBuffers();
+    void handleAccept(const struct io_uring_cqe* cqe);
+    void adoptClient(int clientSocket) override;
+    void handleRecv(const struct io_uring_cqe* cqe);
+    void handleSend(const struct io_uring_cqe* cqe);
+    bool inFlight(const Connection& connection) const;
+    void disconnectClient(int clientSocket) override;
+    void flushClient(Connection& connection) override;
+    void pauseReading(Connection& connection) override;
+    void resumeReading(Connection& connection) override;
+    void stopAccepting() override;
+};
+
+#endif
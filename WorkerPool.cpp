@@ -0,0 +1,594 @@
+#include "WorkerPool.h" // Including the header file to define the Worker and WorkerPool classes
+#include "Server.h" // Including the Server class for its error type
+#include "Logger.h" // Including the logger for status and error messages
+#include "Metrics.h" // Including the metrics to time the handling of every message
+#include "CpuTopology.h" // Including the thread placement to pin the workers
+#include <cstdint> // This header file is included for the fixed width integers used by the hash
+#include <sched.h> // This header file is included to yield while every task queue is full
+
+#define STATIC
+
+// Constructor for the Worker class, taking the pool's handler and workers, the capacity of its queue, the
+// round-robin quantum, the scheduling of the pool and its index. Only the queue the scheduling uses gets the capacity
+Worker::Worker(const MessageHandler& messageHandler, const WorkerList& pool, size_t queueCapacity, size_t fairQuantum,
+               WorkerScheduling workerScheduling, int workerIndex)
+    : handler(messageHandler), workers(pool), scheduling(workerScheduling), index(workerIndex),
+      messageQueue(workerScheduling == WorkerScheduling::CLIENT_AFFINITY ? queueCapacity : 1),
+      taskQueue(workerScheduling == WorkerScheduling::CLIENT_AFFINITY ? 1 : queueCapacity),
+      quantum(fairQuantum), stagedMessages(0)
+{
+}
+
+// Function to push a message to this worker, returns false if its queue is full; safe from any thread
+bool Worker::tryPush(Message& message)
+{
+    if(!messageQueue.tryPush(message))
+    {
+        return false;
+    }
+
+    messageQueueNotifier.notify(); // Only costs a system call when the worker is asleep
+    return true;
+}
+
+// Function to hand a task to this worker in the work-stealing modes, returns false if its queue is full; safe from any thread
+bool Worker::tryPush(HandlerTask* task)
+{
+    if(!taskQueue.tryPush(task))
+    {
+        return false;
+    }
+
+    messageQueueNotifier.notify();
+    return true;
+}
+
+// Function to start the worker thread, pinned to the given CPU unless it is negative
+void Worker::start(int cpu)
+{
+    stopping.store(false);
+    discarding.store(false);
+    running.store(true);
+    if(CpuTopology::startThread(thread, handleMessageQueueWrapper, (void *)this, cpu) != 0)
+    {
+        running.store(false);
+        throw TCPServerError("Worker Thread could not be created."); // Throw an error if thread creation fails
+    }
+}
+
+// Function to ask the worker to return once it has handled every queued message; safe from any thread
+void Worker::stop()
+{
+    stopping.store(true, std::memory_order_release);
+    messageQueueNotifier.notify(); // Wake the worker if it sleeps on an empty queue
+}
+
+// Function to make a stopping worker release its remaining messages unhandled, e.g. once the drain timeout has passed
+void Worker::abandon()
+{
+    discarding.store(true, std::memory_order_relaxed);
+    stop();
+}
+
+// Function to check whether the worker thread has returned
+bool Worker::finished() const
+{
+    return !running.load(std::memory_order_acquire);
+}
+
+// Function to wait until the worker thread returns
+void Worker::join()
+{
+    if(pthread_join(thread, NULL) != 0)
+    {
+        LOG_ERROR << "Failed to join thread."; // Log error message if joining thread fails
+    }
+}
+
+// Function to drain the message queue and run the handler on every message until the worker is stopped
+void* Worker::handleMessageQueue()
+{
+    if(scheduling != WorkerScheduling::CLIENT_AFFINITY)
+    {
+        handleTasks();
+    }
+    else if(quantum > 0)
+    {
+        handleFairly();
+    }
+    else
+    {
+        handleInOrder();
+    }
+    return NULL;
+}
+
+// Function to handle the messages in batches in the order they were queued
+void Worker::handleInOrder()
+{
+    std::vector<Message> batch; // Messages drained in the current wakeup
+    batch.resize(MESSAGE_BATCH_SIZE);
+
+    while(true)
+    {
+        // Retrieve up to a batch of messages from the message queue, this thread is its only consumer
+        size_t count = 0;
+        while(count < batch.size() && messageQueue.tryPop(batch[count]))
+        {
+            ++count;
+        }
+
+        if(count == 0)
+        {
+            if(!waitForMessages())
+            {
+                break; // Queue drained after the stop request
+            }
+            continue;
+        }
+
+        uint64_t started = Metrics::nowNs();
+        for(size_t i = 0; i < count; ++i)
+        {
+            started = handle(batch[i], started);
+        }
+        Metrics::add(Counter::MESSAGES_HANDLED, count);
+    }
+}
+
+// Function to handle the messages in deficit round-robin order across clients: everything queued is staged
+// per client, and each client in turn gets a quantum of bytes, so a client flooding the worker only delays
+// the others by one turn instead of by its whole backlog
+void Worker::handleFairly()
+{
+    size_t stageLimit = messageQueue.capacity(); // Beyond it the ring fills up and backpressure applies as usual
+    Message message;
+
+    while(true)
+    {
+        while(stagedMessages < stageLimit && messageQueue.tryPop(message))
+        {
+            ClientQueue& queue = clientQueues[message.client.socket];
+            if(queue.messages.empty())
+            {
+                activeClients.push_back(message.client.socket); // Waiting clients get their turn first
+            }
+            queue.messages.push_back(std::move(message));
+            ++stagedMessages;
+        }
+
+        if(stagedMessages == 0)
+        {
+            if(!waitForMessages())
+            {
+                break; // Queue drained after the stop request
+            }
+            continue;
+        }
+
+        // Give turns until a batch is handled, then stage what arrived meanwhile
+        uint64_t started = Metrics::nowNs();
+        size_t handled = 0;
+        while(handled < MESSAGE_BATCH_SIZE && !activeClients.empty())
+        {
+            int clientSocket = activeClients.front();
+            activeClients.pop_front();
+            auto it = clientQueues.find(clientSocket);
+            ClientQueue& queue = it->second;
+
+            queue.deficit += quantum; // Larger messages wait for the deficit of several turns
+            while(!queue.messages.empty() && queue.messages.front().payload.size() <= queue.deficit)
+            {
+                queue.deficit -= queue.messages.front().payload.size();
+                started = handle(queue.messages.front(), started);
+                queue.messages.pop_front();
+                --stagedMessages;
+                ++handled;
+            }
+
+            if(queue.messages.empty())
+            {
+                clientQueues.erase(it); // A client without messages keeps no deficit for later
+            }
+            else
+            {
+                activeClients.push_back(clientSocket);
+            }
+        }
+        Metrics::add(Counter::MESSAGES_HANDLED, handled);
+    }
+}
+
+// Function to run tasks in the work-stealing modes: first those of this worker's deque, refilled from its task
+// queue, then the oldest ones of the other workers' deques, so no worker idles while another has a backlog
+void Worker::handleTasks()
+{
+    uint64_t started = Metrics::nowNs();
+    while(true)
+    {
+        HandlerTask* task = nextTask();
+        if(task == NULL)
+        {
+            if(!waitForTasks())
+            {
+                break; // Every queue drained after the stop request
+            }
+            started = Metrics::nowNs(); // Time spent asleep is not handler time
+            continue;
+        }
+        started = run(task, started);
+    }
+}
+
+// Function to get the next task to run, NULL if this worker found nothing to do
+HandlerTask* Worker::nextTask()
+{
+    HandlerTask* task = tasks.pop();
+    if(task == NULL && refillTasks())
+    {
+        task = tasks.pop(); // May have been stolen meanwhile
+    }
+    return task != NULL ? task : stealTask();
+}
+
+// Function to move a batch from the task queue to the empty deque, returns false if the queue was empty
+bool Worker::refillTasks()
+{
+    HandlerTask* batch[MESSAGE_BATCH_SIZE];
+    size_t count = 0;
+    while(count < MESSAGE_BATCH_SIZE && taskQueue.tryPop(batch[count]))
+    {
+        ++count;
+    }
+
+    // Pushed newest first, so this worker pops the batch in arrival order while thieves take the newest tasks
+    for(size_t i = count; i > 0; --i)
+    {
+        tasks.push(batch[i - 1]);
+    }
+    if(count > 1)
+    {
+        wakeIdleWorker(); // Let a sleeping worker share the batch
+    }
+    return count > 0;
+}
+
+// Function to steal the oldest task of another worker's deque, returns NULL if every deque was empty
+HandlerTask* Worker::stealTask()
+{
+    for(size_t i = 1; i < workers.size(); ++i)
+    {
+        Worker& victim = *workers[(index + i) % workers.size()];
+        HandlerTask* task = victim.tasks.steal();
+        if(task != NULL)
+        {
+            if(!victim.tasks.empty())
+            {
+                wakeIdleWorker(); // More is left to take, so another sleeping worker can help as well
+            }
+            Metrics::add(Counter::TASKS_STOLEN);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+// Function to check whether another worker has tasks left to steal
+bool Worker::stealable() const
+{
+    for(const auto& worker: workers)
+    {
+        if(worker.get() != this && !worker->tasks.empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to wake one sleeping worker, if any, to steal from the deques
+void Worker::wakeIdleWorker()
+{
+    for(size_t i = 1; i < workers.size(); ++i)
+    {
+        if(workers[(index + i) % workers.size()]->messageQueueNotifier.notify())
+        {
+            return;
+        }
+    }
+}
+
+// Function to run a task taken at started, which is also when the previous one ended. Returns the time it finished
+uint64_t Worker::run(HandlerTask* task, uint64_t started)
+{
+    if(task->strand == NULL)
+    {
+        started = handle(task->message, started);
+        Metrics::add(Counter::MESSAGES_HANDLED);
+        releaseHandlerTask(task); // Taken by the pool when the message was queued
+        return started;
+    }
+
+    // A strand with messages left goes behind the other tasks, it is only run on if no queue has room for it
+    while(runStrand(*task->strand, started) && !taskQueue.tryPush(task) && !tasks.push(task))
+    {
+    }
+    return started;
+}
+
+// Function to handle up to a batch of a strand's messages in order, returns true if it still has messages.
+// The strand stays scheduled in that case, so its task must be queued again by the caller
+bool Worker::runStrand(ClientStrand& strand, uint64_t& started)
+{
+    for(size_t handled = 0; ; ++handled)
+    {
+        HandlerTask* task;
+        {
+            std::lock_guard<std::mutex> lock(strand.lock);
+            if(strand.head == NULL || handled == STRAND_BATCH_SIZE)
+            {
+                Metrics::add(Counter::MESSAGES_HANDLED, handled);
+                strand.scheduled = strand.head != NULL; // Once cleared, the next message queues the strand again
+                return strand.scheduled;
+            }
+            task = strand.head;
+            strand.head = task->next;
+            if(strand.head == NULL)
+            {
+                strand.tail = NULL;
+            }
+            --strand.count;
+        }
+        started = handle(task->message, started); // Unlocked, the client's reader keeps appending meanwhile
+        releaseHandlerTask(task);
+    }
+}
+
+// Function to sleep until messages arrive, returns false once the queue is empty after the stop request
+bool Worker::waitForMessages()
+{
+    if(stopping.load(std::memory_order_acquire))
+    {
+        return !messageQueue.empty();
+    }
+
+    // Sleep on the eventfd, re-checking the queue after announcing it so no wakeup is lost
+    messageQueueNotifier.prepareWait();
+    if(!messageQueue.empty() || stopping.load(std::memory_order_relaxed))
+    {
+        messageQueueNotifier.cancelWait();
+        return true;
+    }
+    messageQueueNotifier.wait();
+    return true;
+}
+
+// Function to sleep until a task arrives or another worker has tasks to steal, returns false once every
+// queue is empty after the stop request
+bool Worker::waitForTasks()
+{
+    if(stopping.load(std::memory_order_acquire))
+    {
+        return !taskQueue.empty() || stealable();
+    }
+
+    // Workers pushing into their deques wake a sleeping one after publishing, so re-checking after announcing suffices
+    messageQueueNotifier.prepareWait();
+    if(!taskQueue.empty() || stealable() || stopping.load(std::memory_order_relaxed))
+    {
+        messageQueueNotifier.cancelWait();
+        return true;
+    }
+    messageQueueNotifier.wait();
+    return true;
+}
+
+// Function to run the handler on a message that was taken at started, which is also when the previous one ended.
+// Returns the time the handler returned
+uint64_t Worker::handle(Message& message, uint64_t started)
+{
+    if(discarding.load(std::memory_order_relaxed))
+    {
+        message.payload.reset();
+        release(message);
+        return started; // Given up by the shutdown
+    }
+    Metrics::record(Histogram::QUEUE_LATENCY, started - message.queuedAt);
+    handler(message.client, message.payload.view());
+    message.payload.reset(); // Drop the slice once handled, the last one returns the receive buffer to the pool
+    release(message);
+
+    uint64_t finished = Metrics::nowNs();
+    Metrics::record(Histogram::HANDLER_LATENCY, finished - started);
+    return finished; // The next message starts where this one ended, one clock read per message
+}
+
+// Function to take a handled message off its client's count of queued messages, which may resume reading the client
+STATIC void Worker::release(Message& message)
+{
+    if(message.queuedCount != NULL)
+    {
+        message.queuedCount->fetch_sub(1, std::memory_order_relaxed);
+        message.queuedCount = NULL;
+    }
+}
+
+// Static function wrapper for handling the message queue in a separate thread
+STATIC void* Worker::handleMessageQueueWrapper(void* arg)
+{
+    Worker* instance = reinterpret_cast<Worker*>(arg);
+    instance->handleMessageQueue(); // Call the non-static member function to handle the message queue
+    instance->clientQueues.clear(); // Only left over if messages were abandoned
+    instance->activeClients.clear();
+    instance->stagedMessages = 0;
+    instance->running.store(false, std::memory_order_release);
+    return NULL;
+}
+
+// Constructor for the WorkerPool class, taking the number of workers, the capacity of each worker's queue,
+// the deficit round-robin quantum, 0 to handle messages in arrival order, and how messages are spread
+WorkerPool::WorkerPool(int workerCount, size_t queueCapacity, size_t fairQuantum, WorkerScheduling workerScheduling)
+    : scheduling(workerScheduling), strandCapacity(queueCapacity), started(false)
+{
+    if(workerCount <= 0)
+    {
+        workerCount = DEFAULT_WORKER_THREADS;
+    }
+
+    for(int i = 0; i < workerCount; ++i)
+    {
+        workers.push_back(std::make_unique<Worker>(handler, workers, queueCapacity, fairQuantum, scheduling, i));
+    }
+}
+
+// Function to register the message handler, must be called before the pool starts
+void WorkerPool::setHandler(MessageHandler messageHandler)
+{
+    if(started)
+    {
+        throw TCPServerError("Message handler cannot be changed while the workers are running."); // Workers read the handler unlocked
+    }
+    handler = std::move(messageHandler);
+}
+
+// Function to start every worker thread, pinning worker i to cpus[i] modulo their number; an empty list
+// leaves them to the scheduler. Does nothing if they already run
+void WorkerPool::start(const std::vector<int>& cpus)
+{
+    if(started)
+    {
+        return;
+    }
+
+    for(size_t i = 0; i < workers.size(); ++i)
+    {
+        workers[i]->start(cpus.empty() ? -1 : cpus[i % cpus.size()]);
+    }
+    started = true;
+}
+
+// Function to ask every worker to return once its queue is empty, the producers must have stopped pushing
+void WorkerPool::stop()
+{
+    if(!started)
+    {
+        return;
+    }
+
+    for(auto& worker: workers)
+    {
+        worker->stop();
+    }
+}
+
+// Function to make every stopping worker release its remaining messages without handling them
+void WorkerPool::abandon()
+{
+    if(!started)
+    {
+        return;
+    }
+
+    for(auto& worker: workers)
+    {
+        worker->abandon();
+    }
+}
+
+// Function to check whether every worker has returned after stop
+bool WorkerPool::finished() const
+{
+    for(auto& worker: workers)
+    {
+        if(!worker->finished())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to wait until every worker thread returns
+void WorkerPool::join()
+{
+    if(!started)
+    {
+        return;
+    }
+
+    for(auto& worker: workers)
+    {
+        worker->join();
+    }
+    started = false;
+}
+
+// Function to queue a message for the workers, returns false without taking it if there is no room:
+// the queue of the client's worker with CLIENT_AFFINITY, every task queue, or when ordered the client's strand is full
+bool WorkerPool::tryPush(Message& message, ClientStrand& strand)
+{
+    if(scheduling == WorkerScheduling::CLIENT_AFFINITY)
+    {
+        return workers[workerFor(message.client.socket)]->tryPush(message);
+    }
+
+    HandlerTask* task = acquireHandlerTask(); // Released by the worker handling the message
+    task->message = std::move(message);
+    if(scheduling == WorkerScheduling::WORK_STEALING ? tryPushTask(task) : tryAppend(strand, task))
+    {
+        return true;
+    }
+    message = std::move(task->message);
+    releaseHandlerTask(task); // Back to this thread's cache, a retry takes it again without touching the heap
+    return false;
+}
+
+// Function to append a message's task to its client's strand and queue the strand unless it already is,
+// returns false if the strand is full
+bool WorkerPool::tryAppend(ClientStrand& strand, HandlerTask* task)
+{
+    {
+        std::lock_guard<std::mutex> lock(strand.lock);
+        if(strand.count >= strandCapacity)
+        {
+            return false;
+        }
+        (strand.tail != NULL ? strand.tail->next : strand.head) = task;
+        strand.tail = task;
+        ++strand.count;
+        if(strand.scheduled)
+        {
+            return true; // The worker running the strand also handles this message
+        }
+        strand.scheduled = true;
+    }
+
+    // The message is already the strand's, so its task must be queued. A task queue holds at most one task
+    // per strand and is drained into the deques right away, waiting here is a corner case
+    while(!tryPushTask(&strand.task))
+    {
+        sched_yield();
+    }
+    return true;
+}
+
+// Function to hand a task to the next worker in turn, trying every worker once; returns false if all are full
+bool WorkerPool::tryPushTask(HandlerTask* task)
+{
+    static thread_local size_t next = 0; // Per reader thread, so spreading the tasks writes nothing shared
+    for(size_t i = 0; i < workers.size(); ++i)
+    {
+        if(workers[next++ % workers.size()]->tryPush(task))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Function to pick the worker of a client, always the same one so its messages are handled in order
+size_t WorkerPool::workerFor(int clientSocket) const
+{
+    uint32_t hash = (uint32_t)clientSocket * 2654435769u; // Fibonacci hashing spreads consecutive descriptors
+    return (size_t)(((uint64_t)hash * workers.size()) >> 32);
+}
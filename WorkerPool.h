@@ -0,0 +1,112 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "ServerConfig.h"
+#include "MessageRing.h"
+#include "EventNotifier.h"
+#include "Message.h"
+#include "HandlerTask.h"
+#include "TaskDeque.h"
+#include <pthread.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#define MESSAGE_BATCH_SIZE 64 // Maximum number of messages a worker drains per wakeup
+#define STRAND_BATCH_SIZE 16 // Messages of one client a worker handles before the strand goes to the back of the queue
+
+// Callback executed for every message received from a client
+typedef std::function<void(ClientId client, std::string_view message)> MessageHandler;
+
+// Messages of one client staged by a worker until it is the client's turn
+struct ClientQueue
+{
+    std::deque<Message> messages; // Oldest first, so every client's messages keep their order
+    size_t deficit = 0; // Bytes the client may still use in its current turn
+};
+
+class Worker;
+typedef std::vector<std::unique_ptr<Worker>> WorkerList;
+
+// Handler thread consuming its own message ring, or in the work-stealing modes its own task ring and deque
+// while stealing from the deques of the other workers once it runs dry
+class Worker
+{
+public:
+    Worker(const MessageHandler& messageHandler, const WorkerList& pool, size_t queueCapacity, size_t fairQuantum,
+           WorkerScheduling workerScheduling, int workerIndex);
+    bool tryPush(Message& message);
+    bool tryPush(HandlerTask* task);
+    void start(int cpu);
+    void stop();
+    void abandon();
+    bool finished() const;
+    void join();
+
+private:
+    const MessageHandler& handler; // Handler owned by the pool
+    const WorkerList& workers; // Every worker of the pool including this one, to steal from
+    WorkerScheduling scheduling; // How the pool spreads messages, decides which queue is used
+    int index; // Index of this worker in the pool
+    MessageRing<Message> messageQueue; // Lock-free channel from the client readers to this worker, CLIENT_AFFINITY only
+    MessageRing<HandlerTask*> taskQueue; // Tasks handed to this worker in the work-stealing modes
+    TaskDeque<HandlerTask, MESSAGE_BATCH_SIZE> tasks; // Tasks taken from taskQueue, the others steal the oldest
+    size_t quantum; // Bytes of a client's messages handled per turn, 0 handles messages in arrival order
+    std::unordered_map<int, ClientQueue> clientQueues; // Staged messages by client socket, only clients with messages
+    std::deque<int> activeClients; // Clients of clientQueues in the order of their next turn
+    size_t stagedMessages; // Messages in clientQueues
+    EventNotifier messageQueueNotifier; // Wakes the worker when messages arrive in an empty queue
+    pthread_t thread; // Thread running the worker
+    std::atomic<bool> stopping{false}; // The worker returns once its queue is empty
+    std::atomic<bool> running{false}; // Set while the worker thread has not returned
+    std::atomic<bool> discarding{false}; // Queued messages are released without running the handler
+
+    void* handleMessageQueue();
+    void handleInOrder();
+    void handleFairly();
+    void handleTasks();
+    HandlerTask* nextTask();
+    bool refillTasks();
+    HandlerTask* stealTask();
+    bool stealable() const;
+    void wakeIdleWorker();
+    uint64_t run(HandlerTask* task, uint64_t started);
+    bool runStrand(ClientStrand& strand, uint64_t& started);
+    bool waitForMessages();
+    bool waitForTasks();
+    uint64_t handle(Message& message, uint64_t started);
+    static void release(Message& message);
+    static void* handleMessageQueueWrapper(void* arg);
+};
+
+// Fixed-size pool of workers. With CLIENT_AFFINITY every client is hashed to one worker so its messages keep
+// their order; the work-stealing modes let any worker handle any message, serialised per client by its strand if ordered
+class WorkerPool
+{
+public:
+    WorkerPool(int workerCount, size_t queueCapacity, size_t fairQuantum, WorkerScheduling workerScheduling);
+    void setHandler(MessageHandler messageHandler);
+    void start(const std::vector<int>& cpus);
+    void stop();
+    void abandon();
+    bool finished() const;
+    void join();
+    bool tryPush(Message& message, ClientStrand& strand);
+
+private:
+    MessageHandler handler; // Handler shared by every worker, set before the pool starts
+    WorkerList workers; // Workers of the pool
+    WorkerScheduling scheduling; // How messages are spread over the workers
+    size_t strandCapacity; // Messages one client's strand holds before pushing fails
+    bool started; // Whether the worker threads are running
+
+    size_t workerFor(int clientSocket) const;
+    bool tryPushTask(HandlerTask* task);
+    bool tryAppend(ClientStrand& strand, HandlerTask* task);
+};
+
+#endif
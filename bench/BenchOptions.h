@@ -0,0 +1,57 @@
+#ifndef BENCH_OPTIONS_H
+#define BENCH_OPTIONS_H
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// Command line of the benchmark programs, a list of "--name value" pairs
+class BenchOptions
+{
+public:
+    BenchOptions(int argc, char* argv[]) : count(argc), values(argv)
+    {
+        for(int i = 1; i < count; i += 2)
+        {
+            if(strncmp(values[i], "--", 2) != 0 || i + 1 >= count)
+            {
+                std::cerr << "Expected --name value, got " << values[i] << "\n";
+                exit(2);
+            }
+        }
+    }
+
+    // Function to get an option as text, or the default if it was not given
+    std::string text(const char* name, const char* fallback) const
+    {
+        for(int i = 1; i + 1 < count; i += 2)
+        {
+            if(strcmp(values[i] + 2, name) == 0)
+            {
+                return values[i + 1];
+            }
+        }
+        return fallback;
+    }
+
+    // Function to get an option as a number, or the default if it was not given
+    long integer(const char* name, long fallback) const
+    {
+        std::string value = text(name, "");
+        return value.empty() ? fallback : strtol(value.c_str(), NULL, 10);
+    }
+
+    // Function to get an option as a floating point number, or the default if it was not given
+    double real(const char* name, double fallback) const
+    {
+        std::string value = text(name, "");
+        return value.empty() ? fallback : strtod(value.c_str(), NULL);
+    }
+
+private:
+    int count;
+    char** values;
+};
+
+#endif
@@ -0,0 +1,74 @@
+// Echo server driven by the load generator: every message is sent straight back to its client.
+// Build from the repository root:
+//     g++ -std=c++17 -O2 -pthread -I. bench/EchoServer.cpp $(ls *.cpp | grep -v main.cpp) -o echo_server -lssl -lcrypto
+// adding e.g. -DTCPSERVER_WITH_ZSTD ... -lzstd for the codecs offered with --compression
+// Usage: echo_server [--port 8080] [--mode thread|epoll|reuseport|uring] [--loops 1] [--workers 1]
+//                    [--scheduling affinity|stealing|ordered] [--framing newline|length]
+//                    [--tuning default|latency|throughput] [--stats 0] [--tls-cert cert.pem --tls-key key.pem]
+//                    [--compression zstd,lz4,deflate] [--compression-threshold 256]
+//                    [--spool /var/tmp/echo-spool] [--spool-commit-us 1000]
+#include "BenchOptions.h"
+#include "Server.h"
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options(argc, argv);
+    ServerConfig config;
+    config.echoMessages = false;
+    config.logLevel = LogLevel::WARNING; // Connection messages would dominate the profile
+    config.reactorThreads = options.integer("loops", 1);
+    config.workerThreads = options.integer("workers", 1);
+    config.statsIntervalMs = options.integer("stats", 0) * 1000; // Seconds between metrics reports
+
+    std::string mode = options.text("mode", "epoll");
+    config.mode = mode == "thread" ? ServerMode::THREAD_PER_CLIENT :
+                  mode == "reuseport" ? ServerMode::REUSEPORT_REACTOR :
+                  mode == "uring" ? ServerMode::IO_URING_REACTOR : ServerMode::EPOLL_REACTOR;
+    std::string scheduling = options.text("scheduling", "affinity");
+    config.scheduling = scheduling == "stealing" ? WorkerScheduling::WORK_STEALING :
+                        scheduling == "ordered" ? WorkerScheduling::ORDERED_WORK_STEALING : WorkerScheduling::CLIENT_AFFINITY;
+    config.framing = options.text("framing", "newline") == "length" ? FramingMode::LENGTH_PREFIXED : FramingMode::NEWLINE;
+    config.tlsCertificateFile = options.text("tls-cert", "");
+    config.tlsPrivateKeyFile = options.text("tls-key", "");
+    std::string compression = options.text("compression", "");
+    for(CompressionCodec codec : {CompressionCodec::ZSTD, CompressionCodec::LZ4, CompressionCodec::DEFLATE})
+    {
+        if(CompressionPool::negotiate(compression, {codec}) == codec)
+        {
+            config.compressionCodecs.push_back(codec); // Listed codecs that are compiled in, zstd first
+        }
+    }
+    config.compressionThreshold = options.integer("compression-threshold", DEFAULT_COMPRESSION_THRESHOLD);
+    config.spoolDirectory = options.text("spool", ""); // Messages pass through the durable log, a leftover one is replayed
+    config.spoolCommitIntervalUs = options.integer("spool-commit-us", DEFAULT_SPOOL_COMMIT_INTERVAL_US);
+
+    std::string tuning = options.text("tuning", "default");
+    if(tuning == "latency")
+    {
+        config.tuning = SocketTuning::latency();
+    }
+    else if(tuning == "throughput")
+    {
+        config.tuning = SocketTuning::throughput();
+    }
+    if(config.statsIntervalMs > 0)
+    {
+        config.logLevel = LogLevel::INFO; // Reports are logged at INFO
+    }
+
+    try
+    {
+        Server server(options.integer("port", 8080), config);
+        server.setMessageHandler([&server](ClientId client, std::string_view message)
+        {
+            server.send(client, message);
+        });
+        server.startServer();
+    }
+    catch(const TCPServerError& ex)
+    {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,120 @@
+// Microbenchmark of the frame decoder: a stream of frames of one size is fed in receive-sized chunks,
+// as a reactor would after every recv, and every frame is handed to a callback that only counts it,
+// or that decodes it with the message codec to show what parsing adds per frame.
+// Build from the repository root:
+//     g++ -std=c++17 -O2 -pthread -I. bench/FramingBench.cpp Framing.cpp DelimiterScan.cpp Compression.cpp BufferPool.cpp Metrics.cpp -o framing_bench
+// Usage: framing_bench [--bytes 268435456] [--chunk 4096]
+#include "BenchOptions.h"
+#include "DelimiterScan.h"
+#include "Framing.h"
+#include "MessageCodec.h"
+#include "Metrics.h"
+#include <arpa/inet.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Order message decoded by the codec benchmark
+struct BenchOrder
+{
+    uint64_t id;
+    int32_t quantity;
+    uint8_t side;
+    std::array<char, 8> symbol;
+    double price;
+};
+
+template <>
+struct MessageSchema<BenchOrder>
+{
+    static constexpr uint16_t type = 1;
+    static constexpr auto fields = std::make_tuple(&BenchOrder::id, &BenchOrder::quantity, &BenchOrder::side,
+                                                   &BenchOrder::symbol, &BenchOrder::price);
+};
+
+typedef MessageCodec<BenchOrder> BenchCodec;
+
+// Function to build a stream of back-to-back frames carrying the given payload
+static std::string buildStream(FramingMode mode, const std::string& payload, size_t totalBytes)
+{
+    std::string frame;
+    if(mode == FramingMode::LENGTH_PREFIXED)
+    {
+        uint32_t length = htonl((uint32_t)payload.size());
+        frame.append(reinterpret_cast<const char*>(&length), FRAME_LENGTH_PREFIX_SIZE);
+        frame += payload;
+    }
+    else
+    {
+        frame += payload;
+        frame += '\n';
+    }
+
+    std::string stream;
+    stream.reserve(totalBytes + frame.size());
+    while(stream.size() < totalBytes)
+    {
+        stream += frame;
+    }
+    return stream;
+}
+
+// Function to decode a stream through the receive buffer path, handing every frame to onFrame, and report the throughput
+template <typename OnFrame>
+static void benchmarkDecoder(FramingMode mode, const char* name, const std::string& payload, size_t totalBytes, size_t chunkSize,
+                             OnFrame onFrame)
+{
+    std::string stream = buildStream(mode, payload, totalBytes);
+    FrameDecoder decoder(mode, DEFAULT_MAX_FRAME_SIZE);
+    size_t frames = 0;
+    auto countFrame = [&frames, &onFrame](BufferSlice&& frame)
+    {
+        ++frames;
+        onFrame(frame.view());
+        return true;
+    };
+
+    uint64_t start = Metrics::nowNs();
+    for(size_t offset = 0; offset < stream.size(); offset += chunkSize)
+    {
+        size_t length = stream.size() - offset < chunkSize ? stream.size() - offset : chunkSize;
+        size_t available;
+        char* space = decoder.prepareWrite(length, available);
+        memcpy(space, stream.data() + offset, length); // Stands in for recv writing into the buffer
+        decoder.commitWrite(length);
+        decoder.decode(countFrame);
+    }
+    uint64_t elapsed = Metrics::nowNs() - start;
+
+    printf("%s, %zu byte payloads: %.2f GB/s, %.1f ns per frame\n", name, payload.size(), stream.size() / (double)elapsed,
+           (double)elapsed / frames);
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options(argc, argv);
+    size_t totalBytes = options.integer("bytes", 256 * 1024 * 1024);
+    size_t chunkSize = options.integer("chunk", 4096);
+
+    printf("delimiter search: %s\n", DelimiterScan::kernelName());
+    auto ignore = [](std::string_view) {};
+    for(size_t payloadSize : {16, 64, 512, 4096})
+    {
+        std::string payload(payloadSize, 'x');
+        benchmarkDecoder(FramingMode::NEWLINE, "newline", payload, totalBytes, chunkSize, ignore);
+        benchmarkDecoder(FramingMode::LENGTH_PREFIXED, "length prefixed", payload, totalBytes, chunkSize, ignore);
+    }
+    benchmarkDecoder(FramingMode::RAW, "raw", std::string(chunkSize, 'x'), totalBytes, chunkSize, ignore);
+
+    // The same frames as length prefixed, once only counted and once decoded into their struct
+    BenchOrder order{1, 100, 1, {'T', 'C', 'P', 'S', 'R', 'V', '0', '1'}, 12.5};
+    std::string encoded(BenchCodec::encodedSize(order), '\0');
+    BenchCodec::encode(order, &encoded[0]);
+    uint64_t checksum = 0;
+    benchmarkDecoder(FramingMode::LENGTH_PREFIXED, "length prefixed order", encoded, totalBytes, chunkSize, ignore);
+    benchmarkDecoder(FramingMode::LENGTH_PREFIXED, "decoded order", encoded, totalBytes, chunkSize, [&checksum](std::string_view frame)
+    {
+        BenchCodec::decode(frame, [&checksum](const BenchOrder& decoded) { checksum += decoded.id + decoded.quantity; });
+    });
+    printf("checksum %llu\n", (unsigned long long)checksum); // Keeps the decoded fields from being optimised away
+}
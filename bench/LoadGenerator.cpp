@@ -0,0 +1,441 @@
+// Multi-threaded load generator for the server, reporting throughput and latency percentiles.
+// Each thread drives its share of the connections from its own epoll loop.
+//   rr: request/response, up to --pipeline requests per connection wait for their echo and
+//       the latency from the intended send time to the reply is recorded
+//   ff: fire-and-forget, messages are sent as fast as --rate allows and replies are discarded
+// With --rate the schedule is fixed in advance, so a stalled server shows up in the latencies
+// instead of silently lowering the offered load.
+// Build from the repository root:
+//     g++ -std=c++17 -O2 -pthread -I. bench/LoadGenerator.cpp Metrics.cpp -o load_generator
+// Usage: load_generator [--host 127.0.0.1] [--port 8080] [--connections 64] [--threads 4] [--size 64]
+//                       [--rate 0] [--duration 10] [--warmup 1] [--mode rr|ff] [--pipeline 1]
+//                       [--framing newline|length]
+#include "BenchOptions.h"
+#include "Metrics.h"
+#include <pthread.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define LOAD_OUTPUT_LIMIT (64 * 1024) // Unwritten bytes per connection above which no more messages are generated
+#define LOAD_RECV_SIZE (64 * 1024) // Bytes read per recv
+#define LOAD_MAX_EVENTS 256 // Events per epoll_wait
+
+// Settings shared by every load thread
+struct LoadSettings
+{
+    std::string host;
+    int port;
+    int connections;
+    int threads;
+    size_t size; // Payload bytes per message
+    double rate; // Messages per second over all connections, 0 for as fast as possible
+    bool requestResponse; // rr mode, otherwise fire-and-forget
+    size_t pipeline; // Outstanding requests per connection in rr mode
+    bool lengthPrefixed; // Framing of requests and replies
+    uint64_t measureStartNs; // Measurement begins after the warmup
+    uint64_t measureEndNs; // And ends here, so do the threads
+};
+
+// One client connection of a load thread
+struct LoadConnection
+{
+    int socket = -1;
+    std::string output; // Framed messages not written yet
+    size_t outputOffset = 0; // Bytes of output already written
+    std::string input; // Bytes of an incomplete reply
+    std::deque<uint64_t> sentAt; // Intended send times of the requests waiting for their reply
+    uint64_t nextSendAt = 0; // Time the next message is due in paced mode
+    bool wantWrite = false; // Registered for EPOLLOUT because output is backed up
+};
+
+// Load thread with its own connections and results
+struct LoadThread
+{
+    const LoadSettings* settings;
+    std::vector<LoadConnection> connections;
+    std::string message; // Framed message sent over and over
+    uint64_t intervalNs = 0; // Time between two messages of one connection in paced mode
+    int epollFd = -1;
+    pthread_t thread;
+
+    // Results inside the measurement window
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t failures = 0; // Connections lost while running
+    std::unique_ptr<LatencyHistogram> latency = std::make_unique<LatencyHistogram>();
+};
+
+// Function to open a non-blocking connection to the server, -1 on failure
+static int connectToServer(const LoadSettings& settings)
+{
+    int clientSocket = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(settings.port);
+    if(clientSocket == -1 || inet_pton(AF_INET, settings.host.c_str(), &address.sin_addr) != 1 ||
+       connect(clientSocket, (struct sockaddr*)&address, sizeof(address)) == -1)
+    {
+        if(clientSocket != -1)
+        {
+            close(clientSocket);
+        }
+        return -1;
+    }
+
+    int enable = 1;
+    setsockopt(clientSocket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable)); // Measure the server, not Nagle
+    fcntl(clientSocket, F_SETFL, fcntl(clientSocket, F_GETFL) | O_NONBLOCK);
+    return clientSocket;
+}
+
+// Function to close a connection that failed, it no longer takes part in the run
+static void dropConnection(LoadThread& load, LoadConnection& connection)
+{
+    epoll_ctl(load.epollFd, EPOLL_CTL_DEL, connection.socket, NULL);
+    close(connection.socket);
+    connection.socket = -1;
+    ++load.failures;
+}
+
+// Function to write as much of a connection's output as the socket takes, watching for EPOLLOUT while it is backed up
+static void flushConnection(LoadThread& load, LoadConnection& connection)
+{
+    while(connection.outputOffset < connection.output.size())
+    {
+        ssize_t written = send(connection.socket, connection.output.data() + connection.outputOffset,
+                               connection.output.size() - connection.outputOffset, MSG_NOSIGNAL);
+        if(written > 0)
+        {
+            connection.outputOffset += written;
+        }
+        else if(written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        else if(written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            break;
+        }
+        else
+        {
+            dropConnection(load, connection);
+            return;
+        }
+    }
+
+    bool backedUp = connection.outputOffset < connection.output.size();
+    if(!backedUp)
+    {
+        connection.output.clear();
+        connection.outputOffset = 0;
+    }
+    if(backedUp != connection.wantWrite)
+    {
+        struct epoll_event event{};
+        event.events = backedUp ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        event.data.ptr = &connection;
+        epoll_ctl(load.epollFd, EPOLL_CTL_MOD, connection.socket, &event);
+        connection.wantWrite = backedUp;
+    }
+}
+
+// Function to queue every message a connection may send now and write them out
+static void pumpConnection(LoadThread& load, LoadConnection& connection, uint64_t now)
+{
+    const LoadSettings& settings = *load.settings;
+    while(connection.output.size() - connection.outputOffset < LOAD_OUTPUT_LIMIT)
+    {
+        if(settings.rate > 0 && connection.nextSendAt > now)
+        {
+            break; // Not due yet
+        }
+        if(settings.requestResponse && connection.sentAt.size() >= settings.pipeline)
+        {
+            break; // Window full, wait for replies
+        }
+
+        uint64_t due = settings.rate > 0 ? connection.nextSendAt : now;
+        connection.output += load.message;
+        if(settings.requestResponse)
+        {
+            connection.sentAt.push_back(due);
+        }
+        if(settings.rate > 0)
+        {
+            connection.nextSendAt += load.intervalNs;
+        }
+        if(due >= settings.measureStartNs)
+        {
+            ++load.sent;
+        }
+    }
+    flushConnection(load, connection);
+}
+
+// Function to read the replies of a connection, recording the latency of every completed request
+static void readConnection(LoadThread& load, LoadConnection& connection)
+{
+    const LoadSettings& settings = *load.settings;
+    char buffer[LOAD_RECV_SIZE];
+    while(true)
+    {
+        ssize_t bytesRead = recv(connection.socket, buffer, sizeof(buffer), 0);
+        if(bytesRead == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if(bytesRead == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        if(bytesRead <= 0)
+        {
+            dropConnection(load, connection);
+            return;
+        }
+
+        uint64_t now = Metrics::nowNs();
+        bool measuring = now >= settings.measureStartNs && now < settings.measureEndNs;
+        if(measuring)
+        {
+            load.bytesReceived += bytesRead;
+        }
+        if(!settings.requestResponse)
+        {
+            continue; // Replies are only drained so the server does not stop reading
+        }
+
+        // Split the replies, every complete one answers the oldest outstanding request
+        connection.input.append(buffer, bytesRead);
+        size_t position = 0;
+        while(true)
+        {
+            size_t end;
+            if(settings.lengthPrefixed)
+            {
+                uint32_t length;
+                if(connection.input.size() - position < sizeof(length))
+                {
+                    break;
+                }
+                memcpy(&length, connection.input.data() + position, sizeof(length));
+                end = position + sizeof(length) + ntohl(length);
+                if(end > connection.input.size())
+                {
+                    break;
+                }
+            }
+            else
+            {
+                size_t newline = connection.input.find('\n', position);
+                if(newline == std::string::npos)
+                {
+                    break;
+                }
+                end = newline + 1;
+            }
+            position = end;
+
+            if(connection.sentAt.empty())
+            {
+                continue; // Not a reply to this generator
+            }
+            uint64_t sentAt = connection.sentAt.front();
+            connection.sentAt.pop_front();
+            if(measuring && sentAt >= settings.measureStartNs)
+            {
+                load.latency->record(now - sentAt);
+                ++load.received;
+            }
+        }
+        connection.input.erase(0, position);
+    }
+}
+
+// Function to run one load thread until the measurement window has ended
+static void* runLoad(void* arg)
+{
+    LoadThread& load = *reinterpret_cast<LoadThread*>(arg);
+    const LoadSettings& settings = *load.settings;
+    struct epoll_event events[LOAD_MAX_EVENTS];
+
+    uint64_t now = Metrics::nowNs();
+    for(size_t i = 0; i < load.connections.size(); ++i)
+    {
+        // Spread the first sends over one interval so paced connections do not fire in lockstep
+        load.connections[i].nextSendAt = now + (load.intervalNs * i) / load.connections.size();
+    }
+
+    while((now = Metrics::nowNs()) < settings.measureEndNs)
+    {
+        uint64_t nextDue = settings.measureEndNs;
+        for(LoadConnection& connection : load.connections)
+        {
+            if(connection.socket != -1)
+            {
+                pumpConnection(load, connection, now);
+                nextDue = connection.nextSendAt < nextDue ? connection.nextSendAt : nextDue;
+            }
+        }
+
+        // Unpaced fire-and-forget always has more to send; otherwise sleep until replies or the next due message,
+        // with a nanosecond timeout so paced sends are not rounded to whole milliseconds
+        uint64_t waitNs = settings.rate > 0 ? (nextDue > now ? nextDue - now : 0) : (settings.requestResponse ? 10000000 : 0);
+        struct timespec timeout = {(time_t)(waitNs / 1000000000), (long)(waitNs % 1000000000)};
+        int eventCount = epoll_pwait2(load.epollFd, events, LOAD_MAX_EVENTS, &timeout, NULL);
+        for(int i = 0; i < eventCount; ++i)
+        {
+            LoadConnection& connection = *static_cast<LoadConnection*>(events[i].data.ptr);
+            if(connection.socket != -1 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+            {
+                readConnection(load, connection);
+            }
+            if(connection.socket != -1 && (events[i].events & EPOLLOUT))
+            {
+                flushConnection(load, connection);
+            }
+        }
+    }
+
+    for(LoadConnection& connection : load.connections)
+    {
+        if(connection.socket != -1)
+        {
+            close(connection.socket);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options(argc, argv);
+    LoadSettings settings;
+    settings.host = options.text("host", "127.0.0.1");
+    settings.port = options.integer("port", 8080);
+    settings.connections = options.integer("connections", 64);
+    settings.threads = options.integer("threads", 4);
+    settings.size = options.integer("size", 64);
+    settings.rate = options.real("rate", 0);
+    settings.requestResponse = options.text("mode", "rr") != "ff";
+    settings.pipeline = options.integer("pipeline", 1);
+    settings.lengthPrefixed = options.text("framing", "newline") == "length";
+    double duration = options.real("duration", 10);
+    double warmup = options.real("warmup", 1);
+    if(settings.threads > settings.connections)
+    {
+        settings.threads = settings.connections;
+    }
+    if(settings.connections <= 0 || settings.threads <= 0 || settings.pipeline == 0 || duration <= 0)
+    {
+        fprintf(stderr, "Connections, threads, pipeline and duration must be positive.\n");
+        return 2;
+    }
+
+    // Payload without newlines so both framings can carry it
+    std::string message;
+    if(settings.lengthPrefixed)
+    {
+        uint32_t length = htonl((uint32_t)settings.size);
+        message.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        message.append(settings.size, 'x');
+    }
+    else
+    {
+        message.append(settings.size, 'x');
+        message += '\n';
+    }
+
+    std::vector<std::unique_ptr<LoadThread>> threads;
+    for(int t = 0; t < settings.threads; ++t)
+    {
+        threads.push_back(std::make_unique<LoadThread>());
+        LoadThread& load = *threads.back();
+        load.settings = &settings;
+        load.message = message;
+        load.epollFd = epoll_create1(EPOLL_CLOEXEC);
+        load.connections.resize(settings.connections / settings.threads + (t < settings.connections % settings.threads ? 1 : 0));
+        if(settings.rate > 0)
+        {
+            load.intervalNs = (uint64_t)(1e9 * settings.connections / settings.rate);
+        }
+
+        for(LoadConnection& connection : load.connections)
+        {
+            connection.socket = connectToServer(settings);
+            if(connection.socket == -1)
+            {
+                fprintf(stderr, "Could not connect to %s:%d: %s\n", settings.host.c_str(), settings.port, strerror(errno));
+                return 1;
+            }
+            struct epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.ptr = &connection;
+            epoll_ctl(load.epollFd, EPOLL_CTL_ADD, connection.socket, &event);
+        }
+    }
+
+    uint64_t start = Metrics::nowNs();
+    settings.measureStartNs = start + (uint64_t)(warmup * 1e9);
+    settings.measureEndNs = settings.measureStartNs + (uint64_t)(duration * 1e9);
+    for(auto& load : threads)
+    {
+        pthread_create(&load->thread, NULL, runLoad, load.get());
+    }
+
+    uint64_t sent = 0, received = 0, bytesReceived = 0, failures = 0;
+    HistogramSnapshot latency;
+    for(auto& load : threads)
+    {
+        pthread_join(load->thread, NULL);
+        close(load->epollFd);
+        sent += load->sent;
+        received += load->received;
+        bytesReceived += load->bytesReceived;
+        failures += load->failures;
+        for(size_t i = 0; i < LATENCY_BUCKET_COUNT; ++i)
+        {
+            uint64_t count = load->latency->buckets[i].get();
+            latency.buckets[i] += count;
+            latency.count += count;
+        }
+    }
+
+    printf("%s, %d connections on %d threads, %zu byte payloads, %s, %.1f s\n",
+           settings.requestResponse ? "request/response" : "fire-and-forget", settings.connections, settings.threads,
+           settings.size, settings.rate > 0 ? "paced" : "unpaced", duration);
+    printf("sent %llu messages (%.0f/s), received %.0f MB/s", (unsigned long long)sent, sent / duration,
+           bytesReceived / duration / 1e6);
+    if(settings.requestResponse)
+    {
+        printf(", %llu replies (%.0f/s)\n", (unsigned long long)received, received / duration);
+        printf("latency us p50 %.1f p90 %.1f p99 %.1f p999 %.1f max %.1f\n", latency.percentile(0.5) / 1e3,
+               latency.percentile(0.9) / 1e3, latency.percentile(0.99) / 1e3, latency.percentile(0.999) / 1e3,
+               latency.max() / 1e3);
+    }
+    else
+    {
+        printf("\n");
+    }
+    if(failures > 0)
+    {
+        printf("%llu connections were lost\n", (unsigned long long)failures);
+    }
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+// Microbenchmarks of the message path between the readers and the workers: the MPSC message ring
+// with one to N producers, and the pooled buffers every frame lives in.
+// Build from the repository root:
+//     g++ -std=c++17 -O2 -pthread -I. bench/QueueBench.cpp BufferPool.cpp Metrics.cpp -o queue_bench
+// Usage: queue_bench [--messages 10000000] [--producers 4] [--capacity 65536]
+#include "BenchOptions.h"
+#include "BufferPool.h"
+#include "Message.h"
+#include "MessageRing.h"
+#include "Metrics.h"
+#include <pthread.h>
+#include <sched.h>
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+// Shared state of one ring benchmark run
+struct RingRun
+{
+    MessageRing<Message>* ring;
+    size_t messagesPerProducer;
+    std::atomic<bool> go{false}; // Released once every thread is ready
+};
+
+// Function to push this producer's share of messages, yielding while the ring is full
+static void* produce(void* arg)
+{
+    RingRun& run = *reinterpret_cast<RingRun*>(arg);
+    while(!run.go.load(std::memory_order_acquire))
+    {
+    }
+
+    Message message;
+    for(size_t i = 0; i < run.messagesPerProducer; ++i)
+    {
+        message.client.socket = (int)i;
+        while(!run.ring->tryPush(message))
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// Function to measure the ring with the given number of producers and the calling thread as consumer
+static void benchmarkRing(size_t producers, size_t messages, size_t capacity)
+{
+    MessageRing<Message> ring(capacity);
+    RingRun run;
+    run.ring = &ring;
+    run.messagesPerProducer = messages / producers;
+
+    std::vector<pthread_t> threads(producers);
+    for(pthread_t& thread : threads)
+    {
+        pthread_create(&thread, NULL, produce, &run);
+    }
+
+    uint64_t start = Metrics::nowNs();
+    run.go.store(true, std::memory_order_release);
+    size_t total = run.messagesPerProducer * producers;
+    Message message;
+    for(size_t popped = 0; popped < total;)
+    {
+        if(ring.tryPop(message))
+        {
+            ++popped;
+        }
+    }
+    uint64_t elapsed = Metrics::nowNs() - start;
+    for(pthread_t& thread : threads)
+    {
+        pthread_join(thread, NULL);
+    }
+
+    printf("ring, %zu producer%s: %.1f M messages/s, %.1f ns per message\n", producers, producers == 1 ? "" : "s",
+           total * 1e3 / elapsed, (double)elapsed / total);
+}
+
+// Function to measure a push followed by a pop on one thread, the cost without any cache line transfer
+static void benchmarkRingUncontended(size_t messages, size_t capacity)
+{
+    MessageRing<Message> ring(capacity);
+    Message message;
+    uint64_t start = Metrics::nowNs();
+    for(size_t i = 0; i < messages; ++i)
+    {
+        ring.tryPush(message);
+        ring.tryPop(message);
+    }
+    uint64_t elapsed = Metrics::nowNs() - start;
+    printf("ring, same thread: %.1f ns per push and pop\n", (double)elapsed / messages);
+}
+
+// Function to measure acquiring and releasing a pooled buffer of the given size on one thread
+static void benchmarkPool(size_t size, size_t iterations)
+{
+    uint64_t start = Metrics::nowNs();
+    for(size_t i = 0; i < iterations; ++i)
+    {
+        PooledBuffer buffer(size);
+        buffer.data()[0] = (char)i; // Keep the allocation from being optimised away
+    }
+    uint64_t elapsed = Metrics::nowNs() - start;
+    printf("buffer pool, %zu bytes: %.1f ns per acquire and release\n", size, (double)elapsed / iterations);
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options(argc, argv);
+    size_t messages = options.integer("messages", 10000000);
+    size_t maxProducers = options.integer("producers", 4);
+    size_t capacity = options.integer("capacity", 65536);
+
+    benchmarkRingUncontended(messages, capacity);
+    for(size_t producers = 1; producers <= maxProducers; producers *= 2)
+    {
+        benchmarkRing(producers, messages, capacity);
+    }
+    for(size_t size : {64, 4096, 65536})
+    {
+        benchmarkPool(size, messages / 10);
+    }
+}
@@ -1,11 +1,53 @@
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
 #include "Server.h"
 
-int main() 
+int main(int argc, char* argv[]) 
 {
+    ServerConfig config;
+
+    // Usage: server [epoll|reuseport|uring [loop threads [latency|throughput]]]
+    if(argc > 1)
+    {
+        if(strcmp(argv[1], "epoll") == 0)
+        {
+            config.mode = ServerMode::EPOLL_REACTOR;
+        }
+        else if(strcmp(argv[1], "reuseport") == 0)
+        {
+            config.mode = ServerMode::REUSEPORT_REACTOR;
+        }
+        else if(strcmp(argv[1], "uring") == 0)
+        {
+            config.mode = ServerMode::IO_URING_REACTOR;
+        }
+
+        if(argc > 2)
+        {
+            config.reactorThreads = atoi(argv[2]);
+        }
+
+        if(argc > 3 && strcmp(argv[3], "latency") == 0)
+        {
+            config.tuning = SocketTuning::latency();
+        }
+        else if(argc > 3 && strcmp(argv[3], "throughput") == 0)
+        {
+            config.tuning = SocketTuning::throughput();
+        }
+    }
+
+    // A restarted server started with the same path takes over the listeners of the running one
+    const char* handoffPath = getenv("TCP_SERVER_HANDOFF_PATH");
+    if(handoffPath != NULL)
+    {
+        config.handoffPath = handoffPath;
+    }
+
     try
     {
-        Server TCPServer(8080);
+        Server TCPServer(8080, config);
         TCPServer.startServer();
     }
     catch(const TCPServerError& ex)
@@ -18,4 +60,4 @@ int main()
         std::cerr << ex.what() << "\n";
         std::cout << "Server stopped working.\n";
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,105 @@
+// Checks of the buffer pool: size-class rounding, oversized buffers bypassing the pool, shared handles, and
+// buffers released by another thread coming back through that thread's cache and the depot instead of the heap
+#include "BufferPool.h"
+#include "TestCheck.h"
+#include <set>
+#include <thread>
+#include <vector>
+
+#define TEST_CLASS_SIZE 4096 // A thread caches 256 buffers of this class
+#define TEST_BUFFERS 300 // More than a thread caches, so a batch goes to the depot
+
+static void testSizeClasses()
+{
+    size_t requests[] = {0, 1, 64, 65, 1000, 4096, 4097, (size_t)1 << BUFFER_POOL_MAX_SHIFT};
+    size_t capacities[] = {64, 64, 64, 128, 1024, 4096, 8192, (size_t)1 << BUFFER_POOL_MAX_SHIFT};
+    for(size_t i = 0; i < sizeof(requests) / sizeof(requests[0]); ++i)
+    {
+        BufferBlock* block = BufferPool::acquire(requests[i]);
+        CHECK(block->capacity == capacities[i]);
+        CHECK(block->sizeClass != BUFFER_POOL_LARGE_CLASS);
+        BufferPool::release(block);
+    }
+
+    size_t large = ((size_t)1 << BUFFER_POOL_MAX_SHIFT) + 1;
+    BufferBlock* block = BufferPool::acquire(large);
+    CHECK(block->sizeClass == BUFFER_POOL_LARGE_CLASS);
+    CHECK(block->capacity == large); // Exactly what was asked for
+    BufferPool::release(block);
+
+    BufferBlock* first = BufferPool::acquire(100);
+    BufferPool::release(first);
+    CHECK(BufferPool::acquire(100) == first); // Reused from the thread's cache, newest first
+    BufferPool::release(first);
+}
+
+static void testSharedHandles()
+{
+    PooledBuffer buffer("payload", 7);
+    CHECK(buffer.view() == "payload");
+    CHECK(buffer.unique());
+    PooledBuffer other = buffer.share();
+    CHECK(!buffer.unique() && !other.unique());
+    CHECK(other.data() == buffer.data());
+    buffer.reset();
+    CHECK(other.unique()); // The buffer stays with the last handle
+    CHECK(other.view() == "payload");
+}
+
+static void testCrossThreadRelease()
+{
+    std::vector<BufferBlock*> blocks;
+    for(int i = 0; i < TEST_BUFFERS; ++i)
+    {
+        blocks.push_back(BufferPool::acquire(TEST_CLASS_SIZE));
+    }
+    std::set<BufferBlock*> released(blocks.begin(), blocks.end());
+
+    // Freed by a worker: surplus beyond its cache goes to the depot, the rest when the thread exits
+    int reusedByWorker = 0;
+    bool sameNode = true;
+    std::thread worker([&blocks, &released, &reusedByWorker, &sameNode]()
+    {
+        BufferBlock* probe = BufferPool::acquire(64);
+        sameNode = probe->node == blocks[0]->node; // Buffers of another node are not cached, only handed back
+        BufferPool::release(probe);
+        for(BufferBlock* block : blocks)
+        {
+            BufferPool::release(block);
+        }
+        std::vector<BufferBlock*> again;
+        for(int i = 0; i < 10; ++i)
+        {
+            again.push_back(BufferPool::acquire(TEST_CLASS_SIZE));
+            reusedByWorker += released.count(again.back()) == 1;
+        }
+        for(BufferBlock* block : again)
+        {
+            BufferPool::release(block);
+        }
+    });
+    worker.join();
+    CHECK(reusedByWorker == (sameNode ? 10 : 0));
+
+    // Every buffer is back in the depot, the allocating thread gets them all again without the heap
+    std::vector<BufferBlock*> reacquired;
+    int reused = 0;
+    for(int i = 0; i < TEST_BUFFERS; ++i)
+    {
+        reacquired.push_back(BufferPool::acquire(TEST_CLASS_SIZE));
+        reused += released.count(reacquired.back()) == 1;
+    }
+    CHECK(reused == TEST_BUFFERS);
+    for(BufferBlock* block : reacquired)
+    {
+        BufferPool::release(block);
+    }
+}
+
+int main()
+{
+    testSizeClasses();
+    testSharedHandles();
+    testCrossThreadRelease();
+    return testResult();
+}
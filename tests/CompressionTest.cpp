@@ -0,0 +1,148 @@
+// Checks of the stream compression: negotiation of the offered codecs, and newline frames sent through
+// compressed and stored blocks of every compiled-in codec and decoded again by the frame decoder
+#include "Compression.h"
+#include "Framing.h"
+#include "TestCheck.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+static void testNegotiate()
+{
+    std::vector<CompressionCodec> preferred = {CompressionCodec::ZSTD, CompressionCodec::DEFLATE};
+    if(CompressionPool::available(CompressionCodec::DEFLATE))
+    {
+        CHECK(CompressionPool::negotiate("deflate", preferred) == CompressionCodec::DEFLATE);
+    }
+    if(CompressionPool::available(CompressionCodec::ZSTD))
+    {
+        CHECK(CompressionPool::negotiate("lz4,deflate,zstd", preferred) == CompressionCodec::ZSTD); // The server's preference wins
+    }
+    CHECK(CompressionPool::negotiate("lz4", preferred) == CompressionCodec::NONE);
+    CHECK(CompressionPool::negotiate("", preferred) == CompressionCodec::NONE);
+    CHECK(isCompressionOffer(COMPRESSION_OFFER_PREFIX "zstd"));
+    CHECK(!isCompressionOffer("compress:zstd"));
+}
+
+// Function to feed a compressed stream to a decoder in chunks and collect the frames
+static std::vector<std::string> decodeCompressed(CompressionCodec codec, const std::string& wire, size_t chunkSize, DecodeResult& last)
+{
+    FrameDecoder decoder(FramingMode::NEWLINE, DEFAULT_MAX_FRAME_SIZE);
+    CHECK(decoder.startDecompression(CompressionPool::acquireDecompressor(codec)));
+    std::vector<std::string> frames;
+    last = DecodeResult::OK;
+    for(size_t offset = 0; offset < wire.size() && last == DecodeResult::OK; offset += chunkSize)
+    {
+        size_t length = std::min(chunkSize, wire.size() - offset);
+        size_t available;
+        char* space = decoder.prepareWrite(length, available);
+        memcpy(space, wire.data() + offset, length);
+        decoder.commitWrite(length);
+        last = decoder.decode([&frames](BufferSlice&& frame)
+        {
+            frames.push_back(std::string(frame.view()));
+            return true;
+        });
+    }
+    return frames;
+}
+
+static void testRoundTrip(CompressionCodec codec)
+{
+    CompressorHandle compressor = CompressionPool::acquireCompressor(codec, 0);
+    CHECK(compressor != NULL);
+    std::vector<std::string> lines;
+    std::string wire;
+    for(int block = 0; block < 20; ++block)
+    {
+        std::string plain;
+        for(int i = 0; i < 50; ++i)
+        {
+            lines.push_back("message " + std::to_string(block) + "/" + std::to_string(i) + std::string(i, 'x'));
+            plain += lines.back() + "\n";
+        }
+        PooledBuffer encoded;
+        // Every fourth block is stored, as small flushes are
+        CHECK(encodeCompressionBlock(block % 4 == 3 ? NULL : compressor.get(), plain.data(), plain.size(), encoded));
+        wire.append(encoded.data(), encoded.size());
+    }
+
+    for(size_t chunkSize : {1, 7, 1000, 1000000})
+    {
+        DecodeResult last;
+        CHECK(decodeCompressed(codec, wire, chunkSize, last) == lines);
+        CHECK(last == DecodeResult::OK);
+    }
+
+    std::string garbage = wire.substr(0, COMPRESSION_BLOCK_HEADER_SIZE) + std::string(wire.size(), '\x55');
+    DecodeResult last;
+    decodeCompressed(codec, garbage, 4096, last);
+    CHECK(last == DecodeResult::INVALID_STREAM);
+}
+
+// A stream decompressing to far more than it takes on the wire is only decompressed block by block
+static void testBoundedExpansion(CompressionCodec codec)
+{
+    CompressorHandle compressor = CompressionPool::acquireCompressor(codec, 0);
+    std::string plain(COMPRESSION_MAX_BLOCK_SIZE - 1, 'a');
+    plain += "\n";
+    PooledBuffer encoded;
+    std::string wire;
+    for(int block = 0; block < 64; ++block)
+    {
+        CHECK(encodeCompressionBlock(compressor.get(), plain.data(), plain.size(), encoded));
+        wire.append(encoded.data(), encoded.size());
+    }
+
+    // Pausing after every frame keeps all the blocks behind it compressed
+    FrameDecoder decoder(FramingMode::NEWLINE, DEFAULT_MAX_FRAME_SIZE);
+    CHECK(decoder.startDecompression(CompressionPool::acquireDecompressor(codec)));
+    decoder.append(wire.data(), wire.size());
+    size_t frames = 0;
+    for(int pass = 0; pass < 1000; ++pass)
+    {
+        DecodeResult result = decoder.decode([&decoder, &frames](BufferSlice&& frame)
+        {
+            CHECK(frame.size() == COMPRESSION_MAX_BLOCK_SIZE - 1);
+            ++frames;
+            decoder.pause();
+            return true;
+        });
+        CHECK(result == DecodeResult::PAUSED || result == DecodeResult::OK);
+        CHECK(decoder.bufferedBytes() <= wire.size() + COMPRESSION_MAX_BLOCK_SIZE); // The wire bytes and one block at most
+        if(result == DecodeResult::OK)
+        {
+            break;
+        }
+    }
+    CHECK(frames == 64);
+
+    // A line longer than the largest frame fails after little more than that many bytes
+    std::string line(COMPRESSION_MAX_BLOCK_SIZE, 'b');
+    std::string bomb;
+    for(int block = 0; block < 64; ++block)
+    {
+        CHECK(encodeCompressionBlock(compressor.get(), line.data(), line.size(), encoded));
+        bomb.append(encoded.data(), encoded.size());
+    }
+    FrameDecoder bounded(FramingMode::NEWLINE, DEFAULT_MAX_FRAME_SIZE);
+    CHECK(bounded.startDecompression(CompressionPool::acquireDecompressor(codec)));
+    bounded.append(bomb.data(), bomb.size());
+    CHECK(bounded.decode([](BufferSlice&&) { return true; }) == DecodeResult::FRAME_TOO_LARGE);
+    CHECK(bounded.bufferedBytes() <= DEFAULT_MAX_FRAME_SIZE + COMPRESSION_MAX_BLOCK_SIZE + bomb.size());
+}
+
+int main()
+{
+    testNegotiate();
+    for(CompressionCodec codec : {CompressionCodec::ZSTD, CompressionCodec::LZ4, CompressionCodec::DEFLATE})
+    {
+        if(CompressionPool::available(codec))
+        {
+            printf("codec %s\n", CompressionPool::name(codec));
+            testRoundTrip(codec);
+            testBoundedExpansion(codec);
+        }
+    }
+    return testResult();
+}
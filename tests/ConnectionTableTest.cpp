@@ -0,0 +1,90 @@
+// Checks of the connection table: descriptor bounds, chunks allocated on first use, and generations that keep
+// an identity of a closed client from ever resolving to the owner of the next client on its descriptor
+#include "ConnectionTable.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <thread>
+
+#define TEST_DESCRIPTORS (4 * CONNECTION_TABLE_CHUNK)
+
+static void testSlots()
+{
+    ConnectionTable table(TEST_DESCRIPTORS);
+    CHECK(table.capacity() == TEST_DESCRIPTORS);
+    CHECK(table.slot(-1) == NULL);
+    CHECK(table.slot(TEST_DESCRIPTORS) == NULL);
+    CHECK(table.find(5) == NULL); // Chunk not allocated yet
+    ConnectionSlot* slot = table.slot(5);
+    CHECK(slot != NULL && table.find(5) == slot && table.slot(5) == slot);
+    CHECK(table.find(6) == slot + 1); // Same chunk
+    CHECK(table.find(5 + CONNECTION_TABLE_CHUNK) == NULL);
+    CHECK(table.slot(5 + CONNECTION_TABLE_CHUNK) != NULL);
+
+    ClientId never;
+    never.socket = 2 * CONNECTION_TABLE_CHUNK;
+    CHECK(table.ownerOf(never) == NO_OWNER); // Descriptor never used
+}
+
+static void testReuse()
+{
+    ConnectionTable table(TEST_DESCRIPTORS);
+    table.slot(7);
+    ClientId first = table.open(7, 2);
+    CHECK(first.socket == 7 && first.generation == 1);
+    CHECK(table.ownerOf(first) == 2);
+    table.close(7);
+    CHECK(table.ownerOf(first) == NO_OWNER);
+
+    ClientId second = table.open(7, 0); // The kernel hands the descriptor to the next client, a client thread
+    CHECK(second.generation == first.generation + 1);
+    CHECK(table.ownerOf(second) == 0);
+    CHECK(table.ownerOf(first) == NO_OWNER); // A late reply to the first client is dropped
+    table.close(7);
+    CHECK(table.ownerOf(second) == NO_OWNER);
+}
+
+static void testConcurrentReuse()
+{
+    const uint32_t cycles = 200000;
+    ConnectionTable table(TEST_DESCRIPTORS);
+    table.slot(9);
+    std::atomic<uint32_t> latest{0};
+    std::atomic<bool> done{false};
+    int wrongOwners = 0;
+
+    // Neighbouring generations get different owners, so an identity resolving to another client's owner shows
+    std::thread reader([&table, &latest, &done, &wrongOwners]()
+    {
+        while(!done.load())
+        {
+            uint32_t current = latest.load();
+            for(uint32_t generation = current > 0 ? current - 1 : 0; generation <= current + 1; ++generation)
+            {
+                ClientId probe;
+                probe.socket = 9;
+                probe.generation = generation;
+                int owner = table.ownerOf(probe);
+                wrongOwners += owner != NO_OWNER && owner != (int)(generation % 4 + 1);
+            }
+        }
+    });
+
+    for(uint32_t generation = 1; generation <= cycles; ++generation)
+    {
+        ClientId client = table.open(9, generation % 4 + 1);
+        CHECK(client.generation == generation);
+        latest.store(generation);
+        table.close(9);
+    }
+    done.store(true);
+    reader.join();
+    CHECK(wrongOwners == 0);
+}
+
+int main()
+{
+    testSlots();
+    testReuse();
+    testConcurrentReuse();
+    return testResult();
+}
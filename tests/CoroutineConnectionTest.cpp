@@ -0,0 +1,198 @@
+// Checks of coroutine connections on a real epoll loop: echoed reads and writes, a write suspended above the
+// high watermark until the client reads, and clients leaving or the server stopping while the coroutine is suspended
+#include "CoroutineConnection.h"
+#include "Server.h"
+#include "TestCheck.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <functional>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+#define TEST_PORT 47312
+#define FLOOD_REPLIES 1000 // Replies of a flood, together far more than the socket buffers take
+#define FLOOD_REPLY_SIZE 8192
+
+static std::atomic<int> writeSuspensions{0}; // Writes that found the replies above the high watermark
+static std::atomic<int> failedWrites{0}; // Writes that resumed because the client had left
+static std::atomic<int> finishedHandlers{0}; // Coroutines that returned after their last read or write
+static std::atomic<int> destroyedFrames{0}; // Coroutine frames destroyed, returned or not
+
+// Local of every coroutine frame, counts the frame when it is destroyed
+struct FrameGuard
+{
+    ~FrameGuard() { destroyedFrames.fetch_add(1); }
+};
+
+// Handler echoing every frame, except "flood" which is answered with FLOOD_REPLIES numbered replies
+static ConnectionTask echo(CoroutineConnection& connection)
+{
+    FrameGuard guard;
+    co_await connection.write("hello");
+    while(std::optional<BufferSlice> message = co_await connection.read())
+    {
+        if(message->view() != "flood")
+        {
+            co_await connection.write(message->view());
+            continue;
+        }
+        for(int i = 0; i < FLOOD_REPLIES; ++i)
+        {
+            std::string reply = std::to_string(i) + " " + std::string(FLOOD_REPLY_SIZE, 'x');
+            CoroutineConnection::WriteAwaiter written = connection.write(reply);
+            if(!written.await_ready())
+            {
+                writeSuspensions.fetch_add(1);
+            }
+            if(!co_await written)
+            {
+                failedWrites.fetch_add(1);
+                co_return;
+            }
+        }
+    }
+    finishedHandlers.fetch_add(1);
+}
+
+// Client side of a connection reading newline-framed replies
+class TestClient
+{
+public:
+    TestClient() : clientSocket(socket(AF_INET, SOCK_STREAM, 0))
+    {
+        struct sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(TEST_PORT);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        for(int attempt = 0; attempt < 500 && connect(clientSocket, (struct sockaddr*)&address, sizeof(address)) == -1; ++attempt)
+        {
+            close(clientSocket); // The server is still starting
+            clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+            usleep(10000);
+        }
+        struct timeval timeout{5, 0};
+        setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    ~TestClient() { disconnect(); }
+
+    void sendLine(const std::string& line)
+    {
+        std::string framed = line + "\n";
+        CHECK(send(clientSocket, framed.data(), framed.size(), MSG_NOSIGNAL) == (ssize_t)framed.size());
+    }
+
+    // Function to read one reply, empty on timeout or close
+    std::string readLine()
+    {
+        size_t end;
+        while((end = received.find('\n')) == std::string::npos)
+        {
+            char chunk[65536];
+            ssize_t length = recv(clientSocket, chunk, sizeof(chunk), 0);
+            if(length <= 0)
+            {
+                return std::string();
+            }
+            received.append(chunk, length);
+        }
+        std::string line = received.substr(0, end);
+        received.erase(0, end + 1);
+        return line;
+    }
+
+    void disconnect()
+    {
+        if(clientSocket != -1)
+        {
+            close(clientSocket);
+            clientSocket = -1;
+        }
+    }
+
+private:
+    int clientSocket;
+    std::string received; // Bytes read past the last returned reply
+};
+
+// Function to wait up to five seconds for a condition set by the loop thread
+static bool waitFor(const std::function<bool()>& condition)
+{
+    for(int i = 0; i < 500 && !condition(); ++i)
+    {
+        usleep(10000);
+    }
+    return condition();
+}
+
+static void testEcho()
+{
+    TestClient client;
+    CHECK(client.readLine() == "hello");
+    client.sendLine("one");
+    client.sendLine("two");
+    CHECK(client.readLine() == "one");
+    CHECK(client.readLine() == "two");
+    client.disconnect(); // The coroutine waits in read, it resumes empty and returns
+    CHECK(waitFor([]() { return finishedHandlers.load() == 1 && destroyedFrames.load() == 1; }));
+}
+
+static void testBackpressure()
+{
+    TestClient client;
+    CHECK(client.readLine() == "hello");
+    client.sendLine("flood");
+    CHECK(waitFor([]() { return writeSuspensions.load() > 0; })); // Not read yet, the coroutine waits in write
+    int inOrder = 0;
+    for(int i = 0; i < FLOOD_REPLIES; ++i)
+    {
+        inOrder += client.readLine() == std::to_string(i) + " " + std::string(FLOOD_REPLY_SIZE, 'x');
+    }
+    CHECK(inOrder == FLOOD_REPLIES);
+    client.sendLine("after");
+    CHECK(client.readLine() == "after");
+    client.disconnect();
+    CHECK(waitFor([]() { return finishedHandlers.load() == 2 && destroyedFrames.load() == 2; }));
+    CHECK(failedWrites.load() == 0);
+}
+
+static void testCloseInWrite()
+{
+    int suspended = writeSuspensions.load();
+    TestClient client;
+    CHECK(client.readLine() == "hello");
+    client.sendLine("flood");
+    CHECK(waitFor([suspended]() { return writeSuspensions.load() > suspended; }));
+    client.disconnect(); // The suspended write resumes with false
+    CHECK(waitFor([]() { return failedWrites.load() == 1 && destroyedFrames.load() == 3; }));
+    CHECK(finishedHandlers.load() == 2);
+}
+
+int main()
+{
+    ServerConfig config;
+    config.mode = ServerMode::EPOLL_REACTOR;
+    config.reactorThreads = 1;
+    config.framing = FramingMode::NEWLINE;
+    config.outboundHighWatermark = 64 * 1024;
+    config.outboundLowWatermark = 16 * 1024;
+    config.logLevel = LogLevel::ERROR;
+    Server server(TEST_PORT, config);
+    server.setSessionFactory(CoroutineConnection::factory(echo));
+    std::thread serving([&server]() { server.startServer(); });
+
+    testEcho();
+    testBackpressure();
+    testCloseInWrite();
+
+    // A client still connected when the server stops: its coroutine is suspended in read, the frame goes anyway
+    TestClient idle;
+    CHECK(idle.readLine() == "hello");
+    server.stop();
+    serving.join();
+    CHECK(destroyedFrames.load() == 4);
+    return testResult();
+}
@@ -0,0 +1,81 @@
+// Checks of the delimiter search against memchr: random buffers at every alignment, the mask of the
+// following delimiters, and buffers ending right before an unmapped page
+#include "DelimiterScan.h"
+#include "TestCheck.h"
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Function to check one search of data against memchr and the bits of the following delimiters
+static bool matchesMemchr(const char* data, size_t length)
+{
+    uint64_t following = 0;
+    const char* expected = static_cast<const char*>(memchr(data, '\n', length));
+    const char* found = DelimiterScan::find(data, length, '\n', following);
+    if(found != expected)
+    {
+        return false;
+    }
+    if(found == NULL)
+    {
+        return true;
+    }
+
+    size_t remaining = length - (found - data);
+    if((following & 1) == 0)
+    {
+        return false; // Bit 0 is the match itself
+    }
+    for(size_t k = 0; k < 64; ++k)
+    {
+        bool bit = (following >> k) & 1;
+        if(bit && (k >= remaining || found[k] != '\n'))
+        {
+            return false; // Only delimiters within the buffer may be reported
+        }
+        if(following != 1 && k < remaining && found[k] == '\n' && !bit)
+        {
+            return false; // A block that was compared reports every delimiter in it
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    printf("kernel %s\n", DelimiterScan::kernelName());
+    srand(1);
+    for(int round = 0; round < 100000; ++round)
+    {
+        size_t length = rand() % 300;
+        std::string storage(length + 80, 'x');
+        char* data = &storage[rand() % 16];
+        int density = 1 + rand() % 50;
+        for(size_t i = 0; i < length; ++i)
+        {
+            data[i] = rand() % density == 0 ? '\n' : 'a' + rand() % 3;
+        }
+        data[length] = '\n'; // Past the end, must never be reported
+        CHECK(matchesMemchr(data, length));
+    }
+
+    // Blocks may be read past the match but never past the page the buffer ends in
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    char* mapping = static_cast<char*>(mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    CHECK(mapping != MAP_FAILED);
+    mprotect(mapping + page, page, PROT_NONE);
+    for(int round = 0; round < 20000; ++round)
+    {
+        size_t length = rand() % 200;
+        char* data = mapping + page - length;
+        for(size_t i = 0; i < length; ++i)
+        {
+            data[i] = rand() % 8 == 0 ? '\n' : 'a';
+        }
+        CHECK(matchesMemchr(data, length));
+    }
+    munmap(mapping, 2 * page);
+    return testResult();
+}
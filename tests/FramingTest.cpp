@@ -0,0 +1,128 @@
+// Checks of the frame decoder: every framing mode, streams split at every possible point, frames kept
+// alive across buffer moves, pausing and oversized frames
+#include "Framing.h"
+#include "TestCheck.h"
+#include <arpa/inet.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Function to feed a stream to a decoder in chunks of chunkSize bytes, collecting every frame
+static std::vector<std::string> decodeStream(FrameDecoder& decoder, const std::string& stream, size_t chunkSize,
+                                             std::vector<BufferSlice>* kept = NULL)
+{
+    std::vector<std::string> frames;
+    for(size_t offset = 0; offset < stream.size(); offset += chunkSize)
+    {
+        size_t length = std::min(chunkSize, stream.size() - offset);
+        size_t available;
+        char* space = decoder.prepareWrite(length, available);
+        memcpy(space, stream.data() + offset, length);
+        decoder.commitWrite(length);
+        DecodeResult result = decoder.decode([&frames, kept](BufferSlice&& frame)
+        {
+            frames.push_back(std::string(frame.view()));
+            if(kept != NULL)
+            {
+                kept->push_back(std::move(frame)); // Held like a queued message while more bytes arrive
+            }
+            return true;
+        });
+        CHECK(result == DecodeResult::OK);
+    }
+    return frames;
+}
+
+// Function to build a length-prefixed frame
+static std::string prefixed(const std::string& payload)
+{
+    uint32_t length = htonl((uint32_t)payload.size());
+    return std::string(reinterpret_cast<const char*>(&length), FRAME_LENGTH_PREFIX_SIZE) + payload;
+}
+
+static void testNewline()
+{
+    std::vector<std::string> lines = {"a", "", "hello world", std::string(300, 'x'), "last"};
+    std::string stream;
+    for(const std::string& line : lines)
+    {
+        stream += line + "\n";
+    }
+    for(size_t chunkSize = 1; chunkSize <= stream.size(); ++chunkSize)
+    {
+        FrameDecoder decoder(FramingMode::NEWLINE, DEFAULT_MAX_FRAME_SIZE);
+        std::vector<BufferSlice> kept;
+        CHECK(decodeStream(decoder, stream, chunkSize, &kept) == lines);
+        for(size_t i = 0; i < kept.size(); ++i)
+        {
+            CHECK(kept[i].view() == lines[i]); // Slices stay valid after the decoder moved to another buffer
+        }
+        CHECK(decoder.bufferedBytes() == 0);
+    }
+
+    FrameDecoder custom(FramingMode::NEWLINE, DEFAULT_MAX_FRAME_SIZE, '|');
+    CHECK(decodeStream(custom, "one|two|", 3) == std::vector<std::string>({"one", "two"}));
+}
+
+static void testLengthPrefixed()
+{
+    std::vector<std::string> payloads = {"", "abc", std::string(5000, 'y'), std::string(1, '\n')};
+    std::string stream;
+    for(const std::string& payload : payloads)
+    {
+        stream += prefixed(payload);
+    }
+    for(size_t chunkSize : {1, 2, 3, 5, 7, 100, 4096, 10000})
+    {
+        FrameDecoder decoder(FramingMode::LENGTH_PREFIXED, DEFAULT_MAX_FRAME_SIZE);
+        CHECK(decodeStream(decoder, stream, chunkSize) == payloads);
+    }
+}
+
+static void testRaw()
+{
+    FrameDecoder decoder(FramingMode::RAW, DEFAULT_MAX_FRAME_SIZE);
+    CHECK(decodeStream(decoder, "abcdef", 4) == std::vector<std::string>({"abcd", "ef"}));
+}
+
+static void testPause()
+{
+    FrameDecoder decoder(FramingMode::NEWLINE, DEFAULT_MAX_FRAME_SIZE);
+    decoder.append("a\nb\nc\n", 6);
+    std::vector<std::string> frames;
+    auto pauseAfterEach = [&frames, &decoder](BufferSlice&& frame)
+    {
+        frames.push_back(std::string(frame.view()));
+        decoder.pause();
+        return true;
+    };
+    CHECK(decoder.decode(pauseAfterEach) == DecodeResult::PAUSED);
+    CHECK(frames.size() == 1);
+    CHECK(decoder.decode(pauseAfterEach) == DecodeResult::PAUSED);
+    CHECK(decoder.decode(pauseAfterEach) == DecodeResult::PAUSED);
+    CHECK(decoder.decode(pauseAfterEach) == DecodeResult::OK);
+    CHECK(frames == std::vector<std::string>({"a", "b", "c"}));
+}
+
+static void testTooLarge()
+{
+    FrameDecoder prefixedDecoder(FramingMode::LENGTH_PREFIXED, 16);
+    std::string frame = prefixed(std::string(17, 'z'));
+    prefixedDecoder.append(frame.data(), frame.size());
+    CHECK(prefixedDecoder.decode([](BufferSlice&&) { return true; }) == DecodeResult::FRAME_TOO_LARGE);
+
+    FrameDecoder lineDecoder(FramingMode::NEWLINE, 16);
+    std::string line(64, 'z');
+    lineDecoder.append(line.data(), line.size()); // No delimiter within the limit
+    CHECK(lineDecoder.decode([](BufferSlice&&) { return true; }) == DecodeResult::FRAME_TOO_LARGE);
+}
+
+int main()
+{
+    testNewline();
+    testLengthPrefixed();
+    testRaw();
+    testPause();
+    testTooLarge();
+    return testResult();
+}
@@ -0,0 +1,105 @@
+// Checks of the message codec: the wire layout of every field kind, round trips, and the rejection of
+// short frames and unknown types
+#include "MessageCodec.h"
+#include "TestCheck.h"
+#include <string>
+#include <type_traits>
+
+enum class Side : uint8_t
+{
+    BUY = 1,
+    SELL = 2
+};
+
+struct Order
+{
+    uint64_t id;
+    int32_t quantity;
+    Side side;
+    std::array<char, 8> symbol;
+    double price;
+    bool live;
+    std::string_view note;
+};
+
+struct Ping
+{
+    uint32_t sequence;
+};
+
+template <>
+struct MessageSchema<Order>
+{
+    static constexpr uint16_t type = 7;
+    static constexpr auto fields = std::make_tuple(&Order::id, &Order::quantity, &Order::side, &Order::symbol,
+                                                   &Order::price, &Order::live, &Order::note);
+};
+
+template <>
+struct MessageSchema<Ping>
+{
+    static constexpr uint16_t type = 1;
+    static constexpr auto fields = std::make_tuple(&Ping::sequence);
+};
+
+typedef MessageCodec<Order, Ping> TestCodec;
+
+static_assert(MessageLayout<Order>::fixedSize == 8 + 4 + 1 + 8 + 8 + 1, "Fields are packed without padding");
+
+static void testRoundTrip()
+{
+    Order order{42, -5, Side::SELL, {'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H'}, 3.25, true, "hello"};
+    std::string encoded(TestCodec::encodedSize(order), '\0');
+    CHECK(TestCodec::encode(order, &encoded[0]) == CODEC_TYPE_SIZE + MessageLayout<Order>::fixedSize + 5);
+    CHECK(encoded[0] == 0 && encoded[1] == 7); // Big-endian type number
+    CHECK(encoded[2 + 7] == 42); // Big-endian id
+
+    int decoded = 0;
+    CodecResult result = TestCodec::decode(encoded, [&decoded](const auto& message)
+    {
+        if constexpr(std::is_same_v<std::decay_t<decltype(message)>, Order>)
+        {
+            CHECK(message.id == 42);
+            CHECK(message.quantity == -5);
+            CHECK(message.side == Side::SELL);
+            CHECK(message.symbol[7] == 'H');
+            CHECK(message.price == 3.25);
+            CHECK(message.live);
+            CHECK(message.note == "hello");
+            ++decoded;
+        }
+    });
+    CHECK(result == CodecResult::OK);
+    CHECK(decoded == 1);
+
+    Ping ping{0x01020304};
+    char buffer[8];
+    CHECK(TestCodec::encode(ping, buffer) == 6);
+    CHECK(buffer[2] == 1 && buffer[5] == 4);
+    Ping back{0};
+    CHECK(TestCodec::decodeFields(std::string_view(buffer + CODEC_TYPE_SIZE, 4), back) && back.sequence == ping.sequence);
+}
+
+static void testInvalidFrames()
+{
+    Order order{1, 1, Side::BUY, {}, 0, false, ""};
+    std::string encoded(TestCodec::encodedSize(order), '\0');
+    TestCodec::encode(order, &encoded[0]);
+    auto ignore = [](const auto&) {};
+    CHECK(TestCodec::decode(std::string_view(encoded.data(), 1), ignore) == CodecResult::TOO_SHORT);
+    CHECK(TestCodec::decode(std::string_view(encoded.data(), 20), ignore) == CodecResult::TOO_SHORT);
+    encoded[1] = 9;
+    CHECK(TestCodec::decode(encoded, ignore) == CodecResult::UNKNOWN_TYPE);
+
+    int errors = 0;
+    auto handler = TestCodec::handler([](ClientId, const auto&) {}, [&errors](ClientId, CodecResult) { ++errors; });
+    handler(ClientId(), encoded);
+    CHECK(errors == 1);
+}
+
+int main()
+{
+    testRoundTrip();
+    testInvalidFrames();
+    return testResult();
+}
@@ -0,0 +1,108 @@
+// Checks of the MPSC message ring: capacity rounding, FIFO order across laps, a full ring refusing items
+// without taking them, and producers racing each other with nothing lost, duplicated or reordered per producer
+#include "MessageRing.h"
+#include "TestCheck.h"
+#include <memory>
+#include <thread>
+#include <vector>
+
+static void testSingleThread()
+{
+    CHECK(MessageRing<int>(1).capacity() == 2);
+    CHECK(MessageRing<int>(5).capacity() == 8);
+    CHECK(MessageRing<int>(8).capacity() == 8);
+
+    MessageRing<std::unique_ptr<int>> ring(4);
+    std::unique_ptr<int> item;
+    CHECK(ring.empty());
+    CHECK(!ring.tryPop(item));
+    for(int lap = 0; lap < 3; ++lap)
+    {
+        for(int i = 0; i < 4; ++i)
+        {
+            std::unique_ptr<int> pushed(new int(lap * 4 + i));
+            CHECK(ring.tryPush(pushed));
+            CHECK(pushed == NULL); // Moved into the ring
+        }
+        std::unique_ptr<int> refused(new int(-1));
+        CHECK(!ring.tryPush(refused)); // Full
+        CHECK(refused != NULL && *refused == -1); // Left to the caller to retry
+        for(int i = 0; i < 4; ++i)
+        {
+            CHECK(ring.tryPop(item));
+            CHECK(item != NULL && *item == lap * 4 + i);
+        }
+        CHECK(ring.empty());
+        CHECK(!ring.tryPop(item));
+    }
+}
+
+static void testProducers()
+{
+    const int producerCount = 4;
+    const uint64_t itemsPerProducer = 200000;
+    MessageRing<std::unique_ptr<uint64_t>> ring(64); // Small, so producers keep finding it full
+
+    std::vector<std::thread> producers;
+    for(int p = 0; p < producerCount; ++p)
+    {
+        producers.emplace_back([&ring, p, itemsPerProducer]()
+        {
+            for(uint64_t i = 0; i < itemsPerProducer; ++i)
+            {
+                std::unique_ptr<uint64_t> item(new uint64_t((uint64_t)p << 32 | i));
+                while(!ring.tryPush(item))
+                {
+                    std::this_thread::yield(); // Full, retried with the same item
+                }
+            }
+        });
+    }
+
+    std::vector<uint64_t> next(producerCount, 0);
+    uint64_t received = 0;
+    int missing = 0;
+    int outOfOrder = 0;
+    std::unique_ptr<uint64_t> item;
+    while(received < producerCount * itemsPerProducer)
+    {
+        if(!ring.tryPop(item))
+        {
+            std::this_thread::yield(); // Empty, the producers may share this core
+            continue;
+        }
+        ++received;
+        if(item == NULL)
+        {
+            ++missing; // A refused push gave its item away
+            continue;
+        }
+        uint64_t producer = *item >> 32;
+        uint64_t sequence = *item & 0xffffffffu;
+        if(producer >= (uint64_t)producerCount || sequence != next[producer])
+        {
+            ++outOfOrder; // Lost, duplicated or overtaken by a later item of the same producer
+            continue;
+        }
+        ++next[producer];
+    }
+    for(std::thread& producer : producers)
+    {
+        producer.join();
+    }
+
+    CHECK(missing == 0);
+    CHECK(outOfOrder == 0);
+    for(int p = 0; p < producerCount; ++p)
+    {
+        CHECK(next[p] == itemsPerProducer);
+    }
+    CHECK(ring.empty());
+}
+
+int main()
+{
+    testSingleThread();
+    testProducers();
+    return testResult();
+}
@@ -0,0 +1,114 @@
+// Checks of the spool's recovery: the messages a crashed server did not handle are handed on again, in order,
+// across segments filled exactly by their records and up to a torn last record
+#include "MessageSpool.h"
+#include "TestCheck.h"
+#include <cstdlib>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#define TEST_SEGMENT_SIZE 4096
+#define TEST_PAYLOAD_SIZE (64 - sizeof(SpoolRecordHeader)) // Records of 64 bytes fill a segment exactly
+
+static ServerConfig spoolConfig(const std::string& directory)
+{
+    ServerConfig config;
+    config.spoolDirectory = directory;
+    config.spoolSegmentSize = TEST_SEGMENT_SIZE;
+    config.spoolCommitIntervalUs = 100;
+    return config;
+}
+
+static std::string payloadOf(int i)
+{
+    std::string payload = "message " + std::to_string(i) + " ";
+    payload.resize(TEST_PAYLOAD_SIZE, 'x');
+    return payload;
+}
+
+// Function to append messages and drop the spool without handling any of them, as a crash would
+static void appendAndCrash(const std::string& directory, int count)
+{
+    MessageSpool spool(spoolConfig(directory));
+    for(int i = 0; i < count; ++i)
+    {
+        CHECK(spool.append(ClientId(), payloadOf(i), 0));
+    }
+}
+
+// Function to open the spool again and collect the recovered messages, handling every one of them
+static std::vector<std::string> recoverAll(const std::string& directory)
+{
+    MessageSpool spool(spoolConfig(directory));
+    std::vector<std::string> received;
+    spool.start([&received](Message& message)
+    {
+        received.push_back(std::string(message.payload.view()));
+        message.queuedCount->fetch_sub(1, std::memory_order_release);
+        return true;
+    });
+    for(int i = 0; i < 20000 && !spool.settled(); ++i)
+    {
+        usleep(100);
+    }
+    CHECK(spool.settled());
+    spool.stop();
+    return received;
+}
+
+static std::string makeDirectory()
+{
+    char pattern[] = "/tmp/spooltestXXXXXX";
+    CHECK(mkdtemp(pattern) != NULL);
+    return pattern;
+}
+
+static void removeDirectory(const std::string& directory)
+{
+    std::string command = "rm -rf " + directory;
+    CHECK(system(command.c_str()) == 0);
+}
+
+static void testExactFill()
+{
+    std::string directory = makeDirectory();
+    appendAndCrash(directory, 200); // 64 records per segment, the first three are filled exactly
+    std::vector<std::string> received = recoverAll(directory);
+    CHECK(received.size() == 200);
+    for(size_t i = 0; i < received.size(); ++i)
+    {
+        CHECK(received[i] == payloadOf(i));
+    }
+    CHECK(recoverAll(directory).empty()); // Handled messages are not handed on again
+    removeDirectory(directory);
+}
+
+static void testTornTail()
+{
+    std::string directory = makeDirectory();
+    appendAndCrash(directory, 100);
+    char name[64];
+    snprintf(name, sizeof(name), "/%016x.spool", TEST_SEGMENT_SIZE);
+    int fd = open((directory + name).c_str(), O_RDWR);
+    CHECK(fd != -1);
+    CHECK(pwrite(fd, "torn", 4, 35 * 64 + sizeof(SpoolRecordHeader)) == 4); // Payload of message 99
+    close(fd);
+
+    std::vector<std::string> received = recoverAll(directory);
+    CHECK(received.size() == 99);
+    CHECK(!received.empty() && received.back() == payloadOf(98));
+
+    appendAndCrash(directory, 3); // Appending goes on after the last valid record
+    received = recoverAll(directory);
+    CHECK(received.size() == 3);
+    CHECK(!received.empty() && received.front() == payloadOf(0));
+    removeDirectory(directory);
+}
+
+int main()
+{
+    testExactFill();
+    testTornTail();
+    return testResult();
+}
@@ -0,0 +1,97 @@
+// Checks of the work-stealing deque: LIFO for the owner, FIFO for thieves, bounded capacity, and every task
+// taken exactly once while thieves race the owner
+#include "TaskDeque.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static void testSingleThread()
+{
+    TaskDeque<int, 4> deque;
+    int tasks[5] = {0, 1, 2, 3, 4};
+    CHECK(deque.empty());
+    CHECK(deque.pop() == NULL);
+    CHECK(deque.steal() == NULL);
+    for(int i = 0; i < 4; ++i)
+    {
+        CHECK(deque.push(&tasks[i]));
+    }
+    CHECK(!deque.push(&tasks[4])); // Full
+    CHECK(deque.pop() == &tasks[3]); // Newest for the owner
+    CHECK(deque.steal() == &tasks[0]); // Oldest for a thief
+    CHECK(deque.pop() == &tasks[2]);
+    CHECK(deque.pop() == &tasks[1]);
+    CHECK(deque.pop() == NULL);
+    CHECK(deque.empty());
+}
+
+static void testConcurrentSteal()
+{
+    const int taskCount = 200000;
+    TaskDeque<int, 256> deque;
+    std::vector<int> tasks(taskCount);
+    std::vector<std::atomic<int>> taken(taskCount);
+    for(int i = 0; i < taskCount; ++i)
+    {
+        tasks[i] = i;
+        taken[i].store(0);
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> thieves;
+    for(int t = 0; t < 3; ++t)
+    {
+        thieves.emplace_back([&deque, &taken, &done]()
+        {
+            while(!done.load() || !deque.empty())
+            {
+                if(int* task = deque.steal())
+                {
+                    taken[*task].fetch_add(1);
+                }
+            }
+        });
+    }
+
+    for(int i = 0; i < taskCount; ++i)
+    {
+        while(!deque.push(&tasks[i]))
+        {
+            if(int* task = deque.pop())
+            {
+                taken[*task].fetch_add(1);
+            }
+        }
+        if(i % 3 == 0)
+        {
+            if(int* task = deque.pop())
+            {
+                taken[*task].fetch_add(1);
+            }
+        }
+    }
+    while(int* task = deque.pop())
+    {
+        taken[*task].fetch_add(1);
+    }
+    done.store(true);
+    for(std::thread& thief : thieves)
+    {
+        thief.join();
+    }
+
+    int wrong = 0;
+    for(int i = 0; i < taskCount; ++i)
+    {
+        wrong += taken[i].load() != 1;
+    }
+    CHECK(wrong == 0);
+}
+
+int main()
+{
+    testSingleThread();
+    testConcurrentSteal();
+    return testResult();
+}
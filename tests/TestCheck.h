@@ -0,0 +1,30 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <cstdio>
+
+// Minimal checks for the unit tests: a failed check is reported with its location and the test goes on,
+// main returns testResult() so ctest sees the failure
+static int testFailures = 0;
+
+#define CHECK(condition)                                                                  \
+    do                                                                                    \
+    {                                                                                     \
+        if(!(condition))                                                                  \
+        {                                                                                 \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++testFailures;                                                               \
+        }                                                                                 \
+    } while(0)
+
+// Function to get the exit status of a test, 0 if every check passed
+inline int testResult()
+{
+    if(testFailures == 0)
+    {
+        printf("all checks passed\n");
+    }
+    return testFailures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,70 @@
+// Checks of the timer wheel: timers fire exactly at their tick on every level, cancelled timers do not
+// fire, and a timer can be scheduled again from its own callback
+#include "TimerWheel.h"
+#include "TestCheck.h"
+#include <cstdlib>
+#include <vector>
+
+static void testExpiryTicks()
+{
+    TimerWheel wheel;
+    std::vector<TimerEntry> entries(2000);
+    srand(2);
+    for(size_t i = 0; i < entries.size(); ++i)
+    {
+        entries[i].owner = (int)i;
+        // Spread over every level, including ticks that cascade several times
+        uint64_t delay = 1 + rand() % (i % 4 == 0 ? 20000000 : i % 4 == 1 ? 200000 : i % 4 == 2 ? 4000 : 64);
+        wheel.schedule(entries[i], wheel.currentTick() + delay);
+    }
+
+    std::vector<uint64_t> firedAt(entries.size(), 0);
+    uint64_t now = 0;
+    while(!wheel.empty())
+    {
+        now += 1 + rand() % 5000; // Advanced in uneven steps like the loops do
+        wheel.advance(now, [&firedAt, &wheel](int owner) { firedAt[owner] = wheel.currentTick(); });
+    }
+    for(size_t i = 0; i < entries.size(); ++i)
+    {
+        CHECK(firedAt[i] == entries[i].expiry);
+        CHECK(!entries[i].scheduled());
+    }
+}
+
+static void testCancelAndReschedule()
+{
+    TimerWheel wheel;
+    TimerEntry cancelled;
+    TimerEntry repeating;
+    cancelled.owner = 1;
+    repeating.owner = 2;
+    wheel.schedule(cancelled, 100);
+    wheel.schedule(repeating, 10);
+    wheel.cancel(cancelled);
+    CHECK(!cancelled.scheduled());
+
+    int cancelledFired = 0;
+    int repeats = 0;
+    wheel.advance(1000, [&](int owner)
+    {
+        if(owner == 1)
+        {
+            ++cancelledFired;
+        }
+        else if(++repeats < 5)
+        {
+            wheel.schedule(repeating, wheel.currentTick() + 10);
+        }
+    });
+    CHECK(cancelledFired == 0);
+    CHECK(repeats == 5);
+    CHECK(wheel.empty());
+}
+
+int main()
+{
+    testExpiryTicks();
+    testCancelAndReschedule();
+    return testResult();
+}
@@ -0,0 +1,56 @@
+// Checks of the token bucket: a full bucket admits a burst of its capacity, then messages are paced at the
+// refill rate, and an idle bucket refills up to its capacity but never beyond
+#include "TokenBucket.h"
+#include "TestCheck.h"
+
+#define TEST_INTERVAL_NS 1000000ull // One token per millisecond
+#define TEST_CAPACITY_NS (3 * TEST_INTERVAL_NS) // Three tokens
+#define TEST_START_NS 5000000000ull // Monotonic clocks do not start at 0
+
+static void testBurstAndPacing()
+{
+    TokenBucket bucket;
+    uint64_t now = TEST_START_NS;
+    for(int i = 0; i < 3; ++i)
+    {
+        CHECK(bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS) == 0); // A full bucket
+    }
+    CHECK(bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS) == TEST_INTERVAL_NS); // Over the burst, wait a token
+
+    // Sending when told to keeps the client at the refill rate
+    for(int i = 0; i < 10; ++i)
+    {
+        now += TEST_INTERVAL_NS;
+        CHECK(bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS) == TEST_INTERVAL_NS);
+    }
+
+    // Three intervals later two tokens are back, the first one repaid the message that waited
+    now += 3 * TEST_INTERVAL_NS;
+    CHECK(bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS) == 0);
+    CHECK(bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS) == 0);
+    CHECK(bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS) == TEST_INTERVAL_NS);
+}
+
+static void testIdleRefill()
+{
+    TokenBucket bucket;
+    uint64_t now = TEST_START_NS;
+    for(int i = 0; i < 5; ++i)
+    {
+        bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS);
+    }
+
+    now += 1000 * TEST_INTERVAL_NS; // Idle far longer than a refill of the whole bucket
+    for(int i = 0; i < 3; ++i)
+    {
+        CHECK(bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS) == 0);
+    }
+    CHECK(bucket.take(now, TEST_INTERVAL_NS, TEST_CAPACITY_NS) == TEST_INTERVAL_NS); // No more than the capacity saved up
+}
+
+int main()
+{
+    testBurstAndPacing();
+    testIdleRefill();
+    return testResult();
+}
@@ -0,0 +1,229 @@
+// Checks of the topic router: subscription round trips over the wire, the removal of a topic's last subscriber
+// from a shard it shares with another topic, pruning of disconnected subscribers, and publishes racing
+// subscription changes
+#include "Server.h"
+#include "TopicRouter.h"
+#include "TestCheck.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <functional>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#define TEST_PORT 47311
+
+// Function to connect to the test server, retrying while it starts listening
+static int connectClient()
+{
+    struct sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(TEST_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for(int attempt = 0; attempt < 500; ++attempt)
+    {
+        int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if(connect(clientSocket, (struct sockaddr*)&address, sizeof(address)) == 0)
+        {
+            struct timeval timeout{5, 0};
+            setsockopt(clientSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            return clientSocket;
+        }
+        close(clientSocket);
+        usleep(10000);
+    }
+    return -1;
+}
+
+static void sendLine(int clientSocket, const std::string& line)
+{
+    std::string framed = line + "\n";
+    CHECK(send(clientSocket, framed.data(), framed.size(), MSG_NOSIGNAL) == (ssize_t)framed.size());
+}
+
+// Function to read one newline-framed message, empty on timeout or close
+static std::string readLine(int clientSocket)
+{
+    std::string line;
+    char c;
+    while(recv(clientSocket, &c, 1, 0) == 1)
+    {
+        if(c == '\n')
+        {
+            return line;
+        }
+        line.push_back(c);
+    }
+    return std::string();
+}
+
+// Function to find a topic name that falls into the same shard as another one
+static std::string topicInShardOf(const std::string& topic)
+{
+    std::hash<std::string_view> hash;
+    for(int i = 0;; ++i)
+    {
+        std::string candidate = "neighbour" + std::to_string(i);
+        if(hash(candidate) % TOPIC_SHARDS == hash(topic) % TOPIC_SHARDS)
+        {
+            return candidate;
+        }
+    }
+}
+
+// Client that never connected, its subscriptions are only kept until a publish tries to deliver to it
+static ClientId absentClient(int index)
+{
+    ClientId client;
+    client.socket = 100000 + index;
+    client.generation = 7;
+    return client;
+}
+
+static void testRoundTrip(Server& server)
+{
+    int first = connectClient();
+    int second = connectClient();
+    CHECK(first != -1 && second != -1);
+
+    sendLine(first, "SUBSCRIBE news");
+    CHECK(readLine(first) == "SUBSCRIBED news");
+    sendLine(second, "SUBSCRIBE news");
+    CHECK(readLine(second) == "SUBSCRIBED news");
+    sendLine(second, "SUBSCRIBE news"); // Already subscribed, still one subscription
+    CHECK(readLine(second) == "SUBSCRIBED news");
+    CHECK(server.topics().subscriberCount("news") == 2);
+
+    CHECK(server.topics().publish("news", "hello") == 2);
+    CHECK(readLine(first) == "MESSAGE news hello");
+    CHECK(readLine(second) == "MESSAGE news hello");
+    CHECK(server.topics().publish("sports", "goal") == 0); // Nobody subscribed
+
+    sendLine(first, "UNSUBSCRIBE news");
+    CHECK(readLine(first) == "UNSUBSCRIBED news");
+    CHECK(server.topics().subscriberCount("news") == 1);
+    sendLine(first, "PUBLISH news from a client");
+    CHECK(readLine(second) == "MESSAGE news from a client");
+
+    sendLine(second, "SUBSCRIBE " + std::string(TOPIC_MAX_NAME + 1, 'x'));
+    CHECK(readLine(second) == "REJECTED " + std::string(TOPIC_MAX_NAME + 1, 'x'));
+    sendLine(second, "UNSUBSCRIBE news");
+    CHECK(readLine(second) == "UNSUBSCRIBED news");
+    CHECK(server.topics().subscriberCount("news") == 0);
+    close(first);
+    close(second);
+}
+
+static void testLastSubscriber(Server& server)
+{
+    TopicRouter& router = server.topics();
+    std::string topic = "orders";
+    std::string neighbour = topicInShardOf(topic);
+    CHECK(router.subscribe(topic, absentClient(0)));
+    CHECK(router.subscribe(topic, absentClient(1)));
+    CHECK(router.subscribe(neighbour, absentClient(2)));
+
+    CHECK(router.unsubscribe(topic, absentClient(0)));
+    CHECK(router.unsubscribe(topic, absentClient(1))); // Last one, the entry leaves the shard's table
+    CHECK(!router.unsubscribe(topic, absentClient(1)));
+    CHECK(router.subscriberCount(topic) == 0);
+    CHECK(router.subscriberCount(neighbour) == 1); // The replaced table kept the other topic of the shard
+
+    CHECK(router.subscribe(topic, absentClient(3))); // A new entry for the same name
+    CHECK(router.subscriberCount(topic) == 1);
+    CHECK(!router.unsubscribe("", absentClient(3)));
+    CHECK(!router.subscribe("", absentClient(3)));
+
+    CHECK(router.publish(topic, "lost") == 0); // Prunes the absent subscribers
+    CHECK(router.subscriberCount(topic) == 0);
+    CHECK(router.publish(neighbour, "lost") == 0);
+    CHECK(router.subscriberCount(neighbour) == 0);
+}
+
+static void testConcurrentChurn(Server& server)
+{
+    const int publishers = 2;
+    const int publishesEach = 5000;
+    TopicRouter& router = server.topics();
+    int reader = connectClient();
+    CHECK(reader != -1);
+    sendLine(reader, "SUBSCRIBE live");
+    CHECK(readLine(reader) == "SUBSCRIBED live");
+
+    std::atomic<int> received{0};
+    std::thread receiver([reader, &received]()
+    {
+        while(received.load() < publishers * publishesEach && readLine(reader) == "MESSAGE live tick")
+        {
+            received.fetch_add(1);
+        }
+    });
+
+    std::atomic<bool> publishing{true};
+    std::string neighbour = topicInShardOf("live");
+    std::thread churn([&router, &publishing, &neighbour]()
+    {
+        // Absent clients join and leave, both topics of the shard swap their lists and entries meanwhile
+        for(int i = 0; publishing.load(); ++i)
+        {
+            router.subscribe("live", absentClient(i % 16));
+            router.subscribe(neighbour, absentClient(i % 16));
+            router.unsubscribe(neighbour, absentClient((i + 8) % 16));
+            router.unsubscribe("live", absentClient((i + 8) % 16));
+        }
+    });
+
+    std::atomic<int> missed{0};
+    std::vector<std::thread> threads;
+    for(int p = 0; p < publishers; ++p)
+    {
+        threads.emplace_back([&router, &missed, &neighbour]()
+        {
+            for(int i = 0; i < publishesEach; ++i)
+            {
+                if(router.publish("live", "tick") == 0)
+                {
+                    missed.fetch_add(1); // The subscribed client must always be reached
+                }
+                router.publish(neighbour, "tock");
+            }
+        });
+    }
+    for(std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    publishing.store(false);
+    churn.join();
+    receiver.join();
+
+    CHECK(missed.load() == 0);
+    CHECK(received.load() == publishers * publishesEach);
+    close(reader);
+}
+
+int main()
+{
+    ServerConfig config;
+    config.mode = ServerMode::EPOLL_REACTOR;
+    config.reactorThreads = 2;
+    config.workerThreads = 2;
+    config.framing = FramingMode::NEWLINE;
+    config.topicCommands = true;
+    config.echoMessages = false;
+    config.logLevel = LogLevel::ERROR;
+    Server server(TEST_PORT, config);
+    std::thread serving([&server]() { server.startServer(); });
+
+    testRoundTrip(server);
+    testLastSubscriber(server);
+    testConcurrentChurn(server);
+
+    server.stop();
+    serving.join();
+    return testResult();
+}
@@ -0,0 +1,69 @@
+// Checks of the worker's deficit round-robin: a client flooding the worker delays the others by one turn, a
+// message larger than the quantum waits for the deficit of several turns, and every client keeps its order
+#include "WorkerPool.h"
+#include "TestCheck.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+#define TEST_QUANTUM 1000 // Bytes of a client handled per turn
+
+// Function to queue a message of size bytes from a client, tagged with its position in the client's stream
+static void queueMessage(WorkerPool& pool, int clientSocket, int index, size_t size)
+{
+    std::string payload = std::to_string(index) + " ";
+    payload.resize(size, 'x');
+    PooledBuffer buffer(payload.data(), payload.size());
+    const char* data = buffer.data();
+    ClientId client;
+    client.socket = clientSocket;
+    Message message(client, BufferSlice(std::move(buffer), data, payload.size()));
+    ClientStrand strand; // Unused with CLIENT_AFFINITY
+    CHECK(pool.tryPush(message, strand));
+}
+
+static void testFairness()
+{
+    WorkerPool pool(1, 1024, TEST_QUANTUM, WorkerScheduling::CLIENT_AFFINITY);
+    std::vector<std::pair<int, int>> handled; // Client and index, in the order the worker handled them
+    pool.setHandler([&handled](ClientId client, std::string_view message)
+    {
+        handled.emplace_back(client.socket, std::stoi(std::string(message.substr(0, message.find(' ')))));
+    });
+
+    // Queued before the worker starts, so it stages all of them at once
+    for(int i = 0; i < 100; ++i)
+    {
+        queueMessage(pool, 10, i, TEST_QUANTUM); // Flooding client, one message per turn
+    }
+    for(int i = 0; i < 5; ++i)
+    {
+        queueMessage(pool, 11, i, 100); // Small messages, all of them fit one turn
+    }
+    queueMessage(pool, 12, 0, 2500); // Needs the deficit of three turns
+
+    pool.start(std::vector<int>());
+    pool.stop();
+    pool.join();
+
+    std::vector<std::pair<int, int>> expected;
+    expected.emplace_back(10, 0); // First turn: one flood message, every small one, the large one waits
+    for(int i = 0; i < 5; ++i)
+    {
+        expected.emplace_back(11, i);
+    }
+    expected.emplace_back(10, 1); // Second turn, the large one still waits
+    expected.emplace_back(10, 2); // Third turn
+    expected.emplace_back(12, 0);
+    for(int i = 3; i < 100; ++i)
+    {
+        expected.emplace_back(10, i); // Only the flood is left
+    }
+    CHECK(handled == expected);
+}
+
+int main()
+{
+    testFairness();
+    return testResult();
+}